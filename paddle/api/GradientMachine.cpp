@@ -158,3 +158,26 @@ SequenceGenerator* GradientMachine::asSequenceGenerator(
   r->setBeamSize(beam_size);
   return r;
 }
+
+SequenceGeneratorPool* GradientMachine::asSequenceGeneratorPool(
+    size_t num_threads,
+    size_t max_batch_requests,
+    const std::vector<std::string>& dict,
+    size_t begin_id,
+    size_t end_id,
+    size_t max_length,
+    size_t beam_size) throw(UnsupportError) {
+  return SequenceGeneratorPool::createByGradientMachineSharedPtr(
+      &m->machine,
+      num_threads,
+      max_batch_requests,
+      dict,
+      begin_id,
+      end_id,
+      max_length,
+      beam_size);
+}
+
+StreamingInference* GradientMachine::asStreamingInference() {
+  return StreamingInference::createByGradientMachineSharedPtr(&m->machine);
+}
@@ -451,6 +451,8 @@ private:
   friend class Trainer;
   friend class GradientMachine;
   friend class SequenceGenerator;
+  friend class SequenceGeneratorPool;
+  friend class StreamingInference;
 };
 
 enum GradientMatchineCreateMode {
@@ -670,6 +672,8 @@ private:
 };
 
 class SequenceGenerator;
+class SequenceGeneratorPool;
+class StreamingInference;
 
 struct GradientMachinePrivate;
 class GradientMachine {
@@ -748,6 +752,38 @@ public:
       size_t max_length = 100UL,
       size_t beam_size = -1UL);
 
+  /**
+   * Create a pool of sequence generators that decode many requests at once.
+   *
+   * All the threads share the parameters of this GradientMachine.
+   *
+   * @param num_threads  number of decoding threads.
+   * @param max_batch_requests  number of requests each thread decodes in one
+   *                            batch. If it is larger than 1, a finished
+   *                            request frees its beam slots for the next
+   *                            queued one (continuous batching), which needs
+   *                            a network whose states are lstmemory or
+   *                            gated_recurrent layers.
+   * @throw UnsupportError  if --use_gpu is on, num_threads is 0 or the
+   *                        machine is not a plain NeuralNetwork.
+   */
+  SequenceGeneratorPool* asSequenceGeneratorPool(
+      size_t num_threads,
+      size_t max_batch_requests = 1UL,
+      const std::vector<std::string>& dict = std::vector<std::string>(),
+      size_t begin_id = 0UL,
+      size_t end_id = 0UL,
+      size_t max_length = 100UL,
+      size_t beam_size = -1UL) throw(UnsupportError);
+
+  /**
+   * Create a streaming inferencer, which keeps the recurrent states of many
+   * sessions between forward calls.
+   *
+   * @note  It turns on the global flag prev_batch_state.
+   */
+  StreamingInference* asStreamingInference();
+
 private:
   GradientMachinePrivate* m;
 
@@ -861,3 +897,79 @@ private:
 private:
   SequenceGeneratorPrivate* m;
 };
+
+struct SequenceGeneratorPoolPrivate;
+class SequenceGeneratorPool {
+  DISABLE_COPY_AND_ASSIGN(SequenceGeneratorPool);
+  SequenceGeneratorPool();
+
+public:
+  /// Wait for the queued requests, then stop the threads.
+  virtual ~SequenceGeneratorPool();
+
+  /**
+   * Queue one generation request.
+   *
+   * @note  The inArgs is just one sequence of data. It is copied, so the
+   *        caller can reuse it right away.
+   * @return the id used to get the results.
+   */
+  size_t submit(const Arguments& inArgs);
+
+  /**
+   * Wait until a request is done and return its N-best results, sorted by
+   * score. The results of a request can only be taken once.
+   */
+  ISequenceResults* getResults(size_t requestId) throw(RangeError);
+
+  /// Number of requests submitted but not taken yet.
+  size_t getNumPending() const;
+
+private:
+  static SequenceGeneratorPool* createByGradientMachineSharedPtr(
+      void* ptr,
+      size_t numThreads,
+      size_t maxBatchRequests,
+      const std::vector<std::string>& dict,
+      size_t bos,
+      size_t eos,
+      size_t maxLength,
+      size_t beamSize) throw(UnsupportError);
+  friend class GradientMachine;
+
+private:
+  SequenceGeneratorPoolPrivate* m;
+};
+
+struct StreamingInferencePrivate;
+class StreamingInference {
+  DISABLE_COPY_AND_ASSIGN(StreamingInference);
+  StreamingInference();
+
+public:
+  virtual ~StreamingInference();
+
+  /**
+   * Advance a batch of sessions by one chunk of frames each.
+   *
+   * @param sessionIds  the session of each sequence in inArgs. A session
+   *                    starts from zero states the first time it is seen.
+   * @note  The cost only depends on the chunk, not on the frames that the
+   *        sessions have consumed before.
+   */
+  void forward(const std::vector<int>& sessionIds,
+               const Arguments& inArgs,
+               Arguments* outArgs);
+
+  /// Release the states of a finished session.
+  void endSession(int sessionId);
+
+  size_t getNumSessions() const;
+
+private:
+  static StreamingInference* createByGradientMachineSharedPtr(void* ptr);
+  friend class GradientMachine;
+
+private:
+  StreamingInferencePrivate* m;
+};
@@ -14,12 +14,20 @@ limitations under the License. */
 
 #include "PaddleAPI.h"
 #include "paddle/gserver/gradientmachines/GradientMachine.h"
+#include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/gserver/gradientmachines/StreamingStatePool.h"
 #include "paddle/parameter/Argument.h"
 #include "paddle/utils/Flags.h"
 #include <vector>
 #include <sstream>
 #include <algorithm>
 #include <iterator>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 // used to represent partial sequence
 struct Path {
@@ -240,3 +248,391 @@ void SequenceGenerator::setBeamSize(size_t beamSize) {
 }
 
 ISequenceResults::~ISequenceResults() {}
+
+// one queued request of a SequenceGeneratorPool
+struct GenerationRequest {
+  std::vector<paddle::Argument> inArgs;  // without the feedback
+  std::shared_ptr<std::vector<Path>> paths;
+  bool done;
+
+  GenerationRequest()
+      : paths(std::make_shared<std::vector<Path>>()), done(false) {}
+};
+
+typedef std::shared_ptr<GenerationRequest> GenerationRequestPtr;
+
+// partial sequence decoded in a batch. Its states are the rows of session
+// sessionId in a StreamingStatePool.
+struct BatchPath {
+  std::vector<int> ids;
+  float logProb;
+  int64_t sessionId;
+
+  bool operator<(const BatchPath& other) const {
+    return (logProb > other.logProb);
+  }
+};
+
+struct ActiveRequest {
+  GenerationRequestPtr request;
+  std::vector<BatchPath> paths;
+  float minFinalPathLogProb;
+};
+
+// feedback of numPaths sequences of one word each
+static void resizeFeedback(paddle::Argument* feedback, size_t numPaths) {
+  paddle::IVector::resizeOrCreate(feedback->ids, numPaths, false);
+  paddle::ICpuGpuVector::resizeOrCreate(
+      feedback->sequenceStartPositions, numPaths + 1, false);
+  int* starts = feedback->sequenceStartPositions->getMutableData(false);
+  for (size_t i = 0; i <= numPaths; ++i) {
+    starts[i] = i;
+  }
+}
+
+struct SequenceGeneratorPoolPrivate {
+  std::shared_ptr<paddle::GradientMachine> machine;
+  std::shared_ptr<std::vector<std::string>> dict;
+  size_t beginPos;
+  size_t endPos;
+  size_t maxLength;
+  size_t maxBatchRequests;
+
+  // one network per thread, sharing the parameter values of machine
+  std::vector<std::unique_ptr<paddle::NeuralNetwork>> workers;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable queueCond;
+  std::condition_variable doneCond;
+  std::deque<GenerationRequestPtr> queue;
+  std::unordered_map<size_t, GenerationRequestPtr> requests;
+  size_t nextRequestId;
+  bool stopping;
+
+  // sequence start positions of a single one-frame sequence
+  paddle::ICpuGpuVectorPtr seqStartPos;
+
+  template <typename T>
+  inline T& cast(void* ptr) {
+    return *(T*)(ptr);
+  }
+
+  SequenceGeneratorPoolPrivate()
+      : dict(std::make_shared<std::vector<std::string>>()),
+        beginPos(0UL),
+        endPos(0UL),
+        maxLength(0UL),
+        maxBatchRequests(1UL),
+        nextRequestId(0UL),
+        stopping(false) {
+    paddle::Argument arg;
+    resizeFeedback(&arg, 1);
+    seqStartPos = arg.sequenceStartPositions;
+  }
+
+  void start(size_t numThreads) {
+    auto nn = std::dynamic_pointer_cast<paddle::NeuralNetwork>(machine);
+    CHECK(nn) << "SequenceGeneratorPool needs a NeuralNetwork";
+    auto& params = machine->getParameters();
+    auto shareValue = [&params](int paramId, paddle::Parameter* para) {
+      // generation only reads the values, no gradient is created
+      para->enableSharedType(paddle::PARAMETER_VALUE,
+                             params[paramId]->getBuf(paddle::PARAMETER_VALUE),
+                             params[paramId]->getMat(paddle::PARAMETER_VALUE));
+    };
+    for (size_t i = 0; i < numThreads; ++i) {
+      workers.emplace_back(paddle::NeuralNetwork::create(nn->getConfig()));
+      workers.back()->init(nn->getConfig(),
+                           shareValue,
+                           {paddle::PARAMETER_VALUE},
+                           /* useGpu= */ false);
+    }
+    for (auto& worker : workers) {
+      paddle::NeuralNetwork* w = worker.get();
+      threads.emplace_back([this, w]() {
+        if (maxBatchRequests > 1) {
+          decodeBatch(w);
+        } else {
+          decode(w);
+        }
+      });
+    }
+  }
+
+  // Let the threads finish the queued requests and exit.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      stopping = true;
+    }
+    queueCond.notify_all();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+  }
+
+  // Return nullptr if the queue is empty. If wait is true, only return
+  // nullptr once the pool is stopping.
+  GenerationRequestPtr dequeue(bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait) {
+      queueCond.wait(lock, [this]() { return stopping || !queue.empty(); });
+    }
+    if (queue.empty()) {
+      return nullptr;
+    }
+    GenerationRequestPtr request = queue.front();
+    queue.pop_front();
+    return request;
+  }
+
+  void finish(const GenerationRequestPtr& request) {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      request->done = true;
+    }
+    doneCond.notify_all();
+  }
+
+  // one request at a time, exactly as SequenceGenerator does
+  void decode(paddle::GradientMachine* worker) {
+    paddle::Argument feedback;
+    resizeFeedback(&feedback, 1);
+    std::vector<paddle::Argument> inArgs;
+    while (GenerationRequestPtr request = dequeue(/* wait= */ true)) {
+      inArgs = request->inArgs;
+      inArgs.push_back(feedback);
+      ::findNBest(worker, inArgs, *request->paths, beginPos, endPos, maxLength);
+      finish(request);
+    }
+  }
+
+  /*
+   * Continuous batching: the live paths of up to maxBatchRequests requests
+   * are stacked as one sequence each and advanced by a single forward. The
+   * recurrent states of the paths are kept in a StreamingStatePool, so an
+   * extended path copies the state row of its parent instead of calling
+   * setState() once per path. As soon as a request is done, the next queued
+   * one takes its place in the following step.
+   */
+  void decodeBatch(paddle::GradientMachine* worker) {
+    paddle::StreamingStatePool states(worker);
+    std::vector<ActiveRequest> active;
+    std::vector<ActiveRequest> stillActive;
+    std::vector<int64_t> sessionIds;
+    std::vector<std::vector<paddle::Argument>> slotArgs;
+    std::vector<paddle::Argument> inArgs;
+    std::vector<paddle::Argument> outArgs;
+    paddle::Argument feedback;
+    int64_t nextSessionId = 0;
+
+    while (true) {
+      while (active.size() < maxBatchRequests) {
+        GenerationRequestPtr request = dequeue(/* wait= */ active.empty());
+        if (!request) {
+          break;
+        }
+        ActiveRequest newRequest;
+        newRequest.request = request;
+        newRequest.minFinalPathLogProb = 0;
+        BatchPath emptyPath;
+        emptyPath.logProb = 0;
+        emptyPath.sessionId = nextSessionId++;
+        newRequest.paths.push_back(emptyPath);
+        active.push_back(newRequest);
+      }
+      if (active.empty()) {
+        return;
+      }
+
+      size_t numInputs = active[0].request->inArgs.size();
+      slotArgs.resize(numInputs);
+      for (auto& args : slotArgs) {
+        args.clear();
+      }
+      sessionIds.clear();
+      for (auto& a : active) {
+        CHECK_EQ(a.request->inArgs.size(), numInputs);
+        for (auto& path : a.paths) {
+          sessionIds.push_back(path.sessionId);
+          for (size_t i = 0; i < numInputs; ++i) {
+            slotArgs[i].push_back(a.request->inArgs[i]);
+          }
+        }
+      }
+      size_t numPaths = sessionIds.size();
+      inArgs.resize(numInputs + 1);
+      for (size_t i = 0; i < numInputs; ++i) {
+        inArgs[i].concat(slotArgs[i], /* useGpu= */ false);
+      }
+      resizeFeedback(&feedback, numPaths);
+      int* feedbackIds = feedback.ids->getData();
+      for (auto& a : active) {
+        for (auto& path : a.paths) {
+          *feedbackIds++ = path.ids.empty() ? (int)beginPos : path.ids.back();
+        }
+      }
+      inArgs[numInputs] = feedback;
+
+      states.forward(sessionIds, inArgs, &outArgs);
+
+      size_t beam = outArgs[0].ids->getSize() / numPaths;
+      const int* ids = outArgs[0].ids->getData();
+      const paddle::MatrixPtr& probs = outArgs[0].in;
+      size_t row = 0;
+      stillActive.clear();
+      for (auto& a : active) {
+        std::vector<Path>& finalPaths = *a.request->paths;
+        std::vector<BatchPath> newPaths;
+        for (auto& path : a.paths) {
+          for (size_t k = 0; k < beam; k++) {
+            BatchPath newPath;
+            newPath.ids = path.ids;
+            newPath.ids.push_back(ids[row * beam + k]);
+            newPath.logProb = path.logProb + log(probs->getElement(row, k));
+            newPath.sessionId = path.sessionId;
+            if (newPath.ids.back() == (int)endPos ||
+                newPath.ids.size() >= maxLength) {
+              finalPaths.push_back(Path());
+              finalPaths.back().ids.swap(newPath.ids);
+              finalPaths.back().logProb = newPath.logProb;
+              if (a.minFinalPathLogProb > newPath.logProb) {
+                a.minFinalPathLogProb = newPath.logProb;
+              }
+            } else {
+              newPaths.push_back(newPath);
+            }
+          }
+          ++row;
+        }
+
+        bool done = newPaths.empty();
+        if (!done) {
+          std::nth_element(newPaths.begin(),
+                           newPaths.begin() + std::min(beam, newPaths.size()),
+                           newPaths.end());
+          if (newPaths.size() > beam) {
+            newPaths.resize(beam);
+          }
+          float maxPathLogProb =
+              std::min_element(newPaths.begin(), newPaths.end())->logProb;
+          done = finalPaths.size() >= beam &&
+                 a.minFinalPathLogProb >= maxPathLogProb;
+        }
+        if (!done) {
+          for (auto& newPath : newPaths) {
+            int64_t sessionId = nextSessionId++;
+            states.copySession(newPath.sessionId, sessionId);
+            newPath.sessionId = sessionId;
+          }
+        }
+        for (auto& path : a.paths) {
+          states.endSession(path.sessionId);
+        }
+
+        if (done) {
+          std::partial_sort(
+              finalPaths.begin(),
+              finalPaths.begin() + std::min(beam, finalPaths.size()),
+              finalPaths.end());
+          if (finalPaths.size() > beam) {
+            finalPaths.resize(beam);
+          }
+          finish(a.request);
+        } else {
+          a.paths.swap(newPaths);
+          stillActive.push_back(a);
+        }
+      }
+      active.swap(stillActive);
+    }
+  }
+};
+
+SequenceGeneratorPool::SequenceGeneratorPool()
+    : m(new SequenceGeneratorPoolPrivate()) {}
+
+SequenceGeneratorPool::~SequenceGeneratorPool() {
+  m->stop();
+  delete m;
+}
+
+size_t SequenceGeneratorPool::submit(const Arguments& inArgs) {
+  auto& in_args =
+      m->cast<std::vector<paddle::Argument>>(inArgs.getInternalArgumentsPtr());
+  auto request = std::make_shared<GenerationRequest>();
+  request->inArgs.resize(in_args.size());
+  for (size_t i = 0; i < in_args.size(); ++i) {
+    request->inArgs[i].concat({in_args[i]}, /* useGpu= */ false);
+    request->inArgs[i].sequenceStartPositions = m->seqStartPos;
+  }
+
+  size_t requestId;
+  {
+    std::lock_guard<std::mutex> guard(m->mutex);
+    requestId = m->nextRequestId++;
+    m->requests[requestId] = request;
+    m->queue.push_back(request);
+  }
+  m->queueCond.notify_one();
+  return requestId;
+}
+
+ISequenceResults* SequenceGeneratorPool::getResults(size_t requestId) throw(
+    RangeError) {
+  std::unique_lock<std::mutex> lock(m->mutex);
+  auto it = m->requests.find(requestId);
+  if (it == m->requests.end()) {
+    RangeError e;
+    throw e;
+  }
+  GenerationRequestPtr request = it->second;
+  m->doneCond.wait(lock, [&request]() { return request->done; });
+  m->requests.erase(requestId);
+  return new PathSequenceResults(request->paths, m->dict);
+}
+
+size_t SequenceGeneratorPool::getNumPending() const {
+  std::lock_guard<std::mutex> guard(m->mutex);
+  return m->requests.size();
+}
+
+SequenceGeneratorPool* SequenceGeneratorPool::createByGradientMachineSharedPtr(
+    void* ptr,
+    size_t numThreads,
+    size_t maxBatchRequests,
+    const std::vector<std::string>& dict,
+    size_t bos,
+    size_t eos,
+    size_t maxLength,
+    size_t beamSize) throw(UnsupportError) {
+  if (FLAGS_use_gpu) {
+    throw UnsupportError("SequenceGeneratorPool only runs on CPU");
+  }
+  if (numThreads == 0) {
+    throw UnsupportError("SequenceGeneratorPool needs at least one thread");
+  }
+  auto& machine = *static_cast<std::shared_ptr<paddle::GradientMachine>*>(ptr);
+  if (!std::dynamic_pointer_cast<paddle::NeuralNetwork>(machine)) {
+    throw UnsupportError("SequenceGeneratorPool needs a NeuralNetwork");
+  }
+  if (beamSize != -1UL) {
+    // read by the maxid layers of the worker networks
+    FLAGS_beam_size = beamSize;
+  }
+  if (maxBatchRequests > 1) {
+    // recurrent layers keep one state row per path only under this flag
+    FLAGS_prev_batch_state = true;
+  }
+  SequenceGeneratorPool* r = new SequenceGeneratorPool();
+  r->m->machine = machine;
+  *r->m->dict = dict;
+  r->m->beginPos = bos;
+  r->m->endPos = eos;
+  r->m->maxLength = maxLength;
+  r->m->maxBatchRequests = maxBatchRequests;
+  r->m->start(numThreads);
+  return r;
+}
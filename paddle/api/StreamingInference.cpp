@@ -0,0 +1,65 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "PaddleAPI.h"
+#include "paddle/gserver/gradientmachines/GradientMachine.h"
+#include "paddle/gserver/gradientmachines/StreamingStatePool.h"
+#include "paddle/parameter/Argument.h"
+#include "paddle/utils/Flags.h"
+#include <memory>
+#include <vector>
+
+struct StreamingInferencePrivate {
+  std::shared_ptr<paddle::GradientMachine> machine;
+  std::unique_ptr<paddle::StreamingStatePool> pool;
+
+  template <typename T>
+  inline T& cast(void* ptr) {
+    return *(T*)(ptr);
+  }
+};
+
+StreamingInference::StreamingInference()
+    : m(new StreamingInferencePrivate()) {}
+
+StreamingInference::~StreamingInference() { delete m; }
+
+void StreamingInference::forward(const std::vector<int>& sessionIds,
+                                 const Arguments& inArgs,
+                                 Arguments* outArgs) {
+  auto& in =
+      m->cast<std::vector<paddle::Argument>>(inArgs.getInternalArgumentsPtr());
+  auto& out = m->cast<std::vector<paddle::Argument>>(
+      outArgs->getInternalArgumentsPtr());
+  std::vector<int64_t> ids(sessionIds.begin(), sessionIds.end());
+  m->pool->forward(ids, in, &out);
+}
+
+void StreamingInference::endSession(int sessionId) {
+  m->pool->endSession(sessionId);
+}
+
+size_t StreamingInference::getNumSessions() const {
+  return m->pool->getNumSessions();
+}
+
+StreamingInference* StreamingInference::createByGradientMachineSharedPtr(
+    void* ptr) {
+  // recurrent layers keep one state row per sequence only under this flag
+  FLAGS_prev_batch_state = true;
+  StreamingInference* r = new StreamingInference();
+  r->m->machine = r->m->cast<std::shared_ptr<paddle::GradientMachine>>(ptr);
+  r->m->pool.reset(new paddle::StreamingStatePool(r->m->machine.get()));
+  return r;
+}
@@ -0,0 +1,92 @@
+# Copyright (c) 2016 Baidu, Inc. All Rights Reserved
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from py_paddle import swig_paddle
+import unittest
+import numpy
+
+NUM_REQUESTS = 16
+HIDDEN_DIM = 8
+BOS_ID = 0
+EOS_ID = 1
+MAX_LENGTH = 12
+BEAM_SIZE = 3
+
+
+def createInput(row):
+    args = swig_paddle.Arguments.createArguments(1)
+    args.setSlotValue(0, swig_paddle.Matrix.createDense(row, 1, HIDDEN_DIM))
+    return args
+
+
+def collect(results):
+    return [(results.getSequence(i), results.getScore(i))
+            for i in xrange(results.getSize())]
+
+
+class TestSequenceGeneratorPool(unittest.TestCase):
+    def setUp(self):
+        trainer_config = swig_paddle.TrainerConfig.createFromTrainerConfigFile(
+            './testSequenceGeneratorConfig.py')
+        self.machine = swig_paddle.GradientMachine.createByModelConfig(
+            trainer_config.getModelConfig(), swig_paddle.CREATE_MODE_TESTING,
+            [swig_paddle.PARAMETER_VALUE])
+        self.machine.randParameters()
+        rand = numpy.random.RandomState(1)
+        self.rows = [
+            rand.uniform(-1, 1, HIDDEN_DIM).tolist()
+            for _ in xrange(NUM_REQUESTS)
+        ]
+
+        # the results of the single-threaded generator are the reference
+        generator = self.machine.asSequenceGenerator([], BOS_ID, EOS_ID,
+                                                     MAX_LENGTH, BEAM_SIZE)
+        self.expected = [
+            collect(generator.generateSequence(createInput(row)))
+            for row in self.rows
+        ]
+
+    def checkPool(self, num_threads, max_batch_requests):
+        pool = self.machine.asSequenceGeneratorPool(
+            num_threads, max_batch_requests, [], BOS_ID, EOS_ID, MAX_LENGTH,
+            BEAM_SIZE)
+        # all the requests are queued before any result is taken, so the
+        # threads decode them concurrently
+        ids = [pool.submit(createInput(row)) for row in self.rows]
+        self.assertEqual(NUM_REQUESTS, pool.getNumPending())
+        for request_id, expected in zip(ids, self.expected):
+            actual = collect(pool.getResults(request_id))
+            self.assertEqual(len(expected), len(actual))
+            for (exp_seq, exp_score), (seq, score) in zip(expected, actual):
+                self.assertEqual(list(exp_seq), list(seq))
+                self.assertAlmostEqual(exp_score, score, places=4)
+        self.assertEqual(0, pool.getNumPending())
+
+    def test_one_thread(self):
+        self.checkPool(1, 1)
+
+    def test_concurrent_sessions(self):
+        self.checkPool(4, 1)
+
+    def test_no_thread(self):
+        self.assertRaises(RuntimeError, self.machine.asSequenceGeneratorPool, 0)
+
+    # Turns on the global prev_batch_state flag, so it runs after the others.
+    def test_z_continuous_batching(self):
+        self.checkPool(4, 3)
+
+
+if __name__ == '__main__':
+    swig_paddle.initPaddle('--use_gpu=0')
+    unittest.main()
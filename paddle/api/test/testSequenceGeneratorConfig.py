@@ -0,0 +1,28 @@
+from paddle.trainer_config_helpers import *
+
+settings(batch_size=1)
+
+dict_dim = 10
+hidden_dim = 8
+
+# One generation step. The last input is the feedback of the word generated in
+# the previous step, and the lstm keeps the state of the path between steps.
+src = data_layer(name='src', size=hidden_dim)
+word = data_layer(name='word', size=dict_dim)
+
+emb = embedding_layer(
+    input=word, size=hidden_dim, param_attr=ParamAttr(initial_std=1.0))
+with mixed_layer(size=hidden_dim * 4) as lstm_input:
+    lstm_input += full_matrix_projection(
+        input=src, param_attr=ParamAttr(initial_std=1.0))
+    lstm_input += full_matrix_projection(
+        input=emb, param_attr=ParamAttr(initial_std=1.0))
+lstm = lstmemory(input=lstm_input)
+prob = fc_layer(
+    input=lstm,
+    size=dict_dim,
+    act=SoftmaxActivation(),
+    param_attr=ParamAttr(initial_std=1.0))
+
+inputs(src, word)
+outputs(maxid_layer(input=prob))
@@ -17,6 +17,7 @@ limitations under the License. */
 #include "paddle/utils/Util.h"
 #include "paddle/utils/StringUtil.h"
 #include "paddle/utils/Logging.h"
+#include "paddle/utils/Trace.h"
 #include <algorithm>
 #include <unistd.h>
 #include "ProtoDataProvider.h"
@@ -139,6 +140,7 @@ void DoubleBuffer::asyncLoadBatch() {
       DataBatch newBatch;
       {
         REGISTER_TIMER("getNextBatchInternal");
+        REGISTER_TRACE("loadBatch", "data");
         actualSize = dataPool_->getNextBatchInternal(batchSize_, &newBatch);
       }
       insertOneBatch(&newBatch);
@@ -168,6 +170,7 @@ REGISTER_DATA_PROVIDER(proto, ProtoDataProvider);
 REGISTER_DATA_PROVIDER(proto_sequence, ProtoSequenceDataProvider);
 
 int64_t DataProvider::getNextBatch(int64_t size, DataBatch* batch) {
+  REGISTER_TRACE("getNextBatch", "data");
   int64_t batchSize = doubleBuffer_ ? getNextBatchFromBuffer(size, batch)
                                     : getNextBatchInternal(size, batch);
 
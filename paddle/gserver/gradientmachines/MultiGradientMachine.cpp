@@ -14,9 +14,14 @@ limitations under the License. */
 
 #include "MultiGradientMachine.h"
 
+#include <algorithm>
+
 #include "paddle/utils/Logging.h"
 
+#include "paddle/math/SIMDFunctions.h"
+#include "paddle/utils/Numa.h"
 #include "paddle/utils/Stat.h"
+#include "paddle/utils/Trace.h"
 
 #include "NeuralNetwork.h"
 #include "ParallelNeuralNetwork.h"
@@ -24,12 +29,51 @@ limitations under the License. */
 P_DEFINE_bool(allow_only_one_model_on_one_gpu,
               true,
               "If true, do not allow multiple models on one GPU device");
+P_DEFINE_bool(overlap_grad_merge,
+              false,
+              "If true, merge the dense gradients of CPU parameters as soon as "
+              "all the trainer threads have computed them, overlapping the "
+              "merge with the rest of backward()");
+P_DEFINE_string(thread_batch_split,
+                "samples",
+                "How to split a batch among the trainer threads: samples "
+                "gives each thread the same number of sequences, tokens the "
+                "same number of tokens");
+P_DEFINE_bool(thread_batch_rebalance,
+              false,
+              "If true, give each trainer thread a share of the batch "
+              "proportional to the speed it had on the previous batches");
 #ifdef PADDLE_METRIC_LEARNING
 P_DECLARE_bool(external);
 #endif
 
 namespace paddle {
 
+/// number of values in one block of the overlapped dense gradient merge,
+/// the unit of work taken by a thread
+static const size_t kGradMergeBlockSize = 64 * 1024;
+
+/// number of values reduced at once by the tree, small enough for the
+/// chunks of all the slaves to stay in cache
+static const size_t kGradMergeChunkSize = 1024;
+
+// whether the gradient of para is merged by mergeGradDense()
+static bool isDenseCpuGradient(const Parameter& para) {
+  return !para.useGpu() && !para.isStatic() && !para.isSparseRemoteUpdate() &&
+         !para.isGradSparseUpdate();
+}
+
+// number of tokens of sequence seqId summed over the sequence inputs, or 1 if
+// there is no sequence input
+static double sequenceTokens(const std::vector<const int*>& starts, int seqId) {
+  if (starts.empty()) return 1;
+  double tokens = 0;
+  for (auto start : starts) {
+    tokens += start[seqId + 1] - start[seqId];
+  }
+  return tokens;
+}
+
 // get types of the parameters which need to be merged after backward()
 static void fillMergeTypes(PassType passType,
                            std::vector<ParameterType>* mergeTypes) {
@@ -44,7 +88,24 @@ MultiGradientMachine::MultiGradientMachine(const ModelConfig& config,
     : useGpu_(useGpu),
       trainerBarrier_(FLAGS_trainer_count),
       allBarrier_(FLAGS_trainer_count + 1),
-      inArgsCopied_(false) {
+      inArgsCopied_(false),
+      hogwild_(false),
+      numaBind_(false),
+      sumBusyUsec_(0),
+      sumIdleUsec_(0),
+      overlapGradMerge_(false),
+      nextMergeBlock_(0),
+      numMergeBlocks_(0),
+      numCpuBackwardDone_(0),
+      pendingBackward_(0),
+      numCpuUpdates_(0),
+      sumStaleness_(0),
+      maxStaleness_(0),
+      mergeWaitUsec_(0),
+      numBatches_(0),
+      numSamples_(0),
+      passStartCpuUpdates_(0),
+      passStartUsec_(0) {
 #ifdef PADDLE_METRIC_LEARNING
   isPassGrad_ = FLAGS_external;
 #else
@@ -126,6 +187,11 @@ MultiGradientMachine::MultiGradientMachine(const ModelConfig& config,
     }
   }
 
+  numaBind_ = FLAGS_numa_bind && !useGpu_;
+  if (numaBind_) {
+    initNuma();
+  }
+
   for (int i = 0; i < numThreads_; ++i) {
     threads_.emplace_back(new TrainerThread(config, i, this));
   }
@@ -163,6 +229,45 @@ MultiGradientMachine::MultiGradientMachine(const ModelConfig& config,
     }
   }
 
+  hogwild_ = FLAGS_hogwild && numThreads_ > 1 && hasNonstaticCpuParamters_;
+  if (hogwild_) {
+    for (auto& para : parameters_) {
+      if (para->useGpu() || para->isStatic()) continue;
+      CHECK(!para->isSparseRemoteUpdate())
+          << "--hogwild does not support sparse_remote_update: "
+          << para->getName();
+      CHECK_EQ(para->getConfig().update_hooks_size(), 0)
+          << "--hogwild does not support update hooks: " << para->getName();
+    }
+    LOG(INFO) << "CPU parameters are updated by each trainer thread (hogwild)";
+  }
+
+  overlapGradMerge_ = FLAGS_overlap_grad_merge && numThreads_ > 1 &&
+                      hasNonstaticCpuParamters_ && !hogwild_;
+  if (overlapGradMerge_) {
+    gradReadyCount_.resize(parameters_.size(), 0);
+    for (auto& para : parameters_) {
+      if (!isDenseCpuGradient(*para)) continue;
+      numMergeBlocks_ +=
+          (para->getSize() + kGradMergeBlockSize - 1) / kGradMergeBlockSize;
+    }
+    mergeBlocks_.reserve(numMergeBlocks_);
+  }
+
+  CHECK(FLAGS_thread_batch_split == "samples" ||
+        FLAGS_thread_batch_split == "tokens")
+      << "unknown --thread_batch_split=" << FLAGS_thread_batch_split;
+  splitPoints_.resize(numThreads_ + 1, 0);
+  outArgStarts_.resize(numThreads_ + 1, 0);
+  threadCosts_.resize(numThreads_, 0);
+  threadSpeed_.resize(numThreads_, 0);
+  for (int i = 0; i < numThreads_; ++i) {
+    std::string prefix = "trainerThread" + std::to_string(i);
+    threadBusyStats_.push_back(globalStat.getStat(prefix + "Busy"));
+    threadIdleStats_.push_back(globalStat.getStat(prefix + "Idle"));
+  }
+  mergeStat_ = globalStat.getStat("trainerThreadMerge");
+
   gradBufs_.resize(numThreads_);
   for (int i = 0; i < numThreads_; ++i) {
     gradBufs_[i].resize(numLogicalDevices_);
@@ -212,6 +317,8 @@ void MultiGradientMachine::prefetch(const std::vector<Argument>& inArgs) {
   // Each gradient machine in threads needs to do prefetch on its own
   // part of inArgs. So we need to first divide inArgs to each thread
   inArgs_ = inArgs;
+  splitBatch();
+  inArgsCopied_ = true;
   startTask(TASK_COPY_IN_ARGS);
 
   for (auto& para : parameters_) {
@@ -257,7 +364,17 @@ void MultiGradientMachine::forwardImp(const std::vector<Argument>& inArgs,
 
   if (!inArgsCopied_) {
     inArgs_ = inArgs;
-    inArgsCopied_ = false;
+    splitBatch();
+  }
+  inArgsCopied_ = false;
+
+  if (passType != PASS_TEST && !inArgs_.empty()) {
+    if (numBatches_ == 0) {
+      passStartUsec_ = nowInMicroSec();
+      passStartCpuUpdates_ = numCpuUpdates_;
+    }
+    ++numBatches_;
+    numSamples_ += inArgs_[0].getBatchSize();
   }
 
   fillMergeTypes(passType, &mergeTypes_);
@@ -268,7 +385,7 @@ void MultiGradientMachine::forwardImp(const std::vector<Argument>& inArgs,
 }
 
 void MultiGradientMachine::backward(const UpdateCallback& callback) {
-  backwardCallback_ = callback;
+  setBackwardCallback(callback);
   startTask(TASK_BACKWARD);
   backwardImp(callback);
 }
@@ -277,7 +394,7 @@ void MultiGradientMachine::forwardBackward(const std::vector<Argument>& inArgs,
                                            std::vector<Argument>* outArgs,
                                            PassType passType,
                                            const UpdateCallback& callback) {
-  backwardCallback_ = callback;
+  setBackwardCallback(callback);
   forwardImp(inArgs, outArgs, passType, TASK_FORWARD_BACKWARD);
   backwardImp(callback);
 }
@@ -288,8 +405,14 @@ void MultiGradientMachine::backwardImp(const UpdateCallback& callback) {
     REGISTER_TIMER("controller_dequeue");
     gradQueue_.dequeue();
   }
-  if (hasNonstaticCpuParamters()) {
+  if (hogwild_) {
+    // the threads update the CPU parameters themselves, there is no merge.
+    // The updater must not start the next batch before they are done.
+    REGISTER_TIMER("waitBackwardDone");
+    waitBackwardDone();
+  } else if (hasNonstaticCpuParamters()) {
     waitAfterMerge();
+    recordThreadTimes();
     if (backwardCallback_) {
       for (auto& para : parameters_) {
         if (!para->useGpu() && !para->isStatic()) {
@@ -300,8 +423,68 @@ void MultiGradientMachine::backwardImp(const UpdateCallback& callback) {
   }
 }
 
+void MultiGradientMachine::initNuma() {
+  int numNodes = numa::getNumNodes();
+  std::vector<int> numThreadsOfNode(numNodes, 0);
+  for (int i = 0; i < numThreads_; ++i) {
+    int node = i * numNodes / numThreads_;
+    const std::vector<int>& cpus = numa::getNodeCpus(node);
+    CHECK(!cpus.empty()) << "node " << node << " has no cpu";
+    threadNodes_.push_back(node);
+    threadCpus_.push_back(cpus[numThreadsOfNode[node]++ % cpus.size()]);
+  }
+  LOG(INFO) << "trainer threads are spread over " << numNodes
+            << " NUMA nodes";
+
+  CHECK(FLAGS_numa_shared_value == "interleave" ||
+        FLAGS_numa_shared_value == "replicate")
+      << "unknown --numa_shared_value=" << FLAGS_numa_shared_value;
+  bool replicate = FLAGS_numa_shared_value == "replicate";
+  CHECK(!(replicate && FLAGS_hogwild))
+      << "--hogwild updates the shared values in place, "
+      << "it does not work with --numa_shared_value=replicate";
+  if (replicate) {
+    nodeParameters_.resize(numNodes, parameters_);
+  }
+
+  for (size_t pid = 0; pid < parameters_.size(); ++pid) {
+    const ParameterPtr& para = parameters_[pid];
+    if (para->useGpu() || para->isSparseRemoteUpdate() ||
+        para->isValueShared() || para->getConfig().is_sparse()) {
+      continue;
+    }
+    const VectorPtr& value = para->getBuf(PARAMETER_VALUE);
+    if (!replicate) {
+      numa::interleaveMemory(value->getData(), value->getSize() * sizeof(real));
+      continue;
+    }
+    for (int node = 0; node < numNodes; ++node) {
+      NumaNodeScope scope(node);
+      ParameterPtr replica = std::make_shared<Parameter>(
+          para->getConfig(), /* useGpu= */ false, /* doInit= */ false);
+      replica->enableType(PARAMETER_VALUE);
+      replica->getBuf(PARAMETER_VALUE)->copyFrom(*value);
+      nodeParameters_[node][pid] = replica;
+    }
+  }
+}
+
+void MultiGradientMachine::syncNodeReplicas() {
+  REGISTER_TIMER("syncNodeReplicas");
+  for (auto& replicas : nodeParameters_) {
+    for (size_t pid = 0; pid < parameters_.size(); ++pid) {
+      if (replicas[pid] == parameters_[pid]) continue;
+      replicas[pid]->getBuf(PARAMETER_VALUE)->copyFrom(
+          *parameters_[pid]->getBuf(PARAMETER_VALUE));
+    }
+  }
+}
+
 void MultiGradientMachine::updateThreadParameters() {
   for (size_t pid = 0; pid < parameters_.size(); ++pid) {
+    // thread machines read the main value, so wait for any pipelined
+    // remote receive to finish before dispatching it.
+    parameters_[pid]->waitValueReady();
     if (!parameters_[pid]->useGpu()) continue;
     if (!parameters_[pid]->isValueUpdated()) continue;
     parameters_[pid]->clearValueUpdated();
@@ -313,15 +496,222 @@ void MultiGradientMachine::updateThreadParameters() {
     // is called.
     threads_[paraMainThread_[pid]]->notifyValueReady(pid);
   }
+  // the main values may have been updated, loaded, averaged or received
+  // since the last forward
+  syncNodeReplicas();
+}
+
+void MultiGradientMachine::setBackwardCallback(const UpdateCallback& callback) {
+  std::lock_guard<std::mutex> guard(backwardCallbackMutex_);
+  backwardCallback_ = callback;
+}
+
+void MultiGradientMachine::finishCpuUpdate(int64_t staleness) {
+  sumStaleness_ += staleness;
+  int64_t maxStaleness = maxStaleness_;
+  while (staleness > maxStaleness &&
+         !maxStaleness_.compare_exchange_weak(maxStaleness, staleness)) {
+  }
+  ++numCpuUpdates_;
+}
+
+void MultiGradientMachine::splitBatch() {
+  int32_t numSequences = inArgs_.empty() ? 0 : inArgs_[0].getNumSequences();
+  bool byCost = costFunc_ || FLAGS_thread_batch_split == "tokens";
+  bool useSpeed = FLAGS_thread_batch_rebalance &&
+                  std::all_of(threadSpeed_.begin(),
+                              threadSpeed_.end(),
+                              [](double speed) { return speed > 0; });
+
+  std::vector<const int*> starts;
+  if (byCost && !costFunc_) {
+    for (auto& arg : inArgs_) {
+      if (arg.sequenceStartPositions && arg.getNumSequences() == numSequences) {
+        starts.push_back(arg.sequenceStartPositions->getData(false));
+      }
+    }
+  }
+
+  // costs[s] is the cost of the sequences [0, s)
+  std::vector<double> costs(numSequences + 1, 0);
+  for (int32_t s = 0; s < numSequences; ++s) {
+    double cost = 1;
+    if (costFunc_) {
+      cost = costFunc_(inArgs_, s);
+    } else if (byCost) {
+      cost = sequenceTokens(starts, s);
+    }
+    costs[s + 1] = costs[s] + cost;
+  }
+
+  // weights[i] is the share of the threads [0, i)
+  std::vector<double> weights(numThreads_ + 1, 0);
+  for (int i = 0; i < numThreads_; ++i) {
+    weights[i + 1] = weights[i] + (useSpeed ? threadSpeed_[i] : 1.0);
+  }
+
+  // every thread gets at least one sequence if there are enough of them
+  int32_t minSize = numSequences >= numThreads_ ? 1 : 0;
+  splitPoints_[0] = 0;
+  splitPoints_[numThreads_] = numSequences;
+  for (int i = 1; i < numThreads_; ++i) {
+    int32_t point;
+    if (!byCost && !useSpeed) {
+      point = numSequences * i / numThreads_;
+    } else {
+      double target = costs[numSequences] * weights[i] / weights[numThreads_];
+      point = std::lower_bound(costs.begin(), costs.end(), target) -
+              costs.begin();
+      if (point > 0 && target - costs[point - 1] < costs[point] - target) {
+        --point;
+      }
+    }
+    point = std::max(point, splitPoints_[i - 1] + minSize);
+    point = std::min(point, numSequences - (numThreads_ - i) * minSize);
+    splitPoints_[i] = point;
+  }
+
+  for (int i = 0; i < numThreads_; ++i) {
+    threadCosts_[i] = costs[splitPoints_[i + 1]] - costs[splitPoints_[i]];
+  }
+}
+
+void MultiGradientMachine::recordThreadTimes() {
+  uint64_t lastDone = 0;
+  for (auto& thread : threads_) {
+    lastDone = std::max(lastDone, thread->getComputeDoneUsec());
+  }
+  for (int i = 0; i < numThreads_; ++i) {
+    uint64_t done = threads_[i]->getComputeDoneUsec();
+    uint64_t busy = done - threads_[i]->getTaskStartUsec();
+    uint64_t idle = lastDone - done;
+    threadBusyStats_[i]->addSample(busy);
+    threadIdleStats_[i]->addSample(idle);
+    sumBusyUsec_ += busy;
+    sumIdleUsec_ += idle;
+
+    // the speed of a test batch, which runs no backward, would not predict
+    // the speed of the training batches
+    if (FLAGS_thread_batch_rebalance && passType_ != PASS_TEST && busy > 0 &&
+        threadCosts_[i] > 0) {
+      double speed = threadCosts_[i] / busy;
+      threadSpeed_[i] =
+          threadSpeed_[i] > 0 ? 0.8 * threadSpeed_[i] + 0.2 * speed : speed;
+    }
+  }
+}
+
+void MultiGradientMachine::resetMergeBlocks() {
+  std::lock_guard<std::mutex> guard(mergeMutex_);
+  std::fill(gradReadyCount_.begin(), gradReadyCount_.end(), 0);
+  mergeBlocks_.clear();
+  nextMergeBlock_ = 0;
+  numCpuBackwardDone_ = 0;
+}
+
+void MultiGradientMachine::pushMergeBlocks(int paramId) {
+  size_t size = parameters_[paramId]->getSize();
+  for (size_t begin = 0; begin < size; begin += kGradMergeBlockSize) {
+    mergeBlocks_.emplace_back(paramId, begin);
+  }
+}
+
+void MultiGradientMachine::notifyCpuGradReady(int paramId) {
+  std::lock_guard<std::mutex> guard(mergeMutex_);
+  if (++gradReadyCount_[paramId] == numThreads_) {
+    pushMergeBlocks(paramId);
+    mergeCond_.notify_all();
+  }
+}
+
+void MultiGradientMachine::notifyCpuBackwardDone() {
+  std::lock_guard<std::mutex> guard(mergeMutex_);
+  if (++numCpuBackwardDone_ < numThreads_) return;
+  // The callback is not called for the parameters used only inside a
+  // recurrent layer group. Their gradients are final now.
+  for (size_t pid = 0; pid < parameters_.size(); ++pid) {
+    if (!isDenseCpuGradient(*parameters_[pid])) continue;
+    if (gradReadyCount_[pid] < numThreads_) {
+      gradReadyCount_[pid] = numThreads_;
+      pushMergeBlocks(pid);
+    }
+  }
+  CHECK_EQ(mergeBlocks_.size(), numMergeBlocks_);
+  mergeCond_.notify_all();
+}
+
+bool MultiGradientMachine::popMergeBlock(int* paramId, size_t* begin) {
+  std::unique_lock<std::mutex> lock(mergeMutex_);
+  if (nextMergeBlock_ == mergeBlocks_.size() &&
+      nextMergeBlock_ < numMergeBlocks_) {
+    REGISTER_TIMER("waitMergeBlock");
+    Timer timer;
+    mergeCond_.wait(lock, [this] {
+      return nextMergeBlock_ < mergeBlocks_.size() ||
+             nextMergeBlock_ == numMergeBlocks_;
+    });
+    addMergeWaitTime(timer.stop());
+  }
+  if (nextMergeBlock_ == numMergeBlocks_) return false;
+  *paramId = mergeBlocks_[nextMergeBlock_].first;
+  *begin = mergeBlocks_[nextMergeBlock_].second;
+  ++nextMergeBlock_;
+  return true;
+}
+
+void MultiGradientMachine::notifyBackwardDone() {
+  backwardDoneCond_.notify_all([this] { --pendingBackward_; });
+}
+
+void MultiGradientMachine::waitBackwardDone() {
+  backwardDoneCond_.wait([this] { return pendingBackward_ == 0; });
+}
+
+void MultiGradientMachine::logCpuUpdateStats() {
+  if (!hasNonstaticCpuParamters_ || numBatches_ == 0) return;
+  double seconds = (nowInMicroSec() - passStartUsec_) * 1e-6;
+  std::ostringstream os;
+  os << (hogwild_ ? "hogwild" : "synchronous")
+     << " CPU update: batches=" << numBatches_
+     << " samples/sec=" << numSamples_ / std::max(seconds, 1e-6);
+  if (hogwild_) {
+    int64_t numUpdates = numCpuUpdates_ - passStartCpuUpdates_;
+    os << " avgStaleness="
+       << (numUpdates ? (double)sumStaleness_ / numUpdates : 0.0)
+       << " maxStaleness=" << maxStaleness_;
+  } else {
+    os << " mergeWaitMsPerBatch="
+       << mergeWaitUsec_ * 1e-3 / (numBatches_ * numThreads_);
+  }
+  if (sumBusyUsec_ + sumIdleUsec_ > 0) {
+    os << " threadIdleRatio="
+       << (double)sumIdleUsec_ / (sumBusyUsec_ + sumIdleUsec_);
+  }
+  LOG(INFO) << os.str();
+
+  numBatches_ = 0;
+  numSamples_ = 0;
+  sumStaleness_ = 0;
+  maxStaleness_ = 0;
+  mergeWaitUsec_ = 0;
+  sumBusyUsec_ = 0;
+  sumIdleUsec_ = 0;
 }
 
 void MultiGradientMachine::onPassEnd() {
+  if (hogwild_) {
+    waitBackwardDone();
+  }
+  logCpuUpdateStats();
   for (auto& thread : threads_) {
     thread->onPassEnd();
   }
 }
 
 void MultiGradientMachine::finish() {
+  if (hogwild_) {
+    waitBackwardDone();
+  }
   for (auto& thread : threads_) {
     thread->stop();
   }
@@ -345,6 +735,11 @@ void MultiGradientMachine::getOutArgs(std::vector<Argument>* outArgs,
     thread->waitOutArgsReady();
   }
   outArgs_.resize(threads_[0]->getOutArgs().size());
+  for (int i = 0; i < numThreads_; ++i) {
+    const std::vector<Argument>& args = threads_[i]->getOutArgs();
+    outArgStarts_[i + 1] =
+        outArgStarts_[i] + (args.empty() ? 0 : args[0].getNumSequences());
+  }
 
   REGISTER_TIMER("copyOutArgs");
   for (size_t i = 0; i < outArgs_.size(); ++i) {
@@ -356,6 +751,10 @@ void MultiGradientMachine::getOutArgs(std::vector<Argument>* outArgs,
     outArgs_[i].concat(args, useGpu_, outArgStream_, passType);
   }
 
+  if (taskType_ == TASK_FORWARD) {
+    recordThreadTimes();
+  }
+
   if (useGpu_) {
     hl_stream_synchronize(outArgStream_);
   }
@@ -371,6 +770,16 @@ void MultiGradientMachine::setOutputGrad(const std::vector<Argument>& args) {
 }
 
 void MultiGradientMachine::startTask(TaskType taskType) {
+  bool hasBackward =
+      taskType == TASK_FORWARD_BACKWARD || taskType == TASK_BACKWARD;
+  if (hogwild_ && hasBackward) {
+    backwardDoneCond_.notify_all([this] { pendingBackward_ += numThreads_; });
+  }
+  if (overlapGradMerge_ && hasBackward) {
+    // the threads are idle, the previous batch was merged before
+    // waitAfterMerge()
+    resetMergeBlocks();
+  }
   taskType_ = taskType;
   for (auto& thread : threads_) {
     thread->notifyTaskReady();
@@ -383,10 +792,14 @@ TrainerThread::TrainerThread(const ModelConfig& config,
     : multiMachine_(multiMachine),
       config_(config),
       threadId_(threadId),
-      inArgsCopied_(false) {
+      inArgsCopied_(false),
+      valueVersion_(0),
+      optimizerBufsShared_(false),
+      taskStartUsec_(0),
+      computeDoneUsec_(0) {
   int numThreads = multiMachine->getNumThreads();
 
-  auto& mainParas = multiMachine->getParameters();
+  auto& mainParas = multiMachine->getValueParameters(threadId);
 
   using std::placeholders::_1;
   using std::placeholders::_2;
@@ -397,6 +810,8 @@ TrainerThread::TrainerThread(const ModelConfig& config,
                   ? -1
                   : multiMachine_->logicalDeviceId2RealDeviceId(0, threadId_);
   SetDevice gpuDevice(deviceId_);
+  // allocate the buffers of this thread on its node
+  NumaNodeScope numaScope(multiMachine->getThreadNumaNode(threadId));
 
   NeuralNetwork* nn = nullptr;
   if (!multiMachine->useGpu() || !FLAGS_parallel_nn) {
@@ -486,6 +901,11 @@ void TrainerThread::computeThread() {
     hl_init(deviceId_);
   }
 
+  if (multiMachine_->isNumaBind()) {
+    numa::bindThreadToCpu(multiMachine_->getThreadCpu(threadId_),
+                          multiMachine_->getThreadNumaNode(threadId_));
+  }
+
   while (true) {
     {
       REGISTER_TIMER("taskSem_wait");
@@ -494,6 +914,11 @@ void TrainerThread::computeThread() {
 
     if (stopping_) break;
 
+    taskStartUsec_ = nowInMicroSec();
+    if (multiMachine_->isHogwild()) {
+      hogwildCallback_ = multiMachine_->copyBackwardCallback();
+    }
+
     switch (multiMachine_->getTaskType()) {
       case MultiGradientMachine::TASK_FORWARD_BACKWARD:
         forward();
@@ -520,8 +945,10 @@ void TrainerThread::prefetch() {
 }
 
 void TrainerThread::forward() {
+  REGISTER_TRACE("thread_forward", "trainer_thread");
   if (!inArgsCopied_) {
     REGISTER_TIMER("copyInArgs");
+    REGISTER_TRACE("copyInArgs", "trainer_thread");
     copyInArgs();
   } else {
     inArgsCopied_ = false;
@@ -545,32 +972,54 @@ void TrainerThread::forward() {
 
   {
     REGISTER_TIMER("wait_value");
+    REGISTER_TRACE("wait_value", "trainer_thread");
     valueReadyCond_.wait([this]() { return !parameterUpdated_; });
   }
 
   { fillMergeTypes(multiMachine_->getPassType(), &mergeTypes_); }
 
+  valueVersion_ = multiMachine_->getNumCpuUpdates();
+
   {
     REGISTER_TIMER("thread_forward");
     gradientMachine_->forward(inArgs_, &outArgs_, multiMachine_->getPassType());
   }
+  computeDoneUsec_ = nowInMicroSec();
   outArgsReadySem_.post();
 }
 
 void TrainerThread::backward() {
   REGISTER_TIMER("thread_backward");
+  REGISTER_TRACE("thread_backward", "trainer_thread");
   if (multiMachine_->isPassGrad()) {
     copyOutputGrad();
   }
   gradientMachine_->backward(backwardCallback_);
+  computeDoneUsec_ = nowInMicroSec();
   if (multiMachine_->hasNonstaticCpuParamters()) {
-    mergeCpuGradients();
+    if (multiMachine_->isHogwild()) {
+      applyCpuGradients();
+    } else {
+      REGISTER_TRACE("mergeCpuGradients", "trainer_thread");
+      uint64_t mergeStart = nowInMicroSec();
+      mergeCpuGradients();
+      multiMachine_->addMergeTime(nowInMicroSec() - mergeStart);
+    }
+  }
+  if (multiMachine_->isHogwild()) {
+    multiMachine_->notifyBackwardDone();
   }
 }
 
 void TrainerThread::backwardCallback(Parameter* para) {
-  // CPU parameters are merged in the end
-  if (!para->useGpu()) return;
+  // CPU parameters are merged in the end, or once all threads have their
+  // gradients if the dense merge is overlapped
+  if (!para->useGpu()) {
+    if (multiMachine_->isOverlapGradMerge() && isDenseCpuGradient(*para)) {
+      multiMachine_->notifyCpuGradReady(para->getID());
+    }
+    return;
+  }
 
   int paramId = para->getID();
   if (multiMachine_->getNumThreads() == 1) {
@@ -722,11 +1171,9 @@ void TrainerThread::notifyValueReady(int paramId) {
 
 void TrainerThread::copyInArgs() {
   const std::vector<Argument>& fullInArgs = multiMachine_->getInArgs();
-  int numThreads = multiMachine_->getAllThreads().size();
-  int32_t numSequences = fullInArgs[0].getNumSequences();
-  int32_t startSeq = numSequences * threadId_ / numThreads;
-  int32_t endSeq = numSequences * (threadId_ + 1) / numThreads;
-  int32_t copySize = endSeq - startSeq;
+  auto range = multiMachine_->getSequenceRange(threadId_);
+  int32_t startSeq = range.first;
+  int32_t copySize = range.second - range.first;
 
   /**
    * For the first copy, need to allocate space here
@@ -752,14 +1199,29 @@ void TrainerThread::mergeCpuGradients() {
   CHECK_EQ(mergeTypes_.size(), 1UL);
   CHECK_EQ(mergeTypes_[0], PARAMETER_GRADIENT);
 
+  std::vector<const std::vector<ParameterPtr>*> slaveParameters =
+      multiMachine_->getSlaveParameters();
+  CHECK(slaveParameters.size());
+
+  bool overlap = multiMachine_->isOverlapGradMerge();
+  if (overlap) {
+    REGISTER_TIMER("mergeGradDenseBlocks");
+    multiMachine_->notifyCpuBackwardDone();
+    int pid;
+    size_t begin;
+    while (multiMachine_->popMergeBlock(&pid, &begin)) {
+      mergeGradDenseBlock(pid, begin, slaveParameters);
+    }
+  }
+
   {
     REGISTER_TIMER("waitbeforeMerge");
+    REGISTER_TRACE("waitBeforeMerge", "trainer_thread");
+    Timer timer;
     multiMachine_->waitBeforeMerge();
+    multiMachine_->addMergeWaitTime(timer.stop());
   }
-  std::vector<const std::vector<ParameterPtr>*> slaveParameters =
-      multiMachine_->getSlaveParameters();
 
-  CHECK(slaveParameters.size());
   for (auto& para : multiMachine_->getNonStaticParameters()) {
     if (para->useGpu()) continue;
     if (para->isSparseRemoteUpdate()) {
@@ -768,15 +1230,46 @@ void TrainerThread::mergeCpuGradients() {
     } else if (para->isGradSparseUpdate()) {
       REGISTER_TIMER("mergeGradSparse");
       mergeGradSparse(para.get(), slaveParameters);
-    } else {
+    } else if (!overlap) {
       REGISTER_TIMER("mergeGradDense");
       mergeGradDense(para.get(), slaveParameters);
     }
   }
   {
     REGISTER_TIMER("waitbeforeMerge");
+    REGISTER_TRACE("waitAfterMerge", "trainer_thread");
+    Timer timer;
     multiMachine_->waitAfterMerge();
+    multiMachine_->addMergeWaitTime(timer.stop());
+  }
+}
+
+void TrainerThread::applyCpuGradients() {
+  CHECK_EQ(mergeTypes_.size(), 1UL);
+  CHECK_EQ(mergeTypes_[0], PARAMETER_GRADIENT);
+  CHECK(hogwildCallback_) << "--hogwild needs an update callback in backward()";
+
+  int64_t staleness = multiMachine_->getNumCpuUpdates() - valueVersion_;
+  auto& mainParas = multiMachine_->getParameters();
+  for (auto& para : parameters_) {
+    if (para->useGpu() || para->isStatic()) continue;
+    if (!optimizerBufsShared_) {
+      // the optimizer buffers are created by ParameterUpdater::init(), which
+      // runs after the threads are constructed
+      const ParameterPtr& mainPara = mainParas[para->getID()];
+      for (int i = PARAMETER_GRADIENT + 1; i < NUM_PARAMETER_TYPES; ++i) {
+        ParameterType type = (ParameterType)i;
+        if (mainPara->getBuf(type)) {
+          para->enableSharedType(
+              type, mainPara->getBuf(type), mainPara->getMat(type));
+        }
+      }
+    }
+    REGISTER_TIMER("hogwildUpdate");
+    hogwildCallback_(para.get());
   }
+  optimizerBufsShared_ = true;
+  multiMachine_->finishCpuUpdate(staleness);
 }
 
 void TrainerThread::mergeGradSparse(
@@ -839,12 +1332,46 @@ void TrainerThread::mergeGradDense(
   }
 }
 
+void TrainerThread::mergeGradDenseBlock(
+    int paramId,
+    size_t begin,
+    std::vector<const std::vector<ParameterPtr>*>& slaveParameters) {
+  const ParameterPtr& mainPara = multiMachine_->getParameters()[paramId];
+  size_t end = std::min(begin + kGradMergeBlockSize, mainPara->getSize());
+  real* destGrad = mainPara->getBuf(PARAMETER_GRADIENT)->getData();
+
+  std::vector<real*> slaveGrads;
+  slaveGrads.reserve(slaveParameters.size());
+  for (auto slaveParams : slaveParameters) {
+    slaveGrads.push_back(
+        (*slaveParams)[paramId]->getBuf(PARAMETER_GRADIENT)->getData());
+  }
+
+  // Pairwise tree: after the pass with stride s, slaveGrads[i] with i a
+  // multiple of 2s holds the sum of slaveGrads[i .. i+2s). The chunks of all
+  // the slaves stay in cache, so each gradient is read from memory once.
+  size_t numSlaves = slaveGrads.size();
+  for (size_t chunk = begin; chunk < end; chunk += kGradMergeChunkSize) {
+    size_t len = std::min(kGradMergeChunkSize, end - chunk);
+    for (size_t stride = 1; stride < numSlaves; stride *= 2) {
+      for (size_t i = 0; i + stride < numSlaves; i += 2 * stride) {
+        simd::addTo(slaveGrads[i] + chunk, slaveGrads[i + stride] + chunk, len);
+      }
+    }
+    simd::addTo(destGrad + chunk, slaveGrads[0] + chunk, len);
+  }
+}
+
 void TrainerThread::copyOutputGrad() {
   const std::vector<Argument>& outputGradArgs = multiMachine_->outArgs_;
   int numThreads = multiMachine_->getAllThreads().size();
-  int32_t numSequences = outputGradArgs[0].getNumSequences();
-  int32_t startSeq = numSequences * threadId_ / numThreads;
-  int32_t endSeq = numSequences * (threadId_ + 1) / numThreads;
+  int32_t startSeq, endSeq;
+  // the gradients follow the outputs, which this thread computed for the
+  // sequences of its own split
+  std::tie(startSeq, endSeq) = multiMachine_->getOutArgRange(threadId_);
+  CHECK_EQ(outputGradArgs[0].getNumSequences(),
+           multiMachine_->getOutArgRange(numThreads - 1).second)
+      << "The output gradients do not match the outputs of the batch";
   int32_t copySize = endSeq - startSeq;
   outArgs_.resize(outputGradArgs.size());
   for (size_t i = 0; i < outputGradArgs.size(); i++) {
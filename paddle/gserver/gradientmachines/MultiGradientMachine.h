@@ -20,6 +20,7 @@ limitations under the License. */
 
 #include "paddle/utils/Queue.h"
 #include "paddle/utils/Locks.h"
+#include "paddle/utils/Stat.h"
 #include "hl_gpu.h"
 
 namespace paddle {
@@ -164,6 +165,74 @@ struct GradBuffer {
  *     into main parameter grad (SparseRowCpuMatrix). And the framework will
  send
  *     the merged gradient to parameter server.
+ *
+ *  * Hogwild update (--hogwild)
+ *
+ *  With --hogwild, CPU parameter gradients are not merged. Right after its
+ *  backward(), each TrainerThread calls the update callback with its own
+ *  slave parameter. The slave parameter shares the value and the optimizer
+ *  buffers (momentum etc.) with the main parameter, so each thread updates
+ *  the shared value directly, without the merge barriers and without locks
+ *  for dense parameters. Local sparse parameters are updated row by row by
+ *  the ParameterUpdater, which is expected to stripe its row locks.
+ *
+ *  The end of a batch is still a join: like forward() waits for the outputs
+ *  of every thread, backward() waits until every thread has applied its
+ *  gradients, so the ParameterUpdater changes its per batch state (learning
+ *  rate, special traversals in finishBatch()) while no thread is updating.
+ *  Hogwild saves the merge and the waits around it, but a fast thread still
+ *  idles at the end of the batch until the slowest one is done. Within a
+ *  batch a thread reads values which the other threads are updating. Remote
+ *  sparse update and parameter update hooks are not supported in this
+ *  mode.
+ *
+ *  * Overlapped dense gradient merge (--overlap_grad_merge)
+ *
+ *  By default the dense CPU gradients are merged after every thread finished
+ *  backward(). With --overlap_grad_merge, backwardCallback() counts for each
+ *  dense CPU parameter how many threads have computed its gradient. Once all
+ *  of them have, the parameter is cut into blocks of kGradMergeBlockSize
+ *  values and the blocks are queued. A thread which finishes its backward()
+ *  early takes blocks from the queue while the slower threads are still
+ *  computing the gradients of the lower layers. Each block is reduced chunk
+ *  by chunk with a pairwise tree of SIMD adds over the slave gradients, and
+ *  the sum is added straight into the main gradient. The slave gradients are
+ *  used as scratch space by the tree, so they are garbage after the merge.
+ *  Sparse gradients are still merged after the barrier.
+ *
+ *  * Splitting a batch (--thread_batch_split)
+ *
+ *  Each thread gets a contiguous range of the sequences of the batch. By
+ *  default the ranges have the same number of sequences. With
+ *  --thread_batch_split=tokens they have about the same number of tokens,
+ *  which balances batches of variable length sequences. A cost function set
+ *  by setSequenceCostFunc() replaces the token count. With
+ *  --thread_batch_rebalance, the share of each thread is further weighted by
+ *  the cost per microsecond it achieved on the previous batches, so a thread
+ *  running on a slower or busier core gets less work.
+ *
+ *  The busy time of thread i (copying its inputs, forward and backward) and
+ *  its idle time (waiting for the slowest thread) are recorded in globalStat
+ *  as trainerThread<i>Busy and trainerThread<i>Idle. They are collected
+ *  after forward() and, for CPU parameters in synchronous mode, after
+ *  backward(). The time each thread spends in merging the CPU gradients
+ *  after its backward is recorded as trainerThreadMerge.
+ *
+ *  * NUMA placement (--numa_bind)
+ *
+ *  With --numa_bind, the CPU trainer threads are spread evenly over the NUMA
+ *  nodes and each one is pinned to a core of its node. The buffers of a
+ *  thread (slave gradients, arguments, layer buffers) are allocated from the
+ *  memory pool of its node, and the workers of the SyncThreadPools it creates
+ *  run on that node. The values shared by all the threads are either
+ *  interleaved over the nodes (--numa_shared_value=interleave), or copied to
+ *  one replica per node before each forward (--numa_shared_value=replicate),
+ *  which trades one copy of the values per node and batch for local reads.
+ *
+ *  At the end of each pass the number of samples per second is logged. In
+ *  synchronous mode the log also shows the time threads wait for each other
+ *  before merging. In hogwild mode it shows how many updates of other threads
+ *  landed between reading the value and applying the gradient (staleness).
  */
 class MultiGradientMachine : public GradientMachine {
 public:
@@ -209,6 +278,14 @@ public:
   /// The gradietns will be copied to each thread in the computing threads.
   virtual void setOutputGrad(const std::vector<Argument>& args);
 
+  /// Estimated cost of sequence seqId of args, used to split a batch.
+  typedef std::function<double(const std::vector<Argument>& args, int seqId)>
+      SequenceCostFunc;
+
+  /// Split the batches by func instead of --thread_batch_split.
+  /// An empty func restores the flag.
+  void setSequenceCostFunc(const SequenceCostFunc& func) { costFunc_ = func; }
+
 protected:
   friend class TrainerThread;
 
@@ -249,6 +326,47 @@ protected:
   /// finishing
   void waitForCopyInArgs() { allBarrier_.wait(); }
 
+  bool isHogwild() const { return hogwild_; }
+
+  bool isOverlapGradMerge() const { return overlapGradMerge_; }
+
+  /// Called by TrainerThread when it has computed the dense CPU gradient of
+  /// paramId (overlapped merge).
+  void notifyCpuGradReady(int paramId);
+
+  /// Called by TrainerThread when its backward() returns (overlapped merge).
+  /// The last thread queues the gradients for which no callback was called.
+  void notifyCpuBackwardDone();
+
+  /**
+   * @brief Take the next dense gradient block to merge (overlapped merge).
+   *
+   * Waits until a block is ready. Returns false when every block of the
+   * batch has been taken.
+   */
+  bool popMergeBlock(int* paramId, size_t* begin);
+
+  /// Number of CPU gradients applied by the threads so far (hogwild).
+  int64_t getNumCpuUpdates() const { return numCpuUpdates_; }
+
+  /// Called by TrainerThread after it applied its CPU gradients (hogwild).
+  /// staleness is the number of updates from other threads since it read
+  /// the value.
+  void finishCpuUpdate(int64_t staleness);
+
+  /// Called by TrainerThread to report the time waiting before merging.
+  void addMergeWaitTime(int64_t usec) { mergeWaitUsec_ += usec; }
+
+  /// Called by TrainerThread with the time spent in merging the CPU
+  /// gradients, waits included.
+  void addMergeTime(uint64_t usec) { mergeStat_->addSample(usec); }
+
+  /// Called by TrainerThread when its backward task is done (hogwild).
+  void notifyBackwardDone();
+
+  /// Wait until every thread finished its backward task (hogwild).
+  void waitBackwardDone();
+
   TrainerThreadPtr& getThread(int threadId) { return threads_[threadId]; }
 
   std::vector<GradBuffer>& getGradBuf(int threadId) {
@@ -269,6 +387,13 @@ protected:
     return backwardCallback_;
   }
 
+  /// A copy of the update callback which a hogwild thread can keep using
+  /// while the next batch sets a new one.
+  UpdateCallback copyBackwardCallback() {
+    std::lock_guard<std::mutex> guard(backwardCallbackMutex_);
+    return backwardCallback_;
+  }
+
   int getNumDevices() const { return numDevices_; }
 
   int getNumLogicalDevices() const { return numLogicalDevices_; }
@@ -277,6 +402,34 @@ protected:
 
   int paraMainThread(int pid) const { return paraMainThread_[pid]; }
 
+  bool isNumaBind() const { return numaBind_; }
+
+  /// NUMA node of a thread, -1 without --numa_bind.
+  int getThreadNumaNode(int threadId) const {
+    return numaBind_ ? threadNodes_[threadId] : -1;
+  }
+
+  /// The core a thread is pinned to with --numa_bind.
+  int getThreadCpu(int threadId) const { return threadCpus_[threadId]; }
+
+  /// The parameters whose values a thread shares, the replicas of its node
+  /// with --numa_shared_value=replicate.
+  std::vector<ParameterPtr>& getValueParameters(int threadId) {
+    return nodeParameters_.empty() ? parameters_
+                                   : nodeParameters_[threadNodes_[threadId]];
+  }
+
+  /// [first, second) are the sequences of inArgs_ computed by threadId.
+  std::pair<int32_t, int32_t> getSequenceRange(int threadId) const {
+    return std::make_pair(splitPoints_[threadId], splitPoints_[threadId + 1]);
+  }
+
+  /// [first, second) are the sequences of outArgs_ computed by threadId.
+  std::pair<int32_t, int32_t> getOutArgRange(int threadId) const {
+    return std::make_pair(outArgStarts_[threadId],
+                          outArgStarts_[threadId + 1]);
+  }
+
 protected:
   virtual void forwardImp(const std::vector<Argument>& inArgs,
                           std::vector<Argument>* outArgs,
@@ -288,12 +441,37 @@ protected:
   /// update all parameters
   void updateThreadParameters();
 
+  void setBackwardCallback(const UpdateCallback& callback);
+
   void startTask(TaskType taskType);
 
   void getOutArgs(std::vector<Argument>* outArgs, PassType passType);
 
   void allocGradBufs();
 
+  /// Log the throughput and the merge wait or staleness of the pass.
+  void logCpuUpdateStats();
+
+  /// Choose the node and the core of each thread, and interleave or
+  /// replicate the shared values (--numa_bind).
+  void initNuma();
+
+  /// Copy the main values to the replicas of every node.
+  void syncNodeReplicas();
+
+  /// Compute splitPoints_ for inArgs_.
+  void splitBatch();
+
+  /// Record the busy and idle time of the threads for the last task, and
+  /// update threadSpeed_ with --thread_batch_rebalance.
+  void recordThreadTimes();
+
+  /// Reset the merge queue before the backward of a batch.
+  void resetMergeBlocks();
+
+  /// Queue all the blocks of paramId. mergeMutex_ must be held.
+  void pushMergeBlocks(int paramId);
+
 protected:
   bool useGpu_;
 
@@ -321,6 +499,7 @@ protected:
   int numThreads_;         /* number of train threads */
 
   UpdateCallback backwardCallback_;
+  std::mutex backwardCallbackMutex_;
 
   /// barrrier for threads_
   ThreadBarrier trainerBarrier_;
@@ -333,6 +512,62 @@ protected:
 
   /// Whether to copy the gradient back from an external input.
   bool isPassGrad_;
+
+  /// Whether the threads apply their CPU gradients themselves.
+  bool hogwild_;
+
+  /// see isNumaBind()
+  bool numaBind_;
+  std::vector<int> threadNodes_;
+  std::vector<int> threadCpus_;
+  /// [node][pid], the values of node, empty unless replicated
+  std::vector<std::vector<ParameterPtr>> nodeParameters_;
+
+  SequenceCostFunc costFunc_;
+  /// the sequences of thread i are [splitPoints_[i], splitPoints_[i + 1])
+  std::vector<int32_t> splitPoints_;
+  /// the output sequences of thread i are
+  /// [outArgStarts_[i], outArgStarts_[i + 1]) in outArgs_
+  std::vector<int32_t> outArgStarts_;
+  /// estimated cost of the sequences of each thread
+  std::vector<double> threadCosts_;
+  /// cost per microsecond of each thread (--thread_batch_rebalance)
+  std::vector<double> threadSpeed_;
+  std::vector<StatPtr> threadBusyStats_;
+  std::vector<StatPtr> threadIdleStats_;
+  StatPtr mergeStat_;
+  int64_t sumBusyUsec_;
+  int64_t sumIdleUsec_;
+
+  /// Whether the dense CPU gradients are merged during backward().
+  bool overlapGradMerge_;
+
+  /// state of the overlapped merge of the current batch, see popMergeBlock()
+  std::mutex mergeMutex_;
+  std::condition_variable mergeCond_;
+  /// number of threads which have computed the gradient, [paramId]
+  std::vector<int> gradReadyCount_;
+  /// (paramId, begin) of the blocks whose gradients are ready
+  std::vector<std::pair<int, size_t>> mergeBlocks_;
+  /// index of the next block in mergeBlocks_ to merge
+  size_t nextMergeBlock_;
+  /// total number of blocks of all the dense CPU parameters
+  size_t numMergeBlocks_;
+  int numCpuBackwardDone_;
+
+  /// number of thread backward tasks not finished yet (hogwild)
+  int pendingBackward_;
+  LockedCondition backwardDoneCond_;
+
+  /// statistics of the current pass, see logCpuUpdateStats()
+  std::atomic<int64_t> numCpuUpdates_;
+  std::atomic<int64_t> sumStaleness_;
+  std::atomic<int64_t> maxStaleness_;
+  std::atomic<int64_t> mergeWaitUsec_;
+  int64_t numBatches_;
+  int64_t numSamples_;
+  int64_t passStartCpuUpdates_;
+  uint64_t passStartUsec_;
 };
 
 class TrainerThread {
@@ -351,6 +586,12 @@ public:
 
   void notifyTaskReady() { taskReadySem_.post(); }
 
+  /// Time when the thread started its last task.
+  uint64_t getTaskStartUsec() const { return taskStartUsec_; }
+
+  /// Time when the thread finished the forward or backward of its last task.
+  uint64_t getComputeDoneUsec() const { return computeDoneUsec_; }
+
   int getDeviceId() const { return deviceId_; }
 
   GradientMachine* getGradientMachine() { return gradientMachine_.get(); }
@@ -398,6 +639,16 @@ protected:
       Parameter* para,
       std::vector<const std::vector<ParameterPtr>*>& slaveParameters);
 
+  /// Add the sum of the slave gradients of one block of paramId to the main
+  /// gradient (overlapped merge).
+  void mergeGradDenseBlock(
+      int paramId,
+      size_t begin,
+      std::vector<const std::vector<ParameterPtr>*>& slaveParameters);
+
+  /// Apply the CPU gradients of this thread to the shared values (hogwild).
+  void applyCpuGradients();
+
   void computeThread();
   void valueDispatchThread();
   void copyGradToBufferThread();
@@ -463,6 +714,17 @@ protected:
 
   /// indicate whether inArgs is copied before forward()
   bool inArgsCopied_;
+
+  /// update callback of the current task (hogwild)
+  UpdateCallback hogwildCallback_;
+  /// MultiGradientMachine::getNumCpuUpdates() when forward() started
+  int64_t valueVersion_;
+  /// whether the optimizer buffers of the main parameters are shared
+  bool optimizerBufsShared_;
+
+  /// see getTaskStartUsec() and getComputeDoneUsec()
+  uint64_t taskStartUsec_;
+  uint64_t computeDoneUsec_;
 };
 
 }  // namespace paddle
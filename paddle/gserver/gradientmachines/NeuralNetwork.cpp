@@ -245,7 +245,15 @@ void NeuralNetwork::forward(const std::vector<Argument>& inArgs,
     for (auto& layer : layers_) {
       REGISTER_TIMER_INFO("ForwardTimer", layer->getName().c_str());
       gLayerStackTrace.push(layer->getName());
-      layer->forward(passType);
+      // values of late layers may still be received by a pipelined
+      // remote updater while early layers are already computing.
+      for (auto& para : layer->getParameters()) {
+        if (para) para->waitValueReady();
+      }
+      if (layer->getBiasParameter()) {
+        layer->getBiasParameter()->waitValueReady();
+      }
+      layer->timedForward(passType);
     }
   }
 
@@ -287,7 +295,7 @@ void NeuralNetwork::backward(const UpdateCallback& callback) {
   FOR_EACH_R(layer, layers_) {
     REGISTER_TIMER_INFO("BackwardTimer", (*layer)->getName().c_str());
     if ((*layer)->needGradient()) {
-      (*layer)->backward(callback);
+      (*layer)->timedBackward(callback);
     }
     gLayerStackTrace.pop((*layer)->getName());
   }
@@ -113,6 +113,8 @@ public:
 
   ParameterMap* getParameterMap() { return &parameterMap_; }
 
+  const ModelConfig& getConfig() const { return config_; }
+
   /**
    * @brief Access each layer as a for each loop.
    * @param callback invoke with each layer.
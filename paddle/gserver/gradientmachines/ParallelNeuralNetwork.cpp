@@ -175,11 +175,19 @@ void ParallelThread::computeThread() {
         REGISTER_TIMER_INFO("waitInputValue",
                             job_work.layer_->getName().c_str());
         job_work.layer_->waitInputValue();
+        // the values may still be received by a pipelined remote updater,
+        // as in NeuralNetwork::forward()
+        for (auto& para : job_work.layer_->getParameters()) {
+          if (para) para->waitValueReady();
+        }
+        if (job_work.layer_->getBiasParameter()) {
+          job_work.layer_->getBiasParameter()->waitValueReady();
+        }
       }
       {
         REGISTER_TIMER_INFO("threadForwardTimer",
                             job_work.layer_->getName().c_str());
-        job_work.layer_->forward(passType_);
+        job_work.layer_->timedForward(passType_);
       }
       {
         REGISTER_TIMER_INFO("copyOutputToOtherDevice",
@@ -195,7 +203,7 @@ void ParallelThread::computeThread() {
       {
         REGISTER_TIMER_INFO("threadBackwardTimer",
                             job_work.layer_->getName().c_str());
-        job_work.layer_->backward(backwardCallback_);
+        job_work.layer_->timedBackward(backwardCallback_);
       }
       hl_stream_synchronize(HPPL_STREAM_DEFAULT);
       job_work.layer_->markAllInputGrad();
@@ -25,6 +25,11 @@ limitations under the License. */
 #include "paddle/gserver/layers/AgentLayer.h"
 
 P_DEFINE_string(diy_beam_search_prob_so, "", "the diy beam search cost so");
+P_DEFINE_int32(rnn_checkpoint_interval,
+               0,
+               "If positive, recurrent layer groups longer than this reuse "
+               "this many frames, and compute them again in backward from "
+               "checkpoints saved every this many steps");
 
 static const char* DIY_CALC_PROB_SYMBOL_NAME = "calc_prob";
 static const char* DIY_START_CALC_PROB_SYMBOL_NAME = "start_calc_prob";
@@ -127,6 +132,8 @@ RecurrentGradientMachine::RecurrentGradientMachine(
     const std::string& subModelName, NeuralNetwork* rootNetwork)
     : NeuralNetwork(subModelName),
       rootNetwork_(rootNetwork),
+      useCheckpoint_(false),
+      canRecompute_(true),
       beamSearchCtrlCallbacks_(nullptr),
       beamSearchStatistics_(nullptr) {
   CHECK(!subModelName_.empty());
@@ -189,6 +196,24 @@ public:
   }
 };
 
+/**
+ * Output of the last frame of previous segment in checkpoint mode, which
+ * boots the memory of the first frame of a segment. Its value and gradient
+ * are rows of MemoryFrameLine::checkpointValue and checkpointGrad.
+ */
+class CheckpointLayer : public Layer {
+public:
+  explicit CheckpointLayer(const LayerConfig& config) : Layer(config) {}
+
+  void setOutput(const MatrixPtr& value, const MatrixPtr& grad) {
+    output_.value = value;
+    output_.grad = grad;
+  }
+
+  virtual void forward(PassType passType) {}
+  virtual void backward(const UpdateCallback& callback) {}
+};
+
 void RecurrentGradientMachine::init(
     const ModelConfig& config,
     ParamInitCallback callback,
@@ -261,6 +286,10 @@ void RecurrentGradientMachine::init(
       memoryFrameLines_[i].bootLayer = memoryFrameLines_[i].biasLayer;
     }
 
+    memoryFrameLines_[i].checkpointLayer.reset(
+        new CheckpointLayer(*agentConfig));
+    memoryFrameLines_[i].checkpointLayer->init(LayerMap(), parameterMap_);
+
     if (subModelConfig->has_generator()) {
       memoryFrameLines_[i].scatterAgents.resize(2);
       for (auto& agent : memoryFrameLines_[i].scatterAgents) {
@@ -272,6 +301,20 @@ void RecurrentGradientMachine::init(
     }
   }
 
+  // dropout masks differ when a frame is computed again
+  for (auto& layerName : subModelConfig->layer_names()) {
+    auto layerConfig =
+        std::find_if(config.layers().begin(),
+                     config.layers().end(),
+                     [&layerName](const LayerConfig& layerConfig) {
+                       return layerConfig.name() == layerName;
+                     });
+    if (layerConfig != config.layers().end() &&
+        layerConfig->drop_rate() > 0) {
+      canRecompute_ = false;
+    }
+  }
+
   if (subModelConfig->has_generator()) {
     generator_.config = subModelConfig->generator();
     eosFrameLine_.reset(new EosFrameLine);
@@ -472,7 +515,9 @@ void RecurrentGradientMachine::forward(const std::vector<Argument>& inArgs,
                         passType);
     }
   }
-  resizeOrCreateFrames(maxSequenceLength_);
+  useCheckpoint_ = isCheckpointable(hasSubseq);
+  resizeOrCreateFrames(useCheckpoint_ ? FLAGS_rnn_checkpoint_interval
+                                      : maxSequenceLength_);
   resizeBootFrame(numSequences);
 
   for (auto& memoryFrameLine : memoryFrameLines_) {
@@ -504,28 +549,13 @@ void RecurrentGradientMachine::forward(const std::vector<Argument>& inArgs,
                                        info_[targetInfoInlinkId_].idIndex);
   }
 
+  if (useCheckpoint_) {
+    forwardCheckpoint(passType);
+    return;
+  }
+
   for (int i = 0; i < maxSequenceLength_; ++i) {
-    int idSize = 0;
-    // connect in_links
-    for (size_t j = 0; j < inFrameLines_.size(); ++j) {
-      Info& info = info_[shareInlinkInfo ? 0 : j];
-      // idSize denotes the sum number of tokens in each length i
-      idSize = info.idIndex[i + 1] - info.idIndex[i];
-      InFrameLine inFrameLine = inFrameLines_[j];
-      auto scatterAgent =
-          dynamic_cast<ScatterAgentLayer*>(inFrameLine.agents[i].get());
-      scatterAgent->setRealLayerAndOutput(inFrameLine.inLayer,
-                                          inFrameLine.outArg,
-                                          info.allIds,
-                                          info.idIndex[i],
-                                          idSize);
-      if (hasSubseq) {
-        // size: the length of subsequence
-        int size = info.seqStartPosIndex[i + 1] - info.seqStartPosIndex[i];
-        scatterAgent->setSequenceStartPositions(
-            info.sequenceStartPositions, info.seqStartPosIndex[i], size);
-      }
-    }
+    connectFrame(i, i, shareInlinkInfo, hasSubseq);
 
     // connect out_links
     for (auto& outFrameLine : outFrameLines_) {
@@ -533,17 +563,6 @@ void RecurrentGradientMachine::forward(const std::vector<Argument>& inArgs,
           dynamic_cast<GatherAgentLayer*>(outFrameLine.agentLayer.get());
       gatherAgent->addRealLayer(outFrameLine.frames[i]);
     }
-    // connect memory links
-    // Adopt info_[0].idIndex because seq which has_subseq=True
-    // doesn't support Memory with !hasSubseq bootlayer;
-    // And inlinks that !hasSubSeq must have same inlink length.
-    idSize = info_[0].idIndex[i + 1] - info_[0].idIndex[i];
-    for (auto& memoryFrameLine : memoryFrameLines_) {
-      NeuralNetwork::connect(
-          memoryFrameLine.agents[i],
-          i == 0 ? memoryFrameLine.bootLayer : memoryFrameLine.frames[i - 1],
-          numSeqs_[i] /*height of agent*/);
-    }
   }
 
   REGISTER_TIMER_INFO("RecurrentFwTime", "RecurrentFwTime");
@@ -567,11 +586,222 @@ void RecurrentGradientMachine::forward(const std::vector<Argument>& inArgs,
   }
 }
 
+void RecurrentGradientMachine::connectFrame(int stepId,
+                                            int frameId,
+                                            bool shareInlinkInfo,
+                                            bool hasSubseq) {
+  int i = stepId;
+  // connect in_links
+  for (size_t j = 0; j < inFrameLines_.size(); ++j) {
+    Info& info = info_[shareInlinkInfo ? 0 : j];
+    // idSize denotes the sum number of tokens in each length i
+    int idSize = info.idIndex[i + 1] - info.idIndex[i];
+    InFrameLine& inFrameLine = inFrameLines_[j];
+    auto scatterAgent =
+        dynamic_cast<ScatterAgentLayer*>(inFrameLine.agents[frameId].get());
+    scatterAgent->setRealLayerAndOutput(inFrameLine.inLayer,
+                                        inFrameLine.outArg,
+                                        info.allIds,
+                                        info.idIndex[i],
+                                        idSize);
+    if (hasSubseq) {
+      // size: the length of subsequence
+      int size = info.seqStartPosIndex[i + 1] - info.seqStartPosIndex[i];
+      scatterAgent->setSequenceStartPositions(
+          info.sequenceStartPositions, info.seqStartPosIndex[i], size);
+    }
+  }
+
+  // connect memory links
+  // Adopt numSeqs_ of info_[0] because seq which has_subseq=True
+  // doesn't support Memory with !hasSubseq bootlayer;
+  // And inlinks that !hasSubSeq must have same inlink length.
+  for (auto& memoryFrameLine : memoryFrameLines_) {
+    LayerPtr prevLayer;
+    if (i == 0) {
+      prevLayer = memoryFrameLine.bootLayer;
+    } else if (frameId == 0) {
+      prevLayer = memoryFrameLine.checkpointLayer;
+    } else {
+      prevLayer = memoryFrameLine.frames[frameId - 1];
+    }
+    NeuralNetwork::connect(memoryFrameLine.agents[frameId],
+                           prevLayer,
+                           numSeqs_[i] /*height of agent*/);
+  }
+}
+
+bool RecurrentGradientMachine::isCheckpointable(bool hasSubseq) {
+  int interval = FLAGS_rnn_checkpoint_interval;
+  if (interval <= 0 || maxSequenceLength_ <= interval) {
+    return false;
+  }
+  if (hasSubseq || evaluator_ || !canRecompute_) {
+    return false;
+  }
+  for (auto& memoryFrameLine : memoryFrameLines_) {
+    if (memoryFrameLine.rootAgent && memoryFrameLine.is_sequence) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RecurrentGradientMachine::forwardCheckpoint(PassType passType) {
+  int interval = FLAGS_rnn_checkpoint_interval;
+  int numSegments = (maxSequenceLength_ + interval - 1) / interval;
+  bool needGrad = passType != PASS_TEST;
+  passType_ = passType;
+
+  // outputs of every step are stored in one matrix, one step after another
+  Info& info = info_[targetInfoInlinkId_];
+  size_t numTokens = info.allIds->getSize();
+  for (auto& outFrameLine : outFrameLines_) {
+    Argument& outArg = outFrameLine.outArg;
+    size_t width = outFrameLine.agentLayer->getSize();
+    Matrix::resizeOrCreate(outArg.value, numTokens, width, false, useGpu_);
+    if (needGrad) {
+      Matrix::resizeOrCreate(outArg.grad, numTokens, width, false, useGpu_);
+      outArg.grad->zeroMem();
+    } else {
+      outArg.grad = nullptr;
+    }
+    auto gatherAgent =
+        dynamic_cast<GatherAgentLayer*>(outFrameLine.agentLayer.get());
+    gatherAgent->setRealOutput(outArg);
+  }
+
+  // the i-th checkpoint is the memory after step (i + 1) * interval - 1
+  checkpointStarts_.resize(numSegments);
+  checkpointStarts_[0] = 0;
+  for (int i = 1; i < numSegments; ++i) {
+    checkpointStarts_[i] =
+        checkpointStarts_[i - 1] + numSeqs_[i * interval - 1];
+  }
+  size_t numRows = checkpointStarts_.back();
+  for (auto& memoryFrameLine : memoryFrameLines_) {
+    size_t width = memoryFrameLine.checkpointLayer->getSize();
+    Matrix::resizeOrCreate(
+        memoryFrameLine.checkpointValue, numRows, width, false, useGpu_);
+    if (needGrad) {
+      Matrix::resizeOrCreate(
+          memoryFrameLine.checkpointGrad, numRows, width, false, useGpu_);
+      memoryFrameLine.checkpointGrad->zeroMem();
+    }
+  }
+
+  REGISTER_TIMER_INFO("RecurrentFwTime", "RecurrentFwTime");
+  for (auto& memoryFrameLine : memoryFrameLines_) {
+    memoryFrameLine.bootLayer->forward(passType);
+  }
+  for (int i = 0; i < numSegments; ++i) {
+    if (i > 0) {
+      int rows = checkpointStarts_[i] - checkpointStarts_[i - 1];
+      for (auto& memoryFrameLine : memoryFrameLines_) {
+        const MatrixPtr& lastValue =
+            memoryFrameLine.frames[interval - 1]->getOutputValue();
+        CHECK(lastValue) << "Only memories of values are supported when "
+                         << "rnn_checkpoint_interval > 0";
+        CHECK_EQ(lastValue->getHeight(), (size_t)rows);
+        memoryFrameLine.checkpointValue
+            ->subMatrix(checkpointStarts_[i - 1], rows)
+            ->copyFrom(*lastValue);
+      }
+    }
+    forwardSegment(i * interval, passType, /* storeOutput */ true);
+  }
+}
+
+void RecurrentGradientMachine::forwardSegment(int start,
+                                              PassType passType,
+                                              bool storeOutput) {
+  int interval = FLAGS_rnn_checkpoint_interval;
+  int end = std::min(start + interval, maxSequenceLength_);
+  if (start > 0) {
+    int index = start / interval - 1;
+    int rows = checkpointStarts_[index + 1] - checkpointStarts_[index];
+    for (auto& memoryFrameLine : memoryFrameLines_) {
+      auto checkpointLayer = dynamic_cast<CheckpointLayer*>(
+          memoryFrameLine.checkpointLayer.get());
+      const MatrixPtr& grad = memoryFrameLine.checkpointGrad;
+      checkpointLayer->setOutput(
+          memoryFrameLine.checkpointValue->subMatrix(
+              checkpointStarts_[index], rows),
+          passType != PASS_TEST
+              ? grad->subMatrix(checkpointStarts_[index], rows)
+              : nullptr);
+    }
+  }
+
+  const std::vector<int>& idIndex = info_[targetInfoInlinkId_].idIndex;
+  for (int i = start; i < end; ++i) {
+    connectFrame(i, i - start, /* shareInlinkInfo */ true, false);
+    const std::vector<Argument> inArgs;
+    std::vector<Argument> outArgs;
+    frames_[i - start]->forward(inArgs, &outArgs, passType);
+    if (!storeOutput) {
+      continue;
+    }
+    int rows = idIndex[i + 1] - idIndex[i];
+    for (auto& outFrameLine : outFrameLines_) {
+      const MatrixPtr& value = outFrameLine.frames[i - start]->getOutputValue();
+      CHECK(value) << "Only out links of values are supported when "
+                   << "rnn_checkpoint_interval > 0";
+      outFrameLine.outArg.value->subMatrix(idIndex[i], rows)->copyFrom(*value);
+    }
+  }
+}
+
+void RecurrentGradientMachine::backwardCheckpoint() {
+  int interval = FLAGS_rnn_checkpoint_interval;
+  int numSegments = (maxSequenceLength_ + interval - 1) / interval;
+  const std::vector<int>& idIndex = info_[targetInfoInlinkId_].idIndex;
+  for (int i = numSegments - 1; i >= 0; --i) {
+    int start = i * interval;
+    int end = std::min(start + interval, maxSequenceLength_);
+    if (i < numSegments - 1) {
+      // frames of the last segment are still there after forward
+      REGISTER_TIMER_INFO("RecurrentRecomputeTime", "RecurrentRecomputeTime");
+      forwardSegment(start, passType_, /* storeOutput */ false);
+    }
+
+    // gradients from outside of this segment
+    for (int j = start; j < end; ++j) {
+      int rows = idIndex[j + 1] - idIndex[j];
+      for (auto& outFrameLine : outFrameLines_) {
+        const MatrixPtr& grad = outFrameLine.frames[j - start]->getOutputGrad();
+        if (grad) {
+          grad->add(*outFrameLine.outArg.grad->subMatrix(idIndex[j], rows));
+        }
+      }
+    }
+    if (i < numSegments - 1) {
+      int rows = checkpointStarts_[i + 1] - checkpointStarts_[i];
+      for (auto& memoryFrameLine : memoryFrameLines_) {
+        const MatrixPtr& grad =
+            memoryFrameLine.frames[end - start - 1]->getOutputGrad();
+        if (grad) {
+          grad->add(*memoryFrameLine.checkpointGrad->subMatrix(
+              checkpointStarts_[i], rows));
+        }
+      }
+    }
+
+    for (int j = end - 1; j >= start; --j) {
+      frames_[j - start]->backward(nullptr);
+    }
+  }
+}
+
 void RecurrentGradientMachine::backward(const UpdateCallback& callback) {
   REGISTER_TIMER_INFO("RecurrentBwTime", "RecurrentBwTime");
   AsyncGpuBlock asyncGpuBlock;
-  for (int i = maxSequenceLength_ - 1; i >= 0; --i) {
-    frames_[i]->backward(nullptr);
+  if (useCheckpoint_) {
+    backwardCheckpoint();
+  } else {
+    for (int i = maxSequenceLength_ - 1; i >= 0; --i) {
+      frames_[i]->backward(nullptr);
+    }
   }
   for (auto& memoryFrameLine : memoryFrameLines_) {
     memoryFrameLine.bootLayer->backward(nullptr);
@@ -1043,6 +1273,10 @@ void RecurrentGradientMachine::singlePathExpand(Path& curPath,
                                                 size_t expandWidth) {
   int calc_id =
       gDiyProbStart ? gDiyProbStart(curPath.ids.size(), curPath.ids.data()) : 0;
+  bool copyIds = needPathIds();
+  if (beamSearchCtrlCallbacks_) {
+    getProbHistory(curPath.nodeId, &probHistoryBuf_);
+  }
 
   const int* idVec = cpuId_->getData();
   const real* probMat = cpuProb_->getData();
@@ -1064,25 +1298,30 @@ void RecurrentGradientMachine::singlePathExpand(Path& curPath,
     if (id == -1) break;
 
     real newLogProb = generator_.config.log_prob() ? std::log(prob) : prob;
-    Path newPath(
-        curPath, id, newLogProb, curPathId /*machineId*/, k /*topIndex*/);
+    pathNodes_.push_back({id, (int)curPathId, curPath.nodeId, newLogProb});
+    Path newPath(curPath,
+                 id,
+                 newLogProb,
+                 curPathId /*machineId*/,
+                 k /*topIndex*/,
+                 pathNodes_.size() - 1 /*nodeId*/,
+                 copyIds);
     if (this->beamSearchCtrlCallbacks_) {
+      probHistoryBuf_.push_back(newLogProb);
       if (beamSearchCtrlCallbacks_->stopDetermineCandidates(
-              newPath.seqId, newPath.ids, newPath.probHistory))
+              newPath.seqId, newPath.ids, probHistoryBuf_))
         return;
     }
-    // outFrameLines_.size() > 1UL
-    if (dataArgsSize_) {
-      newPath.machineIdVec = curPath.machineIdVec;
-      newPath.machineIdVec.push_back(curPathId);
-    }
-    bool atEos =
-        eosVec[index] == 1U || newPath.ids.size() >= (size_t)maxSequenceLength_;
+    bool atEos = eosVec[index] == 1U || newPath.length >= maxSequenceLength_;
     // adjustNewPath
     newPath.adjustProb(calc_id, atEos);
     if (this->beamSearchCtrlCallbacks_) {
       this->beamSearchCtrlCallbacks_->normOrDropNode(
-          newPath.seqId, newPath.ids, newPath.probHistory, &newPath.logProb);
+          newPath.seqId, newPath.ids, probHistoryBuf_, &newPath.logProb);
+      // the prefix is shared with the other paths, only the probability of
+      // the new node may be changed by the callback
+      pathNodes_.back().logProb = probHistoryBuf_.back();
+      probHistoryBuf_.pop_back();
     }
     if (!newPath.isDropable()) {
       atEos ? finalPaths_[curPath.seqId].push_back(newPath)
@@ -1171,6 +1410,9 @@ void RecurrentGradientMachine::fillGenOutputs() {
                       finalPaths_[i].end(),
                       Path::greaterPath);
     finalPaths_[i].resize(minFinalPathsSize);
+    for (auto& path : finalPaths_[i]) {
+      recoverPath(path);
+    }
   }
 
   batchMachineIdVec_.clear();
@@ -1207,6 +1449,46 @@ void RecurrentGradientMachine::fillGenOutputs() {
   }
 }
 
+void RecurrentGradientMachine::recoverPath(Path& path) {
+  if (beamSearchCtrlCallbacks_) {
+    getProbHistory(path.nodeId, &path.probHistory);
+  }
+  bool fillIds = (int)path.ids.size() != path.length;
+  bool fillMachineIds =
+      dataArgsSize_ && (int)path.machineIdVec.size() != path.length;
+  if (!fillIds && !fillMachineIds) {
+    return;
+  }
+  path.ids.resize(path.length);
+  if (fillMachineIds) {
+    path.machineIdVec.resize(path.length);
+  }
+  int nodeId = path.nodeId;
+  for (int i = path.length - 1; i >= 0; --i) {
+    CHECK_GE(nodeId, 0);
+    const PathNode& node = pathNodes_[nodeId];
+    path.ids[i] = node.id;
+    if (fillMachineIds) {
+      path.machineIdVec[i] = node.machineId;
+    }
+    nodeId = node.parent;
+  }
+}
+
+void RecurrentGradientMachine::getProbHistory(int nodeId,
+                                              std::vector<real>* history) {
+  history->clear();
+  for (; nodeId >= 0; nodeId = pathNodes_[nodeId].parent) {
+    history->push_back(pathNodes_[nodeId].logProb);
+  }
+  history->push_back(0);
+  std::reverse(history->begin(), history->end());
+}
+
+bool RecurrentGradientMachine::needPathIds() {
+  return beamSearchCtrlCallbacks_ || gDiyProbStart || gDiyProbMethod;
+}
+
 void RecurrentGradientMachine::copyDataOutlinkFrame(size_t machineCur) {
   for (size_t i = 0; i < dataArgsSize_; i++) {
     Argument outFrame;
@@ -1248,14 +1530,12 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
   seqIds_.resize(batchSize);
   minFinalPathLogProb_.clear();
   minFinalPathLogProb_.resize(batchSize, 0);
+  pathNodes_.clear();
 
   std::vector<Path> paths;
   std::vector<Path> newPaths;
   for (size_t i = 0; i < batchSize; ++i) {
     paths.push_back(Path(i));
-    if (this->beamSearchCtrlCallbacks_) {
-      paths.back().recordHistory();
-    }
   }
 
   // restart beam search
@@ -1293,7 +1573,7 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
     beamExpand(paths, newPaths);
     if (newPaths.empty()) break;
 
-    paths = newPaths;
+    paths.swap(newPaths);
     newPaths.clear();
   }  // end for machineCur
   fillGenOutputs();
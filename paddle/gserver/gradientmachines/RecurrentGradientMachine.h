@@ -115,7 +115,8 @@ public:
     *
     * The second parameter is path.ids
     *
-    * The third parameter is probabilites for each node in this path.
+    * The third parameter is probabilites for each node in this path. Only
+    * the change of the last one, the new node, is kept.
     *
     * The fourth parameter is the probability of the whole path.
     */
@@ -186,9 +187,22 @@ public:
   struct Path {
     /**
      * @brief ids, path of beam search.
+     *
+     * @note  It is only filled during beam search when user callbacks need it,
+     *        otherwise it is recovered from pathNodes_ for the final paths.
      */
     std::vector<int> ids;
 
+    /**
+     * @brief index of the last node of this path in pathNodes_, -1 if empty.
+     */
+    int nodeId;
+
+    /**
+     * @brief number of ids in this path.
+     */
+    int length;
+
     /**
      * @brief logProb, current probability of path.
      */
@@ -202,19 +216,22 @@ public:
     /**
      * @brief A record of each node's probality in a formed path in beam search.
      *
-     * @note  It could be empty when history is not recorded. If the history is
-     *        wanted to be recorded, recordHistory() MUST be invoked first.
+     * @note  It is only filled for the final paths when beam search control
+     *        callbacks are registered. During beam search, the probabilities
+     *        are kept in pathNodes_.
      */
     std::vector<real> probHistory;
 
     /**
      * @brief Path default ctor, first logProb is 0.
      */
-    Path() {
+    Path() : nodeId(-1), length(0) {
       logProb = 0;
       seqId = 0;
     }
-    explicit Path(size_t seqId) : seqId(seqId) { logProb = 0; }
+    explicit Path(size_t seqId) : nodeId(-1), length(0), seqId(seqId) {
+      logProb = 0;
+    }
 
     /**
      * @brief Create a new path based on an old path and
@@ -225,18 +242,25 @@ public:
      * @param logProb   probability of the new node.
      * @param machineId sample index of a frame in RNN
      * @param topIndex  index of MaxIdLayer output in one sample
+     * @param nodeId    index of the new node in pathNodes_
+     * @param copyIds   whether to copy ids of the old path.
      */
-    Path(Path& old, int newId, real logProb, int machineId, int topIndex)
-        : ids(old.ids),
+    Path(Path& old,
+         int newId,
+         real logProb,
+         int machineId,
+         int topIndex,
+         int nodeId,
+         bool copyIds)
+        : nodeId(nodeId),
+          length(old.length + 1),
           logProb(old.logProb + logProb),
           machineId(machineId),
           topIndex(topIndex),
           seqId(old.seqId) {
-      ids.push_back(newId);
-      if (!old.probHistory.empty()) {
-        this->probHistory = old.probHistory;
-        // probHistory store current prob, not sum
-        this->probHistory.push_back(logProb);
+      if (copyIds) {
+        ids = old.ids;
+        ids.push_back(newId);
       }
     }
 
@@ -251,11 +275,6 @@ public:
 
     static bool greaterPath(const Path& a, const Path& b) { return (b < a); }
 
-    /**
-     * @brief Start recording history in this path.
-     */
-    void recordHistory() { this->probHistory.push_back(this->logProb); }
-
     /**
      * @brief Adjust probability for DIY beam search interface.
      * In normal situation, it will do nothing.
@@ -287,10 +306,50 @@ protected:
   void resizeOrCreateFrames(int numFrames);
   void resizeBootFrame(int numSequences);
 
+  /*
+   * @brief connect in links and memory links of the frameId-th frame to
+   * compute the stepId-th time step. Frames are reused for different steps
+   * in checkpoint mode, see forwardCheckpoint().
+   */
+  void connectFrame(int stepId,
+                    int frameId,
+                    bool shareInlinkInfo,
+                    bool hasSubseq);
+
+  /*
+   * @brief whether to run this batch in checkpoint mode.
+   *
+   * In checkpoint mode, only FLAGS_rnn_checkpoint_interval frames are
+   * created, and they are reused by every segment of that many steps. The
+   * outputs of out links are stored by steps in one matrix sized by the total
+   * number of tokens, and the memories at the beginning of every segment are
+   * stored as checkpoints. In backward, each segment is computed again from
+   * its checkpoint before its frames go backward.
+   */
+  bool isCheckpointable(bool hasSubseq);
+  void forwardCheckpoint(PassType passType);
+  void backwardCheckpoint();
+  void forwardSegment(int start, PassType passType, bool storeOutput);
+
   void generateSequence();
   void oneWaySearch(size_t batchSize);
   void beamSearch(size_t batchSize);
 
+  /**
+   * A node of paths in beam search. Each path only refers to its last node,
+   * and its prefix is found by following parent, so expanding a path does not
+   * copy its prefix.
+   */
+  struct PathNode {
+    int id;
+    int machineId;  // index of sample in frame which generates id
+    int parent;     // index in pathNodes_, -1 for the first node
+    real logProb;   // probability of id, not the sum of the path
+  };
+  std::vector<PathNode> pathNodes_;
+  /// probability history given to the beam search control callbacks
+  std::vector<real> probHistoryBuf_;
+
   struct InFrameLine {
     std::string linkName;
     LayerPtr inLayer;
@@ -304,6 +363,7 @@ protected:
     std::string layerName;
     LayerPtr agentLayer;
     std::vector<LayerPtr> frames;
+    Argument outArg;  // outputs of all steps in checkpoint mode
   };
   std::vector<OutFrameLine> outFrameLines_;
 
@@ -318,6 +378,9 @@ protected:
     std::vector<LayerPtr> agents;
     std::vector<LayerPtr> scatterAgents;  // scatter agent used by beam search
     Argument outArg;                      // scatter output argument
+    LayerPtr checkpointLayer;             // boot first frame of a segment
+    MatrixPtr checkpointValue;            // memories at segment beginnings
+    MatrixPtr checkpointGrad;
     bool is_sequence;
     // Different memoryFrameLine have different element as follows
     IVectorPtr allIds;  // scattered id of realLayer
@@ -389,6 +452,14 @@ protected:
   // if hasSubseq: max number of sentences(subseq)in batchsize samples
   // else: max number of tokens in batchsize samples(sentences)
   int maxSequenceLength_;
+
+  // whether current batch runs in checkpoint mode
+  bool useCheckpoint_;
+  // no dropout in this layer group, so it can be computed again
+  bool canRecompute_;
+  PassType passType_;
+  // checkpointStarts_[i] is the first row of the i-th checkpoint
+  std::vector<int> checkpointStarts_;
   bool useGpu_;
   bool stopBeamSearch_;
 
@@ -499,6 +570,25 @@ private:
    */
   void fillGenOutputs();
 
+  /*
+   * @brief fill ids and machineIdVec of a path from pathNodes_,
+   * if they are not copied during beam search, and probHistory if the beam
+   * search control callbacks need it.
+   */
+  void recoverPath(Path& path);
+
+  /*
+   * @brief the probability history of the path ending at node nodeId: the
+   * initial probability 0 of the empty path, followed by the probability of
+   * each node.
+   */
+  void getProbHistory(int nodeId, std::vector<real>* history);
+
+  /*
+   * @return whether user callbacks need ids of every path in beam search.
+   */
+  bool needPathIds();
+
   std::vector<int> machineIds_;
   std::vector<int> topIds_;
   std::vector<int> seqIds_;
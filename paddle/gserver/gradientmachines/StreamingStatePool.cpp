@@ -0,0 +1,212 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <algorithm>
+#include "StreamingStatePool.h"
+#include "paddle/utils/Flags.h"
+#include "paddle/utils/Stat.h"
+
+namespace paddle {
+
+void StreamingStatePool::forward(const std::vector<int64_t>& sessionIds,
+                                 const std::vector<Argument>& inArgs,
+                                 std::vector<Argument>* outArgs) {
+  REGISTER_TIMER("StreamingForward");
+  CHECK(FLAGS_prev_batch_state)
+      << "StreamingStatePool requires --prev_batch_state=true";
+  CHECK(!inArgs.empty());
+  CHECK_EQ(sessionIds.size(), (size_t)inArgs[0].getNumSequences())
+      << "one session id is expected for each input sequence";
+
+  std::vector<size_t> newSlots = assignSlots(sessionIds);
+  if (initialized_) {
+    reserve(numSlots_);
+    for (auto slot : newSlots) {
+      zeroSlot(slot);
+    }
+    gather(&state_);
+    machine_->setState(state_);
+  } else {
+    // every session is new, the layers start from zero states
+    machine_->resetState();
+  }
+
+  machine_->forward(inArgs, outArgs, PASS_TEST);
+
+  machine_->getState(state_);
+  if (!initialized_) {
+    initPool(state_);
+    initialized_ = true;
+  }
+  scatter(state_);
+}
+
+void StreamingStatePool::copySession(int64_t srcId, int64_t dstId) {
+  CHECK(initialized_) << "copySession needs a forward first";
+  auto it = slots_.find(srcId);
+  CHECK(it != slots_.end()) << "unknown session " << srcId;
+  CHECK(!slots_.count(dstId)) << "session " << dstId << " already exists";
+  size_t srcSlot = it->second;
+  size_t dstSlot = allocateSlot();
+  slots_[dstId] = dstSlot;
+  reserve(numSlots_);
+  for (auto& values : pool_) {
+    for (auto& value : values) {
+      value->subMatrix(dstSlot, 1)->copyFrom(*value->subMatrix(srcSlot, 1));
+    }
+  }
+}
+
+void StreamingStatePool::endSession(int64_t sessionId) {
+  auto it = slots_.find(sessionId);
+  if (it == slots_.end()) {
+    return;
+  }
+  freeSlots_.push_back(it->second);
+  slots_.erase(it);
+}
+
+void StreamingStatePool::clear() {
+  slots_.clear();
+  freeSlots_.clear();
+  numSlots_ = 0;
+}
+
+size_t StreamingStatePool::allocateSlot() {
+  if (freeSlots_.empty()) {
+    return numSlots_++;
+  }
+  size_t slot = freeSlots_.back();
+  freeSlots_.pop_back();
+  return slot;
+}
+
+std::vector<size_t> StreamingStatePool::assignSlots(
+    const std::vector<int64_t>& sessionIds) {
+  size_t numSessions = sessionIds.size();
+  IVector::resizeOrCreate(cpuSlotIds_, numSessions, /* useGpu= */ false);
+  int* slotIds = cpuSlotIds_->getData();
+
+  std::vector<size_t> newSlots;
+  for (size_t i = 0; i < numSessions; ++i) {
+    auto it = slots_.find(sessionIds[i]);
+    size_t slot;
+    if (it != slots_.end()) {
+      slot = it->second;
+    } else {
+      slot = allocateSlot();
+      slots_[sessionIds[i]] = slot;
+      newSlots.push_back(slot);
+    }
+    slotIds[i] = slot;
+  }
+
+  std::vector<bool> used(numSlots_, false);
+  for (size_t i = 0; i < numSessions; ++i) {
+    CHECK(!used[slotIds[i]]) << "session " << sessionIds[i]
+                             << " appears twice in one batch";
+    used[slotIds[i]] = true;
+  }
+  return newSlots;
+}
+
+void StreamingStatePool::initPool(const MachineState& state) {
+  pool_.clear();
+  pool_.resize(state.size());
+  for (size_t i = 0; i < state.size(); ++i) {
+    if (!state[i]) continue;
+    for (auto& value : state[i]->value) {
+      pool_[i].push_back(Matrix::create(numSlots_,
+                                        value->getWidth(),
+                                        /* trans= */ false,
+                                        value->useGpu()));
+    }
+  }
+  capacity_ = numSlots_;
+}
+
+void StreamingStatePool::reserve(size_t capacity) {
+  if (capacity <= capacity_) {
+    return;
+  }
+  capacity = std::max(capacity, 2 * capacity_);
+  for (auto& values : pool_) {
+    for (auto& value : values) {
+      MatrixPtr grown = Matrix::create(
+          capacity, value->getWidth(), /* trans= */ false, value->useGpu());
+      grown->subMatrix(0, capacity_)->copyFrom(*value);
+      value = grown;
+    }
+  }
+  capacity_ = capacity;
+}
+
+void StreamingStatePool::gather(MachineState* state) {
+  size_t numSessions = cpuSlotIds_->getSize();
+  state->resize(pool_.size());
+  for (size_t i = 0; i < pool_.size(); ++i) {
+    if (pool_[i].empty()) {
+      (*state)[i] = nullptr;
+      continue;
+    }
+    if (!(*state)[i]) {
+      (*state)[i] = std::make_shared<LayerState>();
+    }
+    auto& values = (*state)[i]->value;
+    values.resize(pool_[i].size());
+    for (size_t k = 0; k < pool_[i].size(); ++k) {
+      const MatrixPtr& table = pool_[i][k];
+      Matrix::resizeOrCreate(values[k],
+                             numSessions,
+                             table->getWidth(),
+                             /* trans= */ false,
+                             table->useGpu());
+      if (table->useGpu()) {
+        IVector::resizeOrCreate(slotIds_, numSessions, /* useGpu= */ true);
+        slotIds_->copyFrom(*cpuSlotIds_);
+        values[k]->copyByRowIndex(*table, *slotIds_);
+      } else {
+        values[k]->copyByRowIndex(*table, *cpuSlotIds_);
+      }
+    }
+  }
+}
+
+void StreamingStatePool::scatter(const MachineState& state) {
+  size_t numSessions = cpuSlotIds_->getSize();
+  const int* slotIds = cpuSlotIds_->getData();
+  CHECK_EQ(state.size(), pool_.size());
+  for (size_t i = 0; i < pool_.size(); ++i) {
+    CHECK_EQ(pool_[i].size(), state[i] ? state[i]->value.size() : 0UL);
+    for (size_t k = 0; k < pool_[i].size(); ++k) {
+      const MatrixPtr& value = state[i]->value[k];
+      CHECK_EQ(value->getHeight(), numSessions)
+          << "layer " << i << " does not keep one state row per sequence";
+      for (size_t j = 0; j < numSessions; ++j) {
+        pool_[i][k]->subMatrix(slotIds[j], 1)->copyFrom(
+            *value->subMatrix(j, 1));
+      }
+    }
+  }
+}
+
+void StreamingStatePool::zeroSlot(size_t slot) {
+  for (auto& values : pool_) {
+    for (auto& value : values) {
+      value->subMatrix(slot, 1)->zeroMem();
+    }
+  }
+}
+
+}  // namespace paddle
@@ -0,0 +1,118 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "GradientMachine.h"
+
+namespace paddle {
+
+/**
+ * @brief Keeps the recurrent states of many streaming sessions resident
+ *        so that each call only advances the sessions in the batch.
+ *
+ * The network is run with FLAGS_prev_batch_state, under which lstmemory and
+ * gated_recurrent layers carry one state row per sequence from one forward
+ * to the next. The pool owns, for every stateful layer, a matrix with one row
+ * per session slot. forward() gathers the rows of the sessions in the batch
+ * (sequence i of inArgs belongs to sessionIds[i]), runs the network on the
+ * new frames only, and scatters the updated rows back. The cost per call is
+ * therefore proportional to the number of sessions and new frames, not to
+ * the length of the utterances seen so far.
+ *
+ * A session gets a zero state the first time its id is seen, and its slot is
+ * recycled by endSession().
+ *
+ * Usage:
+ *
+ *     StreamingStatePool pool(machine);
+ *     pool.forward({7, 9}, inArgs, &outArgs);  // first chunk of 7 and 9
+ *     pool.forward({9}, inArgs, &outArgs);     // next chunk of 9 only
+ *     pool.endSession(7);
+ */
+class StreamingStatePool {
+public:
+  explicit StreamingStatePool(GradientMachine* machine)
+      : machine_(machine), numSlots_(0), capacity_(0), initialized_(false) {}
+
+  /**
+   * @brief Run one forward (PASS_TEST) for a batch of sessions.
+   * @param sessionIds  session id of each sequence in inArgs, all distinct.
+   */
+  void forward(const std::vector<int64_t>& sessionIds,
+               const std::vector<Argument>& inArgs,
+               std::vector<Argument>* outArgs);
+
+  /**
+   * @brief Start session dstId from the current state of session srcId.
+   *
+   * Used by beam search, where every extension of a path continues from the
+   * state of its parent.
+   */
+  void copySession(int64_t srcId, int64_t dstId);
+
+  /// Drop the state of a session. Unknown ids are ignored.
+  void endSession(int64_t sessionId);
+
+  /// Drop all sessions.
+  void clear();
+
+  size_t getNumSessions() const { return slots_.size(); }
+
+protected:
+  /// Take a free slot or append a new one.
+  size_t allocateSlot();
+
+  /// Find or allocate the slot of each session in the batch.
+  /// Returns the newly allocated slots.
+  std::vector<size_t> assignSlots(const std::vector<int64_t>& sessionIds);
+
+  /// Create the pool matrices from the layout of a machine state.
+  void initPool(const MachineState& state);
+
+  /// Grow every pool matrix to at least capacity rows.
+  void reserve(size_t capacity);
+
+  /// state[i][k] <- rows slotIds_ of pool_[i][k]
+  void gather(MachineState* state);
+
+  /// rows slotIds_ of pool_[i][k] <- state[i][k]
+  void scatter(const MachineState& state);
+
+  void zeroSlot(size_t slot);
+
+protected:
+  GradientMachine* machine_;
+
+  std::unordered_map<int64_t, size_t> slots_;
+  std::vector<size_t> freeSlots_;
+  /// number of slots ever handed out, also the used height of pool_
+  size_t numSlots_;
+  size_t capacity_;
+  bool initialized_;
+
+  /// pool_[i][k]: k-th state matrix of layer i, one row per slot.
+  /// Layers without state have an empty list.
+  std::vector<std::vector<MatrixPtr>> pool_;
+
+  /// slot of each session in the current batch
+  IVectorPtr cpuSlotIds_;
+  IVectorPtr slotIds_;
+  MachineState state_;
+};
+
+}  // namespace paddle
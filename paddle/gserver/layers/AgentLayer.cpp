@@ -96,6 +96,7 @@ void GatherAgentLayer::copyIdAndSequenceInfo(const Argument& input,
   output_.sequenceStartPositions = input.sequenceStartPositions;
   output_.subSequenceStartPositions = input.subSequenceStartPositions;
   realLayers_.clear();
+  realOutput_ = Argument();
   allIds_ = ids;
   idIndex_ = idIndex;
 }
@@ -110,6 +111,12 @@ void GatherAgentLayer::forward(PassType passType) {
 
   const MatrixPtr& outV = getOutputValue();
 
+  if (realOutput_.value) {
+    CHECK(realLayers_.empty());
+    realOutput_.value->addToRows(*outV, *allIds_);
+    return;
+  }
+
   for (size_t i = 0; i < realLayers_.size(); ++i) {
     const MatrixPtr& realV = realLayers_[i]->getOutputValue();
     idsVec_[i] = IVector::create(allIds_->getData() + idIndex_[i],
@@ -123,6 +130,13 @@ void GatherAgentLayer::backward(const UpdateCallback& callback) {
   (void)callback;
   const MatrixPtr& outputGrad = getOutputGrad();
 
+  if (realOutput_.value) {
+    if (realOutput_.grad) {
+      realOutput_.grad->selectRows(*outputGrad, *allIds_);
+    }
+    return;
+  }
+
   for (size_t i = 0; i < realLayers_.size(); ++i) {
     const MatrixPtr& realG = realLayers_[i]->getOutputGrad();
     if (realG) {
@@ -72,6 +72,8 @@ protected:
   // we don't clear idsVec_ vector to aviod IVector alloc/free
   IVectorPtr allIds_;
   std::vector<int> idIndex_;
+  // rows of all real layers, see setRealOutput
+  Argument realOutput_;
 
 public:
   explicit GatherAgentLayer(const LayerConfig& config) : Layer(config) {}
@@ -88,6 +90,11 @@ public:
   // add one real layer, can call many times
   void addRealLayer(LayerPtr layer) { realLayers_.push_back(layer); }
 
+  // instead of adding real layers, use one argument holding the rows of all
+  // real layers one after another, in the order of allIds.
+  // call after copyIdAndSequenceInfo
+  void setRealOutput(const Argument& realOutput) { realOutput_ = realOutput; }
+
   void forward(PassType passType);
   void backward(const UpdateCallback& callback);
 };
@@ -23,8 +23,11 @@ bool CRFDecodingLayer::init(const LayerMap& layerMap,
   if (!CRFLayer::init(layerMap, parameterMap)) {
     return false;
   }
-  crf_.reset(new LinearChainCRF(
-      numClasses_, parameter_->getBuf(PARAMETER_VALUE)->getData(), nullptr));
+  // one decoder for each thread
+  for (size_t tid = 0; tid < numThreads_; ++tid) {
+    crfs_.emplace_back(
+        numClasses_, parameter_->getBuf(PARAMETER_VALUE)->getData(), nullptr);
+  }
   return true;
 }
 
@@ -43,11 +46,12 @@ void CRFDecodingLayer::forward(PassType passType) {
   const int* starts = output.sequenceStartPositions->getData(false);
   CHECK_EQ(starts[numSequences], (int)batchSize);
 
-  for (size_t i = 0; i < numSequences; ++i) {
-    crf_->decode(output.value->getData() + numClasses_ * starts[i],
-                 output_.ids->getData() + starts[i],
-                 starts[i + 1] - starts[i]);
-  }
+  forEachSequence(numSequences, [&](size_t i) {
+    crfs_[i % numThreads_].decode(
+        output.value->getData() + numClasses_ * starts[i],
+        output_.ids->getData() + starts[i],
+        starts[i + 1] - starts[i]);
+  });
 
   if (inputLayers_.size() == 2) {
     const Argument& label = getInput(1);
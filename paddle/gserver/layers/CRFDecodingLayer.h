@@ -35,9 +35,6 @@ public:
   virtual bool init(const LayerMap& layerMap, const ParameterMap& parameterMap);
   virtual void forward(PassType passType);
   virtual void backward(const UpdateCallback& callback);
-
-protected:
-  std::unique_ptr<LinearChainCRF> crf_;
 };
 
 }  // namespace paddle
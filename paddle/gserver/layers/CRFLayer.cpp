@@ -13,6 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "CRFLayer.h"
+#include "paddle/parameter/ParameterUpdaterHook.h"
+
+P_DEFINE_int32(seq_cost_num_threads,
+               1,
+               "Number of threads to run the sequences of crf, crf_decoding "
+               "and ctc layers in parallel");
 
 namespace paddle {
 
@@ -43,6 +49,21 @@ bool CRFLayer::init(const LayerMap& layerMap,
 
   parameter_ = parameters_[0];
 
+  numThreads_ = std::max(FLAGS_seq_cost_num_threads, 1);
+  if (numThreads_ > 1) {
+    // forward() may be called from a trainer thread other than the one
+    // calling init()
+    threadPool_.reset(
+        new SyncThreadPool(numThreads_, /* checkOwner= */ false));
+  }
+  // crf_decoding has no gradient
+  if (config_.type() == "crf" && parameter_->getBuf(PARAMETER_GRADIENT)) {
+    for (size_t tid = 0; tid < numThreads_; ++tid) {
+      threadGrads_.push_back(
+          Vector::create(parameter_->getSize(), /* useGpu= */ false));
+    }
+  }
+
   // We don't need sequenceStartPositions because each sample of output_ is
   // for the cost of one sequence.
   setNeedSequenceInfo(false);
@@ -67,19 +88,21 @@ void CRFLayer::forward(PassType passType) {
   const int* starts = label.sequenceStartPositions->getData(false);
   CHECK_EQ(starts[numSequences], batchSize);
 
-  for (size_t i = 0; i < numSequences; ++i) {
-    if (i >= crfs_.size()) {
-      crfs_.emplace_back(numClasses_,
-                         parameter_->getBuf(PARAMETER_VALUE)->getData(),
-                         parameter_->getBuf(PARAMETER_GRADIENT)
-                             ? parameter_->getBuf(PARAMETER_GRADIENT)->getData()
-                             : nullptr);
+  for (size_t i = crfs_.size(); i < numSequences; ++i) {
+    real* grad = nullptr;
+    if (!threadGrads_.empty()) {
+      grad = threadGrads_[i % numThreads_]->getData();
     }
+    crfs_.emplace_back(
+        numClasses_, parameter_->getBuf(PARAMETER_VALUE)->getData(), grad);
+  }
+
+  forEachSequence(numSequences, [&](size_t i) {
     output_.value->getData()[i] =
         crfs_[i].forward(output.value->getData() + numClasses_ * starts[i],
                          label.ids->getData() + starts[i],
                          starts[i + 1] - starts[i]);
-  }
+  });
 
   if (weightLayer_) {
     const MatrixPtr& weight = getInputValue(*weightLayer_);
@@ -91,9 +114,12 @@ void CRFLayer::backward(const UpdateCallback& callback) {
   const Argument& output = getInput(0);
   const Argument& label = getInput(1);
   const int* starts = label.sequenceStartPositions->getData(false);
-  int numSequences = label.sequenceStartPositions->getSize() - 1;
+  size_t numSequences = label.sequenceStartPositions->getSize() - 1;
 
-  for (int i = 0; i < numSequences; ++i) {
+  for (auto& grad : threadGrads_) {
+    grad->zeroMem();
+  }
+  forEachSequence(numSequences, [&](size_t i) {
     crfs_[i].backward(output.value->getData() + numClasses_ * starts[i],
                       output.grad->getData() + numClasses_ * starts[i],
                       label.ids->getData() + starts[i],
@@ -103,13 +129,29 @@ void CRFLayer::backward(const UpdateCallback& callback) {
       MatrixPtr grad = output.grad->subRowMatrix(starts[i], starts[i + 1]);
       grad->mulScalar(weight);
     }
+  });
+  // the loss scale applies to the transition weights, coeff only to the input
+  real lossScale = LossScaler::getScale();
+  for (auto& grad : threadGrads_) {
+    parameter_->getBuf(PARAMETER_GRADIENT)->add(*grad, lossScale);
   }
 
-  if (coeff_ != real(1.0f)) {
-    output.grad->mulScalar(coeff_);
+  real scale = coeff_ * lossScale;
+  if (scale != real(1.0f)) {
+    output.grad->mulScalar(scale);
   }
 
   parameter_->incUpdate(callback);
 }
 
+void CRFLayer::forEachSequence(size_t numSequences,
+                               const std::function<void(size_t)>& job) {
+  SyncThreadPool::execHelper(
+      threadPool_.get(), [&](int tid, size_t numThreads) {
+        for (size_t i = tid; i < numSequences; i += numThreads) {
+          job(i);
+        }
+      });
+}
+
 }  // namespace paddle
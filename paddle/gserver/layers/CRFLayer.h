@@ -18,6 +18,7 @@ limitations under the License. */
 
 #include "Layer.h"
 #include "LinearChainCRF.h"
+#include "paddle/utils/Thread.h"
 
 namespace paddle {
 
@@ -34,9 +35,20 @@ public:
   virtual void backward(const UpdateCallback& callback);
 
 protected:
+  /// run job(i) for every sequence i, sequence i is run by thread
+  /// i % numThreads_
+  void forEachSequence(size_t numSequences,
+                       const std::function<void(size_t)>& job);
+
   size_t numClasses_;
   ParameterPtr parameter_;
   std::vector<LinearChainCRF> crfs_;
+  /// number of threads to run the sequences in parallel
+  size_t numThreads_;
+  std::unique_ptr<SyncThreadPool> threadPool_;
+  /// gradients of parameter_ of each thread, added to parameter_ with the
+  /// loss scale after backward
+  std::vector<VectorPtr> threadGrads_;
   LayerPtr weightLayer_;  // weight for each sequence
   real coeff_;            // weight for the layer
 };
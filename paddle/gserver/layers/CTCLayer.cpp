@@ -13,6 +13,9 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "CTCLayer.h"
+#include "paddle/parameter/ParameterUpdaterHook.h"
+
+P_DECLARE_int32(seq_cost_num_threads);
 
 /* Please reference the Chapter7  in
  * "Alex graves, Supervised Sequence Labelling with
@@ -41,6 +44,10 @@ bool CTCLayer::init(const LayerMap& layerMap,
       tmpCpuInput_.push_back(Argument());
     }
   }
+  if (FLAGS_seq_cost_num_threads > 1) {
+    threadPool_.reset(new SyncThreadPool(FLAGS_seq_cost_num_threads,
+                                         /* checkOwner= */ false));
+  }
   return true;
 }
 
@@ -74,16 +81,20 @@ void CTCLayer::forwardImp(const Argument& softmaxSeqs,
   const int* softmaxSeqsStarts =
       softmaxSeqs.sequenceStartPositions->getData(false);
 
-  for (size_t i = 0; i < numSequences; i++) {
-    if (i >= ctcs_.size()) {
-      ctcs_.emplace_back(numClasses_, normByTimes_);
-    }
-    out[i] = ctcs_[i].forward(
-        softmaxSeqs.value->getData() + numClasses_ * softmaxSeqsStarts[i],
-        softmaxSeqsStarts[i + 1] - softmaxSeqsStarts[i],
-        labelSeqs.ids->getData() + labelSeqsStarts[i],
-        labelSeqsStarts[i + 1] - labelSeqsStarts[i]);
+  for (size_t i = ctcs_.size(); i < numSequences; i++) {
+    ctcs_.emplace_back(numClasses_, normByTimes_);
   }
+  SyncThreadPool::execHelper(
+      threadPool_.get(), [&](int tid, size_t numThreads) {
+        for (size_t i = tid; i < numSequences; i += numThreads) {
+          out[i] = ctcs_[i].forward(
+              softmaxSeqs.value->getData() +
+                  numClasses_ * softmaxSeqsStarts[i],
+              softmaxSeqsStarts[i + 1] - softmaxSeqsStarts[i],
+              labelSeqs.ids->getData() + labelSeqsStarts[i],
+              labelSeqsStarts[i + 1] - labelSeqsStarts[i]);
+        }
+      });
   output_.value->copyFrom(out.data(), numSequences);
 }
 
@@ -109,13 +120,19 @@ void CTCLayer::backwardImp(const UpdateCallback& callback,
   const int* softmaxSeqsStarts =
       softmaxSeqs.sequenceStartPositions->getData(false);
 
-  for (size_t i = 0; i < numSequences; ++i) {
-    ctcs_[i].backward(
-        softmaxSeqs.value->getData() + numClasses_ * softmaxSeqsStarts[i],
-        softmaxSeqs.grad->getData() + numClasses_ * softmaxSeqsStarts[i],
-        labelSeqs.ids->getData() + labelSeqsStarts[i],
-        labelSeqsStarts[i + 1] - labelSeqsStarts[i]);
-  }
+  real lossScale = LossScaler::getScale();
+  SyncThreadPool::execHelper(
+      threadPool_.get(), [&](int tid, size_t numThreads) {
+        for (size_t i = tid; i < numSequences; i += numThreads) {
+          ctcs_[i].backward(
+              softmaxSeqs.value->getData() +
+                  numClasses_ * softmaxSeqsStarts[i],
+              softmaxSeqs.grad->getData() + numClasses_ * softmaxSeqsStarts[i],
+              labelSeqs.ids->getData() + labelSeqsStarts[i],
+              labelSeqsStarts[i + 1] - labelSeqsStarts[i],
+              lossScale);
+        }
+      });
 }
 
 }  // namespace paddle
@@ -16,6 +16,7 @@ limitations under the License. */
 
 #include "Layer.h"
 #include "LinearChainCTC.h"
+#include "paddle/utils/Thread.h"
 
 namespace paddle {
 
@@ -35,6 +36,8 @@ protected:
   bool normByTimes_;
   std::vector<LinearChainCTC> ctcs_;
   std::vector<Argument> tmpCpuInput_;
+  /// the sequences are run in parallel by the threads in threadPool_
+  std::unique_ptr<SyncThreadPool> threadPool_;
 };
 
 }  // namespace paddle
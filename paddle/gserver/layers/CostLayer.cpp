@@ -19,6 +19,7 @@ limitations under the License. */
 #include "CostLayer.h"
 
 #include "paddle/math/SparseMatrix.h"
+#include "paddle/parameter/ParameterUpdaterHook.h"
 
 namespace paddle {
 
@@ -74,8 +75,9 @@ void CostLayer::backward(const UpdateCallback& callback) {
                    << getOutputLayer()->getName() << "'";
     output.grad->rowScale(0, *output.grad, *getInputValue(*weightLayer_));
   }
-  if (coeff_ != real(1.0f)) {
-    output.grad->add(coeff_, 0);
+  real scale = coeff_ * LossScaler::getScale();
+  if (scale != real(1.0f)) {
+    output.grad->add(scale, 0);
   }
 }
 
@@ -275,8 +277,9 @@ void RankingCost::backward(const UpdateCallback& callback) {
     marginGrad_->dotMul(*marginGrad_, *weight);
   }
 
-  getInputGrad(0)->add(*marginGrad_);
-  getInputGrad(1)->sub(*marginGrad_);
+  real lossScale = LossScaler::getScale();
+  getInputGrad(0)->add(*marginGrad_, lossScale);
+  getInputGrad(1)->add(*marginGrad_, -lossScale);
 }
 
 void RankingCost::onPassEnd() {
@@ -364,7 +367,7 @@ void LambdaCost::backward(const UpdateCallback& callback) {
              endPos - beginPos);
   }
 
-  getInputGrad(0)->add(*marginGrad_);
+  getInputGrad(0)->add(*marginGrad_, LossScaler::getScale());
 }
 
 void LambdaCost::onPassEnd() {}
@@ -630,7 +633,7 @@ public:
   }
 
   virtual void backward(const UpdateCallback& callback = nullptr) {
-    getInputGrad(0)->add((real)1);
+    getInputGrad(0)->add(LossScaler::getScale());
   }
 };
 
@@ -16,6 +16,8 @@ limitations under the License. */
 #include "GatedRecurrentLayer.h"
 #include "paddle/utils/Stat.h"
 
+P_DECLARE_int32(rnn_num_threads);
+
 namespace paddle {
 
 REGISTER_LAYER(gated_recurrent, GatedRecurrentLayer);
@@ -40,6 +42,10 @@ bool GatedRecurrentLayer::init(const LayerMap& layerMap,
 
   GruCompute::init(config_);
   useBatch_ = true;
+  if (!useGpu_ && FLAGS_rnn_num_threads > 1) {
+    threadPool_.reset(new SyncThreadPool(FLAGS_rnn_num_threads,
+                                         /* checkOwner= */ false));
+  }
 
   return true;
 }
@@ -51,22 +57,34 @@ void GatedRecurrentLayer::resetState() {
       prevOutput_, 1, getSize(), /* trans= */ false, useGpu_);
   prevOutput_->zeroMem();
 
-  // TODO(hedaoyuan): support prev_batch_state
-  CHECK(!FLAGS_prev_batch_state) << "Not supported";
-
-  useBatch_ = false;
+  if (FLAGS_prev_batch_state) {
+    /// one row per sequence, allocated by the first forward
+    prevOutput_->resize(0, getSize());
+    useBatch_ = true;
+  } else {
+    useBatch_ = false;
+  }
 }
 
 void GatedRecurrentLayer::setState(LayerStatePtr state) {
   CHECK(state->value.size() == 1)
       << "one matrix is expected for GatedRecurrentLayer state";
+  prevOutput_->resize(state->value[0]->getHeight(),
+                      state->value[0]->getWidth());
   prevOutput_->copyFrom(*(state->value[0]));
 }
 
 LayerStatePtr GatedRecurrentLayer::getState() {
   LayerStatePtr res = std::make_shared<LayerState>();
-  res->value.push_back(prevOutput_->clone(0, 0, useGpu_));
-  res->value[0]->copyFrom(*prevOutput_);
+  if (prevOutput_->getHeight() && prevOutput_->getWidth()) {
+    res->value.push_back(prevOutput_->clone(0, 0, useGpu_));
+    res->value[0]->copyFrom(*prevOutput_);
+  } else {
+    MatrixPtr output =
+        Matrix::create(1, getSize(), /* trans= */ false, useGpu_);
+    output->resize(0, getSize());
+    res->value.push_back(output);
+  }
   return res;
 }
 
@@ -309,12 +327,25 @@ void GatedRecurrentLayer::forwardBatch(int batchSize,
 
   if (!batchValue_) {
     batchValue_.reset(new SequenceToBatch(useGpu_));
+    batchValue_->setThreadPool(threadPool_.get());
+  }
+  batchValue_->resizeOrCreateBatch(
+      batchSize, numSequences, starts, reversed_, prevOutput_ ? true : false);
+  if (prevOutput_) {
+    if (prevOutput_->getHeight() == 0) {
+      prevOutput_->resize(numSequences, getSize());
+      prevOutput_->zeroMem();
+    } else {
+      CHECK_EQ(prevOutput_->getHeight(), numSequences)
+          << "the number of sequences must be the same";
+    }
   }
-  batchValue_->resizeOrCreateBatch(batchSize, numSequences, starts, reversed_);
 
-  batchValue_->resizeOrCreate(*output_.value);
+  batchValue_->resizeOrCreate(*output_.value,
+                              /* shareSeq= */ passType_ == PASS_TEST);
   batchValue_->copy(*inputValue, *gate_.value, /* seq2batch */ true);
-  if (bias_ && bias_->getWGrad()) {
+  if (bias_ && useGpu_) {
+    // on CPU the bias is added by forwardBatchStep()
     gate_.value->addBias(*(bias_->getW()), 1);
   }
 
@@ -325,26 +356,64 @@ void GatedRecurrentLayer::forwardBatch(int batchSize,
     for (int n = 0; n < numBatch; n++) {
       MatrixPtr outputValueTmp = batchValue_->getBatchValue(n);
       gruValue.outputValue = outputValueTmp->getData();
-      gruValue.gateValue =
-          (batchValue_->getBatchValue(*gate_.value, n))->getData();
+      MatrixPtr gateValue = batchValue_->getBatchValue(*gate_.value, n);
+      gruValue.gateValue = gateValue->getData();
       gruValue.resetOutputValue =
           (batchValue_->getBatchValue(*resetOutput_.value, n))->getData();
 
       batchSize = outputValueTmp->getHeight();
-      gruValue.prevOutValue =
-          (n == 0 ? nullptr
-                  : (batchValue_->getBatchValue(n - 1, batchSize))->getData());
+      if (n != 0) {
+        gruValue.prevOutValue =
+            (batchValue_->getBatchValue(n - 1, batchSize))->getData();
+      } else if (prevOutput_) {
+        Matrix::resizeOrCreate(prevBatchOutput2_,
+                               batchSize,
+                               getSize(),
+                               /* trans= */ false,
+                               useGpu_);
+        batchValue_->prevOutput2Batch(*prevOutput_, *prevBatchOutput2_);
+        gruValue.prevOutValue = prevBatchOutput2_->getData();
+      } else {
+        gruValue.prevOutValue = nullptr;
+      }
 
-      {
-        if (useGpu_) {
-          GruCompute::forward<1>(gruValue, getSize(), batchSize);
-        } else {
-          GruCompute::forward<0>(gruValue, getSize(), batchSize);
-        }
+      if (useGpu_) {
+        GruCompute::forward<1>(gruValue, getSize(), batchSize);
+      } else {
+        forwardBatchStep(gruValue, gateValue);
       }
     }
   }
   { batchValue_->copyBackSeq(*output_.value); }
+  if (prevOutput_) {
+    prevOutput_->resize(numSequences, getSize());
+    batchValue_->getSeqOutputFromBatch(*prevOutput_,
+                                       *batchValue_->getBatchValue());
+  }
+}
+
+void GatedRecurrentLayer::forwardBatchStep(hl_gru_value gruValue,
+                                           MatrixPtr gateValue) {
+  size_t numRows = gateValue->getHeight();
+  auto stepRows = [&](int tid, size_t numThreads) {
+    size_t begin = numRows * tid / numThreads;
+    size_t end = numRows * (tid + 1) / numThreads;
+    if (begin == end) return;
+    // the rows of one step are independent: each thread runs the bias add,
+    // both recurrent projections and the gates on its own rows
+    if (bias_) {
+      gateValue->subMatrix(begin, end - begin)->addBias(*(bias_->getW()), 1);
+    }
+    hl_gru_value value = gruValue;
+    value.gateValue += begin * getSize() * 3;
+    value.resetOutputValue += begin * getSize();
+    value.outputValue += begin * getSize();
+    if (value.prevOutValue) {
+      value.prevOutValue += begin * getSize();
+    }
+    GruCompute::forward<0>(value, getSize(), end - begin);
+  };
+  SyncThreadPool::execHelper(threadPool_.get(), stepRows);
 }
 
 void GatedRecurrentLayer::backwardBatch(int batchSize, MatrixPtr inputGrad) {
@@ -362,6 +431,7 @@ void GatedRecurrentLayer::backwardBatch(int batchSize, MatrixPtr inputGrad) {
 
   if (!batchGrad_) {
     batchGrad_.reset(new SequenceToBatch(useGpu_));
+    batchGrad_->setThreadPool(threadPool_.get());
   }
   batchGrad_->shareIndexWith(*batchValue_);
 
@@ -385,12 +455,26 @@ void GatedRecurrentLayer::backwardBatch(int batchSize, MatrixPtr inputGrad) {
 
       {
         batchSize = outputGradTmp->getHeight();
-        gruValue.prevOutValue =
-            (n == 0 ? nullptr : (batchValue_->getBatchValue(n - 1, batchSize))
-                                    ->getData());
-        gruGrad.prevOutGrad =
-            (n == 0 ? nullptr
-                    : (batchGrad_->getBatchValue(n - 1, batchSize))->getData());
+        if (n != 0) {
+          gruValue.prevOutValue =
+              (batchValue_->getBatchValue(n - 1, batchSize))->getData();
+          gruGrad.prevOutGrad =
+              (batchGrad_->getBatchValue(n - 1, batchSize))->getData();
+        } else if (prevOutput_) {
+          /// the carried-in state is a constant: its gradient goes to a
+          /// scratch buffer, which the weight gradients of step 0 need
+          gruValue.prevOutValue = prevBatchOutput2_->getData();
+          Matrix::resizeOrCreate(prevBatchOutputGrad_,
+                                 batchSize,
+                                 getSize(),
+                                 /* trans= */ false,
+                                 useGpu_);
+          prevBatchOutputGrad_->zeroMem();
+          gruGrad.prevOutGrad = prevBatchOutputGrad_->getData();
+        } else {
+          gruValue.prevOutValue = nullptr;
+          gruGrad.prevOutGrad = nullptr;
+        }
 
         if (useGpu_) {
           GruCompute::backward<1>(gruValue, gruGrad, getSize(), batchSize);
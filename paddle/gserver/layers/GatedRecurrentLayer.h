@@ -18,6 +18,7 @@ limitations under the License. */
 #include "SequenceToBatch.h"
 #include "GruCompute.h"
 #include "Layer.h"
+#include "paddle/utils/Thread.h"
 
 namespace paddle {
 
@@ -76,6 +77,11 @@ protected:
                     size_t numSequences,
                     const int* starts,
                     MatrixPtr inputValue);
+  /**
+   * One CPU time step of forwardBatch. The rows of the step are divided
+   * among the threads of threadPool_.
+   */
+  void forwardBatchStep(hl_gru_value gruValue, MatrixPtr gateValue);
   void backwardBatch(int batchSize, MatrixPtr inputGrad);
 
 protected:
@@ -94,6 +100,12 @@ protected:
   std::unique_ptr<ActivationFunction> activationGate_;
 
   MatrixPtr prevOutput_;
+  /// prevOutput_ reordered to the first batch under prev_batch_state
+  MatrixPtr prevBatchOutput2_;
+  /// the discarded gradient of prevBatchOutput2_ in backwardBatch()
+  MatrixPtr prevBatchOutputGrad_;
+  /// Threads for forwardBatchStep() on CPU, null if rnn_num_threads is 1.
+  std::unique_ptr<SyncThreadPool> threadPool_;
 };
 
 }  // namespace paddle
@@ -14,6 +14,11 @@ limitations under the License. */
 
 #include "HierarchicalSigmoidLayer.h"
 #include "paddle/utils/Util.h"
+#include "paddle/parameter/ParameterUpdaterHook.h"
+
+P_DEFINE_int32(hsigmoid_num_threads,
+               1,
+               "Number of threads to compute hsigmoid layer on CPU");
 
 namespace paddle {
 
@@ -50,6 +55,13 @@ bool HierarchicalSigmoidLayer::init(const LayerMap& layerMap,
     biases_.reset(new Weight(1, numClasses_ - 1, biasParameter_));
   }
 
+  if (!useGpu_ && FLAGS_hsigmoid_num_threads > 1) {
+    // forward() may be called from a trainer thread other than the one
+    // calling init()
+    threadPool_.reset(new SyncThreadPool(FLAGS_hsigmoid_num_threads,
+                                         /* checkOwner= */ false));
+  }
+
   return true;
 }
 
@@ -82,7 +94,7 @@ void HierarchicalSigmoidLayer::forward(PassType passType) {
   for (size_t i = 0; i < inputLayers_.size() - 1; ++i) {
     MatrixPtr input = getInputValue(i);
     preOutput_.value->mulByBitCode(
-        numClasses_, *label, *weights_[i]->getW(), *input);
+        numClasses_, *label, *weights_[i]->getW(), *input, threadPool_.get());
   }
   // keep consistent with the clipping in the following softrelu
   preOutput_.value->clip(-40.0, 40.0);
@@ -102,6 +114,10 @@ void HierarchicalSigmoidLayer::backward(const UpdateCallback& callback) {
   preOutput_.grad->one();
   preOutput_.grad->softreluDerivative(*preOutput_.value);
   preOutput_.grad->subByBitCode(numClasses_, *label);
+  real lossScale = LossScaler::getScale();
+  if (lossScale != real(1.0f)) {
+    preOutput_.grad->mulScalar(lossScale);
+  }
 
   if (biases_ && biases_->getWGrad()) {
     preOutput_.grad->addByBitCodeBackward(
@@ -115,8 +131,11 @@ void HierarchicalSigmoidLayer::backward(const UpdateCallback& callback) {
     /* Calculate the W-gradient for the current layer */
     MatrixPtr input = getInputValue(i);
     if (weights_[i]->getWGrad()) {
-      preOutput_.grad->mulByBitCodeBackwardWeight(
-          numClasses_, *label, *weights_[i]->getWGrad(), *input);
+      preOutput_.grad->mulByBitCodeBackwardWeight(numClasses_,
+                                                  *label,
+                                                  *weights_[i]->getWGrad(),
+                                                  *input,
+                                                  threadPool_.get());
 
       /* Increasing the number of gradient */
       weights_[i]->getParameterPtr()->incUpdate(callback);
@@ -125,8 +144,11 @@ void HierarchicalSigmoidLayer::backward(const UpdateCallback& callback) {
     /* Calculate the input layers error */
     MatrixPtr inputGrad = getInputGrad(i);
     if (inputGrad) {
-      preOutput_.grad->mulByBitCodeBackwardError(
-          numClasses_, *label, *weights_[i]->getW(), *inputGrad);
+      preOutput_.grad->mulByBitCodeBackwardError(numClasses_,
+                                                 *label,
+                                                 *weights_[i]->getW(),
+                                                 *inputGrad,
+                                                 threadPool_.get());
     }
   }
 }
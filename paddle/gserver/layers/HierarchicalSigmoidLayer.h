@@ -15,6 +15,7 @@ limitations under the License. */
 #pragma once
 
 #include "Layer.h"
+#include "paddle/utils/Thread.h"
 
 namespace paddle {
 
@@ -79,6 +80,8 @@ protected:
   int codeLength_;
   /// temporary result of output_
   Argument preOutput_;
+  /// threads for the bit code kernels, null if hsigmoid_num_threads <= 1
+  std::unique_ptr<SyncThreadPool> threadPool_;
 };
 
 }  // namespace paddle
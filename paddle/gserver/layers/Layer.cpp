@@ -15,6 +15,8 @@ limitations under the License. */
 #include "paddle/utils/Util.h"
 
 #include "paddle/utils/Logging.h"
+#include "paddle/utils/Trace.h"
+#include "paddle/math/Bfloat16.h"
 #include "paddle/math/SparseMatrix.h"
 
 #include "AddtoLayer.h"
@@ -34,6 +36,10 @@ limitations under the License. */
 #include "ValidationLayer.h"
 
 P_DEFINE_bool(log_error_clipping, false, "enable log error clipping or not");
+P_DEFINE_bool(bf16_activations,
+              false,
+              "round the outputs of the CPU layers and their gradients to "
+              "bfloat16 precision, the parameters stay in full precision");
 
 namespace paddle {
 
@@ -105,6 +111,58 @@ bool Layer::init(const LayerMap& layerMap, const ParameterMap& parameterMap) {
 
 ClassRegistrar<Layer, LayerConfig> Layer::registrar_;
 
+StatSet layerForwardStat("LayerForward");
+StatSet layerBackwardStat("LayerBackward");
+
+std::atomic<bool> Layer::timing_(false);
+
+/// Round a dense CPU matrix to bfloat16 precision, see --bf16_activations.
+static void roundMatrixToBf16(const MatrixPtr& mat) {
+  if (mat && !mat->useGpu() && !mat->isSparse()) {
+    roundToBf16(mat->getData(), mat->getElementCnt());
+  }
+}
+
+void Layer::timedForward(PassType passType) {
+  REGISTER_TRACE(getName().c_str(), "forward");
+  if (!timing_) {
+    forward(passType);
+  } else {
+    if (!forwardStat_) {
+      forwardStat_ = layerForwardStat.getStat(getName());
+    }
+    // the kernels of the previous layers must not be counted
+    if (useGpu_) hl_stream_synchronize(HPPL_STREAM_DEFAULT);
+    uint64_t start = nowInMicroSec();
+    forward(passType);
+    if (useGpu_) hl_stream_synchronize(HPPL_STREAM_DEFAULT);
+    forwardStat_->addSample(nowInMicroSec() - start);
+  }
+  if (FLAGS_bf16_activations) {
+    roundMatrixToBf16(output_.value);
+  }
+}
+
+void Layer::timedBackward(const UpdateCallback& callback) {
+  REGISTER_TRACE(getName().c_str(), "backward");
+  if (FLAGS_bf16_activations) {
+    // the gradient is complete here, it was summed by the following layers
+    roundMatrixToBf16(output_.grad);
+  }
+  if (!timing_) {
+    backward(callback);
+    return;
+  }
+  if (!backwardStat_) {
+    backwardStat_ = layerBackwardStat.getStat(getName());
+  }
+  if (useGpu_) hl_stream_synchronize(HPPL_STREAM_DEFAULT);
+  uint64_t start = nowInMicroSec();
+  backward(callback);
+  if (useGpu_) hl_stream_synchronize(HPPL_STREAM_DEFAULT);
+  backwardStat_->addSample(nowInMicroSec() - start);
+}
+
 LayerPtr Layer::create(const LayerConfig& config) {
   std::string type = config.type();
 
@@ -14,12 +14,14 @@ limitations under the License. */
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <paddle/parameter/Argument.h>
 #include "paddle/utils/ClassRegistrar.h"
 #include "paddle/math/CpuSparseMatrix.h"
 #include "paddle/parameter/Parameter.h"
+#include "paddle/utils/Stat.h"
 #include "paddle/utils/Util.h"
 #include "ModelConfig.pb.h"
 
@@ -39,6 +41,10 @@ limitations under the License. */
 
 namespace paddle {
 
+/// Per-layer forward and backward time, see Layer::setTiming().
+extern StatSet layerForwardStat;
+extern StatSet layerBackwardStat;
+
 class Layer;
 typedef std::shared_ptr<Layer> LayerPtr;
 typedef std::map<std::string, LayerPtr> LayerMap;
@@ -100,6 +106,13 @@ protected:
   /// Mark input grad in(true) or out(false) of backward function.
   std::vector<bool> markInBackward_;
 
+  /// Whether timedForward() and timedBackward() are timed, see setTiming().
+  /// Set by the main thread while the trainer threads read it.
+  static std::atomic<bool> timing_;
+  /// Timing stats of the layer, created by the first timed call.
+  StatPtr forwardStat_;
+  StatPtr backwardStat_;
+
 public:
   /**
     * Wait until all input value ready.
@@ -431,6 +444,32 @@ public:
    */
   virtual void onPassEnd() {}
 
+  /**
+   * Call forward(). If the layer timing is on, its wall time is added to
+   * the stat named after the layer in layerForwardStat, and while tracing
+   * it is recorded as a trace event. The networks run their layers through
+   * timedForward() and timedBackward().
+   *
+   * With --bf16_activations, the dense CPU output value is rounded to
+   * bfloat16 precision after forward(), and timedBackward() rounds the
+   * output gradient before backward().
+   */
+  void timedForward(PassType passType);
+
+  /**
+   * Call backward(), timed into layerBackwardStat like timedForward().
+   */
+  void timedBackward(const UpdateCallback& callback);
+
+  /**
+   * Turn the timing of timedForward() and timedBackward() on or off for all
+   * the layers. It is off by default: the timing of a GPU layer waits for
+   * its kernels to finish, which serializes the streams.
+   */
+  static void setTiming(bool timing) { timing_ = timing; }
+
+  static bool isTiming() { return timing_; }
+
 protected:
   /**
    * Forward of activation function.
@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include <algorithm>
+#include <vector>
 #include "LinearChainCRF.h"
 
 namespace paddle {
@@ -78,13 +79,20 @@ real LinearChainCRF::forward(real* x, int* s, int length) {
   real ll = -maxX[0] - log(normalizeL1(alpha, numClasses_));
 
   for (int k = 1; k < length; ++k) {
-    for (int i = 0; i < numClasses_; ++i) {
-      real sum = 0;
-      for (int j = 0; j < numClasses_; ++j) {
-        sum += alpha[(k - 1) * numClasses_ + j]  // (*)
-               * expW[j * numClasses_ + i];
+    const real* prevAlpha = alpha + (k - 1) * numClasses_;
+    real* curAlpha = alpha + k * numClasses_;
+    // curAlpha = prevAlpha * expW, the inner loop runs over a contiguous row
+    // of expW so that it can be vectorized.
+    std::fill(curAlpha, curAlpha + numClasses_, (real)0);
+    for (int j = 0; j < numClasses_; ++j) {
+      const real* expWRow = expW + j * numClasses_;
+      real prev = prevAlpha[j];  // (*)
+      for (int i = 0; i < numClasses_; ++i) {
+        curAlpha[i] += prev * expWRow[i];
       }
-      alpha[k * numClasses_ + i] = expX[k * numClasses_ + i] * sum;
+    }
+    for (int i = 0; i < numClasses_; ++i) {
+      curAlpha[i] *= expX[k * numClasses_ + i];
     }
     // normalizeL1 is to avoid underflow or overflow at (*)
     ll -= maxX[k] + log(normalizeL1(alpha + k * numClasses_, numClasses_));
@@ -126,13 +134,17 @@ void LinearChainCRF::backward(real* x, real* dx, int* s, int length) {
   }
   normalizeL1(beta + (length - 1) * numClasses_, numClasses_);
 
+  std::vector<real> nextBeta(numClasses_);
   for (int k = length - 2; k >= 0; --k) {
+    for (int j = 0; j < numClasses_; ++j) {
+      nextBeta[j] =
+          beta[(k + 1) * numClasses_ + j] * expX[(k + 1) * numClasses_ + j];
+    }
     for (int i = 0; i < numClasses_; ++i) {
+      const real* expWRow = expW + i * numClasses_;
       real sum = 0;
       for (int j = 0; j < numClasses_; ++j) {
-        sum += expW[i * numClasses_ + j]  // (**)
-               * beta[(k + 1) * numClasses_ + j] *
-               expX[(k + 1) * numClasses_ + j];
+        sum += expWRow[j] * nextBeta[j];  // (**)
       }
       beta[k * numClasses_ + i] = sum;
     }
@@ -156,22 +168,31 @@ void LinearChainCRF::backward(real* x, real* dx, int* s, int length) {
   beta_->dotMul(*beta_, *expX_);
   beta_->rowNormalizeL1(*beta_);
 
-  for (int k = 1; dw && k < length; ++k) {
+  if (!dw || length < 2) {
+    return;
+  }
+  // dw += sum_k expW .* (alpha_{k-1}^T * beta_k) / Z_k, where
+  // Z_k = alpha_{k-1} * expW * beta_k^T. The sum over k is done by one GEMM
+  // with alpha_{k-1} scaled by 1 / Z_k.
+  Matrix::resizeOrCreate(scaledAlpha_, length - 1, numClasses_);
+  Matrix::resizeOrCreate(dwTmp_, numClasses_, numClasses_);
+  scaledAlpha_->mul(alpha_->subMatrix(0, length - 1), expW_, 1, 0);
+  real* scaledAlpha = scaledAlpha_->getData();
+  for (int k = 1; k < length; ++k) {
+    real* row = scaledAlpha + (k - 1) * numClasses_;
     real sum = 0;
-    for (int i = 0; i < numClasses_; ++i) {
-      for (int j = 0; j < numClasses_; ++j) {
-        sum += expW[i * numClasses_ + j] * alpha[(k - 1) * numClasses_ + i] *
-               beta[k * numClasses_ + j];
-      }
+    for (int j = 0; j < numClasses_; ++j) {
+      sum += row[j] * beta[k * numClasses_ + j];
     }
     sum = 1 / sum;
     for (int i = 0; i < numClasses_; ++i) {
-      for (int j = 0; j < numClasses_; ++j) {
-        dw[i * numClasses_ + j] += sum * expW[i * numClasses_ + j] *
-                                   alpha[(k - 1) * numClasses_ + i] *
-                                   beta[k * numClasses_ + j];
-      }
+      row[i] = sum * alpha[(k - 1) * numClasses_ + i];
     }
+  }
+  dwTmp_->mul(
+      scaledAlpha_->getTranspose(), beta_->subMatrix(1, length - 1), 1, 0);
+  dw_->addDotMul(*expW_, *dwTmp_, 1, 1);
+  for (int k = 1; k < length; ++k) {
     dw[s[k - 1] * numClasses_ + s[k]] -= (real)1;
   }
 }
@@ -189,18 +210,28 @@ void LinearChainCRF::decode(real* x, int* s, int length) {
     alpha[i] = a[i] + x[i];
   }
   for (int k = 1; k < length; ++k) {
+    const real* prevAlpha = alpha + (k - 1) * numClasses_;
+    real* curAlpha = alpha + k * numClasses_;
+    int* curTrack = track + k * numClasses_;
+    // the max is taken over j in the outer loop, so that the inner loop runs
+    // over a contiguous row of w for all classes i.
     for (int i = 0; i < numClasses_; ++i) {
-      real maxScore = -std::numeric_limits<real>::max();
-      int maxJ = 0;
-      for (int j = 0; j < numClasses_; ++j) {
-        real score = alpha[(k - 1) * numClasses_ + j] + w[j * numClasses_ + i];
-        if (score > maxScore) {
-          maxScore = score;
-          maxJ = j;
+      curAlpha[i] = prevAlpha[0] + w[i];
+      curTrack[i] = 0;
+    }
+    for (int j = 1; j < numClasses_; ++j) {
+      const real* wRow = w + j * numClasses_;
+      real prev = prevAlpha[j];
+      for (int i = 0; i < numClasses_; ++i) {
+        real score = prev + wRow[i];
+        if (score > curAlpha[i]) {
+          curAlpha[i] = score;
+          curTrack[i] = j;
         }
       }
-      alpha[k * numClasses_ + i] = maxScore + x[k * numClasses_ + i];
-      track[k * numClasses_ + i] = maxJ;
+    }
+    for (int i = 0; i < numClasses_; ++i) {
+      curAlpha[i] += x[k * numClasses_ + i];
     }
   }
   real maxScore = -std::numeric_limits<real>::max();
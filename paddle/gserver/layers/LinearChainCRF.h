@@ -72,6 +72,9 @@ protected:
   MatrixPtr beta_;
   MatrixPtr maxX_;
   MatrixPtr expW_;
+  // alpha_{k-1} scaled for the gradient of w
+  MatrixPtr scaledAlpha_;
+  MatrixPtr dwTmp_;
 
   // track_(k,i) = j means that the best sequence at time k for class i comes
   // from the sequence at time k-1 for class j
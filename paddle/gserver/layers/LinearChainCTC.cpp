@@ -219,7 +219,8 @@ real LinearChainCTC::forward(real* softmaxSeq,
 void LinearChainCTC::backward(real* softmaxSeq,
                               real* grad,
                               int* labelSeq,
-                              int labelSeqLen) {
+                              int labelSeqLen,
+                              real scale) {
   /* if not meet the conditions of CTC computing, then set the grads to zeros */
   if (isInvalid_) {
     for (int i = 0; i < totalTime_ * numClasses_; i++) {
@@ -231,6 +232,9 @@ void LinearChainCTC::backward(real* softmaxSeq,
   real* fwdVars = forwardVars_->getData();
   real* bwdVars = backwardVars_->getData();
   real* logActsData = logActs_->getData();
+  if (normByTimes_) {
+    scale /= totalTime_;
+  }
 
   for (int i = 0; i < totalTime_; i++) {
     setLogZero(gradTerms_);
@@ -242,17 +246,10 @@ void LinearChainCTC::backward(real* softmaxSeq,
       gradTermsData[k] = logAdd(gradTermsData[k], logMul(fvars[j], bvars[j]));
     }
     for (int j = 0; j < numClasses_; j++) {
-      if (normByTimes_) {
-        grad[i * numClasses_ + j] +=
-            -safeExp(
-                logDiv(gradTermsData[j],
-                       logMul(logProb_, logActsData[i * numClasses_ + j]))) /
-            totalTime_;
-      } else {
-        grad[i * numClasses_ + j] += -safeExp(
-            logDiv(gradTermsData[j],
-                   logMul(logProb_, logActsData[i * numClasses_ + j])));
-      }
+      grad[i * numClasses_ + j] +=
+          -safeExp(logDiv(gradTermsData[j],
+                          logMul(logProb_, logActsData[i * numClasses_ + j]))) *
+          scale;
     }
   }
 }
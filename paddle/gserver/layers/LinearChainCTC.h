@@ -29,11 +29,12 @@ public:
                int* labelSeq,
                int labelSeqLen);
 
-  // calculate the gradient
+  // calculate the gradient, multiplied by scale
   void backward(real* softmaxSeq,
                 real* softmaxSeqGrad,
                 int* labelSeq,
-                int labelSeqLen);
+                int labelSeqLen,
+                real scale = 1);
 
 protected:
   int numClasses_, blank_, totalSegments_, totalTime_;
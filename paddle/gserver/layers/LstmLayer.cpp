@@ -18,6 +18,10 @@ limitations under the License. */
 #include "paddle/utils/Stat.h"
 
 P_DECLARE_bool(prev_batch_state);
+P_DEFINE_int32(rnn_num_threads,
+               1,
+               "Number of threads to compute one time step of the batched "
+               "lstmemory and gated_recurrent layers on CPU");
 
 namespace paddle {
 
@@ -98,6 +102,10 @@ bool LstmLayer::init(const LayerMap &layerMap,
   LstmCompute::init(config_);
   useBatch_ = true;
   useSeqParallel_ = false;
+  if (!useGpu_ && FLAGS_rnn_num_threads > 1) {
+    threadPool_.reset(new SyncThreadPool(FLAGS_rnn_num_threads,
+                                         /* checkOwner= */ false));
+  }
   if (useGpu_ && (getSize() == 32 || getSize() == 64)) {
     useSeqParallel_ = true;
   }
@@ -515,13 +523,16 @@ void LstmLayer::forwardBatch(int batchSize,
 
   if (!batchValue_) {
     batchValue_.reset(new SequenceToBatch(useGpu_));
+    batchValue_->setThreadPool(threadPool_.get());
   }
   batchValue_->resizeOrCreateBatch(
       batchSize, numSequences, starts, reversed_, prevOutput_ ? true : false);
 
-  batchValue_->resizeOrCreate(*output_.value);
+  batchValue_->resizeOrCreate(*output_.value,
+                              /* shareSeq= */ passType_ == PASS_TEST);
   batchValue_->copy(*inputValue, *gate_.value, /* seq2batch */ true);
-  if (bias_) {
+  if (bias_ && useGpu_) {
+    // on CPU the bias is added by forwardBatchStep()
     gate_.value->addBias(*localBias_, 1);
   }
 
@@ -539,9 +550,9 @@ void LstmLayer::forwardBatch(int batchSize,
       MatrixPtr gateValue = batchValue_->getBatchValue(*gate_.value, n);
       batchSize = outputValue->getHeight();
 
+      MatrixPtr prevOutput;
       if (n != 0) {
-        MatrixPtr batch1 = batchValue_->getBatchValue(n - 1, batchSize);
-        gateValue->mul(batch1, weight_->getW(), 1, 1);
+        prevOutput = batchValue_->getBatchValue(n - 1, batchSize);
       } else if (prevOutput_) {
         Matrix::resizeOrCreate(prevBatchOutput2_,
                                gateValue->getHeight(),
@@ -549,7 +560,7 @@ void LstmLayer::forwardBatch(int batchSize,
                                false,
                                useGpu_);
         batchValue_->prevOutput2Batch(*prevOutput_, *prevBatchOutput2_);
-        gateValue->mul(prevBatchOutput2_, weight_->getW(), 1, 1);
+        prevOutput = prevBatchOutput2_;
 
         batchValue_->prevOutput2Batch(*prevState_,
                                       *totalState_->subMatrix(0, numSequences));
@@ -561,12 +572,13 @@ void LstmLayer::forwardBatch(int batchSize,
           batchValue_->getBatchValue(*state_.value, n)->getData();
       lstmValue.stateActiveValue =
           batchValue_->getBatchValue(*preOutput_.value, n)->getData();
-      {
-        if (useGpu_) {
-          LstmCompute::forwardBatch<1>(lstmValue, getSize(), batchSize);
-        } else {
-          LstmCompute::forwardBatch<0>(lstmValue, getSize(), batchSize);
+      if (useGpu_) {
+        if (prevOutput) {
+          gateValue->mul(prevOutput, weight_->getW(), 1, 1);
         }
+        LstmCompute::forwardBatch<1>(lstmValue, getSize(), batchSize);
+      } else {
+        forwardBatchStep(lstmValue, gateValue, prevOutput);
       }
       lstmValue.prevStateValue = lstmValue.stateValue;
     }
@@ -581,6 +593,37 @@ void LstmLayer::forwardBatch(int batchSize,
   }
 }
 
+void LstmLayer::forwardBatchStep(hl_lstm_value lstmValue,
+                                 MatrixPtr gateValue,
+                                 MatrixPtr prevOutput) {
+  size_t numRows = gateValue->getHeight();
+  auto stepRows = [&](int tid, size_t numThreads) {
+    size_t begin = numRows * tid / numThreads;
+    size_t end = numRows * (tid + 1) / numThreads;
+    if (begin == end) return;
+    // bias, recurrent projection and cell update of the same rows are done
+    // back to back, while the rows are still in cache
+    MatrixPtr gateRows = gateValue->subMatrix(begin, end - begin);
+    if (bias_) {
+      gateRows->addBias(*localBias_, 1);
+    }
+    if (prevOutput) {
+      gateRows->mul(
+          prevOutput->subMatrix(begin, end - begin), weight_->getW(), 1, 1);
+    }
+    hl_lstm_value value = lstmValue;
+    value.gateValue += begin * getSize() * 4;
+    value.stateValue += begin * getSize();
+    value.stateActiveValue += begin * getSize();
+    value.outputValue += begin * getSize();
+    if (value.prevStateValue) {
+      value.prevStateValue += begin * getSize();
+    }
+    LstmCompute::forwardBatch<0>(value, getSize(), end - begin);
+  };
+  SyncThreadPool::execHelper(threadPool_.get(), stepRows);
+}
+
 void LstmLayer::getPrevBatchOutput(size_t numSequences) {
   prevOutput_->resize(numSequences, getSize());
   batchValue_->getSeqOutputFromBatch(*prevOutput_,
@@ -618,6 +661,7 @@ void LstmLayer::backwardBatch(int batchSize,
 
   if (!batchGrad_) {
     batchGrad_.reset(new SequenceToBatch(useGpu_));
+    batchGrad_->setThreadPool(threadPool_.get());
   }
   batchGrad_->shareIndexWith(*batchValue_);
 
@@ -17,6 +17,7 @@ limitations under the License. */
 #include "Layer.h"
 #include "paddle/math/Matrix.h"
 #include "paddle/math/BaseMatrix.h"
+#include "paddle/utils/Thread.h"
 #include "SequenceToBatch.h"
 #include "LstmCompute.h"
 namespace paddle {
@@ -153,6 +154,14 @@ protected:
                            size_t numSequences,
                            const int *starts,
                            MatrixPtr inputGrad);
+  /**
+   * One CPU time step of forwardBatch: adds the bias and the recurrent
+   * projection of prevOutput to gateValue, then updates the cells. The rows
+   * of the step are divided among the threads of threadPool_.
+   */
+  void forwardBatchStep(hl_lstm_value lstmValue,
+                        MatrixPtr gateValue,
+                        MatrixPtr prevOutput);
   /**
    * This function is used for sequence generation and get output after
    * forwardBatch.
@@ -215,6 +224,8 @@ protected:
   MatrixPtr prevBatchOutput2_;
   /// The total state.
   MatrixPtr totalState_;
+  /// Threads for forwardBatchStep() on CPU, null if rnn_num_threads is 1.
+  std::unique_ptr<SyncThreadPool> threadPool_;
 };
 
 }  // namespace paddle
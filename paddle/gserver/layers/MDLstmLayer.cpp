@@ -15,6 +15,7 @@ limitations under the License. */
 #include "LstmLayer.h"
 #include "paddle/math/Matrix.h"
 #include "paddle/math/BaseMatrix.h"
+#include <string.h>
 
 namespace paddle {
 
@@ -193,6 +194,21 @@ protected:
   void forwardGate2OutputSequence(int start, CoordIterator& coordIter);
   void backwardGate2OutputSequence(int start, CoordIterator& coordIter);
 
+  /*
+   * On CPU, cells are computed by wavefronts instead of one by one. A cell
+   * only depends on its previous cells along each dim, so the cells whose
+   * sums of coordinates (in scanning order) are the same, i.e. on the same
+   * anti-diagonal, can be computed together. The cells of one wavefront of
+   * all the sequences in the batch are stored in consecutive rows, so their
+   * recurrent projections are one GEMM per gate, and their gate activations
+   * are one call per gate.
+   */
+  void createWavefront(const int* starts, int numSequences);
+  void forwardWavefront();
+  void backwardWavefront();
+  /// gate arguments of cells in wavefront order and their columns in gate_
+  std::vector<std::pair<Argument*, size_t>> getWaveGates();
+
 protected:
   std::vector<Argument> frameInputGate_;
   std::vector<Argument> frameForgetGate_;
@@ -212,6 +228,28 @@ protected:
   std::vector<bool> directions_;
   std::vector<int> delays_;
   std::vector<std::vector<int>> dimsV_;
+
+  // waveIds_[i] is the row in batch of the i-th cell in wavefront order
+  std::vector<int> waveIds_;
+  // cells of the i-th wavefront are [waveStarts_[i], waveStarts_[i + 1])
+  std::vector<int> waveStarts_;
+  // prevIds_[d][i] is the previous cell of the i-th cell along dim d in
+  // wavefront order, -1 if there is no previous cell
+  std::vector<IVectorPtr> prevIds_;
+  Argument waveInputNode_;
+  Argument waveInputGate_;
+  Argument waveForgetGate_;
+  Argument waveOutputGate_;
+  Argument waveState_;
+  Argument wavePreOutput_;
+  Argument waveOutput_;
+  // states of the previous cells along each dim
+  std::vector<MatrixPtr> wavePrevState_;
+  // sum of the outputs of the previous cells along all dims
+  MatrixPtr wavePrevOutput_;
+  // gradients to the previous cells
+  MatrixPtr wavePrevStateGrad_;
+  MatrixPtr wavePrevOutputGrad_;
 };
 
 REGISTER_LAYER(mdlstmemory, MDLstmLayer);
@@ -320,6 +358,7 @@ void MDLstmLayer::forward(PassType passType) {
   int* dimsData = input.cpuSequenceDims->getData();
   CHECK_EQ(int(input.cpuSequenceDims->getSize()), numDims_ * numSequences);
 
+  dimsV_.clear();
   for (int i = 0; i < numSequences; i++) {
     std::vector<int> dims;
     for (int j = 0; j < numDims_; j++) {
@@ -343,6 +382,19 @@ void MDLstmLayer::forward(PassType passType) {
                          /* trans= */ false,
                          useGpu_);
 
+  AsyncGpuBlock asyncGpuBlock;
+  gate_.value->assign(*input.value);
+
+  if (bias_) {
+    gate_.value->addBias(*localBias_, 1);
+  }
+
+  if (!useGpu_) {
+    createWavefront(starts, numSequences);
+    forwardWavefront();
+    return;
+  }
+
   for (int i = frameGate_.size(); i < batchSize; i++) {
     Argument arg;
     arg.value = Matrix::create(nullptr,
@@ -458,13 +510,6 @@ void MDLstmLayer::forward(PassType passType) {
                                        numBlocks_ * (2 + numDims_));
   }
 
-  AsyncGpuBlock asyncGpuBlock;
-  gate_.value->assign(*input.value);
-
-  if (bias_) {
-    gate_.value->addBias(*localBias_, 1);
-  }
-
   for (int i = 0; i < numSequences; i++) {
     CoordIterator coordIter(dimsV_[i], directions_);
     forwardOneSequence(starts[i], coordIter);
@@ -567,41 +612,45 @@ void MDLstmLayer::backward(const UpdateCallback& callback) {
                          /* trans= */ false,
                          useGpu_);
 
-  for (int i = 0; i < batchSize; i++) {
-    if (frameState_[i].grad == NULL)
-      frameState_[i].grad = Matrix::create(
-          /* height= */ 1, numBlocks_, /* trans= */ false, useGpu_);
-  }
-  for (int i = 0; i < batchSize; i++) {
-    if (framePreOutput_[i].grad == NULL)
-      framePreOutput_[i].grad = Matrix::create(
-          /* height= */ 1, numBlocks_, /* trans= */ false, useGpu_);
-  }
+  if (!useGpu_) {
+    backwardWavefront();
+  } else {
+    for (int i = 0; i < batchSize; i++) {
+      if (frameState_[i].grad == NULL)
+        frameState_[i].grad = Matrix::create(
+            /* height= */ 1, numBlocks_, /* trans= */ false, useGpu_);
+    }
+    for (int i = 0; i < batchSize; i++) {
+      if (framePreOutput_[i].grad == NULL)
+        framePreOutput_[i].grad = Matrix::create(
+            /* height= */ 1, numBlocks_, /* trans= */ false, useGpu_);
+    }
 
-  for (int i = 0; i < batchSize; i++) {
-    frameOutput_[i].grad->setData(output_.grad->getData() + i * numBlocks_);
-    frameGate_[i].grad->setData(gate_.grad->getData() +
-                                i * numBlocks_ * (3 + numDims_));
-    frameInputNode_[i].grad->setData(gate_.grad->getData() +
-                                     i * numBlocks_ * (3 + numDims_) +
-                                     numBlocks_ * 0);
-    frameInputGate_[i].grad->setData(gate_.grad->getData() +
-                                     i * numBlocks_ * (3 + numDims_) +
-                                     numBlocks_ * 1);
-    frameForgetGate_[i].grad->setData(gate_.grad->getData() +
-                                      i * numBlocks_ * (3 + numDims_) +
-                                      numBlocks_ * 2);
-    frameOutputGate_[i].grad->setData(gate_.grad->getData() +
-                                      i * numBlocks_ * (3 + numDims_) +
-                                      numBlocks_ * (2 + numDims_));
-  }
+    for (int i = 0; i < batchSize; i++) {
+      frameOutput_[i].grad->setData(output_.grad->getData() + i * numBlocks_);
+      frameGate_[i].grad->setData(gate_.grad->getData() +
+                                  i * numBlocks_ * (3 + numDims_));
+      frameInputNode_[i].grad->setData(gate_.grad->getData() +
+                                       i * numBlocks_ * (3 + numDims_) +
+                                       numBlocks_ * 0);
+      frameInputGate_[i].grad->setData(gate_.grad->getData() +
+                                       i * numBlocks_ * (3 + numDims_) +
+                                       numBlocks_ * 1);
+      frameForgetGate_[i].grad->setData(gate_.grad->getData() +
+                                        i * numBlocks_ * (3 + numDims_) +
+                                        numBlocks_ * 2);
+      frameOutputGate_[i].grad->setData(gate_.grad->getData() +
+                                        i * numBlocks_ * (3 + numDims_) +
+                                        numBlocks_ * (2 + numDims_));
+    }
 
-  {
-    AsyncGpuBlock asyncGpuBlock;
+    {
+      AsyncGpuBlock asyncGpuBlock;
 
-    for (size_t i = 0; i < numSequences; i++) {
-      CoordIterator coordIter(dimsV_[i], directions_);
-      backwardOneSequence(starts[i], coordIter);
+      for (size_t i = 0; i < numSequences; i++) {
+        CoordIterator coordIter(dimsV_[i], directions_);
+        backwardOneSequence(starts[i], coordIter);
+      }
     }
   }
 
@@ -760,4 +809,313 @@ void MDLstmLayer::backwardOneSequence(int start, CoordIterator& coordIter) {
   }
 }
 
+void MDLstmLayer::createWavefront(const int* starts, int numSequences) {
+  int batchSize = starts[numSequences];
+  std::vector<int> levels(batchSize);
+  std::vector<int> counts;
+  std::vector<int> pos(numDims_);
+  for (int i = 0; i < numSequences; i++) {
+    const std::vector<int>& dims = dimsV_[i];
+    for (int j = starts[i]; j < starts[i + 1]; j++) {
+      // coordinates in scanning order, the first cell is at level 0
+      int offset = j - starts[i];
+      int level = 0;
+      for (int d = numDims_ - 1; d >= 0; d--) {
+        pos[d] = offset % dims[d];
+        offset /= dims[d];
+        level += directions_[d] ? pos[d] : dims[d] - 1 - pos[d];
+      }
+      levels[j] = level;
+      if ((int)counts.size() <= level) {
+        counts.resize(level + 1, 0);
+      }
+      counts[level]++;
+    }
+  }
+
+  waveStarts_.resize(counts.size() + 1);
+  waveStarts_[0] = 0;
+  for (size_t l = 0; l < counts.size(); l++) {
+    waveStarts_[l + 1] = waveStarts_[l] + counts[l];
+  }
+  std::vector<int> waveRows(batchSize);
+  std::vector<int> next(waveStarts_.begin(), waveStarts_.end() - 1);
+  waveIds_.resize(batchSize);
+  for (int j = 0; j < batchSize; j++) {
+    waveRows[j] = next[levels[j]]++;
+    waveIds_[waveRows[j]] = j;
+  }
+
+  prevIds_.resize(numDims_);
+  for (int d = 0; d < numDims_; d++) {
+    IVector::resizeOrCreate(prevIds_[d], batchSize, false);
+  }
+  for (int i = 0; i < numSequences; i++) {
+    CoordIterator coordIter(dimsV_[i], directions_);
+    for (coordIter.begin(); !coordIter.end(); ++coordIter) {
+      int row = waveRows[starts[i] + coordIter.offset()];
+      for (int d = 0; d < numDims_; d++) {
+        std::vector<int> prePos;
+        int* prevIds = prevIds_[d]->getData();
+        if (coordIter.getPrePos(delays_, d, prePos)) {
+          prevIds[row] = waveRows[starts[i] + coordIter.offset(prePos)];
+        } else {
+          prevIds[row] = -1;
+        }
+      }
+    }
+  }
+
+  for (auto& gate : getWaveGates()) {
+    Matrix::resizeOrCreate(gate.first->value,
+                           batchSize,
+                           gate.first == &waveForgetGate_
+                               ? numBlocks_ * numDims_
+                               : numBlocks_,
+                           /* trans= */ false,
+                           useGpu_);
+  }
+  for (Argument* arg : {&waveState_, &wavePreOutput_, &waveOutput_}) {
+    Matrix::resizeOrCreate(
+        arg->value, batchSize, numBlocks_, /* trans= */ false, useGpu_);
+  }
+  wavePrevState_.resize(numDims_);
+  for (auto& prevState : wavePrevState_) {
+    Matrix::resizeOrCreate(
+        prevState, batchSize, numBlocks_, /* trans= */ false, useGpu_);
+    prevState->zeroMem();
+  }
+  Matrix::resizeOrCreate(
+      wavePrevOutput_, batchSize, numBlocks_, /* trans= */ false, useGpu_);
+  wavePrevOutput_->zeroMem();
+}
+
+std::vector<std::pair<Argument*, size_t>> MDLstmLayer::getWaveGates() {
+  return {{&waveInputNode_, 0},
+          {&waveInputGate_, numBlocks_},
+          {&waveForgetGate_, numBlocks_ * 2},
+          {&waveOutputGate_, numBlocks_ * (2 + numDims_)}};
+}
+
+void MDLstmLayer::forwardWavefront() {
+  size_t numCells = waveIds_.size();
+  size_t gateWidth = numBlocks_ * (3 + numDims_);
+  auto waveGates = getWaveGates();
+  for (size_t i = 0; i < numCells; i++) {
+    const real* gate = gate_.value->getData() + waveIds_[i] * gateWidth;
+    for (auto& waveGate : waveGates) {
+      size_t width = waveGate.first->value->getWidth();
+      memcpy(waveGate.first->value->getData() + i * width,
+             gate + waveGate.second,
+             width * sizeof(real));
+    }
+  }
+
+  MatrixPtr weight = weight_->getW();
+  for (size_t l = 0; l + 1 < waveStarts_.size(); l++) {
+    size_t start = waveStarts_[l];
+    size_t numRows = waveStarts_[l + 1] - start;
+    Argument inputNode, inputGate, forgetGate, outputGate, preOutput;
+    inputNode.value = waveInputNode_.value->subMatrix(start, numRows);
+    inputGate.value = waveInputGate_.value->subMatrix(start, numRows);
+    forgetGate.value = waveForgetGate_.value->subMatrix(start, numRows);
+    outputGate.value = waveOutputGate_.value->subMatrix(start, numRows);
+    preOutput.value = wavePreOutput_.value->subMatrix(start, numRows);
+    MatrixPtr state = waveState_.value->subMatrix(start, numRows);
+    MatrixPtr output = waveOutput_.value->subMatrix(start, numRows);
+
+    if (l > 0) {
+      MatrixPtr prevOutput = wavePrevOutput_->subMatrix(start, numRows);
+      for (int d = 0; d < numDims_; d++) {
+        IVectorPtr ids =
+            IVector::create(prevIds_[d]->getData() + start, numRows, false);
+        prevOutput->selectRows(*waveOutput_.value, *ids);
+        MatrixPtr prevState = wavePrevState_[d]->subMatrix(start, numRows);
+        prevState->selectRows(*waveState_.value, *ids);
+
+        inputGate.value->addDotMulMMV(*prevState, *checkIg_);
+        forgetGate.value
+            ->subMatrix(0, numRows, d * numBlocks_, (d + 1) * numBlocks_)
+            ->addDotMulMMV(*prevState, *checkFg_->subMatrix(d, 1));
+      }
+      for (auto& waveGate : waveGates) {
+        size_t width = waveGate.first->value->getWidth();
+        waveGate.first->value->subMatrix(start, numRows)
+            ->mul(prevOutput,
+                  weight->subColMatrix(waveGate.second,
+                                       waveGate.second + width),
+                  1.0,
+                  1.0);
+      }
+    }
+    activationGate_->forward(inputGate);
+    activationGate_->forward(forgetGate);
+    activation_->forward(inputNode);
+
+    state->dotMul(*inputNode.value, *inputGate.value);
+    if (l > 0) {
+      for (int d = 0; d < numDims_; d++) {
+        state->addDotMul(
+            *wavePrevState_[d]->subMatrix(start, numRows),
+            *forgetGate.value->subMatrix(
+                0, numRows, d * numBlocks_, (d + 1) * numBlocks_),
+            1.0,
+            1.0);
+      }
+    }
+
+    outputGate.value->addDotMulMMV(*state, *checkOg_);
+    activationGate_->forward(outputGate);
+
+    preOutput.value->copyFrom(*state);
+    activationState_->forward(preOutput);
+
+    output->dotMul(*preOutput.value, *outputGate.value);
+  }
+
+  for (size_t i = 0; i < numCells; i++) {
+    memcpy(output_.value->getData() + waveIds_[i] * numBlocks_,
+           waveOutput_.value->getData() + i * numBlocks_,
+           numBlocks_ * sizeof(real));
+  }
+}
+
+void MDLstmLayer::backwardWavefront() {
+  size_t numCells = waveIds_.size();
+  size_t gateWidth = numBlocks_ * (3 + numDims_);
+  auto waveGates = getWaveGates();
+  for (auto& waveGate : waveGates) {
+    Matrix::resizeOrCreate(waveGate.first->grad,
+                           numCells,
+                           waveGate.first->value->getWidth(),
+                           /* trans= */ false,
+                           useGpu_);
+  }
+  for (Argument* arg : {&waveState_, &wavePreOutput_, &waveOutput_}) {
+    Matrix::resizeOrCreate(
+        arg->grad, numCells, numBlocks_, /* trans= */ false, useGpu_);
+  }
+  Matrix::resizeOrCreate(
+      wavePrevStateGrad_, numCells, numBlocks_, /* trans= */ false, useGpu_);
+  Matrix::resizeOrCreate(
+      wavePrevOutputGrad_, numCells, numBlocks_, /* trans= */ false, useGpu_);
+
+  for (size_t i = 0; i < numCells; i++) {
+    memcpy(waveOutput_.grad->getData() + i * numBlocks_,
+           output_.grad->getData() + waveIds_[i] * numBlocks_,
+           numBlocks_ * sizeof(real));
+  }
+  waveState_.grad->zeroMem();
+
+  MatrixPtr weight = weight_->getW();
+  for (size_t l = waveStarts_.size() - 1; l-- > 0;) {
+    size_t start = waveStarts_[l];
+    size_t numRows = waveStarts_[l + 1] - start;
+    Argument inputNode, inputGate, forgetGate, outputGate, preOutput;
+    for (auto& arg : {std::make_pair(&inputNode, &waveInputNode_),
+                      std::make_pair(&inputGate, &waveInputGate_),
+                      std::make_pair(&forgetGate, &waveForgetGate_),
+                      std::make_pair(&outputGate, &waveOutputGate_),
+                      std::make_pair(&preOutput, &wavePreOutput_)}) {
+      arg.first->value = arg.second->value->subMatrix(start, numRows);
+      arg.first->grad = arg.second->grad->subMatrix(start, numRows);
+    }
+    MatrixPtr state = waveState_.value->subMatrix(start, numRows);
+    MatrixPtr stateGrad = waveState_.grad->subMatrix(start, numRows);
+    MatrixPtr outputGrad = waveOutput_.grad->subMatrix(start, numRows);
+
+    preOutput.grad->dotMul(*outputGrad, *outputGate.value);
+    activationState_->backward(preOutput);
+    // stateGrad already has the gradients from the next cells
+    stateGrad->add(*preOutput.grad);
+
+    outputGate.grad->dotMul(*outputGrad, *preOutput.value);
+    activationGate_->backward(outputGate);
+    stateGrad->addDotMulMMV(*outputGate.grad, *checkOg_);
+
+    inputNode.grad->dotMul(*stateGrad, *inputGate.value);
+    inputGate.grad->dotMul(*stateGrad, *inputNode.value);
+    forgetGate.grad->zeroMem();
+    if (l > 0) {
+      for (int d = 0; d < numDims_; d++) {
+        forgetGate.grad
+            ->subMatrix(0, numRows, d * numBlocks_, (d + 1) * numBlocks_)
+            ->dotMul(*stateGrad, *wavePrevState_[d]->subMatrix(start, numRows));
+      }
+    }
+
+    activationGate_->backward(inputGate);
+    activationGate_->backward(forgetGate);
+    activation_->backward(inputNode);
+
+    if (l == 0) {
+      continue;
+    }
+    // gradients to the outputs and states of the previous cells
+    MatrixPtr prevOutputGrad = wavePrevOutputGrad_->subMatrix(start, numRows);
+    prevOutputGrad->zeroMem();
+    for (auto& waveGate : waveGates) {
+      size_t width = waveGate.first->value->getWidth();
+      MatrixPtr weightT = Matrix::create(weight->getData() + waveGate.second,
+                                         numBlocks_,
+                                         width,
+                                         weight->getStride(),
+                                         /* trans= */ true,
+                                         useGpu_);
+      prevOutputGrad->mul(waveGate.first->grad->subMatrix(start, numRows),
+                          weightT,
+                          1.0,
+                          1.0);
+    }
+    MatrixPtr prevStateGrad = wavePrevStateGrad_->subMatrix(start, numRows);
+    for (int d = 0; d < numDims_; d++) {
+      IVectorPtr ids =
+          IVector::create(prevIds_[d]->getData() + start, numRows, false);
+      prevOutputGrad->addToRows(*waveOutput_.grad, *ids);
+
+      MatrixPtr forgetGateOneDim = forgetGate.value->subMatrix(
+          0, numRows, d * numBlocks_, (d + 1) * numBlocks_);
+      MatrixPtr forgetGradOneDim = forgetGate.grad->subMatrix(
+          0, numRows, d * numBlocks_, (d + 1) * numBlocks_);
+      prevStateGrad->dotMul(*stateGrad, *forgetGateOneDim);
+      prevStateGrad->addDotMulMMV(*inputGate.grad, *checkIg_);
+      prevStateGrad->addDotMulMMV(*forgetGradOneDim,
+                                  *checkFg_->subMatrix(d, 1));
+      prevStateGrad->addToRows(*waveState_.grad, *ids);
+    }
+  }
+
+  if (bias_->getWGrad()) {
+    for (int d = 0; d < numDims_; d++) {
+      checkIgGrad_->addDotMulVMM(*waveInputGate_.grad, *wavePrevState_[d]);
+      checkFgGrad_->subMatrix(d, 1)->addDotMulVMM(
+          *waveForgetGate_.grad->subMatrix(
+              0, numCells, d * numBlocks_, (d + 1) * numBlocks_),
+          *wavePrevState_[d]);
+    }
+    checkOgGrad_->addDotMulVMM(*waveOutputGate_.grad, *waveState_.value);
+  }
+  if (weight_->getWGrad()) {
+    MatrixPtr weightGrad = weight_->getWGrad();
+    for (auto& waveGate : waveGates) {
+      size_t width = waveGate.first->value->getWidth();
+      weightGrad->subColMatrix(waveGate.second, waveGate.second + width)
+          ->mul(wavePrevOutput_->getTranspose(),
+                waveGate.first->grad,
+                1.0,
+                1.0);
+    }
+  }
+
+  for (size_t i = 0; i < numCells; i++) {
+    real* gateGrad = gate_.grad->getData() + waveIds_[i] * gateWidth;
+    for (auto& waveGate : waveGates) {
+      size_t width = waveGate.first->grad->getWidth();
+      memcpy(gateGrad + waveGate.second,
+             waveGate.first->grad->getData() + i * width,
+             width * sizeof(real));
+    }
+  }
+}
+
 }  // namespace paddle
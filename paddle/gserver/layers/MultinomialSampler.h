@@ -42,6 +42,20 @@ public:
     return gen1([&g, this]() { return rand_(g); });
   }
 
+  /**
+   * @brief Generate n random samples.
+   * @param g is a random number engine. See <random>.
+   * @param[out] ids The n random integers.
+   * @param[in] n Number of samples.
+   */
+  template <typename URNG>
+  void gen(URNG& g, int* ids, size_t n) {
+    auto rand = [&g, this]() { return rand_(g); };
+    for (size_t i = 0; i < n; ++i) {
+      ids[i] = gen1(rand);
+    }
+  }
+
 protected:
   /**
    * @brief Generation
@@ -16,7 +16,7 @@ limitations under the License. */
 
 #include "Layer.h"
 #include "MultinomialSampler.h"
-#include "paddle/math/MathFunctions.h"
+#include "paddle/parameter/ParameterUpdaterHook.h"
 
 namespace paddle {
 
@@ -47,12 +47,25 @@ class NCELayer : public Layer {
     bool target;
     real weight;
   };
+  /// The target samples are before the negative samples, and the negative
+  /// samples are in the order of (sampleId, j) for j < num_neg_samples.
   std::vector<Sample> samples_;
+  /// number of target samples in samples_
+  size_t numTargets_;
   /// whether samples_ is prepared
   bool prepared_;
   Argument sampleOut_;
 
+  /// samples_[i].labelId and samples_[i].sampleId
   IVectorPtr labelIds_;
+  IVectorPtr sampleIds_;
+  /// negative labels shared by all the samples if share_neg_samples is set
+  IVectorPtr negIds_;
+  /// rows of input and weight gathered for each sample
+  MatrixPtr sampleInput_;
+  MatrixPtr sampleWeight_;
+  /// rows of weight (or their gradient) of the shared negative labels
+  MatrixPtr negWeight_;
 
 public:
   explicit NCELayer(const LayerConfig& config)
@@ -120,8 +133,9 @@ public:
 
     auto& randEngine = ThreadLocalRandomEngine::get();
 
+    int numNegSamples = config_.num_neg_samples();
     samples_.clear();
-    samples_.reserve(batchSize * (1 + config_.num_neg_samples()));
+    samples_.reserve(batchSize * (1 + numNegSamples));
 
     real* weight =
         weightLayer_ ? getInputValue(*weightLayer_)->getData() : nullptr;
@@ -138,22 +152,43 @@ public:
           samples_.push_back({i, cols[j], true, w});
         }
       }
-      for (int j = 0; j < config_.num_neg_samples(); ++j) {
-        int id = sampler_ ? sampler_->gen(randEngine) : rand_(randEngine);
-        samples_.push_back({i, id, false, w});
+    }
+    numTargets_ = samples_.size();
+
+    // draw all the negative labels of the batch in one pass
+    size_t numNegIds =
+        config_.share_neg_samples() ? numNegSamples : batchSize * numNegSamples;
+    IVector::resizeOrCreate(negIds_, numNegIds, useGpu_);
+    int* negIds = negIds_->getData();
+    if (sampler_) {
+      sampler_->gen(randEngine, negIds, numNegIds);
+    } else {
+      for (size_t j = 0; j < numNegIds; ++j) {
+        negIds[j] = rand_(randEngine);
+      }
+    }
+    for (int i = 0; i < batchSize; ++i) {
+      real w = weight ? weight[i] : 1;
+      int* ids =
+          config_.share_neg_samples() ? negIds : negIds + i * numNegSamples;
+      for (int j = 0; j < numNegSamples; ++j) {
+        samples_.push_back({i, ids[j], false, w});
       }
     }
-    prepared_ = true;
-  }
 
-  void prefetch() {
-    prepareSamples();
     IVector::resizeOrCreate(labelIds_, samples_.size(), useGpu_);
-    int* ids = labelIds_->getData();
+    IVector::resizeOrCreate(sampleIds_, samples_.size(), useGpu_);
+    int* labelIds = labelIds_->getData();
+    int* sampleIds = sampleIds_->getData();
     for (size_t i = 0; i < samples_.size(); ++i) {
-      ids[i] = samples_[i].labelId;
+      labelIds[i] = samples_[i].labelId;
+      sampleIds[i] = samples_[i].sampleId;
     }
+    prepared_ = true;
+  }
 
+  void prefetch() {
+    prepareSamples();
     for (int i = 0; i < numInputs_; ++i) {
       auto sparseParam =
           dynamic_cast<SparsePrefetchRowCpuMatrix*>(weights_[i]->getW().get());
@@ -209,7 +244,7 @@ public:
 
     activation_->backward(sampleOut_);
 
-    if (biases_->getWGrad()) {
+    if (biases_ && biases_->getWGrad()) {
       backwardBias(callback);
     }
 
@@ -240,17 +275,54 @@ public:
     biases_->incUpdate(callback);
   }
 
+  /// Number of samples scored by gathering rows. If the negative labels are
+  /// shared, they are scored by one GEMM with all the input rows.
+  size_t numGatheredSamples() {
+    return config_.share_neg_samples() ? numTargets_ : samples_.size();
+  }
+
+  /// the shared negative part of data as a (batchSize x num_neg_samples)
+  /// matrix
+  MatrixPtr negSampleMatrix(real* data) {
+    int batchSize = getInputValue(0)->getHeight();
+    return Matrix::create(data + numTargets_,
+                          batchSize,
+                          config_.num_neg_samples(),
+                          /* trans= */ false,
+                          useGpu_);
+  }
+
+  /// dest.row[i] = table.row[ids[i]] for i < numRows
+  void gatherRows(const MatrixPtr& table,
+                  const IVectorPtr& ids,
+                  size_t numRows,
+                  MatrixPtr& dest) {
+    Matrix::resizeOrCreate(
+        dest, numRows, table->getWidth(), /* trans= */ false, useGpu_);
+    dest->zeroMem();
+    dest->selectRows(*table, *IVector::create(ids->getData(), numRows, false));
+  }
+
   void forwardOneInput(int layerId) {
     const MatrixPtr& inputMat = getInputValue(layerId);
     const MatrixPtr& weightMat = weights_[layerId]->getW();
 
-    int dim = inputMat->getWidth();
-    real* sampleOut = sampleOut_.value->getData();
+    size_t numSamples = numGatheredSamples();
+    if (numSamples > 0) {
+      gatherRows(inputMat, sampleIds_, numSamples, sampleInput_);
+      gatherRows(weightMat, labelIds_, numSamples, sampleWeight_);
+      MatrixPtr sampleOut = Matrix::create(sampleOut_.value->getData(),
+                                           numSamples,
+                                           1,
+                                           /* trans= */ false,
+                                           useGpu_);
+      sampleOut->rowDotMul(0, *sampleInput_, *sampleWeight_);
+    }
 
-    for (size_t i = 0; i < samples_.size(); ++i) {
-      sampleOut[i] += dotProduct(dim,
-                                 inputMat->getRowBuf(samples_[i].sampleId),
-                                 weightMat->getRowBuf(samples_[i].labelId));
+    if (config_.share_neg_samples() && config_.num_neg_samples() > 0) {
+      gatherRows(weightMat, negIds_, negIds_->getSize(), negWeight_);
+      negSampleMatrix(sampleOut_.value->getData())
+          ->mul(inputMat, negWeight_->getTranspose(), 1, 1);
     }
   }
 
@@ -260,25 +332,50 @@ public:
     const MatrixPtr& weightMat = weights_[layerId]->getW();
     const MatrixPtr& weightGradMat = weights_[layerId]->getWGrad();
 
-    int dim = inputMat->getWidth();
-    real* sampleGrad = sampleOut_.grad->getData();
+    size_t numSamples = numGatheredSamples();
+    bool shareNeg =
+        config_.share_neg_samples() && config_.num_neg_samples() > 0;
+    MatrixPtr sampleGrad = Matrix::create(sampleOut_.grad->getData(),
+                                          numSamples,
+                                          1,
+                                          /* trans= */ false,
+                                          useGpu_);
+    MatrixPtr negGrad =
+        shareNeg ? negSampleMatrix(sampleOut_.grad->getData()) : nullptr;
 
     if (weightGradMat) {
-      for (size_t i = 0; i < samples_.size(); ++i) {
-        axpy(dim,
-             sampleGrad[i],
-             inputMat->getRowBuf(samples_[i].sampleId),
-             weightGradMat->getRowBuf(samples_[i].labelId));
+      if (numSamples > 0) {
+        // weightGrad.row[labelId] += sampleGrad * input.row[sampleId]
+        gatherRows(inputMat, sampleIds_, numSamples, sampleInput_);
+        sampleInput_->rowScale(0, *sampleInput_, *sampleGrad);
+        sampleInput_->addToRows(
+            *weightGradMat,
+            *IVector::create(labelIds_->getData(), numSamples, false));
+      }
+      if (shareNeg) {
+        Matrix::resizeOrCreate(negWeight_,
+                               negIds_->getSize(),
+                               inputMat->getWidth(),
+                               /* trans= */ false,
+                               useGpu_);
+        negWeight_->mul(negGrad->getTranspose(), inputMat, 1, 0);
+        negWeight_->addToRows(*weightGradMat, *negIds_);
       }
       weights_[layerId]->incUpdate(callback);
     }
 
     if (inputGradMat) {
-      for (size_t i = 0; i < samples_.size(); ++i) {
-        axpy(dim,
-             sampleGrad[i],
-             weightMat->getRowBuf(samples_[i].labelId),
-             inputGradMat->getRowBuf(samples_[i].sampleId));
+      if (numSamples > 0) {
+        // inputGrad.row[sampleId] += sampleGrad * weight.row[labelId]
+        gatherRows(weightMat, labelIds_, numSamples, sampleWeight_);
+        sampleWeight_->rowScale(0, *sampleWeight_, *sampleGrad);
+        sampleWeight_->addToRows(
+            *inputGradMat,
+            *IVector::create(sampleIds_->getData(), numSamples, false));
+      }
+      if (shareNeg) {
+        gatherRows(weightMat, negIds_, negIds_->getSize(), negWeight_);
+        inputGradMat->mul(negGrad, negWeight_, 1, 1);
       }
     }
   }
@@ -303,13 +400,14 @@ public:
     real* sampleGrad = sampleOut_.grad->getData();
 
     real b = 1. / numClasses_ * config_.num_neg_samples();
+    real lossScale = LossScaler::getScale();
     for (size_t i = 0; i < samples_.size(); ++i) {
       real o = sampleOut[i];
       if (sampler_) {
         b = config_.num_neg_samples() *
             config_.neg_sampling_dist(samples_[i].labelId);
       }
-      real w = samples_[i].weight;
+      real w = samples_[i].weight * lossScale;
       sampleGrad[i] = samples_[i].target ? -w * b / (o * (o + b)) : w / (o + b);
     }
   }
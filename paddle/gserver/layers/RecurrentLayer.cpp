@@ -318,7 +318,8 @@ void RecurrentLayer::forwardBatch(int batchSize,
 
   batchValue_->resizeOrCreateBatch(batchSize, numSequences, starts, reversed_);
 
-  batchValue_->copyFromSeq(*output_.value);
+  batchValue_->copyFromSeq(*output_.value,
+                           /* shareSeq= */ passType_ == PASS_TEST);
   {
     REGISTER_TIMER_INFO("RecurrentFwBatch", getName().c_str());
     AsyncGpuBlock asyncGpuBlock;
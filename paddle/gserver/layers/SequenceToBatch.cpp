@@ -17,45 +17,92 @@ limitations under the License. */
 #include "SequenceToBatch.h"
 #include <iostream>
 #include <string.h>
+#include "paddle/utils/Thread.h"
+#include "paddle/utils/ThreadLocal.h"
 
 namespace paddle {
 
-void SequenceToBatch::resizeOrCreateBatch(int batchSize,
-                                          size_t numSequences,
-                                          const int *seqStarts,
-                                          bool reversed,
-                                          bool prevBatchState) {
-  CHECK_EQ(seqStarts[numSequences], batchSize);
-  IVector::resizeOrCreate(seq2BatchIdx_, batchSize, useGpu_);
-  if (!useGpu_) {
-    cpuSeq2BatchIdx_ = seq2BatchIdx_;
-  } else {
-    IVector::resizeOrCreate(cpuSeq2BatchIdx_, batchSize, false);
+namespace {
+
+/// The batch index of one sequence structure. It is never modified after
+/// being built, so SequenceToBatch objects can share its vectors.
+struct SequenceToBatchPlan {
+  std::vector<int> seqStarts;
+  bool reversed;
+  bool prevBatchState;
+  bool useGpu;
+
+  size_t numBatch;
+  bool identity;
+  IVectorPtr batchStartPositions;
+  IVectorPtr seq2BatchIdx;
+  IVectorPtr cpuSeq2BatchIdx;
+  IVectorPtr seqIdx;
+  IVectorPtr cpuSeqIdx;
+  IVectorPtr seqEndIdxInBatch;
+  IVectorPtr cpuSeqEndIdxInBatch;
+
+  bool match(size_t numSequences,
+             const int *starts,
+             bool reversed,
+             bool prevBatchState,
+             bool useGpu) const {
+    return this->reversed == reversed && this->useGpu == useGpu &&
+           (this->prevBatchState || !prevBatchState) &&
+           seqStarts.size() == numSequences + 1 &&
+           std::equal(seqStarts.begin(), seqStarts.end(), starts);
   }
+};
+
+typedef std::shared_ptr<SequenceToBatchPlan> SequenceToBatchPlanPtr;
+
+/// Recently used plans of this thread, the most recent one first. A few
+/// entries cover the forward/reversed layers of one network.
+static ThreadLocal<std::vector<SequenceToBatchPlanPtr>> threadLocalPlans;
+const size_t kMaxNumPlans = 4;
+
+SequenceToBatchPlanPtr buildPlan(size_t numSequences,
+                                 const int *seqStarts,
+                                 bool reversed,
+                                 bool prevBatchState,
+                                 bool useGpu) {
+  auto plan = std::make_shared<SequenceToBatchPlan>();
+  plan->seqStarts.assign(seqStarts, seqStarts + numSequences + 1);
+  plan->reversed = reversed;
+  plan->prevBatchState = prevBatchState;
+  plan->useGpu = useGpu;
+
+  int batchSize = seqStarts[numSequences];
+  plan->seq2BatchIdx = IVector::create(batchSize, useGpu);
+  plan->cpuSeq2BatchIdx =
+      useGpu ? IVector::create(batchSize, false) : plan->seq2BatchIdx;
 
   /*
-   * calculate the length of each sequence & sort sequence index by the length
+   * order the sequences by decreasing length. Lengths are bounded by
+   * batchSize, so a counting sort is used. Ties keep their sequence order.
    * Exampel:  Sequences = {s0, s1, s2}
    *           s0: 0 0 0 0, s1: 1 1 1 1 1, s2: 2 2 2
-   *           seqStartAndLength[3] = {(4, 5, 1), (0, 4, 0), (9, 3, 2)}
+   *           order = {1, 0, 2}
    */
-  struct SeqStartAndLength {
-    int start_;
-    int length_;
-    int seqIdx_;
-    SeqStartAndLength(int start, int length, int seqIdx)
-        : start_(start), length_(length), seqIdx_(seqIdx) {}
-  };
-  std::vector<SeqStartAndLength> seqStartAndLength;
+  int maxLength = 0;
+  for (size_t seqId = 0; seqId < numSequences; ++seqId) {
+    maxLength = std::max(maxLength, seqStarts[seqId + 1] - seqStarts[seqId]);
+  }
+  std::vector<int> count(maxLength + 1, 0);
+  for (size_t seqId = 0; seqId < numSequences; ++seqId) {
+    count[seqStarts[seqId + 1] - seqStarts[seqId]]++;
+  }
+  // numLonger[l]: number of sequences longer than l, which is also the
+  // position in order of the first sequence of length l
+  std::vector<int> numLonger(maxLength + 1, 0);
+  for (int l = maxLength - 1; l >= 0; --l) {
+    numLonger[l] = numLonger[l + 1] + count[l + 1];
+  }
+  std::vector<int> next(numLonger);
+  std::vector<int> order(numSequences);
   for (size_t seqId = 0; seqId < numSequences; ++seqId) {
-    int length = seqStarts[seqId + 1] - seqStarts[seqId];
-    seqStartAndLength.emplace_back(seqStarts[seqId], length, seqId);
+    order[next[seqStarts[seqId + 1] - seqStarts[seqId]]++] = seqId;
   }
-  std::sort(seqStartAndLength.begin(),
-            seqStartAndLength.end(),
-            [](SeqStartAndLength a, SeqStartAndLength b) {
-              return a.length_ > b.length_;
-            });
 
   /*
    * calculate the start position of each batch
@@ -67,63 +114,107 @@ void SequenceToBatch::resizeOrCreateBatch(int batchSize,
    *           b0: 1 0 2, b1: 1 0 2, b2: 1 0 2, b3: 1 0, b4: 1
    *           batchStartPositions[6] = {0, 3, 6, 9, 11, 12}
    */
-  numBatch_ = (size_t)seqStartAndLength[0].length_;
-
-  IVector::resizeOrCreate(batchStartPositions_, numBatch_ + 1, false);
-  int *batchStartPositions = batchStartPositions_->getData();
+  plan->numBatch = maxLength;
+  plan->batchStartPositions = IVector::create(maxLength + 1, false);
+  int *batchStartPositions = plan->batchStartPositions->getData();
+  int *seq2BatchIdx = plan->cpuSeq2BatchIdx->getData();
+  bool identity = true;
   batchStartPositions[0] = 0;
-  for (size_t n = 0; n < numBatch_; n++) {
+  for (int n = 0; n < maxLength; n++) {
     int batchId = batchStartPositions[n];
-    for (size_t i = 0; i < seqStartAndLength.size(); ++i) {
-      size_t seqLength = seqStartAndLength[i].length_;
-      int start = seqStartAndLength[i].start_;
-      if (n < seqLength) {
-        if (!reversed) {
-          cpuSeq2BatchIdx_->getData()[batchId] = start + n;
-        } else {
-          cpuSeq2BatchIdx_->getData()[batchId] = start + seqLength - 1 - n;
-        }
-        batchId++;
-      } else {
-        break;
-      }
+    for (int i = 0; i < numLonger[n]; ++i) {
+      int seqId = order[i];
+      int seqLength = seqStarts[seqId + 1] - seqStarts[seqId];
+      int start = seqStarts[seqId];
+      seq2BatchIdx[batchId] =
+          !reversed ? start + n : start + seqLength - 1 - n;
+      identity = identity && seq2BatchIdx[batchId] == batchId;
+      batchId++;
     }
     batchStartPositions[n + 1] = batchId;
   }
-  if (useGpu_) {
-    seq2BatchIdx_->copyFrom(*cpuSeq2BatchIdx_);
+  plan->identity = identity;
+  if (useGpu) {
+    plan->seq2BatchIdx->copyFrom(*plan->cpuSeq2BatchIdx);
   }
+
   if (prevBatchState) {
-    IVector::resizeOrCreate(seqIdx_, numSequences, useGpu_);
-    IVector::resizeOrCreate(seqEndIdxInBatch_, numSequences, useGpu_);
-    if (!useGpu_) {
-      cpuSeqIdx_ = seqIdx_;
-      cpuSeqEndIdxInBatch_ = seqEndIdxInBatch_;
-    } else {
-      IVector::resizeOrCreate(cpuSeqIdx_, numSequences, false);
-      IVector::resizeOrCreate(cpuSeqEndIdxInBatch_, numSequences, false);
+    plan->seqIdx = IVector::create(numSequences, useGpu);
+    plan->seqEndIdxInBatch = IVector::create(numSequences, useGpu);
+    plan->cpuSeqIdx =
+        useGpu ? IVector::create(numSequences, false) : plan->seqIdx;
+    plan->cpuSeqEndIdxInBatch =
+        useGpu ? IVector::create(numSequences, false) : plan->seqEndIdxInBatch;
+    int *seqIdx = plan->cpuSeqIdx->getData();
+    int *seqEndIdxInBatch = plan->cpuSeqEndIdxInBatch->getData();
+    for (size_t i = 0; i < numSequences; ++i) {
+      int seqId = order[i];
+      int length = seqStarts[seqId + 1] - seqStarts[seqId];
+      seqIdx[i] = seqId;
+      seqEndIdxInBatch[seqId] =
+          length > 0 ? batchStartPositions[length - 1] + i : 0;
     }
-    int *seqIdx = cpuSeqIdx_->getData();
-    int *seqEndIdxInBatch = cpuSeqEndIdxInBatch_->getData();
-    for (size_t i = 0; i < seqStartAndLength.size(); ++i) {
-      seqIdx[i] = seqStartAndLength[i].seqIdx_;
+    if (useGpu) {
+      plan->seqIdx->copyFrom(*plan->cpuSeqIdx);
+      plan->seqEndIdxInBatch->copyFrom(*plan->cpuSeqEndIdxInBatch);
     }
-    for (size_t i = 0; i < seqStartAndLength.size(); ++i) {
-      if (seqStartAndLength[i].length_ > 0) {
-        seqEndIdxInBatch[seqStartAndLength[i].seqIdx_] =
-            batchStartPositions[seqStartAndLength[i].length_ - 1] + i;
-      } else {
-        seqEndIdxInBatch[seqStartAndLength[i].seqIdx_] = 0;
-      }
-    }
-    if (useGpu_) {
-      seqIdx_->copyFrom(*cpuSeqIdx_);
-      seqEndIdxInBatch_->copyFrom(*cpuSeqEndIdxInBatch_);
+  }
+  return plan;
+}
+
+}  // namespace
+
+void SequenceToBatch::resizeOrCreateBatch(int batchSize,
+                                          size_t numSequences,
+                                          const int *seqStarts,
+                                          bool reversed,
+                                          bool prevBatchState) {
+  CHECK_EQ(seqStarts[numSequences], batchSize);
+  auto &plans = *threadLocalPlans;
+  auto it = std::find_if(plans.begin(),
+                         plans.end(),
+                         [&](const SequenceToBatchPlanPtr &plan) {
+                           return plan->match(numSequences,
+                                              seqStarts,
+                                              reversed,
+                                              prevBatchState,
+                                              useGpu_);
+                         });
+  SequenceToBatchPlanPtr plan;
+  if (it != plans.end()) {
+    plan = *it;
+    plans.erase(it);
+  } else {
+    plan = buildPlan(
+        numSequences, seqStarts, reversed, prevBatchState, useGpu_);
+    if (plans.size() == kMaxNumPlans) {
+      plans.pop_back();
     }
   }
+  plans.insert(plans.begin(), plan);
+
+  numBatch_ = plan->numBatch;
+  identity_ = plan->identity;
+  batchStartPositions_ = plan->batchStartPositions;
+  seq2BatchIdx_ = plan->seq2BatchIdx;
+  cpuSeq2BatchIdx_ = plan->cpuSeq2BatchIdx;
+  seqIdx_ = plan->seqIdx;
+  cpuSeqIdx_ = plan->cpuSeqIdx;
+  seqEndIdxInBatch_ = plan->seqEndIdxInBatch;
+  cpuSeqEndIdxInBatch_ = plan->cpuSeqEndIdxInBatch;
 }
 
-void SequenceToBatch::resizeOrCreate(Matrix &seqValue) {
+void SequenceToBatch::resizeOrCreate(Matrix &seqValue, bool shareSeq) {
+  if (shareSeq && identity_) {
+    batchValue_ = Matrix::create(seqValue.getData(),
+                                 seqValue.getHeight(),
+                                 seqValue.getWidth(),
+                                 /* trans= */ false,
+                                 useGpu_);
+    return;
+  }
+  // a batchValue_ sharing seqValue has no memory handle of its own, so
+  // resizeOrCreate() allocates a new buffer for it
   Matrix::resizeOrCreate(batchValue_,
                          seqValue.getHeight(),
                          seqValue.getWidth(),
@@ -171,17 +262,22 @@ void SequenceToBatch::sequence2BatchCopy(Matrix &batch,
     hl_sequence2batch_copy(
         batchData, seqData, idxData, seqWidth, batchCount, seq2batch);
   } else {
-    for (int i = 0; i < batchCount; ++i) {
-      if (seq2batch) {
-        memcpy(batch.rowBuf(i),
-               sequence.rowBuf(idxData[i]),
-               seqWidth * sizeof(real));
-      } else {
-        memcpy(sequence.rowBuf(idxData[i]),
-               batch.rowBuf(i),
-               seqWidth * sizeof(real));
+    auto copyRows = [&](int tid, size_t numThreads) {
+      int begin = (size_t)batchCount * tid / numThreads;
+      int end = (size_t)batchCount * (tid + 1) / numThreads;
+      for (int i = begin; i < end; ++i) {
+        if (seq2batch) {
+          memcpy(batch.rowBuf(i),
+                 sequence.rowBuf(idxData[i]),
+                 seqWidth * sizeof(real));
+        } else {
+          memcpy(sequence.rowBuf(idxData[i]),
+                 batch.rowBuf(i),
+                 seqWidth * sizeof(real));
+        }
       }
-    }
+    };
+    SyncThreadPool::execHelper(pool_, copyRows);
   }
 }
 
@@ -199,38 +295,60 @@ void SequenceToBatch::sequence2BatchAdd(Matrix &batch,
     hl_sequence2batch_add(
         batchData, seqData, idxData, seqWidth, batchCount, seq2batch);
   } else {
-    for (int i = 0; i < batchCount; ++i) {
-      if (seq2batch) {
-        batch.subMatrix(i, 1)->add(*sequence.subMatrix(idxData[i], 1));
-      } else {
-        sequence.subMatrix(idxData[i], 1)->add(*batch.subMatrix(i, 1));
+    auto addRows = [&](int tid, size_t numThreads) {
+      int begin = (size_t)batchCount * tid / numThreads;
+      int end = (size_t)batchCount * (tid + 1) / numThreads;
+      for (int i = begin; i < end; ++i) {
+        real *dst = seq2batch ? batch.rowBuf(i) : sequence.rowBuf(idxData[i]);
+        const real *src =
+            seq2batch ? sequence.rowBuf(idxData[i]) : batch.rowBuf(i);
+        for (int j = 0; j < seqWidth; ++j) {
+          dst[j] += src[j];
+        }
       }
-    }
+    };
+    SyncThreadPool::execHelper(pool_, addRows);
   }
 }
 
-void SequenceToBatch::copyFromSeq(Matrix &seqValue) {
-  Matrix::resizeOrCreate(batchValue_,
-                         seqValue.getHeight(),
-                         seqValue.getWidth(),
-                         /* trans= */ false,
-                         useGpu_);
-  sequence2BatchCopy(*batchValue_, seqValue, *seq2BatchIdx_, true);
+void SequenceToBatch::copyFromSeq(Matrix &seqValue, bool shareSeq) {
+  resizeOrCreate(seqValue, shareSeq);
+  if (batchValue_->getData() != seqValue.getData()) {
+    copy(seqValue, *batchValue_, /* seq2batch */ true);
+  }
 }
 
 void SequenceToBatch::copyBackSeq(Matrix &seqValue) {
-  sequence2BatchCopy(*batchValue_, seqValue, *seq2BatchIdx_, false);
+  if (batchValue_->getData() != seqValue.getData()) {
+    copy(seqValue, *batchValue_, /* seq2batch */ false);
+  }
 }
 
 void SequenceToBatch::copy(Matrix &seqValue,
                            Matrix &batchValue,
                            bool seq2batch) {
+  if (identity_) {
+    if (seq2batch) {
+      batchValue.copyFrom(seqValue);
+    } else {
+      seqValue.copyFrom(batchValue);
+    }
+    return;
+  }
   sequence2BatchCopy(batchValue, seqValue, *seq2BatchIdx_, seq2batch);
 }
 
 void SequenceToBatch::add(Matrix &seqValue,
                           Matrix &batchValue,
                           bool seq2batch) {
+  if (identity_) {
+    if (seq2batch) {
+      batchValue.add(seqValue);
+    } else {
+      seqValue.add(batchValue);
+    }
+    return;
+  }
   sequence2BatchAdd(batchValue, seqValue, *seq2BatchIdx_, seq2batch);
 }
 
@@ -18,6 +18,8 @@ limitations under the License. */
 
 namespace paddle {
 
+class SyncThreadPool;
+
 /*
  * This class can used to modify the matrix structure of sequence matrix into
  * batch structure.
@@ -37,18 +39,31 @@ namespace paddle {
  * 2. seq2batch.resizeOrCreateBatch(seqStarts);     // calculate seq2BatchIdx
  * 3. seq2batch.copy(seqMatrix, batchMatrix, true); // copy seq to batch matrix
  *
+ * The batch index of a given set of seqStarts is a plan which is built once
+ * and cached per thread, so the stacked recurrent layers of a network and
+ * the following mini-batches of the same structure share it. When the batch
+ * order equals the sequence order (e.g. every sequence has one frame, or
+ * there is only one sequence), the plan is an identity and no row gather is
+ * needed.
  */
 class SequenceToBatch {
 public:
-  explicit SequenceToBatch(bool useGpu) : useGpu_(useGpu) {}
+  explicit SequenceToBatch(bool useGpu)
+      : numBatch_(0), identity_(false), useGpu_(useGpu), pool_(nullptr) {}
 
-  /* resize and calculate the batchIndex_ */
+  /* find or calculate the batchIndex_ */
   void resizeOrCreateBatch(int batchSize,
                            size_t numSequences,
                            const int *seqStarts,
                            bool reversed,
                            bool prevBatchState = false);
 
+  /* whether the batch order is the same as the sequence order */
+  bool isIdentity() const { return identity_; }
+
+  /* split the row copies on CPU among the threads of pool */
+  void setThreadPool(SyncThreadPool *pool) { pool_ = pool; }
+
   /* sequence matrix and batch matrix copy:
    * seq2batch: copy(seqValue, batchValue, true);
    * batch2seq: copy(seqValue, batchValue, false);
@@ -60,10 +75,15 @@ public:
 
   size_t getNumBatch() const { return numBatch_; }
 
-  /* resize or create a batch matrix(batchValue_) */
-  void resizeOrCreate(Matrix &seqValue);
-  /* copy seqValue to batchValue_ */
-  void copyFromSeq(Matrix &seqValue);
+  /*
+   * resize or create a batch matrix(batchValue_).
+   * If shareSeq and the plan is an identity, batchValue_ uses the memory of
+   * seqValue and copyBackSeq() has nothing to do. This is only valid when
+   * batchValue_ is not read after seqValue is changed, e.g. in testing.
+   */
+  void resizeOrCreate(Matrix &seqValue, bool shareSeq = false);
+  /* copy seqValue to batchValue_, shareSeq is the same as resizeOrCreate */
+  void copyFromSeq(Matrix &seqValue, bool shareSeq = false);
   /* copy batchValue_ to seqValue */
   void copyBackSeq(Matrix &seqValue);
   MatrixPtr getBatchValue(int batchId, int numRows = 0);
@@ -80,6 +100,7 @@ public:
     seq2BatchIdx_ = seq2batch.seq2BatchIdx_;
     cpuSeq2BatchIdx_ = seq2batch.cpuSeq2BatchIdx_;
     numBatch_ = seq2batch.numBatch_;
+    identity_ = seq2batch.identity_;
   }
 
 protected:
@@ -100,7 +121,9 @@ protected:
   IVectorPtr seqIdx_;
   IVectorPtr seqEndIdxInBatch_;
   size_t numBatch_;
+  bool identity_;
   bool useGpu_;
+  SyncThreadPool *pool_;
   MatrixPtr batchValue_;
 };
 
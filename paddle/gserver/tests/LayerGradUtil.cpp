@@ -281,15 +281,16 @@ void initBatchState(LayerPtr dataLayer,
                     LayerStatePtr state,
                     bool useGpu) {
   int sequenceNum = dataLayer->getOutput().getNumSequences();
-  MatrixPtr prevBatchOutput =
-      Matrix::create(sequenceNum, testLayer->getSize(), false, useGpu);
-  MatrixPtr prevBatchState =
-      Matrix::create(sequenceNum, testLayer->getSize(), false, useGpu);
-  prevBatchOutput->randomizeUniform();
-  prevBatchState->randomizeUniform();
+  // lstm keeps (output, state) per sequence, gru keeps only output
+  testLayer->resetState();
+  size_t numStates = testLayer->getState()->value.size();
   state->value.clear();
-  state->value.push_back(prevBatchOutput);
-  state->value.push_back(prevBatchState);
+  for (size_t i = 0; i < numStates; ++i) {
+    MatrixPtr prevBatchState =
+        Matrix::create(sequenceNum, testLayer->getSize(), false, useGpu);
+    prevBatchState->randomizeUniform();
+    state->value.push_back(prevBatchState);
+  }
 }
 
 void initDataLayer(TestConfig testConf,
@@ -31,6 +31,9 @@ P_DECLARE_int32(gpu_id);
 P_DECLARE_double(checkgrad_eps);
 P_DECLARE_bool(thread_local_rand_use_global_seed);
 P_DECLARE_bool(prev_batch_state);
+P_DECLARE_int32(seq_cost_num_threads);
+P_DECLARE_int32(hsigmoid_num_threads);
+P_DECLARE_int32(rnn_num_threads);
 
 TEST(Operator, dot_mul) {
   TestConfig config;
@@ -288,13 +291,17 @@ TEST(Layer, CRFLayer) {
   config.layerConfig.add_inputs();
 
   // Not support GPU now
-  testLayerGrad(config,
-                "crf",
-                100,
-                /* trans */ false,
-                /* useGpu */ false,
-                false /*useWeight*/,
-                0.03 /*epsilon*/);
+  for (auto numThreads : {1, 3}) {
+    FLAGS_seq_cost_num_threads = numThreads;
+    testLayerGrad(config,
+                  "crf",
+                  100,
+                  /* trans */ false,
+                  /* useGpu */ false,
+                  false /*useWeight*/,
+                  0.03 /*epsilon*/);
+  }
+  FLAGS_seq_cost_num_threads = 1;
 }
 
 TEST(Layer, CTCLayer) {
@@ -312,6 +319,57 @@ TEST(Layer, CTCLayer) {
   for (auto useGpu : {false, true}) {
     testLayerGrad(config, "ctc", 100, /* trans */ false, /* useGpu */ useGpu);
   }
+  FLAGS_seq_cost_num_threads = 3;
+  testLayerGrad(config, "ctc", 100, /* trans */ false, /* useGpu */ false);
+  FLAGS_seq_cost_num_threads = 1;
+}
+
+TEST(Layer, CRFDecodingLayer) {
+  TestConfig config;
+  config.layerConfig.set_type("crf_decoding");
+  config.layerConfig.set_size(10);
+  config.biasSize = 0;
+
+  config.inputDefs.push_back({INPUT_SEQUENCE_DATA, "layer_0", 10, 120});
+  config.inputDefs.push_back({INPUT_SEQUENCE_LABEL, "layer_1", 10, 0});
+  config.layerConfig.add_inputs();
+  config.layerConfig.add_inputs();
+
+  std::vector<DataLayerPtr> dataLayers;
+  LayerMap layerMap;
+  vector<Argument> datas;
+  initDataLayer(config,
+                &dataLayers,
+                &datas,
+                &layerMap,
+                "crf_decoding",
+                100,
+                /* trans */ false,
+                /* useGpu */ false);
+
+  // the decoding with several threads must be the same as with one
+  std::vector<ParameterPtr> parameters;
+  LayerPtr decodingLayer;
+  initTestLayer(config, &layerMap, &parameters, &decodingLayer);
+  decodingLayer->forward(PASS_TEST);
+  const Argument& expected = decodingLayer->getOutput();
+
+  FLAGS_seq_cost_num_threads = 3;
+  std::vector<ParameterPtr> threadParameters;
+  LayerPtr threadDecodingLayer;
+  initTestLayer(config, &layerMap, &threadParameters, &threadDecodingLayer);
+  threadParameters[0]->getBuf(PARAMETER_VALUE)->copyFrom(
+      *parameters[0]->getBuf(PARAMETER_VALUE));
+  threadDecodingLayer->forward(PASS_TEST);
+  const Argument& actual = threadDecodingLayer->getOutput();
+  FLAGS_seq_cost_num_threads = 1;
+
+  ASSERT_EQ(expected.ids->getSize(), actual.ids->getSize());
+  for (size_t i = 0; i < expected.ids->getSize(); ++i) {
+    EXPECT_EQ(expected.ids->getElement(i), actual.ids->getElement(i));
+    EXPECT_EQ(expected.value->getElement(i, 0),
+              actual.value->getElement(i, 0));
+  }
 }
 
 TEST(Layer, cosSimLayer) {
@@ -580,7 +638,12 @@ TEST(Layer, hsigmoidLayer) {
   config.layerConfig.add_inputs();
 
   // Not support GPU now
-  testLayerGrad(config, "hsigmoid", 100, /* trans */ false, /* useGpu */ false);
+  for (auto numThreads : {1, 3}) {
+    FLAGS_hsigmoid_num_threads = numThreads;
+    testLayerGrad(
+        config, "hsigmoid", 100, /* trans */ false, /* useGpu */ false);
+  }
+  FLAGS_hsigmoid_num_threads = 1;
 }
 
 TEST(Layer, multi_cross) {
@@ -1234,6 +1297,14 @@ TEST(Layer, LstmLayer) {
     config.layerConfig.set_reversed(false);
     testLayerGrad(config, "lstmemory", 10, /* trans= */ false, useGpu);
   }
+  config.testState = false;
+  config.testBatchState = false;
+  FLAGS_rnn_num_threads = 3;
+  for (auto reversed : {false, true}) {
+    config.layerConfig.set_reversed(reversed);
+    testLayerGrad(config, "lstmemory", 100, /* trans= */ false, false);
+  }
+  FLAGS_rnn_num_threads = 1;
 }
 
 TEST(Layer, MDLstmLayer) {
@@ -1339,15 +1410,19 @@ TEST(Layer, NCELayer) {
             config.layerConfig.set_neg_sampling_dist(i, p);
           }
         }
-        LOG(INFO) << "NCELayer "
-                  << " isIdLabel=" << isIdLabel << " withWeight=" << withWeight
-                  << " withDist=" << withDist;
-        // Not support GPU now
-        testLayerGrad(config,
-                      "nce",
-                      100,
-                      /* trans= */ false,
-                      /* useGpu */ false);
+        for (auto shareNeg : {false, true}) {
+          config.layerConfig.set_share_neg_samples(shareNeg);
+          LOG(INFO) << "NCELayer "
+                    << " isIdLabel=" << isIdLabel
+                    << " withWeight=" << withWeight << " withDist=" << withDist
+                    << " shareNeg=" << shareNeg;
+          // Not support GPU now
+          testLayerGrad(config,
+                        "nce",
+                        100,
+                        /* trans= */ false,
+                        /* useGpu */ false);
+        }
       }
     }
   }
@@ -1372,6 +1447,21 @@ TEST(Layer, GatedRecurrentLayer) {
       testLayerGrad(config, "gated_recurrent", 100, /* trans= */ false, useGpu);
     }
   }
+  // check the gradients of the weights, which step 0 gets from the random
+  // carried-in state, as well as the batch state itself
+  for (auto useGpu : {false, true}) {
+    config.testState = false;
+    config.testBatchState = true;
+    config.layerConfig.set_reversed(false);
+    testLayerGrad(config, "gated_recurrent", 10, /* trans= */ false, useGpu);
+  }
+  config.testBatchState = false;
+  FLAGS_rnn_num_threads = 3;
+  for (auto reversed : {false, true}) {
+    config.layerConfig.set_reversed(reversed);
+    testLayerGrad(config, "gated_recurrent", 100, /* trans= */ false, false);
+  }
+  FLAGS_rnn_num_threads = 1;
 }
 
 TEST(Layer, GruStepLayer) {
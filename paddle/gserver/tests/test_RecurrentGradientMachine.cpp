@@ -21,6 +21,7 @@ limitations under the License. */
 #include <paddle/gserver/gradientmachines/GradientMachine.h>
 
 P_DECLARE_int32(seed);
+P_DECLARE_int32(rnn_checkpoint_interval);
 
 using namespace paddle;  // NOLINT
 using namespace std;     // NOLINT
@@ -155,6 +156,37 @@ TEST(RecurrentGradientMachine, rnn_multi_unequalength_input) {
   }
 }
 
+// frames reused and computed again from checkpoints should give the same cost
+void testCheckpoint(const string& conf, int interval, double eps, bool useGpu) {
+  if (!paddle::version::isWithGpu() && useGpu) {
+    return;
+  }
+  FLAGS_use_gpu = useGpu;
+  int num_passes = 5;
+  std::vector<real> cost1(num_passes);
+  FLAGS_rnn_checkpoint_interval = 0;
+  CalCost(conf, "gserver/tests/t1", cost1.data(), num_passes);
+
+  std::vector<real> cost2(num_passes);
+  FLAGS_rnn_checkpoint_interval = interval;
+  CalCost(conf, "gserver/tests/t2", cost2.data(), num_passes);
+  FLAGS_rnn_checkpoint_interval = 0;
+
+  for (int i = 0; i < num_passes; i++) {
+    LOG(INFO) << "num_passes: " << i << ", cost1=" << cost1[i]
+              << ", cost2=" << cost2[i]
+              << ", diff=" << std::abs(cost1[i] - cost2[i]);
+    ASSERT_NEAR(cost1[i], cost2[i], eps);
+  }
+}
+
+TEST(RecurrentGradientMachine, checkpoint) {
+  for (bool useGpu : {false, true}) {
+    testCheckpoint("gserver/tests/sequence_rnn.conf", 2, 1e-6, useGpu);
+    testCheckpoint("gserver/tests/sequence_layer_group.conf", 3, 1e-5, useGpu);
+  }
+}
+
 int main(int argc, char** argv) {
   if (paddle::version::isWithPyDataProvider()) {
     if (!paddle::version::isWithGpu()) {
@@ -17,6 +17,7 @@ limitations under the License. */
 #include <paddle/utils/Version.h>
 #include "paddle/gserver/layers/DataLayer.h"
 #include "paddle/gserver/layers/Layer.h"
+#include "paddle/gserver/layers/SequenceToBatch.h"
 #include "ModelConfig.pb.h"
 
 #include "TestUtil.h"
@@ -420,6 +421,62 @@ TEST(Layer, LstmLayer) {
   }
 }
 
+void checkSequenceToBatch(const vector<int>& starts, bool reversed) {
+  size_t numSequences = starts.size() - 1;
+  int batchSize = starts.back();
+  int width = 3;
+  MatrixPtr seqValue = Matrix::create(batchSize, width, false, false);
+  seqValue->randomizeUniform();
+
+  SequenceToBatch seq2batch(/* useGpu= */ false);
+  seq2batch.resizeOrCreateBatch(
+      batchSize, numSequences, starts.data(), reversed);
+  seq2batch.copyFromSeq(*seqValue);
+
+  // reference: longest sequences first, frame n of each at batch n
+  vector<int> order(numSequences);
+  for (size_t i = 0; i < numSequences; ++i) order[i] = i;
+  stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return starts[a + 1] - starts[a] > starts[b + 1] - starts[b];
+  });
+  int batchRow = 0;
+  bool identity = true;
+  for (size_t n = 0; n < seq2batch.getNumBatch(); ++n) {
+    MatrixPtr batch = seq2batch.getBatchValue(n);
+    for (size_t i = 0; i < batch->getHeight(); ++i, ++batchRow) {
+      int seqId = order[i];
+      int length = starts[seqId + 1] - starts[seqId];
+      ASSERT_LT((int)n, length);
+      int seqRow = starts[seqId] + (reversed ? length - 1 - n : n);
+      identity = identity && seqRow == batchRow;
+      for (int j = 0; j < width; ++j) {
+        EXPECT_EQ(seqValue->getElement(seqRow, j), batch->getElement(i, j));
+      }
+    }
+  }
+  EXPECT_EQ(batchSize, batchRow);
+  EXPECT_EQ(identity, seq2batch.isIdentity());
+
+  MatrixPtr backValue = Matrix::create(batchSize, width, false, false);
+  seq2batch.copyBackSeq(*backValue);
+  checkError(*seqValue, *backValue);
+}
+
+TEST(SequenceToBatch, plan) {
+  vector<vector<int>> cases = {{0, 4, 9, 12},
+                               {0, 3, 6, 9},
+                               {0, 1, 2, 3, 4},
+                               {0, 7},
+                               {0, 2, 2, 5}};
+  for (auto reversed : {false, true}) {
+    for (auto& starts : cases) {
+      checkSequenceToBatch(starts, reversed);
+      // the second time the cached plan is used
+      checkSequenceToBatch(starts, reversed);
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   if (version::isWithGpu()) {
     testing::InitGoogleTest(&argc, argv);
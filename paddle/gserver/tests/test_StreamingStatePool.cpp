@@ -0,0 +1,207 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+#include "paddle/gserver/gradientmachines/StreamingStatePool.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+/**
+ * A machine with a stateless layer and a stateful layer. The state of a
+ * sequence is the running sum of all its frames, and it is also the output
+ * of the sequence. Like the recurrent layers with --prev_batch_state, the
+ * state has one row per sequence of the last forward.
+ */
+class SumStateMachine : public GradientMachine {
+public:
+  explicit SumStateMachine(size_t width) : width_(width), reset_(true) {}
+
+  virtual void forward(const std::vector<Argument>& inArgs,
+                       std::vector<Argument>* outArgs,
+                       PassType passType) {
+    const Argument& in = inArgs[0];
+    size_t numSequences = in.getNumSequences();
+    const int* starts = in.sequenceStartPositions->getData(false);
+    MatrixPtr sum = Matrix::create(numSequences, width_, false, false);
+    if (reset_) {
+      sum->zeroMem();
+    } else {
+      CHECK_EQ(state_->getHeight(), numSequences);
+      sum->copyFrom(*state_);
+    }
+    for (size_t i = 0; i < numSequences; ++i) {
+      for (int frame = starts[i]; frame < starts[i + 1]; ++frame) {
+        for (size_t j = 0; j < width_; ++j) {
+          sum->getRowBuf(i)[j] += in.value->getRowBuf(frame)[j];
+        }
+      }
+    }
+    state_ = sum;
+    reset_ = false;
+    outArgs->resize(1);
+    (*outArgs)[0].value = sum;
+  }
+
+  virtual void backward(const UpdateCallback& callback) {}
+  virtual void onPassEnd() {}
+  virtual Evaluator* makeEvaluator() { return nullptr; }
+  virtual void eval(Evaluator* evaluator) {}
+
+  virtual void resetState() { reset_ = true; }
+
+  virtual void setState(const MachineState& machineState) {
+    CHECK_EQ(machineState.size(), 2UL);
+    CHECK(!machineState[0]);
+    CHECK_EQ(machineState[1]->value.size(), 1UL);
+    const MatrixPtr& value = machineState[1]->value[0];
+    state_ = Matrix::create(value->getHeight(), width_, false, false);
+    state_->copyFrom(*value);
+    reset_ = false;
+  }
+
+  virtual void getState(MachineState& machineState) {
+    machineState.resize(2);
+    machineState[0] = nullptr;
+    machineState[1] = std::make_shared<LayerState>();
+    MatrixPtr value = Matrix::create(state_->getHeight(), width_, false, false);
+    value->copyFrom(*state_);
+    machineState[1]->value.push_back(value);
+  }
+
+private:
+  size_t width_;
+  bool reset_;
+  MatrixPtr state_;
+};
+
+class StreamingStatePoolTest : public ::testing::Test {
+protected:
+  StreamingStatePoolTest() : machine_(kWidth), pool_(&machine_) {}
+
+  virtual void SetUp() { FLAGS_prev_batch_state = true; }
+  virtual void TearDown() { FLAGS_prev_batch_state = false; }
+
+  /// Feed numFrames frames of value 1, 2, ... to each session, and check
+  /// the output against the expected running sums.
+  void feed(const std::vector<int64_t>& sessionIds, int numFrames) {
+    size_t numSequences = sessionIds.size();
+    Argument in;
+    in.value = Matrix::create(numSequences * numFrames, kWidth, false, false);
+    in.sequenceStartPositions =
+        ICpuGpuVector::create(numSequences + 1, /* useGpu= */ false);
+    int* starts = in.sequenceStartPositions->getMutableData(false);
+    for (size_t i = 0; i <= numSequences; ++i) {
+      starts[i] = i * numFrames;
+    }
+    for (size_t i = 0; i < numSequences; ++i) {
+      for (int frame = 0; frame < numFrames; ++frame) {
+        for (size_t j = 0; j < kWidth; ++j) {
+          // different in each column, so that rows are not mixed up
+          real value = (frame + 1) * (j + 1);
+          in.value->getRowBuf(starts[i] + frame)[j] = value;
+          sums_[sessionIds[i]].resize(kWidth);
+          sums_[sessionIds[i]][j] += value;
+        }
+      }
+    }
+
+    std::vector<Argument> outArgs;
+    pool_.forward(sessionIds, {in}, &outArgs);
+    ASSERT_EQ(outArgs.size(), 1UL);
+    for (size_t i = 0; i < numSequences; ++i) {
+      for (size_t j = 0; j < kWidth; ++j) {
+        EXPECT_EQ(sums_[sessionIds[i]][j], outArgs[0].value->getRowBuf(i)[j])
+            << "session " << sessionIds[i];
+      }
+    }
+  }
+
+  void endSession(int64_t sessionId) {
+    pool_.endSession(sessionId);
+    sums_.erase(sessionId);
+  }
+
+  static const size_t kWidth = 3;
+  SumStateMachine machine_;
+  StreamingStatePool pool_;
+  /// expected state of each session
+  std::map<int64_t, std::vector<real>> sums_;
+};
+
+TEST_F(StreamingStatePoolTest, gatherAndScatter) {
+  feed({7, 9}, 2);
+  feed({9}, 3);
+  feed({7}, 1);
+  // the order of the sessions in the batch does not matter
+  feed({9, 7}, 2);
+  EXPECT_EQ(2UL, pool_.getNumSessions());
+}
+
+TEST_F(StreamingStatePoolTest, newSessionsStartFromZero) {
+  feed({1}, 2);
+  // session 2 is new while 1 goes on
+  feed({2, 1}, 1);
+  feed({1, 2}, 3);
+}
+
+TEST_F(StreamingStatePoolTest, endSessionReusesSlot) {
+  feed({1, 2, 3}, 2);
+  endSession(2);
+  EXPECT_EQ(2UL, pool_.getNumSessions());
+  // unknown ids are ignored
+  pool_.endSession(100);
+  // session 4 takes the slot of 2, and must not see its state
+  feed({4}, 1);
+  feed({1, 3, 4}, 2);
+  EXPECT_EQ(3UL, pool_.getNumSessions());
+}
+
+TEST_F(StreamingStatePoolTest, reserveKeepsStates) {
+  feed({0, 1}, 1);
+  // grow the pool several times, the old states must survive
+  std::vector<int64_t> all = {0, 1};
+  for (int64_t id = 2; id < 40; ++id) {
+    all.push_back(id);
+    feed({id, 0}, 1);
+  }
+  feed(all, 2);
+  EXPECT_EQ(40UL, pool_.getNumSessions());
+}
+
+TEST_F(StreamingStatePoolTest, copySession) {
+  feed({5}, 3);
+  pool_.copySession(5, 6);
+  sums_[6] = sums_[5];
+  // both go on from the same state independently
+  feed({6}, 1);
+  feed({5, 6}, 2);
+  EXPECT_EQ(2UL, pool_.getNumSessions());
+}
+
+TEST_F(StreamingStatePoolTest, clear) {
+  feed({1, 2}, 2);
+  pool_.clear();
+  sums_.clear();
+  EXPECT_EQ(0UL, pool_.getNumSessions());
+  feed({2, 3}, 1);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -18,6 +18,7 @@ limitations under the License. */
 #include <stdlib.h>
 #include "hl_gpu.h"
 #include "paddle/utils/Logging.h"
+#include "paddle/utils/Numa.h"
 
 namespace paddle {
 
@@ -66,6 +67,46 @@ public:
   virtual std::string getName() { return "cpu_alloc"; }
 };
 
+/**
+ * @brief CPU allocator placing the memory on one NUMA node.
+ */
+class NumaCpuAllocator : public CpuAllocator {
+public:
+  explicit NumaCpuAllocator(int node) : node_(node) {}
+  ~NumaCpuAllocator() {}
+
+  /**
+   * @brief Aligned allocation on the node.
+   * @param size Size to be allocated.
+   * @return Pointer to the allocated memory
+   * @note Blocks of at least one page are rounded up to whole pages and
+   * bound to the node, so that they do not share a page with memory of
+   * another node. Smaller blocks are placed by the first touch, which is
+   * done by the threads of the node.
+   */
+  virtual void* alloc(size_t size) {
+    bool bind = size >= kPageSize;
+    if (bind) {
+      size = (size + kPageSize - 1) / kPageSize * kPageSize;
+    }
+    void* ptr;
+    CHECK_EQ(posix_memalign(&ptr, bind ? kPageSize : 32ul, size), 0);
+    CHECK(ptr) << "Fail to allocate CPU memory: size=" << size;
+    if (bind) {
+      numa::bindMemory(ptr, size, node_);
+    }
+    return ptr;
+  }
+
+  virtual std::string getName() {
+    return "cpu_node" + std::to_string(node_) + "_alloc";
+  }
+
+private:
+  static const size_t kPageSize = 4096;
+  int node_;
+};
+
 /**
  * @brief GPU allocator implementation.
  */
@@ -0,0 +1,37 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "Bfloat16.h"
+
+namespace paddle {
+
+void convertToBf16(const real* src, bfloat16* dst, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    dst[i] = floatToBf16(src[i]);
+  }
+}
+
+void convertFromBf16(const bfloat16* src, real* dst, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    dst[i] = bf16ToFloat(src[i]);
+  }
+}
+
+void roundToBf16(real* data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    data[i] = bf16ToFloat(floatToBf16(data[i]));
+  }
+}
+
+}  // namespace paddle
@@ -0,0 +1,65 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "paddle/utils/TypeDefs.h"
+
+namespace paddle {
+
+/**
+ * bfloat16: the upper 16 bits of an IEEE float, 1 sign bit, 8 exponent bits
+ * and 7 mantissa bits. It has the range of float with about 3 significant
+ * decimal digits, so converting from float keeps the range and only loses
+ * precision.
+ */
+typedef uint16_t bfloat16;
+
+/// float -> bfloat16, rounding to nearest even. NaN stays a quiet NaN.
+inline bfloat16 floatToBf16(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return static_cast<bfloat16>((bits >> 16) | 0x40);
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<bfloat16>(bits >> 16);
+}
+
+/// bfloat16 -> float, exact.
+inline float bf16ToFloat(bfloat16 value) {
+  uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+/// dst[i] = floatToBf16(src[i]), i in [0, len)
+void convertToBf16(const real* src, bfloat16* dst, size_t len);
+
+/// dst[i] = bf16ToFloat(src[i]), i in [0, len)
+void convertFromBf16(const bfloat16* src, real* dst, size_t len);
+
+/**
+ * Round data to the precision of bfloat16 in place, i.e. data[i] becomes
+ * bf16ToFloat(floatToBf16(data[i])). Used by --bf16_activations to train
+ * with the numerics of bf16 activations while they are still stored as real.
+ */
+void roundToBf16(real* data, size_t len);
+
+}  // namespace paddle
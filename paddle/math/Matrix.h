@@ -494,15 +494,18 @@ public:
    *   this(i, j) += <mat.row(index(i, j)), input.row(i)>
    * where index is same as the index for addByBitCode
    * @endcode
+   * If pool is not null, the work is divided among its threads.
    */
   virtual void mulByBitCode(size_t numClasses,
                             const IVector& codes,
                             const Matrix& mat,
-                            const Matrix& input) {
+                            const Matrix& input,
+                            SyncThreadPool* pool = nullptr) {
     (void)numClasses;
     (void)codes;
     (void)mat;
     (void)input;
+    (void)pool;
     LOG(FATAL) << "Not implemeted";
   }
 
@@ -512,15 +515,18 @@ public:
    *   mat.row(index(i, j)) += this(i, j) * input.row(i)
    * where index is same as the index for addByBitCode
    * @endcode
+   * If pool is not null, the work is divided among its threads.
    */
   virtual void mulByBitCodeBackwardWeight(size_t numClasses,
                                           const IVector& codes,
                                           Matrix& mat,
-                                          const Matrix& input) {
+                                          const Matrix& input,
+                                          SyncThreadPool* pool = nullptr) {
     (void)numClasses;
     (void)codes;
     (void)mat;
     (void)input;
+    (void)pool;
     LOG(FATAL) << "Not implemeted";
   }
 
@@ -530,15 +536,18 @@ public:
    *   input.row(i) += this(i, j) * mat.row(index(i, j))
    * where index is same as the index for addByBitCode
    * @endcode
+   * If pool is not null, the work is divided among its threads.
    */
   virtual void mulByBitCodeBackwardError(size_t numClasses,
                                          const IVector& codes,
                                          const Matrix& mat,
-                                         Matrix& input) {
+                                         Matrix& input,
+                                         SyncThreadPool* pool = nullptr) {
     (void)numClasses;
     (void)codes;
     (void)mat;
     (void)input;
+    (void)pool;
     LOG(FATAL) << "Not implemeted";
   }
 
@@ -1877,17 +1886,20 @@ public:
   void mulByBitCode(size_t numClasses,
                     const IVector& codes,
                     const Matrix& mat,
-                    const Matrix& input);
+                    const Matrix& input,
+                    SyncThreadPool* pool = nullptr);
 
   void mulByBitCodeBackwardWeight(size_t numClasses,
                                   const IVector& codes,
                                   Matrix& mat,
-                                  const Matrix& input);
+                                  const Matrix& input,
+                                  SyncThreadPool* pool = nullptr);
 
   void mulByBitCodeBackwardError(size_t numClasses,
                                  const IVector& codes,
                                  const Matrix& mat,
-                                 Matrix& input);
+                                 Matrix& input,
+                                 SyncThreadPool* pool = nullptr);
 
   void sumByBitCode(size_t numClasses,
                     IVector& codes,
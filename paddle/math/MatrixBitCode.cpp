@@ -12,9 +12,12 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
 
+#include <algorithm>
+#include <vector>
 #include "paddle/utils/Logging.h"
 #include "paddle/utils/Util.h"
 #include "Matrix.h"
+#include "MathFunctions.h"
 #include "hl_gpu.h"
 
 namespace paddle {
@@ -125,46 +128,105 @@ void CpuMatrix::addByBitCodeBackward(size_t numClasses,
   addByBitCodeT(op, SimpleCodeTable(numClasses), codes, *this, vec);
 }
 
-/*
-  for i:
-    for j < codeLength:
-      op(tmat(i, j), mat.row(index(i, j)), input.row(i))
-*/
-template <class Op,
-          class CodeTable,
-          class IVec,
-          class TMat,
-          class WMat,
-          class InMat>
-void mulByBitCodeT(Op op,
-                   CodeTable codeTable,
-                   IVec& codes,
-                   TMat& tmat,
-                   WMat& weight,
-                   InMat& input) {
-  CHECK(!tmat.useGpu() && !weight.useGpu() && !input.useGpu());
+/**
+ * The (sample, bit) pairs of a batch grouped by the node index(i, j) they
+ * visit, so that the samples sharing a node use its weight row together.
+ * The pairs of node k are [starts[k], starts[k + 1]).
+ */
+struct NodeGroups {
+  std::vector<int> starts;
+  std::vector<int> samples;
+  std::vector<int> bits;
+
+  /// the first node of the range of tid, the nodes are divided so that each
+  /// range has about the same number of pairs
+  size_t rangeBegin(size_t tid, size_t numThreads) const {
+    size_t numPairs = samples.size();
+    size_t target = numPairs * tid / numThreads;
+    return std::lower_bound(starts.begin(), starts.end(), (int)target) -
+           starts.begin();
+  }
+};
 
-  size_t numClasses = codeTable.size();
-  size_t maxCodeLength = codeTable.getMaxCodeLength();
+template <class CodeTable>
+static void groupByNode(CodeTable codeTable,
+                        const IVector& codes,
+                        NodeGroups& groups) {
+  size_t numNodes = codeTable.size() - 1;
+  size_t numSamples = codes.getSize();
+  const int* c = codes.getData();
+  groups.starts.assign(numNodes + 1, 0);
+  for (size_t i = 0; i < numSamples; ++i) {
+    auto code = codeTable(c[i]);
+    for (int j = 0; j < code.getLength(); ++j) {
+      ++groups.starts[code.calcIndex(j) + 1];
+    }
+  }
+  for (size_t k = 0; k < numNodes; ++k) {
+    groups.starts[k + 1] += groups.starts[k];
+  }
+  groups.samples.resize(groups.starts[numNodes]);
+  groups.bits.resize(groups.starts[numNodes]);
+  std::vector<int> pos(groups.starts.begin(), groups.starts.end() - 1);
+  for (size_t i = 0; i < numSamples; ++i) {
+    auto code = codeTable(c[i]);
+    for (int j = 0; j < code.getLength(); ++j) {
+      int p = pos[code.calcIndex(j)]++;
+      groups.samples[p] = i;
+      groups.bits[p] = j;
+    }
+  }
+}
+
+template <class CodeTable, class TMat, class WMat, class InMat>
+static void checkBitCodeMul(CodeTable codeTable,
+                            const IVector& codes,
+                            TMat& tmat,
+                            WMat& weight,
+                            InMat& input) {
+  CHECK(!tmat.useGpu() && !weight.useGpu() && !input.useGpu());
   size_t numSamples = tmat.getHeight();
-  size_t inputDim = input.getWidth();
-  size_t oWidth = tmat.getWidth();
-  CHECK_EQ(tmat.getWidth(), maxCodeLength);
+  CHECK_EQ(tmat.getWidth(), (size_t)codeTable.getMaxCodeLength());
   CHECK_EQ(codes.getSize(), numSamples);
   CHECK_EQ(input.getHeight(), numSamples);
-  CHECK_EQ(weight.getHeight(), numClasses - 1);
-  CHECK_EQ(weight.getWidth(), inputDim);
+  CHECK_EQ(weight.getHeight(), codeTable.size() - 1);
+  CHECK_EQ(weight.getWidth(), input.getWidth());
+}
+
+/*
+  for each node k in the range of the thread:
+    for (i, j) visiting node k:
+      op(tmat(i, j), mat.row(k), input.row(i))
+*/
+template <class Op, class CodeTable, class TMat, class WMat, class InMat>
+static void mulByNodeT(Op op,
+                       CodeTable codeTable,
+                       const IVector& codes,
+                       TMat& tmat,
+                       WMat& weight,
+                       InMat& input,
+                       SyncThreadPool* pool) {
+  checkBitCodeMul(codeTable, codes, tmat, weight, input);
+  NodeGroups groups;
+  groupByNode(codeTable, codes, groups);
 
+  size_t inputDim = input.getWidth();
+  size_t oWidth = tmat.getWidth();
   real* data = tmat.getData();
-  const int* c = codes.getData();
-  for (size_t i = 0; i < numSamples; ++i) {
-    auto code = codeTable(c[i]);
-    int codeLength = code.getLength();
-    for (int j = 0; j < codeLength; ++j) {
-      size_t index = code.calcIndex(j);
-      op(data[i * oWidth + j], weight.rowBuf(index), input.rowBuf(i), inputDim);
+  SyncThreadPool::execHelper(pool, [&](int tid, size_t numThreads) {
+    size_t begin = groups.rangeBegin(tid, numThreads);
+    size_t end = groups.rangeBegin(tid + 1, numThreads);
+    for (size_t k = begin; k < end; ++k) {
+      auto weightRow = weight.rowBuf(k);
+      for (int p = groups.starts[k]; p < groups.starts[k + 1]; ++p) {
+        int i = groups.samples[p];
+        op(data[i * oWidth + groups.bits[p]],
+           weightRow,
+           input.rowBuf(i),
+           inputDim);
+      }
     }
-  }
+  });
 }
 
 /* For j < codeLength:
@@ -173,51 +235,66 @@ void mulByBitCodeT(Op op,
 void CpuMatrix::mulByBitCode(size_t numClasses,
                              const IVector& codes,
                              const Matrix& weight,
-                             const Matrix& input) {
+                             const Matrix& input,
+                             SyncThreadPool* pool) {
   auto op = [](
       real& t, const real* weightRow, const real* inputRow, size_t inputDim) {
-    real sum = 0;
-    for (size_t k = 0; k < inputDim; ++k) {
-      sum += weightRow[k] * inputRow[k];
-    }
-    t += sum;
+    t += dotProduct<real>(inputDim, weightRow, inputRow);
   };
 
-  mulByBitCodeT(op, SimpleCodeTable(numClasses), codes, *this, weight, input);
+  mulByNodeT(
+      op, SimpleCodeTable(numClasses), codes, *this, weight, input, pool);
 }
 
 /* For index(i, j) >= 0:
    weight.row(index(i, j)) += this(i, j) * input.row(i)
+   Each thread accumulates the rows of its own range of nodes.
 */
 void CpuMatrix::mulByBitCodeBackwardWeight(size_t numClasses,
                                            const IVector& codes,
                                            Matrix& weight,
-                                           const Matrix& input) {
+                                           const Matrix& input,
+                                           SyncThreadPool* pool) {
   auto op = [](
       const real t, real* weightRow, const real* inputRow, size_t inputDim) {
-    for (size_t k = 0; k < inputDim; ++k) {
-      weightRow[k] += t * inputRow[k];
-    }
+    axpy<real>(inputDim, t, inputRow, weightRow);
   };
 
-  mulByBitCodeT(op, SimpleCodeTable(numClasses), codes, *this, weight, input);
+  mulByNodeT(
+      op, SimpleCodeTable(numClasses), codes, *this, weight, input, pool);
 }
 
 /* For j < codeLength:
    input.row(i) += this(i, j) * weight.row(index(i, j))
+   Each thread accumulates the rows of its own range of samples.
 */
 void CpuMatrix::mulByBitCodeBackwardError(size_t numClasses,
                                           const IVector& codes,
                                           const Matrix& weight,
-                                          Matrix& input) {
-  auto op = [](
-      const real t, const real* weightRow, real* inputRow, size_t inputDim) {
-    for (size_t k = 0; k < inputDim; ++k) {
-      inputRow[k] += t * weightRow[k];
-    }
-  };
+                                          Matrix& input,
+                                          SyncThreadPool* pool) {
+  SimpleCodeTable codeTable(numClasses);
+  checkBitCodeMul(codeTable, codes, *this, weight, input);
 
-  mulByBitCodeT(op, SimpleCodeTable(numClasses), codes, *this, weight, input);
+  size_t numSamples = getHeight();
+  size_t inputDim = input.getWidth();
+  size_t oWidth = getWidth();
+  const real* data = getData();
+  const int* c = codes.getData();
+  SyncThreadPool::execHelper(pool, [&](int tid, size_t numThreads) {
+    size_t begin = numSamples * tid / numThreads;
+    size_t end = numSamples * (tid + 1) / numThreads;
+    for (size_t i = begin; i < end; ++i) {
+      auto code = codeTable(c[i]);
+      real* inputRow = input.rowBuf(i);
+      for (int j = 0; j < code.getLength(); ++j) {
+        axpy<real>(inputDim,
+                   data[i * oWidth + j],
+                   weight.rowBuf(code.calcIndex(j)),
+                   inputRow);
+      }
+    }
+  });
 }
 
 template <class CodeTable>
@@ -37,6 +37,9 @@ StorageEngine::~StorageEngine() {
   for (auto it : gpuAllocator_) {
     delete it;
   }
+  for (auto it : cpuNodeAllocators_) {
+    delete it;
+  }
 }
 
 StorageEngine* StorageEngine::singleton() {
@@ -71,6 +74,13 @@ PoolAllocator* StorageEngine::getGpuAllocator(int deviceId) {
 }
 
 PoolAllocator* StorageEngine::getCpuAllocator() {
+  if (FLAGS_numa_bind && !FLAGS_use_gpu) {
+    int node = numa::getThreadNode();
+    if (node >= 0) {
+      return getCpuNodeAllocator(node);
+    }
+  }
+
   {
     // if cpuAllocator_ has been constructed
     ReadLockGuard guard(lock_);
@@ -95,4 +105,29 @@ PoolAllocator* StorageEngine::getCpuAllocator() {
   }
 }
 
+PoolAllocator* StorageEngine::getCpuNodeAllocator(int node) {
+  {
+    // if cpuNodeAllocators_[node] has been constructed
+    ReadLockGuard guard(lock_);
+    if (node < static_cast<int>(cpuNodeAllocators_.size()) &&
+        cpuNodeAllocators_[node] != nullptr) {
+      return cpuNodeAllocators_[node];
+    }
+  }
+
+  {
+    // Construct cpuNodeAllocators_[node]
+    std::lock_guard<RWLock> guard(lock_);
+    if (node >= static_cast<int>(cpuNodeAllocators_.size())) {
+      cpuNodeAllocators_.resize(node + 1);
+    }
+    if (cpuNodeAllocators_[node] == nullptr) {
+      std::string name = "cpu_node" + std::to_string(node) + "_pool";
+      cpuNodeAllocators_[node] = new PoolAllocator(
+          new NumaCpuAllocator(node), FLAGS_pool_limit_size, name);
+    }
+    return cpuNodeAllocators_[node];
+  }
+}
+
 }  // namespace paddle
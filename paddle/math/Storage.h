@@ -37,16 +37,23 @@ public:
   PoolAllocator* getGpuAllocator(int deviceId);
 
   /**
-   * @return return cpu allocator
+   * @return return cpu allocator. With --numa_bind, it is the allocator of
+   * the node of the calling thread if the thread has one.
    */
   PoolAllocator* getCpuAllocator();
 
+  /**
+   * @return return the cpu allocator of a NUMA node
+   */
+  PoolAllocator* getCpuNodeAllocator(int node);
+
 protected:
   StorageEngine();
   ~StorageEngine();
   RWLock lock_;
   std::vector<PoolAllocator*> gpuAllocator_;
   PoolAllocator* cpuAllocator_;
+  std::vector<PoolAllocator*> cpuNodeAllocators_;
 };
 
 }  // namespace paddle
@@ -0,0 +1,70 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "paddle/math/Bfloat16.h"
+
+using namespace paddle;  // NOLINT
+
+TEST(Bfloat16, exactValues) {
+  for (float value : {0.0f, -0.0f, 1.0f, -2.5f, 0.15625f, 65536.0f}) {
+    EXPECT_EQ(value, bf16ToFloat(floatToBf16(value)));
+  }
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(inf, bf16ToFloat(floatToBf16(inf)));
+  EXPECT_EQ(-inf, bf16ToFloat(floatToBf16(-inf)));
+  EXPECT_TRUE(std::isnan(
+      bf16ToFloat(floatToBf16(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+TEST(Bfloat16, roundToNearestEven) {
+  // 8 significant bits: the spacing of the values in [1, 2) is 2^-7
+  const float ulp = std::ldexp(1.0f, -7);
+  EXPECT_EQ(1.0f, bf16ToFloat(floatToBf16(1.0f + ulp / 4)));
+  EXPECT_EQ(1.0f + ulp, bf16ToFloat(floatToBf16(1.0f + ulp * 3 / 4)));
+  // ties go to the even mantissa
+  EXPECT_EQ(1.0f, bf16ToFloat(floatToBf16(1.0f + ulp / 2)));
+  EXPECT_EQ(1.0f + 2 * ulp, bf16ToFloat(floatToBf16(1.0f + ulp * 3 / 2)));
+  // the largest floats round to infinity
+  EXPECT_TRUE(std::isinf(
+      bf16ToFloat(floatToBf16(std::numeric_limits<float>::max()))));
+}
+
+TEST(Bfloat16, arrays) {
+  const size_t len = 1000;
+  std::vector<real> data(len);
+  for (size_t i = 0; i < len; ++i) {
+    data[i] = std::sin(i) * std::exp(i % 50 - 25.0);
+  }
+  std::vector<bfloat16> half(len);
+  convertToBf16(data.data(), half.data(), len);
+  std::vector<real> restored(len);
+  convertFromBf16(half.data(), restored.data(), len);
+  std::vector<real> rounded = data;
+  roundToBf16(rounded.data(), len);
+  for (size_t i = 0; i < len; ++i) {
+    EXPECT_EQ(restored[i], rounded[i]);
+    // relative error at most half the spacing of the values, 2^-8
+    EXPECT_LE(std::abs(rounded[i] - data[i]),
+              std::ldexp(std::abs(data[i]), -8));
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
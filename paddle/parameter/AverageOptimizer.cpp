@@ -175,6 +175,29 @@ void AverageSparseOptimizer::update(const VectorPtr vecs[],
   }
 }
 
+void AverageSparseOptimizer::updateRows(const SparseRows& rows,
+                                        const ParameterConfig& config) const {
+  for (size_t begin = 0; begin < rows.numRows; begin += kRowBlockSize) {
+    SparseRows block =
+        rows.slice(begin, std::min(begin + kRowBlockSize, rows.numRows));
+    optimizer_->updateRows(block, config);
+    // catch up the sum of the rows while they are still in cache
+    for (size_t i = 0; i < block.numRows; ++i) {
+      uint32_t id = block.ids[i];
+      CHECK_LT(id, t0Vec_.size());
+      int timediff = timer_ + 1 - t0Vec_[id];
+      if (timediff > 0) {
+        const real* value = block.getRow(PARAMETER_VALUE, i);
+        real* sum = block.getRow(PARAMETER_SUM1, i);
+        for (size_t j = 0; j < block.width; ++j) {
+          sum[j] += timediff * value[j];
+        }
+        t0Vec_[id] = timer_ + 1;
+      }
+    }
+  }
+}
+
 ParameterOptimizer::TraverseCallback AverageSparseOptimizer::startCatchUpWith()
     const {
   TraverseCallbackVec callbacks;
@@ -119,6 +119,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& paraConfig,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
   void catchUpWith(const VectorPtr vecs[],
                    const ParameterConfig& paraConfig,
                    size_t sparseId) const;
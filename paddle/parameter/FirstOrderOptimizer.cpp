@@ -16,13 +16,31 @@ limitations under the License. */
 #include "paddle/utils/Flags.h"
 
 #include "FirstOrderOptimizer.h"
+#include "ParameterUpdateFunctions.h"
 
+#include <algorithm>
 #include <cmath>
 
 P_DEFINE_bool(log_clipping, false, "enable log clipping or not");
 
 namespace paddle {
 
+void SgdOptimizer::updateRows(const SparseRows& rows,
+                              const ParameterConfig& config) const {
+  real learningRate = getSgdLearningRate(config);
+  real decayRate = applyDecay_ ? config.decay_rate() : 0;
+  for (size_t i = 0; i < rows.numRows; ++i) {
+    sgdUpdateCpu(learningRate,
+                 config.momentum(),
+                 decayRate,
+                 rows.width,
+                 rows.getRow(PARAMETER_VALUE, i),
+                 rows.getGrad(i),
+                 rows.getRow(PARAMETER_MOMENTUM, i));
+    rows.clearGrad(i);
+  }
+}
+
 SparseMomentumParameterOptimizer::SparseMomentumParameterOptimizer(
     const OptimizationConfig& optConfig)
     : ParameterOptimizer(optConfig) {
@@ -82,6 +100,34 @@ void SparseMomentumParameterOptimizer::update(const VectorPtr vecs[],
   }
 }
 
+void SparseMomentumParameterOptimizer::updateRows(
+    const SparseRows& rows, const ParameterConfig& config) const {
+  real uCoeff = -alpha_ * gamma_ * learningRate_;
+  real vCoeff = tau_ * alpha_ * gamma_ * learningRate_;
+  real uScale = tau_ / beta_ + 1.0 / alpha_;
+  real vScale = 1.0 / beta_;
+  for (size_t i = 0; i < rows.numRows; ++i) {
+    uint32_t id = rows.ids[i];
+    CHECK_LT(id, t0Vec_.size());
+    real* value = rows.getRow(PARAMETER_VALUE, i);
+    real* vt = rows.getRow(PARAMETER_MOMENTUM_VT, i);
+    if (t0Vec_[id] == 0) {
+      memcpy(vt, value, rows.width * sizeof(real));
+      t0Vec_[id] = 1;
+    }
+    sparseMomentumUpdateCpu(uCoeff,
+                            vCoeff,
+                            uScale,
+                            vScale,
+                            rows.width,
+                            value,
+                            rows.getGrad(i),
+                            rows.getRow(PARAMETER_MOMENTUM_UT, i),
+                            vt);
+    rows.clearGrad(i);
+  }
+}
+
 ParameterOptimizer::TraverseCallback
 SparseMomentumParameterOptimizer::needSpecialTraversal(
     const ParameterConfig& config) const {
@@ -115,6 +161,21 @@ void SparseMomentumParameterOptimizer::finishBatch() {
 void AdagradParameterOptimizer::update(const VectorPtr vecs[],
                                        const ParameterConfig& config,
                                        size_t sparseId) const {
+  if (!vecs[PARAMETER_VALUE]->useGpu()) {
+    adagradUpdateCpu(learningRate_ * config.learning_rate(),
+                     config.momentum(),
+                     applyDecay_ ? config.decay_rate() : 0,
+                     optConfig_.ada_epsilon(),
+                     vecs[PARAMETER_VALUE]->getSize(),
+                     vecs[PARAMETER_VALUE]->getData(),
+                     vecs[PARAMETER_GRADIENT]->getData(),
+                     vecs[PARAMETER_MOMENTUM]->getData(),
+                     vecs[PARAMETER_GRADIENT_SQURESUM]->getData(),
+                     vecs[PARAMETER_GRADIENT_SQURESUM1]->getData(),
+                     vecs[PARAMETER_LEARNING_RATE]->getData());
+    return;
+  }
+
   vecs[PARAMETER_GRADIENT_SQURESUM1]->addSquare(*vecs[PARAMETER_GRADIENT],
                                                 1.0f);
   vecs[PARAMETER_LEARNING_RATE]->add(*vecs[PARAMETER_GRADIENT_SQURESUM],
@@ -130,6 +191,26 @@ void AdagradParameterOptimizer::update(const VectorPtr vecs[],
                                    applyDecay_ ? config.decay_rate() : 0);
 }
 
+void AdagradParameterOptimizer::updateRows(
+    const SparseRows& rows, const ParameterConfig& config) const {
+  real learningRate = learningRate_ * config.learning_rate();
+  real decayRate = applyDecay_ ? config.decay_rate() : 0;
+  for (size_t i = 0; i < rows.numRows; ++i) {
+    adagradUpdateCpu(learningRate,
+                     config.momentum(),
+                     decayRate,
+                     optConfig_.ada_epsilon(),
+                     rows.width,
+                     rows.getRow(PARAMETER_VALUE, i),
+                     rows.getGrad(i),
+                     rows.getRow(PARAMETER_MOMENTUM, i),
+                     rows.getRow(PARAMETER_GRADIENT_SQURESUM, i),
+                     rows.getRow(PARAMETER_GRADIENT_SQURESUM1, i),
+                     rows.getRow(PARAMETER_LEARNING_RATE, i));
+    rows.clearGrad(i);
+  }
+}
+
 ParameterOptimizer::TraverseCallback
 AdagradParameterOptimizer::needSpecialTraversal(
     const ParameterConfig& config) const {
@@ -191,6 +272,24 @@ void RMSPropParameterOptimizer::update(const VectorPtr vecs[],
     t0Vec_[sparseId] = timer_ + 1;
   }
 
+  if (!vecs[PARAMETER_VALUE]->useGpu()) {
+    rmspropUpdateCpu(learningRate_ * config.learning_rate(),
+                     config.momentum(),
+                     applyDecay_ ? config.decay_rate() : 0,
+                     optConfig_.ada_epsilon(),
+                     accumulatedRou,
+                     firstTime ? 1.0f : 1.0f - rou_,
+                     1.0f - rou_,
+                     vecs[PARAMETER_VALUE]->getSize(),
+                     vecs[PARAMETER_VALUE]->getData(),
+                     vecs[PARAMETER_GRADIENT]->getData(),
+                     vecs[PARAMETER_MOMENTUM]->getData(),
+                     vecs[PARAMETER_GRADIENT_SQURESUM]->getData(),
+                     vecs[PARAMETER_GRADIENT_SQURESUM1]->getData(),
+                     vecs[PARAMETER_LEARNING_RATE]->getData());
+    return;
+  }
+
   // E(g_t^2) = \rou * E(g_{t-1}^2) + (1-\rou) * g^2
   // For the first time update, make the sum be the current square
   // so that the initial estimation of E(g_t^2) will not be too small.
@@ -220,6 +319,34 @@ void RMSPropParameterOptimizer::update(const VectorPtr vecs[],
                                    applyDecay_ ? config.decay_rate() : 0);
 }
 
+void RMSPropParameterOptimizer::updateRows(
+    const SparseRows& rows, const ParameterConfig& config) const {
+  real learningRate = learningRate_ * config.learning_rate();
+  real decayRate = applyDecay_ ? config.decay_rate() : 0;
+  for (size_t i = 0; i < rows.numRows; ++i) {
+    uint32_t id = rows.ids[i];
+    CHECK_LT(id, t0Vec_.size());
+    real accumulatedRou = std::pow(rou_, timer_ + 1 - t0Vec_[id]);
+    bool firstTime = t0Vec_[id] == 0;
+    t0Vec_[id] = timer_ + 1;
+    rmspropUpdateCpu(learningRate,
+                     config.momentum(),
+                     decayRate,
+                     optConfig_.ada_epsilon(),
+                     accumulatedRou,
+                     firstTime ? 1.0f : 1.0f - rou_,
+                     1.0f - rou_,
+                     rows.width,
+                     rows.getRow(PARAMETER_VALUE, i),
+                     rows.getGrad(i),
+                     rows.getRow(PARAMETER_MOMENTUM, i),
+                     rows.getRow(PARAMETER_GRADIENT_SQURESUM, i),
+                     rows.getRow(PARAMETER_GRADIENT_SQURESUM1, i),
+                     rows.getRow(PARAMETER_LEARNING_RATE, i));
+    rows.clearGrad(i);
+  }
+}
+
 void DecayedAdagradParameterOptimizer::update(const VectorPtr vecs[],
                                               const ParameterConfig& config,
                                               size_t sparseId) const {
@@ -233,6 +360,22 @@ void DecayedAdagradParameterOptimizer::update(const VectorPtr vecs[],
     t0Vec_[sparseId] = timer_ + 1;
   }
 
+  if (!vecs[PARAMETER_VALUE]->useGpu()) {
+    decayedAdagradUpdateCpu(learningRate_ * config.learning_rate(),
+                            config.momentum(),
+                            applyDecay_ ? config.decay_rate() : 0,
+                            optConfig_.ada_epsilon(),
+                            accumulatedRou,
+                            firstTime ? 1.0f : 1.0f - rou_,
+                            vecs[PARAMETER_VALUE]->getSize(),
+                            vecs[PARAMETER_VALUE]->getData(),
+                            vecs[PARAMETER_GRADIENT]->getData(),
+                            vecs[PARAMETER_MOMENTUM]->getData(),
+                            vecs[PARAMETER_GRADIENT_SQURESUM]->getData(),
+                            vecs[PARAMETER_LEARNING_RATE]->getData());
+    return;
+  }
+
   // E(g_t^2) = \rou * E(g_{t-1}^2) + (1-\rou) * g^2
   // For the first time update, make the sum be the current square
   // so that the initial estimation of E(g_t^2) will not be too small.
@@ -256,6 +399,32 @@ void DecayedAdagradParameterOptimizer::update(const VectorPtr vecs[],
                                    applyDecay_ ? config.decay_rate() : 0);
 }
 
+void DecayedAdagradParameterOptimizer::updateRows(
+    const SparseRows& rows, const ParameterConfig& config) const {
+  real learningRate = learningRate_ * config.learning_rate();
+  real decayRate = applyDecay_ ? config.decay_rate() : 0;
+  for (size_t i = 0; i < rows.numRows; ++i) {
+    uint32_t id = rows.ids[i];
+    CHECK_LT(id, t0Vec_.size());
+    real accumulatedRou = std::pow(rou_, timer_ + 1 - t0Vec_[id]);
+    bool firstTime = t0Vec_[id] == 0;
+    t0Vec_[id] = timer_ + 1;
+    decayedAdagradUpdateCpu(learningRate,
+                            config.momentum(),
+                            decayRate,
+                            optConfig_.ada_epsilon(),
+                            accumulatedRou,
+                            firstTime ? 1.0f : 1.0f - rou_,
+                            rows.width,
+                            rows.getRow(PARAMETER_VALUE, i),
+                            rows.getGrad(i),
+                            rows.getRow(PARAMETER_MOMENTUM, i),
+                            rows.getRow(PARAMETER_GRADIENT_SQURESUM, i),
+                            rows.getRow(PARAMETER_LEARNING_RATE, i));
+    rows.clearGrad(i);
+  }
+}
+
 void AdamParameterOptimizer::update(const VectorPtr vecs[],
                                     const ParameterConfig& config,
                                     size_t sparseId) const {
@@ -264,6 +433,22 @@ void AdamParameterOptimizer::update(const VectorPtr vecs[],
   Vector* g = vecs[PARAMETER_GRADIENT].get();
   Vector* v = vecs[PARAMETER_SECOND_MOMENTUM].get();
   Vector* theta = vecs[PARAMETER_VALUE].get();
+  real alpha = config.learning_rate() * learningRate_;
+  alpha = alpha * std::sqrt(1 - std::pow(beta2_, step_)) /
+          (1 - std::pow(beta1_, step_));
+
+  if (!theta->useGpu()) {
+    adamUpdateCpu(alpha,
+                  beta1_,
+                  beta2_,
+                  epsilon_,
+                  theta->getSize(),
+                  theta->getData(),
+                  g->getData(),
+                  m->getData(),
+                  v->getData());
+    return;
+  }
 
   // m_t = \beta_1 * m_{t-1} + (1-\beta_1)* g_t;
   m->add(*g, beta1_, 1 - beta1_);
@@ -276,9 +461,6 @@ void AdamParameterOptimizer::update(const VectorPtr vecs[],
   // \theta_t = \theta_{t-1} - \alpha * \sqrt(1-\beta_2^t) / (1-\beta_1^t) * tmp
   g->sqrt(*v);
   g->dotDiv(*m, *g, 0., epsilon_);
-  real alpha = config.learning_rate() * learningRate_;
-  alpha = alpha * std::sqrt(1 - std::pow(beta2_, step_)) /
-          (1 - std::pow(beta1_, step_));
   theta->add(*theta, 1.0, *g, -alpha);
 }
 
@@ -290,6 +472,20 @@ void AdamaxParameterOptimizer::update(const VectorPtr vecs[],
   Vector* g = vecs[PARAMETER_GRADIENT].get();
   Vector* u = vecs[PARAMETER_WEIGHTED_INFINITY_NORM].get();
   Vector* theta = vecs[PARAMETER_VALUE].get();
+  real learningRate = config.learning_rate() * learningRate_;
+  learningRate /= (1 - std::pow(beta1_, step_));
+
+  if (!theta->useGpu()) {
+    adamaxUpdateCpu(learningRate,
+                    beta1_,
+                    beta2_,
+                    theta->getSize(),
+                    theta->getData(),
+                    g->getData(),
+                    m->getData(),
+                    u->getData());
+    return;
+  }
 
   // m_t = \beta_1 * m_{t-1} + (1-\beta_1)* g_t;
   m->add(*g, beta1_, 1 - beta1_);
@@ -301,14 +497,25 @@ void AdamaxParameterOptimizer::update(const VectorPtr vecs[],
 
   // \theta_t = \theta_{t-1} - (\alpha/(1-\beta_1^t))*m_t/u_t
   g->dotDiv(*m, *u);
-  real learningRate = config.learning_rate() * learningRate_;
-  learningRate /= (1 - std::pow(beta1_, step_));
   theta->add(*theta, 1.0, *g, -learningRate);
 }
 
 void OptimizerWithGradientClipping::update(const VectorPtr vecs[],
                                            const ParameterConfig& config,
                                            size_t sparseId) const {
+  const VectorPtr& grad = vecs[PARAMETER_GRADIENT];
+  if (!grad->useGpu() && !FLAGS_log_clipping) {
+    // clipping changes nothing when max|g| <= threshold, so the maximum
+    // need not be computed in a separate pass
+    real threshold = config.gradient_clipping_threshold();
+    real* g = grad->getData();
+    for (size_t i = 0; i < grad->getSize(); ++i) {
+      g[i] = std::min(std::max(g[i], -threshold), threshold);
+    }
+    optimizer_->update(vecs, config, sparseId);
+    return;
+  }
+
   real maxAbsGrad = vecs[PARAMETER_GRADIENT]->getAbsMax();
   if (maxAbsGrad > config.gradient_clipping_threshold()) {
     if (FLAGS_log_clipping) {
@@ -324,4 +531,35 @@ void OptimizerWithGradientClipping::update(const VectorPtr vecs[],
   optimizer_->update(vecs, config, sparseId);
 }
 
+void OptimizerWithGradientClipping::updateRows(
+    const SparseRows& rows, const ParameterConfig& config) const {
+  real threshold = config.gradient_clipping_threshold();
+  for (size_t begin = 0; begin < rows.numRows; begin += kRowBlockSize) {
+    SparseRows block =
+        rows.slice(begin, std::min(begin + kRowBlockSize, rows.numRows));
+    // clip the gradients of the block while they are in cache for the update
+    for (size_t i = 0; i < block.numRows; ++i) {
+      real* grad = block.getGrad(i);
+      real maxAbsGrad = 0;
+      for (size_t j = 0; j < block.width; ++j) {
+        maxAbsGrad = std::max(maxAbsGrad, std::abs(grad[j]));
+      }
+      if (maxAbsGrad <= threshold) continue;
+      if (FLAGS_log_clipping) {
+        real avgAbsGrad = 0;
+        for (size_t j = 0; j < block.width; ++j) {
+          avgAbsGrad += std::abs(grad[j]);
+        }
+        avgAbsGrad /= block.width;
+        LOG(INFO) << "parameter=" << config.name() << " need clipping,"
+                  << " max grad=" << maxAbsGrad << " avg grad=" << avgAbsGrad;
+      }
+      for (size_t j = 0; j < block.width; ++j) {
+        grad[j] = std::min(std::max(grad[j], -threshold), threshold);
+      }
+    }
+    optimizer_->updateRows(block, config);
+  }
+}
+
 }  // namespace paddle
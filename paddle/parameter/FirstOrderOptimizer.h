@@ -34,18 +34,24 @@ public:
                       const ParameterConfig& paraConfig,
                       size_t sparseId) const {
     (void)sparseId;
+    vecs[PARAMETER_VALUE]->sgdUpdate(*vecs[PARAMETER_GRADIENT],
+                                     *vecs[PARAMETER_MOMENTUM],
+                                     getSgdLearningRate(paraConfig),
+                                     paraConfig.momentum(),
+                                     applyDecay_ ? paraConfig.decay_rate() : 0);
+  }
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
+  virtual void finishBatch() { firstTime_ = false; }
+
+protected:
+  real getSgdLearningRate(const ParameterConfig& paraConfig) const {
     real torch_learningRate = optConfig_.learning_method() == "torch_momentum"
                                   ? 1.0 - paraConfig.momentum()
                                   : 1.0;
-    vecs[PARAMETER_VALUE]->sgdUpdate(
-        *vecs[PARAMETER_GRADIENT],
-        *vecs[PARAMETER_MOMENTUM],
-        learningRate_ * paraConfig.learning_rate() *
-            (firstTime_ ? 1.0 : torch_learningRate),
-        paraConfig.momentum(),
-        applyDecay_ ? paraConfig.decay_rate() : 0);
+    return learningRate_ * paraConfig.learning_rate() *
+           (firstTime_ ? 1.0 : torch_learningRate);
   }
-  virtual void finishBatch() { firstTime_ = false; }
 };
 
 // SGD optimization with sparse support.
@@ -74,6 +80,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& paraConfig,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
   virtual TraverseCallback needSpecialTraversal(
       const ParameterConfig& config) const;
   virtual void finishBatch();
@@ -115,6 +123,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& config,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
   virtual TraverseCallback needSpecialTraversal(
       const ParameterConfig& config) const;
 
@@ -179,6 +189,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& config,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
 
 protected:
   real rou_;
@@ -221,6 +233,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& config,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
 
 protected:
   real rou_;
@@ -356,6 +370,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& config,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
 
   virtual void setNoDecay() { optimizer_->setNoDecay(); }
 
@@ -96,6 +96,28 @@ void OptimizerWithRegularizerSparse::update(const VectorPtr vecs[],
   t0Vec_[sparseId] = timer_ + 1;
 }
 
+void OptimizerWithRegularizerSparse::updateRows(
+    const SparseRows& rows, const ParameterConfig& config) const {
+  VectorPtr* vecs = Parameter::getTlsTempBufs();
+  for (size_t begin = 0; begin < rows.numRows; begin += kRowBlockSize) {
+    SparseRows block =
+        rows.slice(begin, std::min(begin + kRowBlockSize, rows.numRows));
+    optimizer_->updateRows(block, config);
+    // para W(t0) -> W(t+1), while the rows of the block are still in cache
+    for (size_t i = 0; i < block.numRows; ++i) {
+      uint32_t id = block.ids[i];
+      CHECK_LT(id, t0Vec_.size());
+      block.subVecs(parameterTypes_, i, vecs);
+      regularizer_->update(vecs,
+                           config,
+                           optimizer_->getLearningRate(),
+                           t0Vec_[id],
+                           timer_ + 1);
+      t0Vec_[id] = timer_ + 1;
+    }
+  }
+}
+
 ParameterOptimizer::TraverseCallback
 OptimizerWithRegularizerSparse::startCatchUpWith() const {
   TraverseCallbackVec callbacks;
@@ -101,6 +101,11 @@ public:
     optimizer_->update(vecs, config, sparseId);
   }
 
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const {
+    optimizer_->updateRows(rows, config);
+  }
+
   virtual TraverseCallback needSpecialTraversal(
       const ParameterConfig& config) const;
   void doTraversal(const VectorPtr vecs[], const ParameterConfig& config) const;
@@ -136,6 +141,8 @@ public:
   virtual void update(const VectorPtr vecs[],
                       const ParameterConfig& config,
                       size_t sparseId) const;
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
   void catchUpWith(const VectorPtr vecs[],
                    const ParameterConfig& config,
                    size_t sparseId) const;
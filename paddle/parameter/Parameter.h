@@ -16,6 +16,7 @@ limitations under the License. */
 
 #include <stdint.h>
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -223,6 +224,29 @@ public:
 
   bool isValueUpdated() const { return updated_; }
 
+  /**
+   * @brief Mark the value as being refreshed by a remote updater.
+   *
+   * Pipelined remote updaters receive the new value of a parameter while the
+   * next forward is already running. Readers must call waitValueReady()
+   * before touching the value until markValueReady() is called.
+   */
+  void markValueNotReady() {
+    valueReadyCond_.notify_all([this] { valueReady_ = false; });
+  }
+
+  void markValueReady() {
+    valueReadyCond_.notify_all([this] { valueReady_ = true; });
+  }
+
+  /// Block until the value is not being refreshed by a remote updater.
+  void waitValueReady() {
+    if (valueReady_) {
+      return;
+    }
+    valueReadyCond_.wait([this] { return valueReady_.load(); });
+  }
+
   /**
    * Update bufs_[PARAMETER_VALUE] using bufs_[PARAMETER_GRADIENT]
    */
@@ -379,6 +403,9 @@ protected:
   bool updated_;
   SparseFormat format_;
 
+  std::atomic<bool> valueReady_;
+  LockedCondition valueReadyCond_;
+
   static ThreadLocal<std::vector<VectorPtr>> tlsTempBufs_;
 
   std::vector<std::shared_ptr<IParameterUpdaterHook>> updaterHooks_;
@@ -25,6 +25,58 @@ limitations under the License. */
 
 namespace paddle {
 
+SparseRows::SparseRows(Parameter* para,
+                       const uint32_t* ids,
+                       size_t numRows,
+                       real* grad,
+                       bool localGrad)
+    : ids(ids),
+      numRows(numRows),
+      width(para->getConfig().dims(1)),
+      grad(grad),
+      localGrad(localGrad) {
+  for (int type = 0; type < NUM_PARAMETER_TYPES; ++type) {
+    auto& buf = para->getBuf((ParameterType)type);
+    bufs[type] = buf ? buf->getData() : nullptr;
+  }
+}
+
+SparseRows SparseRows::slice(size_t begin, size_t end) const {
+  CHECK_LE(begin, end);
+  CHECK_LE(end, numRows);
+  SparseRows rows(*this);
+  rows.ids = ids + begin;
+  rows.numRows = end - begin;
+  if (localGrad) {
+    rows.grad = grad + begin * width;
+  }
+  return rows;
+}
+
+void SparseRows::subVecs(const std::vector<ParameterType>& types,
+                         size_t i,
+                         const VectorPtr vecs[]) const {
+  for (auto type : types) {
+    if (type == PARAMETER_GRADIENT) {
+      vecs[type]->subVecFrom(getGrad(i), 0, width);
+    } else {
+      vecs[type]->subVecFrom(getRow(type, i), 0, width);
+    }
+  }
+}
+
+const size_t ParameterOptimizer::kRowBlockSize;
+
+void ParameterOptimizer::updateRows(const SparseRows& rows,
+                                    const ParameterConfig& config) const {
+  VectorPtr* vecs = Parameter::getTlsTempBufs();
+  for (size_t i = 0; i < rows.numRows; ++i) {
+    rows.subVecs(parameterTypes_, i, vecs);
+    update(vecs, config, rows.ids[i]);
+    vecs[PARAMETER_GRADIENT]->zeroMem();
+  }
+}
+
 ParameterOptimizer* ParameterOptimizer::create(
     const OptimizationConfig& optConfig, bool inPserver) {
   if (inPserver && optConfig.num_batches_per_send_parameter() > 1) {
@@ -19,6 +19,50 @@ limitations under the License. */
 
 namespace paddle {
 
+/**
+ * A batch of touched rows of a sparse parameter, updated by one call of
+ * ParameterOptimizer::updateRows().
+ *
+ * The rows ids[0], ..., ids[numRows - 1] are distinct. The buffer of type t
+ * of the i-th row starts at bufs[t] + ids[i] * width. Its gradient is the
+ * i-th row of grad if localGrad is set (the compact rows of a
+ * SparseRowCpuMatrix), and row ids[i] of grad otherwise.
+ */
+struct SparseRows {
+  SparseRows(Parameter* para,
+             const uint32_t* ids,
+             size_t numRows,
+             real* grad,
+             bool localGrad);
+
+  real* getRow(ParameterType type, size_t i) const {
+    return bufs[type] + ids[i] * width;
+  }
+
+  real* getGrad(size_t i) const {
+    return grad + (localGrad ? i : ids[i]) * width;
+  }
+
+  void clearGrad(size_t i) const {
+    memset(getGrad(i), 0, width * sizeof(real));
+  }
+
+  /// the rows [begin, end) of this batch
+  SparseRows slice(size_t begin, size_t end) const;
+
+  /// point vecs[type] to the buffer of type of the i-th row, for each type
+  void subVecs(const std::vector<ParameterType>& types,
+               size_t i,
+               const VectorPtr vecs[]) const;
+
+  const uint32_t* ids;
+  size_t numRows;
+  size_t width;
+  real* bufs[NUM_PARAMETER_TYPES];
+  real* grad;
+  bool localGrad;
+};
+
 /**
  * Some member functions are set to const for two reasons:
  *
@@ -115,6 +159,20 @@ public:
                       const ParameterConfig& config,
                       size_t sparseId = -1LU) const = 0;
 
+  /**
+   * Sparse update of a batch of rows, same as calling update() for each row
+   * and clearing its gradient afterwards. The rows of a batch are distinct,
+   * and the batches given to concurrent calls do not share rows, so that the
+   * updates run in parallel without locks.
+   *
+   * The default implementation calls update() row by row. The first order
+   * optimizers override it with fused kernels which make one pass over each
+   * row, and the sparse regularizer and averager fold their lazy catch-up
+   * into the same pass over the rows.
+   */
+  virtual void updateRows(const SparseRows& rows,
+                          const ParameterConfig& config) const;
+
   /**
    * following hooks catch up with current time for sparse update,
    * In the beginning, call startCatchUpWith() and check return.
@@ -177,6 +235,10 @@ public:
 protected:
   typedef std::vector<ParameterOptimizer::TraverseCallback> TraverseCallbackVec;
 
+  /// updateRows() of the wrappers processes the rows by blocks of this
+  /// size, so that the rows are still in cache for their own pass
+  static const size_t kRowBlockSize = 32;
+
   static TraverseCallback composeCallbacks(
       const TraverseCallbackVec& callbacks) {
     if (callbacks.size() > 1LU) {
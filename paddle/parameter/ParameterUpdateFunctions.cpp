@@ -18,6 +18,9 @@ limitations under the License. */
 #include <xmmintrin.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
+
 #include "ParameterUpdateFunctions.h"
 
 namespace paddle {
@@ -294,4 +297,117 @@ void sgdUpdateAvx(float learningRate,
 #endif
 }
 
+void adagradUpdateCpu(real learningRate,
+                      real momentum,
+                      real decayRate,
+                      real epsilon,
+                      size_t size,
+                      real* value,
+                      const real* grad,
+                      real* momentumVec,
+                      const real* sqrSum,
+                      real* sqrSum1,
+                      real* lrVec) {
+  for (size_t i = 0; i < size; ++i) {
+    sqrSum1[i] += grad[i] * grad[i];
+    lrVec[i] = 1.0f / std::sqrt(sqrSum[i] + sqrSum1[i] + epsilon);
+    momentumVec[i] = momentum * momentumVec[i] -
+                     learningRate * lrVec[i] * (grad[i] + decayRate * value[i]);
+    value[i] += momentumVec[i];
+  }
+}
+
+void decayedAdagradUpdateCpu(real learningRate,
+                             real momentum,
+                             real decayRate,
+                             real epsilon,
+                             real rou,
+                             real sqrCoeff,
+                             size_t size,
+                             real* value,
+                             const real* grad,
+                             real* momentumVec,
+                             real* sqrSum,
+                             real* lrVec) {
+  for (size_t i = 0; i < size; ++i) {
+    sqrSum[i] = rou * sqrSum[i] + sqrCoeff * grad[i] * grad[i];
+    lrVec[i] = 1.0f / std::sqrt(epsilon + sqrSum[i]);
+    momentumVec[i] = momentum * momentumVec[i] -
+                     learningRate * lrVec[i] * (grad[i] + decayRate * value[i]);
+    value[i] += momentumVec[i];
+  }
+}
+
+void rmspropUpdateCpu(real learningRate,
+                      real momentum,
+                      real decayRate,
+                      real epsilon,
+                      real rou,
+                      real sqrCoeff,
+                      real gradCoeff,
+                      size_t size,
+                      real* value,
+                      const real* grad,
+                      real* momentumVec,
+                      real* sqrSum,
+                      real* meanGrad,
+                      real* lrVec) {
+  for (size_t i = 0; i < size; ++i) {
+    sqrSum[i] = rou * sqrSum[i] + sqrCoeff * grad[i] * grad[i];
+    meanGrad[i] = rou * meanGrad[i] + gradCoeff * grad[i];
+    lrVec[i] =
+        1.0f / std::sqrt(sqrSum[i] - meanGrad[i] * meanGrad[i] + epsilon);
+    momentumVec[i] = momentum * momentumVec[i] -
+                     learningRate * lrVec[i] * (grad[i] + decayRate * value[i]);
+    value[i] += momentumVec[i];
+  }
+}
+
+void adamUpdateCpu(real learningRate,
+                   real beta1,
+                   real beta2,
+                   real epsilon,
+                   size_t size,
+                   real* value,
+                   const real* grad,
+                   real* mom,
+                   real* mom2) {
+  for (size_t i = 0; i < size; ++i) {
+    mom[i] = beta1 * mom[i] + (1 - beta1) * grad[i];
+    mom2[i] = beta2 * mom2[i] + (1 - beta2) * grad[i] * grad[i];
+    value[i] -= learningRate * mom[i] / (std::sqrt(mom2[i]) + epsilon);
+  }
+}
+
+void adamaxUpdateCpu(real learningRate,
+                     real beta1,
+                     real beta2,
+                     size_t size,
+                     real* value,
+                     const real* grad,
+                     real* mom,
+                     real* norm) {
+  for (size_t i = 0; i < size; ++i) {
+    mom[i] = beta1 * mom[i] + (1 - beta1) * grad[i];
+    norm[i] = std::max(beta2 * norm[i], std::abs(grad[i]));
+    value[i] -= learningRate * mom[i] / norm[i];
+  }
+}
+
+void sparseMomentumUpdateCpu(real uCoeff,
+                             real vCoeff,
+                             real uScale,
+                             real vScale,
+                             size_t size,
+                             real* value,
+                             const real* grad,
+                             real* ut,
+                             real* vt) {
+  for (size_t i = 0; i < size; ++i) {
+    ut[i] += uCoeff * grad[i];
+    vt[i] += vCoeff * grad[i];
+    value[i] = uScale * ut[i] + vScale * vt[i];
+  }
+}
+
 }  // namespace paddle
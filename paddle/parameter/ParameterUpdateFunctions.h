@@ -53,4 +53,118 @@ void sgdUpdateAvx(float learningRate,
                   const float* grad,
                   float* momentumVec);
 
+/**
+ * Fused kernels of the first order optimizers on CPU, used by the dense
+ * updates and by the sparse row updates (ParameterOptimizer::updateRows()).
+ * Each one makes a single pass over the buffers, where the equivalent
+ * Vector operations make one pass per operation.
+ *
+ * For the adaptive methods, the per element learning rate lrVec
+ * (PARAMETER_LEARNING_RATE) is computed and stored, because the
+ * regularizers may need it, and the update is then
+ *
+ * momentumVec = momentum * momentumVec
+ *               - learningRate * lrVec * (grad + decayRate * value)
+ * value = value + momentumVec
+ */
+
+/// AdagradParameterOptimizer:
+/// sqrSum1 += grad^2, lrVec = 1 / sqrt(sqrSum + sqrSum1 + epsilon)
+void adagradUpdateCpu(real learningRate,
+                      real momentum,
+                      real decayRate,
+                      real epsilon,
+                      size_t size,
+                      real* value,
+                      const real* grad,
+                      real* momentumVec,
+                      const real* sqrSum,
+                      real* sqrSum1,
+                      real* lrVec);
+
+/// DecayedAdagradParameterOptimizer:
+/// sqrSum = rou * sqrSum + sqrCoeff * grad^2,
+/// lrVec = 1 / sqrt(epsilon + sqrSum)
+void decayedAdagradUpdateCpu(real learningRate,
+                             real momentum,
+                             real decayRate,
+                             real epsilon,
+                             real rou,
+                             real sqrCoeff,
+                             size_t size,
+                             real* value,
+                             const real* grad,
+                             real* momentumVec,
+                             real* sqrSum,
+                             real* lrVec);
+
+/// RMSPropParameterOptimizer:
+/// sqrSum = rou * sqrSum + sqrCoeff * grad^2,
+/// meanGrad = rou * meanGrad + gradCoeff * grad,
+/// lrVec = 1 / sqrt(sqrSum - meanGrad^2 + epsilon)
+void rmspropUpdateCpu(real learningRate,
+                      real momentum,
+                      real decayRate,
+                      real epsilon,
+                      real rou,
+                      real sqrCoeff,
+                      real gradCoeff,
+                      size_t size,
+                      real* value,
+                      const real* grad,
+                      real* momentumVec,
+                      real* sqrSum,
+                      real* meanGrad,
+                      real* lrVec);
+
+/**
+ * AdamParameterOptimizer:
+ *
+ * mom = beta1 * mom + (1 - beta1) * grad
+ * mom2 = beta2 * mom2 + (1 - beta2) * grad^2
+ * value = value - learningRate * mom / (sqrt(mom2) + epsilon)
+ */
+void adamUpdateCpu(real learningRate,
+                   real beta1,
+                   real beta2,
+                   real epsilon,
+                   size_t size,
+                   real* value,
+                   const real* grad,
+                   real* mom,
+                   real* mom2);
+
+/**
+ * AdamaxParameterOptimizer:
+ *
+ * mom = beta1 * mom + (1 - beta1) * grad
+ * norm = max(beta2 * norm, abs(grad))
+ * value = value - learningRate * mom / norm
+ */
+void adamaxUpdateCpu(real learningRate,
+                     real beta1,
+                     real beta2,
+                     size_t size,
+                     real* value,
+                     const real* grad,
+                     real* mom,
+                     real* norm);
+
+/**
+ * SparseMomentumParameterOptimizer:
+ *
+ * ut = ut + uCoeff * grad
+ * vt = vt + vCoeff * grad
+ * value = uScale * ut + vScale * vt
+ */
+void sparseMomentumUpdateCpu(real uCoeff,
+                             real vCoeff,
+                             real uScale,
+                             real vScale,
+                             size_t size,
+                             real* value,
+                             const real* grad,
+                             real* ut,
+                             real* vt);
+
 }  // namespace paddle
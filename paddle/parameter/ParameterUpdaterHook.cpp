@@ -14,6 +14,7 @@ limitations under the License. */
 
 #include "ParameterUpdaterHook.h"
 
+#include <cmath>
 #include <fstream>
 #include <unordered_map>
 #include <mutex>
@@ -25,6 +26,15 @@ limitations under the License. */
 #include "paddle/utils/Util.h"
 #include "paddle/utils/Flags.h"
 
+P_DEFINE_double(loss_scale,
+                1.0,
+                "initial factor of the cost gradient when the parameters "
+                "have loss_scaling hooks");
+P_DEFINE_int32(loss_scale_window,
+               1000,
+               "double the loss scale after this number of batches without "
+               "overflow, 0 keeps it fixed");
+
 namespace paddle {
 
 /**
@@ -131,6 +141,126 @@ private:
   std::vector<bool> mask_;
 };
 
+/**
+ * The loss scaling hook.
+ *
+ * Registers its parameter to LossScaler. The gradients are unscaled by the
+ * trainer for the whole batch, see LossScaler::unscaleGradients().
+ */
+class LossScalingHook : public IParameterUpdaterHook {
+public:
+  LossScalingHook() : initialized_(false) {}
+
+  ~LossScalingHook() {
+    if (initialized_) {
+      LossScaler::removeParameter();
+    }
+  }
+
+  void update(Parameter* para) {}
+
+  void init(Parameter* para) {
+    if (para->isStatic()) return;
+    // a sparse gradient lives in the rows of its SparseRowCpuMatrix, not in
+    // the gradient buffer that is unscaled
+    CHECK(!para->getConfig().sparse_update() &&
+          !para->getConfig().sparse_remote_update())
+        << "loss_scaling does not support the sparse parameter "
+        << para->getName();
+    // the hook is shared by the copies of the parameter, count it once
+    if (!initialized_.exchange(true)) {
+      LossScaler::addParameter();
+    }
+  }
+
+private:
+  std::atomic<bool> initialized_;
+};
+
+namespace {
+
+/// The state of LossScaler. The scale is read by the cost layers without
+/// the lock.
+std::mutex g_lossScaleMutex;
+std::atomic<real> g_lossScale(1);
+size_t g_numScaledParameters = 0;
+int g_numGoodBatches = 0;
+
+bool hasLossScalingHook(const ParameterConfig& config) {
+  for (int i = 0; i < config.update_hooks_size(); ++i) {
+    if (config.update_hooks(i).type() == "loss_scaling") return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+real LossScaler::getScale() { return g_lossScale.load(); }
+
+bool LossScaler::isEnabled() {
+  std::lock_guard<std::mutex> guard(g_lossScaleMutex);
+  return g_numScaledParameters > 0;
+}
+
+void LossScaler::addParameter() {
+  std::lock_guard<std::mutex> guard(g_lossScaleMutex);
+  if (g_numScaledParameters++ == 0) {
+    CHECK_GT(FLAGS_loss_scale, 0);
+    g_lossScale = FLAGS_loss_scale;
+    g_numGoodBatches = 0;
+  }
+}
+
+void LossScaler::removeParameter() {
+  std::lock_guard<std::mutex> guard(g_lossScaleMutex);
+  CHECK_GT(g_numScaledParameters, 0UL);
+  if (--g_numScaledParameters == 0) {
+    g_lossScale = 1;
+  }
+}
+
+bool LossScaler::unscaleGradients(
+    const std::vector<std::shared_ptr<Parameter>>& parameters) {
+  std::lock_guard<std::mutex> guard(g_lossScaleMutex);
+  real scale = g_lossScale;
+  bool overflow = false;
+  for (auto& para : parameters) {
+    CHECK(hasLossScalingHook(para->getConfig()))
+        << "Parameter " << para->getName() << " has no loss_scaling hook, "
+        << "all the trained parameters need it";
+    auto& grad = para->getBuf(PARAMETER_GRADIENT);
+    if (!grad) continue;
+    SetDevice device(para->getDeviceId());
+    if (!std::isfinite(grad->getAbsSum())) {
+      overflow = true;
+      break;
+    }
+  }
+
+  if (overflow) {
+    g_lossScale = scale / 2;
+    g_numGoodBatches = 0;
+    LOG(INFO) << "Gradient overflow, the batch is skipped and the loss scale "
+              << "is lowered to " << g_lossScale;
+    return false;
+  }
+
+  if (scale != real(1.0f)) {
+    for (auto& para : parameters) {
+      auto& grad = para->getBuf(PARAMETER_GRADIENT);
+      if (!grad) continue;
+      SetDevice device(para->getDeviceId());
+      grad->mulScalar(1 / scale);
+    }
+  }
+  if (FLAGS_loss_scale_window > 0 &&
+      ++g_numGoodBatches >= FLAGS_loss_scale_window) {
+    g_lossScale = scale * 2;
+    g_numGoodBatches = 0;
+  }
+  return true;
+}
+
 IParameterUpdaterHook::IParameterUpdaterHook() {}
 
 IParameterUpdaterHook::~IParameterUpdaterHook() {}
@@ -168,6 +298,8 @@ static IParameterUpdaterHook* createImpl(
     if (config.has_purning_mask_filename()) {
       return new StaticPruningHook(config.purning_mask_filename());
     }
+  } else if (type == "loss_scaling") {
+    return new LossScalingHook();
   }
   return nullptr;
 }
@@ -14,8 +14,10 @@ limitations under the License. */
 
 #pragma once
 #include <memory>
+#include <vector>
 
 #include "ParameterConfig.pb.h"
+#include "paddle/utils/TypeDefs.h"
 
 namespace paddle {
 
@@ -60,4 +62,46 @@ protected:
   IParameterUpdaterHook();
 };
 
+/**
+ * The loss scale of the "loss_scaling" hooks.
+ *
+ * Low precision gradients, e.g. with --bf16_activations, lose the small
+ * values. The cost layers multiply the gradient of the cost by getScale(),
+ * and the trainer divides the gradients by the same factor with
+ * unscaleGradients() before the optimizer sees them. If one of the gradients
+ * has inf or nan, no parameter is updated in the batch, and the scale of the
+ * next batch is halved. The scale is doubled after --loss_scale_window
+ * batches without overflow.
+ *
+ * All the trained parameters must have the hook, for example through
+ * default_update_hooks(ParameterHook("loss_scaling")) in the config. The
+ * scale is applied by all the cost layers: the ones derived from CostLayer,
+ * rank-cost, lambda_cost, sum_cost, crf, ctc, nce and hsigmoid.
+ */
+class LossScaler {
+public:
+  /// The factor of the cost gradient in the current batch. It is 1 unless a
+  /// hook is initialized, and starts from --loss_scale afterwards.
+  static real getScale();
+
+  /// Whether a hook is initialized, i.e. the gradients must be unscaled.
+  static bool isEnabled();
+
+  /// Register a parameter whose gradient is scaled.
+  static void addParameter();
+
+  /// Unregister a parameter. After the last one, the scale goes back to 1.
+  static void removeParameter();
+
+  /**
+   * Divide the gradients of the batch by the scale, before any of the
+   * parameters is updated, and choose the scale of the next batch.
+   *
+   * @return false if a gradient overflowed. The gradients are left unchanged
+   *         and none of the parameters should be updated in this batch.
+   */
+  static bool unscaleGradients(
+      const std::vector<std::shared_ptr<Parameter>>& parameters);
+};
+
 }  // namespace paddle
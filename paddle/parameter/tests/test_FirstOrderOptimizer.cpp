@@ -0,0 +1,274 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <paddle/parameter/OptimizerFunctions.h>
+#include <paddle/parameter/ParameterOptimizer.h>
+#include <paddle/utils/Util.h>
+
+using namespace paddle;  // NOLINT
+
+const size_t kHeight = 50;
+// a multiple of 8, the AVX decayL1 of the L1 regularizer needs aligned rows
+const size_t kWidth = 40;
+
+struct TestConfig {
+  std::string method;
+  real momentum;
+  real decayRate;
+  real decayRateL1;
+  real clippingThreshold;
+  double averageWindow;
+};
+
+class UpdateRowsTest : public ::testing::TestWithParam<TestConfig> {
+protected:
+  virtual void SetUp() {
+    const TestConfig& test = GetParam();
+    optConfig_.set_batch_size(10);
+    optConfig_.set_learning_rate(0.1);
+    optConfig_.set_learning_method(test.method);
+    optConfig_.set_average_window(test.averageWindow);
+
+    paraConfig_.set_name("test");
+    paraConfig_.set_size(kHeight * kWidth);
+    paraConfig_.add_dims(kHeight);
+    paraConfig_.add_dims(kWidth);
+    paraConfig_.set_learning_rate(0.5);
+    paraConfig_.set_momentum(test.momentum);
+    paraConfig_.set_decay_rate(test.decayRate);
+    paraConfig_.set_decay_rate_l1(test.decayRateL1);
+    paraConfig_.set_gradient_clipping_threshold(test.clippingThreshold);
+  }
+
+  std::unique_ptr<ParameterOptimizer> createOptimizer() {
+    std::unique_ptr<ParameterOptimizer> optimizer(
+        sgdOptimizerCreate(optConfig_,
+                           paraConfig_,
+                           /* isParameterSparse= */ true,
+                           /* inPserver= */ false));
+    optimizer->init(kHeight, &paraConfig_);
+    return optimizer;
+  }
+
+  ParameterPtr createParameter(const std::vector<ParameterType>& types) {
+    ParameterPtr para =
+        std::make_shared<Parameter>(paraConfig_, /* useGpu= */ false);
+    for (auto type : types) {
+      para->enableType(type);
+      para->getBuf(type)->rand();
+    }
+    if (para->getBuf(PARAMETER_GRADIENT_SQURESUM)) {
+      // keeps the variance estimate of rmsprop positive
+      para->getBuf(PARAMETER_GRADIENT_SQURESUM)->add(1.0f);
+    }
+    return para;
+  }
+
+  OptimizationConfig optConfig_;
+  ParameterConfig paraConfig_;
+};
+
+// updateRows() over a batch must give the same result as update() row by row
+TEST_P(UpdateRowsTest, compareWithUpdate) {
+  auto rowOptimizer = createOptimizer();
+  auto batchOptimizer = createOptimizer();
+  auto types = rowOptimizer->getParameterTypes();
+  ParameterPtr rowPara = createParameter(types);
+  ParameterPtr batchPara = createParameter(types);
+  for (auto type : types) {
+    batchPara->getBuf(type)->copyFrom(*rowPara->getBuf(type));
+  }
+
+  VectorPtr* vecs = Parameter::getTlsTempBufs();
+  int64_t numSamples = 0;
+  for (int batch = 0; batch < 5; ++batch) {
+    // a different subset of rows in each batch, so that the lazy catch-up
+    // of the rows skipped by some batches is exercised
+    std::vector<uint32_t> ids;
+    for (uint32_t id = batch % 3; id < kHeight; id += 1 + batch % 3) {
+      ids.push_back(id);
+    }
+    VectorPtr grad = Vector::create(kHeight * kWidth, /* useGpu= */ false);
+    grad->randnorm(0, 2);
+
+    numSamples += optConfig_.batch_size();
+    rowOptimizer->startBatch(numSamples);
+    batchOptimizer->startBatch(numSamples);
+
+    rowPara->getBuf(PARAMETER_GRADIENT)->copyFrom(*grad);
+    for (auto id : ids) {
+      for (auto type : types) {
+        vecs[type]->subVecFrom(*rowPara->getBuf(type), id * kWidth, kWidth);
+      }
+      rowOptimizer->update(vecs, paraConfig_, id);
+      vecs[PARAMETER_GRADIENT]->zeroMem();
+    }
+
+    batchPara->getBuf(PARAMETER_GRADIENT)->copyFrom(*grad);
+    SparseRows rows(batchPara.get(),
+                    ids.data(),
+                    ids.size(),
+                    batchPara->getBuf(PARAMETER_GRADIENT)->getData(),
+                    /* localGrad= */ false);
+    // two calls, as two threads owning half of the rows each
+    batchOptimizer->updateRows(rows.slice(0, ids.size() / 2), paraConfig_);
+    batchOptimizer->updateRows(rows.slice(ids.size() / 2, ids.size()),
+                               paraConfig_);
+
+    rowOptimizer->finishBatch();
+    batchOptimizer->finishBatch();
+
+    for (auto type : types) {
+      const real* expected = rowPara->getBuf(type)->getData();
+      const real* actual = batchPara->getBuf(type)->getData();
+      for (size_t i = 0; i < kHeight * kWidth; ++i) {
+        ASSERT_NEAR(expected[i], actual[i], 1e-5 * (1 + fabs(expected[i])))
+            << "batch " << batch << " type " << type << " element " << i;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Optimizers,
+    UpdateRowsTest,
+    ::testing::Values(TestConfig{"momentum", 0.9, 0, 0, 0, 0},
+                      TestConfig{"momentum", 0, 0.01, 0, 0, 0},
+                      TestConfig{"momentum", 0, 0.01, 0.02, 0, 0.5},
+                      TestConfig{"momentum", 0, 0, 0.02, 1.0, 0},
+                      TestConfig{"adagrad", 0.5, 0, 0, 0, 0},
+                      TestConfig{"adagrad", 0, 0.01, 0.02, 0, 0},
+                      TestConfig{"rmsprop", 0.5, 0, 0, 0, 0},
+                      TestConfig{"rmsprop", 0, 0.01, 0, 0, 0.5},
+                      TestConfig{"decayed_adagrad", 0.5, 0, 0, 0, 0},
+                      TestConfig{"decayed_adagrad", 0, 0, 0.02, 1.0, 0},
+                      TestConfig{"sparse_momentum", 0.9, 0, 0, 0, 0},
+                      TestConfig{"sparse_momentum", 0.5, 0, 0, 0, 0.5}));
+
+// One dense update on CPU, which runs the fused kernels, against the formulas
+// of the optimizers computed element by element.
+class DenseUpdateTest : public ::testing::TestWithParam<std::string> {};
+
+TEST_P(DenseUpdateTest, compareWithFormula) {
+  const size_t size = 1000;
+  const real momentum = 0.5;
+  const real decayRate = 0.01;
+  OptimizationConfig optConfig;
+  optConfig.set_batch_size(10);
+  optConfig.set_learning_rate(0.1);
+  optConfig.set_learning_method(GetParam());
+  ParameterConfig paraConfig;
+  paraConfig.set_name("test");
+  paraConfig.set_size(size);
+  paraConfig.add_dims(1);
+  paraConfig.add_dims(size);
+  paraConfig.set_learning_rate(0.5);
+  paraConfig.set_momentum(momentum);
+  paraConfig.set_decay_rate(decayRate);
+
+  std::unique_ptr<ParameterOptimizer> optimizer(
+      ParameterOptimizer::create(optConfig));
+  optimizer->init(0, &paraConfig);
+  Parameter para(paraConfig, /* useGpu= */ false);
+  std::vector<std::vector<real>> expected(NUM_PARAMETER_TYPES);
+  for (auto type : optimizer->getParameterTypes()) {
+    para.enableType(type);
+    para.getBuf(type)->rand();
+    if (type == PARAMETER_GRADIENT) {
+      para.getBuf(type)->randnorm(0, 2);
+    }
+    if (type == PARAMETER_GRADIENT_SQURESUM) {
+      para.getBuf(type)->add(1.0f);
+    }
+    real* data = para.getBuf(type)->getData();
+    expected[type].assign(data, data + size);
+  }
+
+  optimizer->startBatch(optConfig.batch_size());
+  optimizer->update(para.getBufs(), paraConfig);
+  optimizer->finishBatch();
+
+  const real lr = optConfig.learning_rate() * paraConfig.learning_rate();
+  const real eps = optConfig.ada_epsilon();
+  const real rou = optConfig.ada_rou();
+  const real beta1 = optConfig.adam_beta1();
+  const real beta2 = optConfig.adam_beta2();
+  const real adamEps = optConfig.adam_epsilon();
+  real* value = expected[PARAMETER_VALUE].data();
+  real* grad = expected[PARAMETER_GRADIENT].data();
+  real* mom = expected[PARAMETER_MOMENTUM].data();
+  for (size_t i = 0; i < size; ++i) {
+    real rate = 1;
+    if (GetParam() == "adagrad") {
+      real* sum = expected[PARAMETER_GRADIENT_SQURESUM].data();
+      real* sum1 = expected[PARAMETER_GRADIENT_SQURESUM1].data();
+      sum1[i] += grad[i] * grad[i];
+      rate = 1 / std::sqrt(sum[i] + sum1[i] + eps);
+    } else if (GetParam() == "rmsprop" || GetParam() == "decayed_adagrad") {
+      // the first update makes the squared sum the square of the gradient
+      real* sum = expected[PARAMETER_GRADIENT_SQURESUM].data();
+      sum[i] = rou * sum[i] + grad[i] * grad[i];
+      if (GetParam() == "rmsprop") {
+        real* sum1 = expected[PARAMETER_GRADIENT_SQURESUM1].data();
+        sum1[i] = rou * sum1[i] + (1 - rou) * grad[i];
+        rate = 1 / std::sqrt(sum[i] - sum1[i] * sum1[i] + eps);
+      } else {
+        rate = 1 / std::sqrt(sum[i] + eps);
+      }
+    } else if (GetParam() == "adam") {
+      real* mom2 = expected[PARAMETER_SECOND_MOMENTUM].data();
+      mom[i] = beta1 * mom[i] + (1 - beta1) * grad[i];
+      mom2[i] = beta2 * mom2[i] + (1 - beta2) * grad[i] * grad[i];
+      real alpha = lr * std::sqrt(1 - beta2) / (1 - beta1);
+      value[i] -= alpha * mom[i] / (std::sqrt(mom2[i]) + adamEps);
+      continue;
+    } else if (GetParam() == "adamax") {
+      real* norm = expected[PARAMETER_WEIGHTED_INFINITY_NORM].data();
+      mom[i] = beta1 * mom[i] + (1 - beta1) * grad[i];
+      norm[i] = std::max(beta2 * norm[i], std::abs(grad[i]));
+      value[i] -= lr / (1 - beta1) * mom[i] / norm[i];
+      continue;
+    }
+    if (GetParam() != "momentum") {
+      expected[PARAMETER_LEARNING_RATE][i] = rate;
+    }
+    mom[i] = momentum * mom[i] - lr * rate * (grad[i] + decayRate * value[i]);
+    value[i] += mom[i];
+  }
+
+  for (auto type : optimizer->getParameterTypes()) {
+    if (type == PARAMETER_GRADIENT) continue;
+    const real* actual = para.getBuf(type)->getData();
+    for (size_t i = 0; i < size; ++i) {
+      ASSERT_NEAR(expected[type][i], actual[i], 1e-5 * (1 + fabs(actual[i])))
+          << "type " << type << " element " << i;
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(Optimizers,
+                        DenseUpdateTest,
+                        ::testing::Values("momentum",
+                                          "adagrad",
+                                          "rmsprop",
+                                          "decayed_adagrad",
+                                          "adam",
+                                          "adamax"));
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <paddle/parameter/Parameter.h>
+#include <paddle/parameter/ParameterUpdaterHook.h>
+#include <paddle/utils/Util.h>
+
+using namespace paddle;  // NOLINT
+
+P_DECLARE_double(loss_scale);
+P_DECLARE_int32(loss_scale_window);
+
+static ParameterPtr createScaledParameter(const std::string& name,
+                                          size_t size) {
+  ParameterConfig config;
+  config.set_name(name);
+  config.set_size(size);
+  config.add_dims(1);
+  config.add_dims(size);
+  config.add_update_hooks()->set_type("loss_scaling");
+  ParameterPtr para = std::make_shared<Parameter>(config, /* useGpu= */ false);
+  para->enableType(PARAMETER_GRADIENT);
+  para->initHook();
+  return para;
+}
+
+// The cost gradient is scaled by getScale(), unscaleGradients() must give
+// back the unscaled gradients, or leave all of them if one overflowed.
+TEST(LossScaler, dynamicScale) {
+  FLAGS_loss_scale = 1024;
+  FLAGS_loss_scale_window = 2;
+  EXPECT_FALSE(LossScaler::isEnabled());
+  EXPECT_EQ(1, LossScaler::getScale());
+
+  std::vector<ParameterPtr> parameters = {createScaledParameter("a", 100),
+                                          createScaledParameter("b", 10)};
+  ParameterPtr copyOfA = createScaledParameter("a", 100);
+  EXPECT_TRUE(LossScaler::isEnabled());
+  EXPECT_EQ(1024, LossScaler::getScale());
+
+  auto runBatch = [&](bool overflow) {
+    real scale = LossScaler::getScale();
+    const VectorPtr& gradA = parameters[0]->getBuf(PARAMETER_GRADIENT);
+    const VectorPtr& gradB = parameters[1]->getBuf(PARAMETER_GRADIENT);
+    gradA->assign(0.5 * scale);
+    gradB->assign(-2 * scale);
+    if (overflow) {
+      gradB->getData()[3] = std::numeric_limits<real>::infinity();
+    }
+    EXPECT_EQ(!overflow, LossScaler::unscaleGradients(parameters));
+    EXPECT_EQ(overflow ? 0.5 * scale * 100 : 0.5 * 100, gradA->getSum());
+    if (!overflow) {
+      EXPECT_EQ(-2 * 10, gradB->getSum());
+    }
+  };
+
+  runBatch(false);
+  EXPECT_EQ(1024, LossScaler::getScale());
+  runBatch(false);
+  EXPECT_EQ(2048, LossScaler::getScale());
+  runBatch(true);
+  EXPECT_EQ(1024, LossScaler::getScale());
+  runBatch(false);
+  EXPECT_EQ(1024, LossScaler::getScale());
+
+  // the hooks are shared by the copies of a parameter, the scale only goes
+  // back to 1 when all of them are destroyed
+  parameters.clear();
+  EXPECT_TRUE(LossScaler::isEnabled());
+  copyOfA.reset();
+  EXPECT_FALSE(LossScaler::isEnabled());
+  EXPECT_EQ(1, LossScaler::getScale());
+
+  // a new model starts from --loss_scale again
+  ParameterPtr c = createScaledParameter("c", 10);
+  EXPECT_EQ(1024, LossScaler::getScale());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -231,3 +231,31 @@ TEST_F(CommonTest, barrierStat) {
   globalStat.printAllStatus();
   globalStat.reset();
 }
+
+TEST_F(CommonTest, barrierLagStat) {
+  const int trainerNum = 4;
+  StatSet statSet("lag");
+  for (int lag = 0; lag < 8; ++lag) {
+    for (int trainerId = 0; trainerId < trainerNum; ++trainerId) {
+      REGISTER_BARRIER_LAG_SERVER_SET(
+          statSet, "asyncLag", trainerNum, trainerId, lag * trainerId);
+    }
+  }
+  statSet.printAllStatus();
+
+#ifndef PADDLE_DISABLE_TIMER
+  auto stat = std::dynamic_pointer_cast<BarrierLagStat>(
+      statSet.getStat(trainerNum, "asyncLag", BARRIER_LAG));
+  ASSERT_TRUE(stat != nullptr);
+  /// trainer 0 never lags
+  EXPECT_EQ(8UL, stat->getBucketCount(0, 0));
+  /// lags of trainer 1 are 0, 1, 2-3, 2-3, 4-7, 4-7, 4-7, 4-7
+  EXPECT_EQ(1UL, stat->getBucketCount(1, 0));
+  EXPECT_EQ(1UL, stat->getBucketCount(1, 1));
+  EXPECT_EQ(2UL, stat->getBucketCount(1, 2));
+  EXPECT_EQ(4UL, stat->getBucketCount(1, 3));
+  EXPECT_EQ(0UL, stat->getBucketCount(1, 4));
+  stat->reset();
+  EXPECT_EQ(0UL, stat->getBucketCount(1, 3));
+#endif
+}
@@ -23,7 +23,11 @@ P_DECLARE_string(pservers);
 namespace paddle {
 
 BaseClient::BaseClient(bool separate, int numPorts)
-    : stopping_(false), numPorts_(numPorts), separateSendAndRecv_(separate) {
+    : stopping_(false),
+      numPorts_(numPorts),
+      separateSendAndRecv_(separate),
+      recvBytes_(0),
+      recvCopiedBytes_(0) {
   CHECK_GT(numPorts, 0);
 }
 
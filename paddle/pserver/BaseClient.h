@@ -14,6 +14,8 @@ limitations under the License. */
 
 #pragma once
 
+#include <atomic>
+
 #include "paddle/pserver/ProtoServer.h"
 #include "paddle/math/Matrix.h"
 #include "paddle/utils/Queue.h"
@@ -81,11 +83,17 @@ public:
     putData(clientId, type, datas, size, DATA_UPDATE_MODE_SET_OWN);
   }
 
+  /**
+   * The piece of each server is read into datas directly if its length is
+   * as expected, otherwise it is received into recvDataMems_ and copied.
+   * A server sends nothing only if its piece is empty.
+   */
   template <class DataType>
   void getAllData(int clientId,
                   SendDataType type,
                   DataType* datas,
                   size_t size) {
+    registerRecvData(datas, size);
     sendData(clientId,
              type,
              DATA_UPDATE_MODE_GET_ALL,
@@ -93,15 +101,25 @@ public:
              0);
     recvData();
     size_t dataOffset = 0;
-    for (auto& recvMem : recvDataMems_) {
+    for (int i = 0; i < serviceNum_; ++i) {
       CHECK_LE(dataOffset, size);
+      size_t ownSize = recvDataIovs_[i].iov_len / sizeof(DataType);
+      if (recvDataInPlace_[i]) {
+        dataOffset += ownSize;
+        continue;
+      }
+      auto& recvMem = recvDataMems_[i];
+      CHECK(recvMem) << "Server " << i << " sent no data for its piece of "
+                     << ownSize << " elements";
       size_t memSize = std::min(recvMem.get()->getSize(),
                                 sizeof(DataType) * (size - dataOffset));
       CHECK_EQ(memSize % sizeof(DataType), size_t(0));
       memcpy(datas + dataOffset, recvMem.get()->getBuf(), memSize);
+      recvCopiedBytes_ += memSize;
       dataOffset += memSize / sizeof(DataType);
     }
     CHECK_EQ(dataOffset, size);
+    recvDataIovs_.assign(recvDataIovs_.size(), {nullptr, 0});
   }
 
   /**
@@ -121,6 +139,17 @@ public:
     }
   }
 
+  /// bytes of data received from servers
+  size_t getRecvBytes() const { return recvBytes_; }
+
+  /// bytes of received data copied again after received
+  size_t getRecvCopiedBytes() const { return recvCopiedBytes_; }
+
+  void resetRecvBytes() {
+    recvBytes_ = 0;
+    recvCopiedBytes_ = 0;
+  }
+
   /**
    * return trans data type according to the input type
    */
@@ -186,7 +215,9 @@ protected:
       auto& request = sendJob->parallelDataRequests[i];
       DataBlock* block = request.add_blocks();
       size_t ownSize = size_t(i) < size % serviceNum_ ? baseSize + 1 : baseSize;
-      size_t realSize = datas ? std::max(ownSize, size_t(1)) : 0;
+      // an empty piece is sent as an empty block, the server replies to
+      // getAllData() without data for it
+      size_t realSize = datas ? ownSize : 0;
       block->set_total_size(realSize * sizeof(DataType));
       block->set_data_size(sizeof(DataType));
       // TODO(yuyang18): The getTransDtype can be rewritten as template method
@@ -201,6 +232,27 @@ protected:
     CHECK_EQ(dataOffset, size);
   }
 
+  /**
+   * @brief register where the piece of each server in datas is received.
+   *
+   * @note  datas are split in the same way as prepareData().
+   */
+  template <class DataType>
+  void registerRecvData(DataType* datas, size_t size) {
+    recvDataIovs_.resize(serviceNum_);
+    recvDataInPlace_.assign(serviceNum_, false);
+    size_t baseSize = size / serviceNum_;
+    size_t dataOffset = 0;
+    for (int i = 0; i < serviceNum_; ++i) {
+      size_t ownSize = size_t(i) < size % serviceNum_ ? baseSize + 1 : baseSize;
+      recvDataIovs_[i] = {datas + dataOffset, ownSize * sizeof(DataType)};
+      recvDataMems_[i].reset();
+      // an empty piece needs no data
+      recvDataInPlace_[i] = ownSize == 0;
+      dataOffset += ownSize;
+    }
+  }
+
   /**
    * @brief send data to all data servers
    *
@@ -310,5 +362,13 @@ protected:
   /// if set, overlapped optimization is disabled
   bool separateSendAndRecv_;
   std::vector<CpuMemHandlePtr> recvDataMems_;
+  /// registered destination of data from each server, see getAllData()
+  std::vector<iovec> recvDataIovs_;
+  /// whether the piece of each server has been read into recvDataIovs_.
+  /// Not vector<bool>, the recv threads write different elements.
+  std::vector<char> recvDataInPlace_;
+
+  std::atomic<size_t> recvBytes_;
+  std::atomic<size_t> recvCopiedBytes_;
 };
 }  // namespace paddle
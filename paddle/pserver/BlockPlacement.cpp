@@ -0,0 +1,159 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "paddle/utils/Logging.h"
+
+#include "BlockPlacement.h"
+
+namespace paddle {
+
+BlockPlacement::BlockPlacement(size_t serviceNum)
+    : serviceNum_(serviceNum), probing_(false) {
+  CHECK_GT(serviceNum_, 0UL);
+  loads_.resize(serviceNum_);
+}
+
+std::vector<double> BlockPlacement::getServerLoads() const {
+  std::vector<double> loads(serviceNum_, 0);
+  for (size_t serverId = 0; serverId < serviceNum_; ++serverId) {
+    for (const auto& block : loads_[serverId]) {
+      loads[serverId] += block.second.cost();
+    }
+  }
+  return loads;
+}
+
+void BlockPlacement::logServerLoads(const std::string& title,
+                                    const std::vector<double>& loads) const {
+  double total = 0;
+  for (auto load : loads) {
+    total += load;
+  }
+  double avg = total / loads.size();
+  std::ostringstream os;
+  for (size_t serverId = 0; serverId < loads.size(); ++serverId) {
+    os << " " << serverId << ":" << loads[serverId] * 1e-6 << "MB("
+       << (avg > 0 ? loads[serverId] / avg : 0) << ")";
+  }
+  LOG(INFO) << title << ", load of each pserver(ratio to average):"
+            << os.str();
+}
+
+size_t BlockPlacement::rebalance(double tolerance,
+                                 size_t maxMoves,
+                                 BlockPlacement* plan) {
+  CHECK_EQ(plan->serviceNum_, serviceNum_);
+  plan->table_ = table_;
+  std::vector<double> loads = getServerLoads();
+  double total = 0;
+  for (auto load : loads) {
+    total += load;
+  }
+  if (total <= 0) {
+    return 0;
+  }
+  double avg = total / serviceNum_;
+  logServerLoads("before rebalance", loads);
+
+  /// blocks of each pserver, hottest first
+  std::vector<std::vector<std::pair<double, BlockKey>>> blocks(serviceNum_);
+  for (size_t serverId = 0; serverId < serviceNum_; ++serverId) {
+    auto& serverBlocks = blocks[serverId];
+    serverBlocks.reserve(loads_[serverId].size());
+    for (const auto& block : loads_[serverId]) {
+      serverBlocks.push_back(std::make_pair(block.second.cost(), block.first));
+    }
+    std::sort(serverBlocks.begin(),
+              serverBlocks.end(),
+              [](const std::pair<double, BlockKey>& a,
+                 const std::pair<double, BlockKey>& b) {
+                return a.first > b.first;
+              });
+  }
+
+  std::vector<size_t> nextBlock(serviceNum_, 0);
+  size_t numMoves = 0;
+  while (numMoves < maxMoves) {
+    auto maxIt = std::max_element(loads.begin(), loads.end());
+    auto minIt = std::min_element(loads.begin(), loads.end());
+    size_t maxId = maxIt - loads.begin();
+    size_t minId = minIt - loads.begin();
+    if (*maxIt <= (1 + tolerance) * avg) {
+      break;
+    }
+
+    /// the hottest block which still decreases the maximum load if moved
+    auto& candidates = blocks[maxId];
+    size_t& i = nextBlock[maxId];
+    while (i < candidates.size() && *minIt + candidates[i].first >= *maxIt) {
+      ++i;
+    }
+    if (i == candidates.size()) {
+      break;
+    }
+    const auto& block = candidates[i++];
+    *maxIt -= block.first;
+    *minIt += block.first;
+    plan->table_[block.second] = minId;
+    ++numMoves;
+  }
+
+  logServerLoads("after rebalance", loads);
+  LOG(INFO) << "rebalance moved " << numMoves << " blocks, "
+            << plan->table_.size() << " blocks are not at default pserver";
+
+  for (auto& serverLoads : loads_) {
+    serverLoads.clear();
+  }
+  return numMoves;
+}
+
+bool BlockPlacement::load(const std::string& filename) {
+  std::ifstream fin(filename);
+  if (!fin.is_open()) {
+    return false;
+  }
+  table_.clear();
+  size_t paraId;
+  int64_t blockId;
+  int serverId;
+  while (fin >> paraId >> blockId >> serverId) {
+    CHECK_GE(serverId, 0);
+    CHECK_LT((size_t)serverId, serviceNum_)
+        << "placement file " << filename << " is for more pservers";
+    table_[BlockKey(paraId, blockId)] = serverId;
+  }
+  LOG(INFO) << "load placement of " << table_.size() << " blocks from "
+            << filename;
+  return true;
+}
+
+bool BlockPlacement::save(const std::string& filename) const {
+  std::ofstream fout(filename);
+  if (!fout.is_open()) {
+    LOG(WARNING) << "fail to open placement file " << filename;
+    return false;
+  }
+  for (const auto& block : table_) {
+    fout << block.first.first << " " << block.first.second << " "
+         << block.second << "\n";
+  }
+  return fout.good();
+}
+
+}  // namespace paddle
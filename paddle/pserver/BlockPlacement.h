@@ -0,0 +1,131 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace paddle {
+
+/**
+ * Decide which pserver stores a parameter block.
+ *
+ * By default block blockId of a parameter is stored at pserver
+ * (blockId + hash(name)) % serviceNum, which does not know anything about
+ * load. With skewed sparse ids (e.g. embedding tables), a few pservers
+ * receive most of the rows while the others idle.
+ *
+ * When probing is enabled, the bytes and requests of every block are
+ * measured. rebalance() then moves the hottest blocks from overloaded pservers
+ * to the least loaded ones and reports the load of each pserver before and
+ * after. Since all trainers and pservers must agree on the placement, the
+ * new table is saved to file and applied by every client at init, i.e. when
+ * training is restarted from a saved pass.
+ */
+class BlockPlacement {
+public:
+  /// serviceNum means the number of ParameterServers
+  explicit BlockPlacement(size_t serviceNum);
+
+  /// pserver of the block, nameHash is the hash of parameter name
+  int getServerId(size_t paraId, int64_t nameHash, int64_t blockId) const {
+    if (!table_.empty()) {
+      auto it = table_.find(BlockKey(paraId, blockId));
+      if (it != table_.end()) {
+        return it->second;
+      }
+    }
+    return std::abs((blockId + nameHash) % (int64_t)serviceNum_);
+  }
+
+  void enableProbe(bool enable) { probing_ = enable; }
+  bool isProbing() const { return probing_; }
+
+  /**
+   * @brief record bytes of one request to a block.
+   *
+   * @note  it is lock-free, loads of one pserver must only be probed by
+   *        one thread at a time.
+   */
+  void probeBlock(int serverId, size_t paraId, int64_t blockId, size_t bytes) {
+    BlockLoad& load = loads_[serverId][BlockKey(paraId, blockId)];
+    load.bytes += bytes;
+    load.requests++;
+  }
+
+  /**
+   * @brief plan moves of hot blocks according to the probed loads.
+   *
+   * Blocks are moved one by one, hottest first, from the most loaded pserver
+   * to the least loaded one, until every pserver is within
+   * (1 + tolerance) * average load, or no move decreases the maximum load.
+   * Probed loads are reset.
+   *
+   * @param[out] plan   placement after the moves. The current placement is
+   *                    not changed, since it is still used by the others.
+   * @return number of blocks moved
+   */
+  size_t rebalance(double tolerance, size_t maxMoves, BlockPlacement* plan);
+
+  /// load of each pserver from probed blocks, under current placement
+  std::vector<double> getServerLoads() const;
+
+  /// number of blocks whose placement overrides the default one
+  size_t size() const { return table_.size(); }
+
+  /**
+   * Placement file is a text file, each line of which is
+   * "para_id block_id server_id".
+   */
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  /// weight of one request in bytes, covering header and per block overhead
+  static const size_t kRequestBytes = 32;
+
+protected:
+  typedef std::pair<size_t, int64_t> BlockKey;
+  struct BlockKeyHash {
+    size_t operator()(const BlockKey& key) const {
+      return std::hash<size_t>()(key.first) + key.second;
+    }
+  };
+  struct BlockLoad {
+    BlockLoad() : bytes(0), requests(0) {}
+    double cost() const { return bytes + (double)requests * kRequestBytes; }
+
+    size_t bytes;
+    size_t requests;
+  };
+  typedef std::unordered_map<BlockKey, BlockLoad, BlockKeyHash> BlockLoadMap;
+
+  void logServerLoads(const std::string& title,
+                      const std::vector<double>& loads) const;
+
+  size_t serviceNum_;
+  bool probing_;
+  /// blocks not placed at the default pserver
+  std::unordered_map<BlockKey, int, BlockKeyHash> table_;
+  /// probed loads of blocks stored at each pserver
+  std::vector<BlockLoadMap> loads_;
+};
+
+}  // namespace paddle
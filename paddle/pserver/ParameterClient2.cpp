@@ -18,10 +18,28 @@ limitations under the License. */
 #include "paddle/utils/StringUtil.h"
 #include "paddle/utils/Flags.h"
 #include "paddle/utils/Stat.h"
+#include "paddle/utils/Trace.h"
 #include "paddle/math/SparseRowMatrix.h"
 
 P_DEFINE_string(pservers, "127.0.0.1", "Comma separated addresses of pservers");
 P_DEFINE_int32(parallel_thread_num, 1, "Thread number for parameter send");
+P_DEFINE_bool(rebalance_parameter_blocks,
+              false,
+              "measure the load of each parameter block at trainer 0, and "
+              "plan a balanced block placement among pservers at the end of "
+              "each pass, which is saved to save_dir");
+P_DEFINE_double(rebalance_tolerance,
+                0.1,
+                "stop moving blocks if the load of every pserver is within "
+                "(1 + rebalance_tolerance) * average load");
+P_DEFINE_int32(rebalance_max_moves,
+               100000,
+               "max number of blocks moved by one rebalance");
+P_DEFINE_string(parameter_placement_dir,
+                "",
+                "directory of the block placement planned by "
+                "rebalance_parameter_blocks. All trainers must use the same "
+                "placement");
 
 namespace paddle {
 
@@ -130,6 +148,20 @@ bool ParameterClient2::init(const std::vector<ParameterPtr>& parameters) {
 
   sparseDistribution_.reset(new SparseParameterDistribution(serviceNum_));
 
+  placement_.reset(new BlockPlacement(serviceNum_));
+  placement_->enableProbe(FLAGS_rebalance_parameter_blocks &&
+                          FLAGS_trainer_id == 0);
+  if (!FLAGS_parameter_placement_dir.empty()) {
+    std::string filename = getPlacementFile(FLAGS_parameter_placement_dir);
+    if (!placement_->load(filename)) {
+      LOG(INFO) << "no placement file " << filename
+                << ", use default placement";
+    } else if (FLAGS_loadsave_parameters_in_pserver) {
+      LOG(WARNING) << "parameters loaded in pserver must be saved with "
+                   << "the same placement " << filename;
+    }
+  }
+
   sleep(2);
 
   initThreads();
@@ -139,6 +171,30 @@ bool ParameterClient2::init(const std::vector<ParameterPtr>& parameters) {
 
 ParameterClient2::~ParameterClient2() { destroy(); }
 
+std::string ParameterClient2::getPlacementFile(
+    const std::string& dirName) const {
+  return dirName + "/pserver_placement." + std::to_string(port_);
+}
+
+void ParameterClient2::rebalanceBlocks(const std::string& dirName) {
+  if (!placement_ || !placement_->isProbing()) {
+    return;
+  }
+  BlockPlacement plan(serviceNum_);
+  placement_->rebalance(
+      FLAGS_rebalance_tolerance, FLAGS_rebalance_max_moves, &plan);
+  if (dirName.empty()) {
+    LOG(WARNING) << "save_dir is not set, block placement is not saved";
+    return;
+  }
+  std::string filename = getPlacementFile(dirName);
+  if (plan.save(filename)) {
+    LOG(INFO) << "block placement is saved to " << filename
+              << ", restart with --parameter_placement_dir=" << dirName
+              << " to apply it";
+  }
+}
+
 void ParameterClient2::destroy() {
   if (clients_.empty()) {
     /// this means not initialized.
@@ -158,6 +214,7 @@ void ParameterClient2::sendParallel(int tid,
 
   for (int j = 0; j < numMyClients; ++j) {
     REGISTER_TIMER("client_sendAndRecv_send");
+    REGISTER_TRACE("client_send", "pserver_client");
     int i = numThreads * j + tid;
     /// Try to make different clients to send data to different pservers
     /// at the same time so that they will not flood data to the same
@@ -176,6 +233,7 @@ void ParameterClient2::sendParallel(int tid,
   SendParameterResponse response;
   for (int j = 0; j < numMyClients; ++j) {
     REGISTER_TIMER("client_sendAndRecv_recv");
+    REGISTER_TRACE("client_recv", "pserver_client");
     int i = numThreads * j + tid;
     i = calcClientId(i, serviceNum_);
     auto msgReader = clients_[i].recv(&response);
@@ -200,6 +258,7 @@ void ParameterClient2::sendParallel(int tid,
       /// storage is continuous, do commit recieved data as that of dense.
       bufs.push_back(buf);
     }
+    recvBytes_ += msgReader->getTotalLength();
     msgReader->readBlocks(bufs);
   }
 }
@@ -245,6 +304,13 @@ void ParameterClient2::prepareSendData(
                         (updateMode == PSERVER_UPDATE_MODE_ADD_GRADIENT ||
                          updateMode == PSERVER_UPDATE_MODE_ASYNC_SGD ||
                          updateMode == PSERVER_UPDATE_MODE_GET_PARAM_SPARSE);
+    /// only probe the traffic of training
+    bool probing = placement_->isProbing() &&
+                   (updateMode == PSERVER_UPDATE_MODE_ADD_GRADIENT ||
+                    updateMode == PSERVER_UPDATE_MODE_ASYNC_SGD ||
+                    updateMode == PSERVER_UPDATE_MODE_GET_PARAM_SPARSE);
+    /// number of times each block is transferred in this request
+    size_t numTransfers = (sendingPara ? 1 : 0) + (sendBackParameter ? 1 : 0);
 
     const auto blockSize = parameter->getConfig().parameter_block_size();
     CHECK_GE(blockSize, 1LU) << "blockSize should > 0 " << blockSize;
@@ -264,10 +330,17 @@ void ParameterClient2::prepareSendData(
         uint64_t endDim = 0;
         for (size_t row = 0; row < nLocalBlocks; ++row) {
           int64_t blockId = localIndices[row];  // local row -> sparse row
-          int serverId = std::abs((blockId + nameHash) % serviceNum_);
+          int serverId =
+              placement_->getServerId(segments.id, nameHash, blockId);
           if (serverId % numThreads != (size_t)tid) {
             continue;
           }
+          if (probing) {
+            placement_->probeBlock(serverId,
+                                   segments.id,
+                                   blockId,
+                                   numTransfers * sizeof(real) * blockSize);
+          }
 
           beginDim = blockId * blockSize;
           endDim = std::min<int64_t>(beginDim + blockSize, paraSize);
@@ -299,7 +372,14 @@ void ParameterClient2::prepareSendData(
       for (uint64_t beginDim = 0; beginDim < paraSize; beginDim = endDim) {
         endDim = std::min<int64_t>(beginDim + blockSize, paraSize);
         int64_t blockId = beginDim / blockSize;
-        int serverId = std::abs((blockId + nameHash) % serviceNum_);
+        int serverId = placement_->getServerId(segments.id, nameHash, blockId);
+        if (probing) {
+          placement_->probeBlock(
+              serverId,
+              segments.id,
+              blockId,
+              numTransfers * sizeof(real) * (size_t)(endDim - beginDim));
+        }
 
         auto& request = sendJob->parallelRequests[serverId];
         ParameterBlock* block = request.add_blocks();
@@ -327,6 +407,7 @@ void ParameterClient2::sendAndReceiveParameter(
     bool sendBackParameter,
     ParameterType sendBackParameterType,
     ParameterType recvParameterType) {
+  REGISTER_TRACE("sendAndReceiveParameter", "pserver_client");
   prepareSendData(updateMode,
                   parameterType,
                   parameterSegments,
@@ -366,7 +447,10 @@ void ParameterClient2::sendParameter(
   }
 }
 
-void ParameterClient2::recvParameter() { recvSyncBarrier_->wait(); }
+void ParameterClient2::recvParameter() {
+  REGISTER_TRACE("recvParameter", "pserver_client");
+  recvSyncBarrier_->wait();
+}
 
 void ParameterClient2::send(int threadId) {
   int index = threadId;
@@ -380,6 +464,7 @@ void ParameterClient2::send(int threadId) {
     }
     for (int j = 0; j < numMyClients; ++j) {
       REGISTER_TIMER("client_send");
+      REGISTER_TRACE("client_send", "pserver_client");
       int i = threadNum_ * j + index;
       /// Try to make different clients to send data to different pservers
       /// at the same time so that they will not flood data to the same
@@ -411,6 +496,7 @@ void ParameterClient2::recv(int threadId) {
     if (stopping_) break;
     for (int j = 0; j < numMyClients; ++j) {
       REGISTER_TIMER("client_recv");
+      REGISTER_TRACE("client_recv", "pserver_client");
       int i = threadNum_ * j + index;
       i = calcClientId(i, serviceNum_);
       if (recvJob->parallelRequests.size()) {
@@ -428,6 +514,7 @@ void ParameterClient2::recv(int threadId) {
                    sizeof(real) * (block.block_size()));
           bufs.push_back(buf);
         }
+        recvBytes_ += msgReader->getTotalLength();
         msgReader->readBlocks(bufs);
       } else {
         auto msgReader = clients_[i].recv(&dataResponse);
@@ -436,13 +523,23 @@ void ParameterClient2::recv(int threadId) {
         if (0 == totalLen) {
           continue;
         }
-        auto& recvMem = recvDataMems_[dataResponse.server_id()];
+        recvBytes_ += totalLen;
+        int serverId = dataResponse.server_id();
+        auto& recvMem = recvDataMems_[serverId];
         CHECK_EQ(dataResponse.blocks_size(), 1)
             << "Only one block currently support now!";
         auto& block = dataResponse.blocks(0);
         CHECK_EQ(totalLen % sizeof(block.data_size()), 0U);
-        recvMem = std::make_shared<CpuMemoryHandle>(totalLen);
-        msgReader->readNextBlock(recvMem.get()->getBuf());
+        if ((size_t)serverId < recvDataIovs_.size() &&
+            recvDataIovs_[serverId].iov_len == totalLen) {
+          /// zero copy, read into the buffer registered by getAllData()
+          recvMem.reset();
+          msgReader->readNextBlock(recvDataIovs_[serverId].iov_base);
+          recvDataInPlace_[serverId] = true;
+        } else {
+          recvMem = std::make_shared<CpuMemoryHandle>(totalLen);
+          msgReader->readNextBlock(recvMem.get()->getBuf());
+        }
       }
     }
     recvSyncBarrier_->wait();
@@ -462,6 +559,7 @@ void ParameterClient2::waitPassFinish() {
 }
 
 void ParameterClient2::synchronize(SyncObject syncObjectId) {
+  REGISTER_TRACE("synchronize", "pserver_client");
   SynchronizeRequest request;
   request.set_sync_object_id(syncObjectId);
   std::vector<SynchronizeResponse> responses;
@@ -32,6 +32,7 @@ limitations under the License. */
 #include "ParameterService.pb.h"
 
 #include "SparseParameterDistribution.h"
+#include "BlockPlacement.h"
 #include "ProtoServer.h"
 
 P_DECLARE_int32(parallel_thread_num);
@@ -510,6 +511,15 @@ public:
 
   void setTrainerId(int trainerId) { trainerId_ = trainerId; }
 
+  /**
+   * @brief plan a load-aware placement of blocks from the loads measured
+   *        since last call, and save it to dirName.
+   *
+   * @note  it only works with --rebalance_parameter_blocks. The plan is
+   *        applied by --parameter_placement_dir when training restarts.
+   */
+  void rebalanceBlocks(const std::string& dirName);
+
 #ifndef PADDLE_DISABLE_TIMER
   void setForwardbackwardTime(uint64_t delta) { forwardbackwordTime_ = delta; }
 #endif
@@ -573,6 +583,9 @@ private:
   /// start necessary threads for threadPool
   void initThreads();
 
+  /// placement file of this client in dirName
+  std::string getPlacementFile(const std::string& dirName) const;
+
 protected:
   /// start port number of pserver
   /// it deduce all ports for dense and sparse with some rules
@@ -592,6 +605,9 @@ protected:
   /// module for sensing sparse parameters distribution on all pservers
   std::unique_ptr<SparseParameterDistribution> sparseDistribution_;
 
+  /// module for deciding pserver of each block and measuring its load
+  std::unique_ptr<BlockPlacement> placement_;
+
   /// thread pool for parallelizing all connections to pservers
   std::unique_ptr<SyncThreadPool> syncThreadPool_;
 
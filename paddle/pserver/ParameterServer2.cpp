@@ -14,6 +14,12 @@ limitations under the License. */
 
 #include "ParameterServer2.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
 #include <algorithm>
 #include <fstream>
 
@@ -39,6 +45,20 @@ P_DEFINE_double(
     1.5,
     "if async_lagged_grad_discard_ratio is not set in trainer_config.conf"
     "use it as defalut value");
+P_DEFINE_int32(async_staleness_bound,
+               0,
+               "if > 0, use bounded staleness in async sgd: a trainer can run "
+               "ahead of the slowest one by at most so many batches, instead "
+               "of discarding lagged gradients");
+P_DEFINE_bool(pserver_background_save,
+              false,
+              "save parameter values of pserver from a snapshot in background, "
+              "so that saveValueVector does not wait for disk");
+P_DEFINE_bool(async_staleness_lr_scaling,
+              true,
+              "in bounded staleness mode, scale the learning rate of a "
+              "gradient by num_gradient_servers / staleness if it is staler "
+              "than num_gradient_servers updates");
 
 namespace paddle {
 
@@ -61,7 +81,8 @@ ParameterServer2::ParameterServer2(const std::string& addr,
       numPassFinishClients_(0),
       allClientPassFinish_(false),
       serverId_(-1),
-      batchId_(-1) {
+      batchId_(-1),
+      snapshotVersion_(0) {
   /**
    * register function for remote client calling, these functions
    * will be mapped to a data structure for quick looking up. each
@@ -123,6 +144,12 @@ bool ParameterServer2::init() {
   asyncTrainerCommitStat_.resize(FLAGS_num_gradient_servers);
   asyncTrainerCommitStat_.assign(asyncTrainerCommitStat_.size(), 0);
 
+  // initialization for bounded staleness
+  asyncStalenessBound_ = 0;
+  asyncTrainerClocks_.assign(FLAGS_num_gradient_servers, 0);
+  asyncTrainerFinished_.assign(FLAGS_num_gradient_servers, false);
+  numAsyncFinishedTrainers_ = 0;
+
   return true;
 }
 
@@ -173,6 +200,13 @@ void ParameterServer2::setConfig(const SetConfigRequest& request,
           static_cast<int64_t>(FLAGS_num_gradient_servers * asyncLaggedRatio);
       LOG(INFO) << "discard lagged async gradient ratio: " << asyncLaggedRatio
                 << " asyncLaggedhreshold: " << asyncLaggedThreshold_;
+      asyncStalenessBound_ = FLAGS_async_staleness_bound;
+      if (asyncStalenessBound_ > 0) {
+        LOG(INFO) << "bounded staleness async sgd, staleness bound: "
+                  << asyncStalenessBound_
+                  << " lr scaling: " << FLAGS_async_staleness_lr_scaling
+                  << ", lagged gradients are not discarded";
+      }
     }
     if (isSparseServer_ && config_.num_batches_per_send_parameter() > 1) {
       /// sparse server must NOT use local update mode
@@ -507,8 +541,14 @@ void ParameterServer2::addGradient(const SendParameterRequest& request,
   }
 }
 
+/// whether request is the last one of a batch of the trainer
+static bool isBatchFinished(const SendParameterRequest& request) {
+  return request.batch_status() == BATCH_FINISH ||
+         request.batch_status() == BATCH_START_AND_FINISH;
+}
+
 bool ParameterServer2::asyncGrdientCommitCheckAndStat(
-    const SendParameterRequest& request) {
+    const SendParameterRequest& request, real* gradientScale) {
   const auto trainerId = request.trainer_id();
   int64_t trainerSteps = asyncTrainerSteps_[trainerId];
   CHECK_GE(asyncUpdateSteps_, trainerSteps)
@@ -519,9 +559,21 @@ bool ParameterServer2::asyncGrdientCommitCheckAndStat(
 
   asyncUpdateSteps_++;
   bool commitGradient = true;
+  *gradientScale = 1.0;
 
   int64_t delta = asyncUpdateSteps_ - trainerSteps;
-  if (delta >= asyncLaggedThreshold_) {
+  if (isBatchFinished(request)) {
+    /// one sample per batch, the lag of its last update
+    REGISTER_BARRIER_LAG_SERVER_SET(
+        *statSet_, "asyncLag", FLAGS_num_gradient_servers, trainerId, delta);
+  }
+  if (asyncStalenessBound_ > 0) {
+    /// bounded staleness commits all gradients, but trusts stale ones less
+    if (FLAGS_async_staleness_lr_scaling &&
+        delta > FLAGS_num_gradient_servers) {
+      *gradientScale = (real)FLAGS_num_gradient_servers / (real)delta;
+    }
+  } else if (delta >= asyncLaggedThreshold_) {
     VLOG(1) << "discard Async Update: "
             << " trainer id: " << trainerId
             << " pserver steps: " << asyncUpdateSteps_
@@ -586,6 +638,14 @@ void ParameterServer2::printAsyncGradientCommitStatAndReset() {
     }
     LOG(INFO) << statFormat.str();
 
+#ifndef PADDLE_DISABLE_TIMER
+    /// lag histogram of each trainer
+    auto lagStat =
+        statSet_->getStat(FLAGS_num_gradient_servers, "asyncLag", BARRIER_LAG);
+    LOG(INFO) << *lagStat;
+    lagStat->reset();
+#endif
+
     /// reset stat
     asyncUpdateSteps_ = 0;
     asyncTrainerSteps_.assign(asyncTrainerSteps_.size(), 0);
@@ -596,6 +656,53 @@ void ParameterServer2::printAsyncGradientCommitStatAndReset() {
   }
 }
 
+int64_t ParameterServer2::getMinAsyncClock() const {
+  int64_t minClock = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < asyncTrainerClocks_.size(); ++i) {
+    if (!asyncTrainerFinished_[i] && asyncTrainerClocks_[i] < minClock) {
+      minClock = asyncTrainerClocks_[i];
+    }
+  }
+  return minClock;
+}
+
+void ParameterServer2::waitAsyncClock(int trainerId) {
+  REGISTER_TIMER_DYNAMIC("asyncStalenessWait", -1, *statSet_);
+  asyncClockCond_.wait([this, trainerId]() {
+    return asyncTrainerClocks_[trainerId] - getMinAsyncClock() <=
+           asyncStalenessBound_;
+  });
+}
+
+void ParameterServer2::advanceAsyncClock(int trainerId) {
+  bool slowest = false;
+  {
+    std::lock_guard<std::mutex> guard(*asyncClockCond_.mutex());
+    /// only the progress of the slowest trainers can unblock others
+    slowest = asyncTrainerClocks_[trainerId] == getMinAsyncClock();
+    ++asyncTrainerClocks_[trainerId];
+  }
+  if (slowest) {
+    asyncClockCond_.notify_all([] {});
+  }
+}
+
+void ParameterServer2::finishAsyncClock(int trainerId) {
+  asyncClockCond_.notify_all([this, trainerId]() {
+    CHECK(!asyncTrainerFinished_[trainerId]);
+    asyncTrainerFinished_[trainerId] = true;
+    /**
+     * the last trainer resets clocks for next pass before it enters the
+     * barrier, so no trainer can start next pass with stale clocks.
+     */
+    if (++numAsyncFinishedTrainers_ == FLAGS_num_gradient_servers) {
+      asyncTrainerClocks_.assign(asyncTrainerClocks_.size(), 0);
+      asyncTrainerFinished_.assign(asyncTrainerFinished_.size(), false);
+      numAsyncFinishedTrainers_ = 0;
+    }
+  });
+}
+
 static ThreadLocal<std::vector<bool>> localBlockBitset_;
 
 void ParameterServer2::asyncSGD(const SendParameterRequest& request,
@@ -612,13 +719,19 @@ void ParameterServer2::asyncSGD(const SendParameterRequest& request,
     localBlockBitset.assign(numBlocks, false);
   }
 
+  if (asyncStalenessBound_ > 0) {
+    /// must not hold parameterMutex_, since it blocks
+    waitAsyncClock(request.trainer_id());
+  }
+
   ReadLockGuard guard(parameterMutex_);
 
   if (request.send_back_parameter()) {
     outputBuffers->reserve(request.blocks_size());
   }
 
-  bool commitGradient = asyncGrdientCommitCheckAndStat(request);
+  real gradientScale = 1.0;
+  bool commitGradient = asyncGrdientCommitCheckAndStat(request, &gradientScale);
 
   VectorPtr* vecs = Parameter::getTlsTempBufs();
   size_t bufferIndex = 0;
@@ -648,6 +761,10 @@ void ParameterServer2::asyncSGD(const SendParameterRequest& request,
         vecs[type]->subVecFrom(*vectors_[type], offset, size);
       }
       vecs[PARAMETER_GRADIENT]->subVecFrom(buffer.base, 0, size);
+      if (gradientScale != 1.0) {
+        /// same as scaling learning rate for sgd and momentum
+        vecs[PARAMETER_GRADIENT]->mulScalar(gradientScale);
+      }
       info.optimizer->update(vecs, config, isSparseServer_ ? 0 : -1);
 
       if (auto callback = info.optimizer->needSpecialTraversal(config)) {
@@ -667,6 +784,10 @@ void ParameterServer2::asyncSGD(const SendParameterRequest& request,
   }  /// foreach block
 
   asyncTrainerSteps_[request.trainer_id()] = asyncUpdateSteps_;
+  if (asyncStalenessBound_ > 0 && isBatchFinished(request)) {
+    /// a batch may be sent in several requests, the clock counts batches
+    advanceAsyncClock(request.trainer_id());
+  }
 
   if (commitGradient && isSparseServer_) {
     /// find blocks that trainer do not request update
@@ -688,8 +809,7 @@ void ParameterServer2::asyncSGD(const SendParameterRequest& request,
     }
   }
 
-  if (commitGradient && (request.batch_status() == BATCH_FINISH ||
-                         request.batch_status() == BATCH_START_AND_FINISH)) {
+  if (commitGradient && isBatchFinished(request)) {
     numSamplesProcessed_ += request.num_samples();
   }
 
@@ -937,11 +1057,21 @@ void ParameterServer2::reduceAndSendData(const SendDataRequest& request,
   response.set_type(request.type());
   response.set_server_id(serverId_);
 
+  if (!dataMems_[0]) {
+    // the piece of this server is empty, reply without data
+    for (auto& mem : dataMems_) {
+      CHECK(!mem) << "Some clients sent data, some sent an empty piece";
+    }
+    std::vector<iovec> outputIovs;
+    callback(response, outputIovs);
+    return;
+  }
   auto sendData = reinterpret_cast<Dtype*>(dataMems_[0].get()->getBuf());
   size_t rawMemSize = dataMems_[0].get()->getSize();
   CHECK_EQ(rawMemSize % sizeof(Dtype), 0U);
   size_t dataMemSize = rawMemSize / sizeof(Dtype);
   for (size_t i = 1; i < dataMems_.size(); ++i) {
+    CHECK(dataMems_[i]) << "Some clients sent data, some sent an empty piece";
     CHECK_EQ(dataMems_[i].get()->getSize(), rawMemSize);
     auto data = reinterpret_cast<Dtype*>(dataMems_[i].get()->getBuf());
     for (size_t j = 0; j < dataMemSize; ++j) {
@@ -1015,6 +1145,12 @@ void ParameterServer2::sendData(const SendDataRequest& request,
         dataMems_[clientId] = std::make_shared<CpuMemoryHandle>(totalLen);
         CHECK_EQ(totalLen % sizeof(block.data_size()), 0U);
         msgReader->readNextBlock(dataMems_[clientId].get()->getBuf());
+      } else {
+        // the piece of this server is empty, forget the data of the last call
+        while (msgReader->getNumBlocks() > 0) {
+          msgReader->readNextBlock(nullptr);
+        }
+        dataMems_[request.client_id()].reset();
       }
       msgReader.reset();
       std::vector<iovec> outputIovs;
@@ -1193,23 +1329,82 @@ void ParameterServer2::op_randomize(const Operation& operation,
   });
 }
 
+/// crc32 of data larger than 4GB
+static uLong crc32Of(uLong crc, const char* data, size_t size) {
+  const size_t kMaxLen = 1UL << 30;
+  while (size > 0) {
+    uInt len = std::min(size, kMaxLen);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data), len);
+    data += len;
+    size -= len;
+  }
+  return crc;
+}
+
+static std::string getValueFileName(const std::string& dirName, int serverId) {
+  constexpr int kBufLen = 100;
+  char buf[kBufLen];
+  snprintf(buf, kBufLen, "/pserver.%04d", serverId);
+  return dirName + buf;
+}
+
+/**
+ * run func(tid, numThreads) with FLAGS_pserver_num_threads threads.
+ * syncThreadPool_ is not used, since saving and loading may come from
+ * another connection while it is running operations.
+ */
+static void parallelRun(const std::function<void(int, size_t)>& func) {
+  size_t numThreads = std::max(FLAGS_pserver_num_threads, 1);
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for (size_t tid = 1; tid < numThreads; ++tid) {
+    threads.emplace_back(func, tid, numThreads);
+  }
+  func(0, numThreads);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+/**
+ * The trailer of a value file, after the values. The checksum is in the
+ * same file as the values, so that both are renamed into place together.
+ * Files without trailer are loaded without checking.
+ */
+struct ValueFileTrailer {
+  uint64_t magic;
+  int64_t version;
+  uint64_t crc;
+} __attribute__((__packed__));
+
+static const uint64_t kValueFileTrailerMagic = 0x5041444443524333UL;
+
 void ParameterServer2::loadValueVector(const LoadValueRequest& request,
                                        ProtoResponseCallback callback) {
   LoadValueResponse response;
   LOG(INFO) << "ParameterServer2::loadValueVector: serverId=" << serverId_;
 
-  constexpr int kBufLen = 100;
-  char buf[kBufLen];
-  snprintf(buf, kBufLen, "/pserver.%04d", static_cast<int>(serverId_));
-  std::string filename = request.dir_name() + buf;
+  /// the file may be still being written by a background save
+  std::lock_guard<std::mutex> saveGuard(valueSaveMutex_);
+  waitValueSaving();
 
-  std::ifstream fs(filename, std::ios_base::binary);
-  CHECK(fs) << "Fail to open " << filename;
+  std::string filename = getValueFileName(request.dir_name(), serverId_);
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Fail to open " << filename;
+  struct stat st;
+  PCHECK(fstat(fd, &st) == 0) << "Fail to stat " << filename;
+  size_t fileSize = st.st_size;
+  CHECK_GE(fileSize, sizeof(Parameter::Header))
+      << "Fail to read parameters in pserver";
+  void* mem = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  PCHECK(mem != MAP_FAILED) << "Fail to mmap " << filename;
+  close(fd);
+  madvise(mem, fileSize, MADV_WILLNEED);
 
   CpuVector& vec = *vectors_[PARAMETER_VALUE];
   Parameter::Header header;
-  CHECK(fs.read(reinterpret_cast<char*>(&header), sizeof(header)))
-      << "Fail to read parameters in pserver";
+  memcpy(&header, mem, sizeof(header));
   CHECK_EQ(header.version, Parameter::kFormatVersion)
       << "Incorrect format version: " << header.version;
   CHECK_EQ(header.size, (size_t)size_)
@@ -1217,8 +1412,41 @@ void ParameterServer2::loadValueVector(const LoadValueRequest& request,
       << "(" << size_ << ") of the pserver: " << serverId_;
   CHECK_EQ(header.valueSize, sizeof(real)) << "Unsupported valueSize "
                                            << header.valueSize;
-  CHECK(fs.read(reinterpret_cast<char*>(vec.getData()),
-                header.size * sizeof(real)));
+  size_t dataSize = header.size * sizeof(real);
+  CHECK_GE(fileSize, sizeof(header) + dataSize)
+      << "Fail to read parameters in pserver";
+
+  /// copy and checksum pieces of the file in parallel
+  const char* src = reinterpret_cast<const char*>(mem) + sizeof(header);
+  char* dest = reinterpret_cast<char*>(vec.getData());
+  size_t numPieces = std::max(FLAGS_pserver_num_threads, 1);
+  std::vector<uLong> crcs(numPieces);
+  std::vector<size_t> pieceSizes(numPieces);
+  parallelRun([&](int tid, size_t numThreads) {
+    size_t begin = dataSize * tid / numThreads;
+    size_t end = dataSize * (tid + 1) / numThreads;
+    memcpy(dest + begin, src + begin, end - begin);
+    crcs[tid] = crc32Of(crc32(0L, Z_NULL, 0), src + begin, end - begin);
+    pieceSizes[tid] = end - begin;
+  });
+  uLong crc = crcs[0];
+  for (size_t i = 1; i < numPieces; ++i) {
+    crc = crc32_combine(crc, crcs[i], pieceSizes[i]);
+  }
+  ValueFileTrailer trailer;
+  bool hasTrailer = fileSize >= sizeof(header) + dataSize + sizeof(trailer);
+  if (hasTrailer) {
+    memcpy(&trailer, src + dataSize, sizeof(trailer));
+    hasTrailer = trailer.magic == kValueFileTrailerMagic;
+  }
+  PCHECK(munmap(mem, fileSize) == 0);
+
+  if (hasTrailer) {
+    CHECK_EQ(trailer.crc, crc) << "Checksum mismatch, " << filename
+                               << " is corrupted";
+    LOG(INFO) << "load " << filename << " of version " << trailer.version
+              << " crc32=" << crc;
+  }
 
   callback(response);
 }
@@ -1228,33 +1456,93 @@ void ParameterServer2::saveValueVector(const SaveValueRequest& request,
   SaveValueResponse response;
   LOG(INFO) << "ParameterServer2::SaveValueVector: serverId=" << serverId_;
 
+  /// only one snapshot is in flight
+  std::lock_guard<std::mutex> saveGuard(valueSaveMutex_);
+  waitValueSaving();
+
   mkDir(request.dir_name().c_str());
 
-  constexpr int kBufLen = 100;
-  char buf[kBufLen];
-  snprintf(buf, kBufLen, "/pserver.%04d", static_cast<int>(serverId_));
-  std::string filename = request.dir_name() + buf;
+  std::string filename = getValueFileName(request.dir_name(), serverId_);
+
+  int64_t version = 0;
+  {
+    REGISTER_TIMER_DYNAMIC("snapshotValue", -1, *statSet_);
+    /// block updates while taking a consistent snapshot
+    std::lock_guard<RWLock> guard(parameterMutex_);
+    CpuVector& vec = vectors_[PARAMETER_APPLY] ? *vectors_[PARAMETER_APPLY]
+                                               : *vectors_[PARAMETER_VALUE];
+    CHECK_EQ((size_t)size_, vec.getSize());
+    if (!valueSnapshot_ || valueSnapshot_->getSize() != vec.getSize()) {
+      valueSnapshot_ = std::make_shared<CpuVector>(vec.getSize());
+    }
+    const real* src = vec.getData();
+    real* dest = valueSnapshot_->getData();
+    size_t size = vec.getSize();
+    parallelRun([&](int tid, size_t numThreads) {
+      size_t begin = size * tid / numThreads;
+      size_t end = size * (tid + 1) / numThreads;
+      memcpy(dest + begin, src + begin, sizeof(real) * (end - begin));
+    });
+    version = ++snapshotVersion_;
+  }
+
+  if (FLAGS_pserver_background_save) {
+    valueSaveThread_.reset(new std::thread([this, filename, version]() {
+      writeValueSnapshot(filename, version);
+    }));
+  } else {
+    writeValueSnapshot(filename, version);
+  }
 
-  std::ofstream fs(filename, std::ios_base::binary);
-  CHECK(fs) << "Fail to open " << filename;
+  callback(response);
+}
+
+void ParameterServer2::writeValueSnapshot(const std::string& filename,
+                                          int64_t version) {
+  REGISTER_TIMER_DYNAMIC("writeValueSnapshot", -1, *statSet_);
+  /// write to a temporary file, so the file is complete once it exists
+  std::string tmpFilename = filename + ".tmp";
+  std::ofstream fs(tmpFilename, std::ios_base::binary);
+  CHECK(fs) << "Fail to open " << tmpFilename;
 
-  CpuVector& vec = vectors_[PARAMETER_APPLY] ? *vectors_[PARAMETER_APPLY]
-                                             : *vectors_[PARAMETER_VALUE];
   Parameter::Header header;
   header.version = Parameter::kFormatVersion;
   header.valueSize = sizeof(real);
-  header.size = size_;
-
-  CHECK_EQ(header.size, vec.getSize());
+  header.size = valueSnapshot_->getSize();
 
   CHECK(fs.write(reinterpret_cast<char*>(&header), sizeof(header)))
       << "Fail to write parameter in pserver: " << serverId_;
 
-  CHECK(fs.write(reinterpret_cast<char*>(vec.getData()),
-                 header.size * sizeof(real)))
+  const char* data = reinterpret_cast<const char*>(valueSnapshot_->getData());
+  size_t dataSize = header.size * sizeof(real);
+  const size_t kChunkSize = 64UL << 20;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  for (size_t pos = 0; pos < dataSize; pos += kChunkSize) {
+    size_t len = std::min(kChunkSize, dataSize - pos);
+    crc = crc32Of(crc, data + pos, len);
+    CHECK(fs.write(data + pos, len))
+        << "Fail to write parameter in pserver: " << serverId_;
+  }
+  ValueFileTrailer trailer;
+  trailer.magic = kValueFileTrailerMagic;
+  trailer.version = version;
+  trailer.crc = crc;
+  CHECK(fs.write(reinterpret_cast<char*>(&trailer), sizeof(trailer)))
       << "Fail to write parameter in pserver: " << serverId_;
+  fs.close();
+  CHECK(fs) << "Fail to write parameter in pserver: " << serverId_;
 
-  callback(response);
+  PCHECK(rename(tmpFilename.c_str(), filename.c_str()) == 0)
+      << "Fail to rename " << tmpFilename;
+  LOG(INFO) << "saved " << filename << " of version " << version
+            << " crc32=" << crc;
+}
+
+void ParameterServer2::waitValueSaving() {
+  if (valueSaveThread_) {
+    valueSaveThread_->join();
+    valueSaveThread_.reset();
+  }
 }
 
 void ParameterServer2::op_RESET(const Operation& operation,
@@ -1513,6 +1801,9 @@ void ParameterServer2::synchronize(const SynchronizeRequest& request,
 
 void ParameterServer2::asyncFinishPass(const SynchronizeRequest& request,
                                        ProtoResponseCallback callback) {
+  if (asyncStalenessBound_ > 0) {
+    finishAsyncClock(request.trainer_id());
+  }
   synchronizeBarriers_[request.sync_object_id()]->wait();
   callback(SynchronizeResponse());
 
@@ -17,6 +17,7 @@ limitations under the License. */
 #include <atomic>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 #include <type_traits>
@@ -289,6 +290,29 @@ protected:
   /// stat per trainer_id
   std::vector<size_t> asyncTrainerCommitStat_;
 
+  /**
+   * for bounded staleness (stale synchronous parallel) in Async Sgd.
+   * instead of discarding lagged gradients, trainers are allowed to run
+   * ahead of the slowest trainer by at most asyncStalenessBound_ batches.
+   * Algorithm:
+   * pserver:
+   * 1. asyncTrainerClocks_[N] counts the batches sent by each trainer.
+   * 2. when push arrives, block it until
+   *    asyncTrainerClocks_[trainer_id] - min(asyncTrainerClocks_)
+   *    <= asyncStalenessBound_, so only the fastest trainers wait.
+   * 3. commit the gradient, scaled down if it is staler than
+   *    num_gradient_servers updates. the last request of a batch advances
+   *    the clock of the trainer.
+   * 4. trainers which finished the pass do not block the others. clocks are
+   *    reset when all trainers finished the pass.
+   * this algorithm is enabled by --async_staleness_bound.
+   */
+  int64_t asyncStalenessBound_;
+  LockedCondition asyncClockCond_;
+  std::vector<int64_t> asyncTrainerClocks_;
+  std::vector<bool> asyncTrainerFinished_;
+  int numAsyncFinishedTrainers_;
+
   /// only used by controller and other control cmd from trainer number 0
   std::unique_ptr<SyncThreadPool> syncThreadPool_;
 
@@ -323,17 +347,52 @@ public:
   };
 
 protected:
-  /// async gradient commit control
-  bool asyncGrdientCommitCheckAndStat(const SendParameterRequest& request);
+  /**
+   * async gradient commit control
+   *
+   * @param[out] gradientScale  scale of the gradient to commit, it is less
+   *                            than 1 for stale gradients in bounded staleness
+   *                            mode.
+   */
+  bool asyncGrdientCommitCheckAndStat(const SendParameterRequest& request,
+                                      real* gradientScale);
   void printAsyncGradientCommitStatAndReset();
 
+  /// bounded staleness control, see asyncStalenessBound_
+  int64_t getMinAsyncClock() const;
+  void waitAsyncClock(int trainerId);
+  void advanceAsyncClock(int trainerId);
+  void finishAsyncClock(int trainerId);
+
+  /**
+   * for checkpoint without stalling training.
+   * saveValueVector() copies the value vector into valueSnapshot_ in
+   * parallel, and returns once the copy is done. valueSaveThread_ then
+   * streams the snapshot to disk with crc32 checksum, while updates go on
+   * with the live value vector. Only one snapshot is in flight, the next
+   * save or load waits for the previous save to finish.
+   */
+  CpuVectorPtr valueSnapshot_;
+  std::unique_ptr<std::thread> valueSaveThread_;
+  int64_t snapshotVersion_;
+  /// guards valueSaveThread_ and valueSnapshot_, held by the save and load
+  /// requests, which may come from different connections
+  std::mutex valueSaveMutex_;
+
+  void writeValueSnapshot(const std::string& filename, int64_t version);
+  /// join valueSaveThread_, the caller holds valueSaveMutex_
+  void waitValueSaving();
+
 public:
   /// disable default parameter for overloading
   /// @rdmaCpu:the id of cpu core hosting RDMA server(0-N)
   /// -1 means using TCP transport instead of RDMA
   ParameterServer2(const std::string& addr, int port, int rdmaCpu = -1);
 
-  ~ParameterServer2() {}
+  ~ParameterServer2() {
+    std::lock_guard<std::mutex> guard(valueSaveMutex_);
+    waitValueSaving();
+  }
 
   static const std::string kRetMsgInvalidMatrixHandle;
   static const std::string kRetMsgInvalidVectorHandle;
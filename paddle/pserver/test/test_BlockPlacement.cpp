@@ -0,0 +1,101 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include "paddle/utils/Util.h"
+#include "paddle/pserver/BlockPlacement.h"
+
+using namespace paddle;  // NOLINT
+
+const size_t kServiceNum = 4;
+const int64_t kNameHash = 7;
+
+TEST(BlockPlacement, defaultPlacement) {
+  BlockPlacement placement(kServiceNum);
+  for (int64_t blockId = 0; blockId < 100; ++blockId) {
+    EXPECT_EQ((blockId + kNameHash) % (int64_t)kServiceNum,
+              placement.getServerId(0, kNameHash, blockId));
+  }
+}
+
+TEST(BlockPlacement, rebalance) {
+  BlockPlacement placement(kServiceNum);
+  placement.enableProbe(true);
+  /// skewed loads, hot blocks are all at the same pserver
+  for (int64_t blockId = 0; blockId < 400; ++blockId) {
+    int serverId = placement.getServerId(0, kNameHash, blockId);
+    size_t bytes = serverId == 0 ? 4000 : 1000;
+    placement.probeBlock(serverId, 0, blockId, bytes);
+  }
+  std::vector<double> before = placement.getServerLoads();
+  double maxBefore = *std::max_element(before.begin(), before.end());
+
+  BlockPlacement plan(kServiceNum);
+  double tolerance = 0.1;
+  size_t numMoves = placement.rebalance(tolerance, 100000, &plan);
+  EXPECT_GT(numMoves, 0UL);
+  EXPECT_EQ(numMoves, plan.size());
+  /// current placement is not changed
+  EXPECT_EQ(0UL, placement.size());
+
+  /// replay the loads with the plan
+  plan.enableProbe(true);
+  for (int64_t blockId = 0; blockId < 400; ++blockId) {
+    int oldServerId = placement.getServerId(0, kNameHash, blockId);
+    size_t bytes = oldServerId == 0 ? 4000 : 1000;
+    plan.probeBlock(plan.getServerId(0, kNameHash, blockId), 0, blockId, bytes);
+  }
+  std::vector<double> after = plan.getServerLoads();
+  double total = 0;
+  for (auto load : after) {
+    total += load;
+  }
+  double maxAfter = *std::max_element(after.begin(), after.end());
+  EXPECT_LT(maxAfter, maxBefore);
+  EXPECT_LE(maxAfter, (1 + tolerance) * total / kServiceNum);
+}
+
+TEST(BlockPlacement, saveAndLoad) {
+  BlockPlacement placement(kServiceNum);
+  placement.enableProbe(true);
+  for (int64_t blockId = 0; blockId < 10; ++blockId) {
+    placement.probeBlock(0, 1, blockId, 1000);
+  }
+  BlockPlacement plan(kServiceNum);
+  placement.rebalance(0.1, 100000, &plan);
+
+  char filename[] = "/tmp/test_BlockPlacement_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(plan.save(filename));
+
+  BlockPlacement loaded(kServiceNum);
+  ASSERT_TRUE(loaded.load(filename));
+  EXPECT_EQ(plan.size(), loaded.size());
+  for (int64_t blockId = 0; blockId < 10; ++blockId) {
+    EXPECT_EQ(plan.getServerId(1, kNameHash, blockId),
+              loaded.getServerId(1, kNameHash, blockId));
+  }
+  unlink(filename);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,6 +22,7 @@ using namespace paddle;  // NOLINT
 using namespace std;     // NOLINT
 
 P_DECLARE_int32(num_gradient_servers);
+P_DECLARE_bool(pserver_background_save);
 P_DEFINE_string(server_addr, "127.0.0.1", "assign server address");
 P_DEFINE_int32(server_cpu, 0, "assign server cpu");
 
@@ -81,6 +82,7 @@ public:
   void setConfigTest();
   void setStatusTest();
   void sendParameterTest();
+  void saveValueTest();
   void sendDataTest(SendDataType type, size_t size);
   void operationTest();
   void mergeBlockSegmentTest();
@@ -167,6 +169,45 @@ void ParameterServer2Tester::sendParameterTest() {
   }
 }
 
+void ParameterServer2Tester::saveValueTest() {
+  setup();
+
+  vector<ParameterPtr> parameterCopies;
+  for (auto& parameter : parameters_) {
+    parameter->getBuf(PARAMETER_VALUE)->uniform(-1.0, 1.0);
+    parameterCopies.emplace_back(
+        new Parameter(parameter->getConfig(), /* useGpu= */ false));
+    parameterCopies.back()
+        ->getBuf(PARAMETER_VALUE)
+        ->copyFrom(*parameter->getBuf(PARAMETER_VALUE));
+  }
+  client_.setParameter();
+
+  std::string dirName = "/tmp/test_ParameterServer2_save";
+  bool oldBackgroundSave = FLAGS_pserver_background_save;
+  FLAGS_pserver_background_save = true;
+  client_.saveValueVector(dirName);
+  FLAGS_pserver_background_save = oldBackgroundSave;
+
+  /// updates are not blocked by saving in background
+  for (auto& parameter : parameters_) {
+    parameter->getBuf(PARAMETER_VALUE)->zeroMem();
+  }
+  client_.setParameter();
+
+  client_.loadValueVector(dirName);
+  client_.getParameter();
+  for (size_t i = 0; i != parameters_.size(); ++i) {
+    real* v1 = parameters_[i]->getBuf(PARAMETER_VALUE)->getData();
+    real* v2 = parameterCopies[i]->getBuf(PARAMETER_VALUE)->getData();
+    size_t size = parameters_[i]->getSize();
+    for (size_t j = 0; j < size; ++j) {
+      EXPECT_EQ(v1[j], v2[j]);
+    }
+  }
+  rmDir(dirName.c_str());
+}
+
 void ParameterServer2Tester::sendDataTest(SendDataType type, size_t size) {
   ParameterClient2 client1(true);
   client1.init(parameters_);
@@ -199,7 +240,14 @@ void ParameterServer2Tester::sendDataTest(SendDataType type, size_t size) {
 
   auto get1 = [&]() {
     LOG(INFO) << "sendData1 get all start";
+    client1.resetRecvBytes();
     client1.getAllData(0, type, getDataReal, size);
+    LOG(INFO) << "received bytes: " << client1.getRecvBytes()
+              << " copied bytes: " << client1.getRecvCopiedBytes();
+    /// every piece is received into getDataReal directly, and the servers
+    /// with an empty piece send nothing
+    CHECK_EQ(client1.getRecvBytes(), size * sizeof(double));
+    CHECK_EQ(client1.getRecvCopiedBytes(), 0UL);
     for (size_t i = 0; i < size; ++i) {
       CHECK_EQ(getDataReal[i], getDataExpect[i]);
     }
@@ -538,6 +586,8 @@ void ParameterServer2Tester::synchronizeTest() {
 
 TEST(ParameterServer2, sendParameter) { g_server->sendParameterTest(); }
 
+TEST(ParameterServer2, saveValue) { g_server->saveValueTest(); }
+
 TEST(ParameterServer2, setConfig) { g_server->setConfigTest(); }
 
 TEST(ParameterServer2, setStatus) { g_server->setStatusTest(); }
@@ -590,6 +640,9 @@ TEST(ParameterServer2, sendData) {
   sleep(2);
   g_server1->sendDataTest(DATA_REDUCE_SUM, 2);
   sleep(2);
+  // the pieces of two servers are empty
+  g_server1->sendDataTest(DATA_REDUCE_SUM, 1);
+  sleep(2);
   g_server1.reset();
   g_server2.reset();
   g_server3.reset();
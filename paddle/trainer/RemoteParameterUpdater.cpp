@@ -20,6 +20,13 @@ limitations under the License. */
 P_DECLARE_int32(trainer_id);
 P_DECLARE_string(save_dir);
 
+P_DEFINE_bool(pipeline_parameter_recv,
+              false,
+              "Do not wait for the updated parameters at the end of batch, "
+              "let forward of next batch wait for each parameter instead. "
+              "Only work with ConcurrentRemoteParameterUpdater and "
+              "num_batches_per_send_parameter=1");
+
 namespace paddle {
 
 static const hl_stream_t kDeviceToHostStream = HPPL_STREAM_1;
@@ -319,6 +326,9 @@ bool RemoteParameterUpdater::finishPass(real cost) {
   } else {
     parameterClient_->asyncFinishPass();
   }
+  if (FLAGS_trainer_id == 0) {
+    parameterClient_->rebalanceBlocks(FLAGS_save_dir);
+  }
   if (localUpdater_) {
     if (config_.center_parameter_update_method() == kElasticAverage) {
       // backup local value to delta as we will get
@@ -362,17 +372,41 @@ ConcurrentRemoteParameterUpdater::ConcurrentRemoteParameterUpdater(
     int passCount,
     std::unique_ptr<ParameterUpdater>&& localUpdater)
     : RemoteParameterUpdater(config, passCount, std::move(localUpdater)) {
-  sendThread_.reset(new std::thread([this]() { this->send(); }));
-  recvThread_.reset(new std::thread([this]() { this->recv(); }));
-
   stopping_ = false;
   oneBatchFinished_ = false;
   separateSendAndRecv_ = true;
+  // local updater computes delta from value, which must be received first.
+  pipelineRecv_ = FLAGS_pipeline_parameter_recv && !localUpdater_;
+  if (FLAGS_pipeline_parameter_recv && localUpdater_) {
+    LOG(WARNING) << "--pipeline_parameter_recv is ignored with a local "
+                 << "updater, e.g. with num_batches_per_send_parameter > 1";
+  }
+  batchPending_ = false;
+  batchStatus_ = BATCH_START;
+  numQueuedBatches_ = 0;
+
+  sendThread_.reset(new std::thread([this]() { this->send(); }));
+  recvThread_.reset(new std::thread([this]() { this->recv(); }));
+}
+
+bool ConcurrentRemoteParameterUpdater::SendOrder::operator()(
+    const SendItem& a, const SendItem& b) const {
+  if (a.batchId != b.batchId) {
+    return a.batchId > b.batchId;
+  }
+  if (a.pid == kFinishBatchPid) {
+    return b.pid != kFinishBatchPid;
+  }
+  if (b.pid == kFinishBatchPid) {
+    return false;
+  }
+  return a.pid > b.pid;
 }
 
 ConcurrentRemoteParameterUpdater::~ConcurrentRemoteParameterUpdater() {
+  waitBatchFinished();
   stopping_ = true;
-  sendQueue_.enqueue(0);
+  sendQueue_.enqueue({0, numQueuedBatches_, 0});
   sendThread_->join();
   recvQueue_.enqueue(0);
   recvThread_->join();
@@ -388,10 +422,29 @@ void ConcurrentRemoteParameterUpdater::finishBatch(real cost) {
     }
   }
 
-  sendQueue_.enqueue(kFinishBatchPid);
+  sendQueue_.enqueue({kFinishBatchPid, numQueuedBatches_++, batchSize_});
 
-  finishBatchCond_.wait([this]() { return oneBatchFinished_; });
+  batchPending_ = true;
+  if (!pipelineRecv_) {
+    waitBatchFinished();
+  }
+  // otherwise forward of next batch waits for values parameter by parameter.
+
+  if (localUpdater_) {
+    ++numBatches_;
+  }
+}
+
+void ConcurrentRemoteParameterUpdater::waitBatchFinished() {
+  if (!batchPending_) {
+    return;
+  }
+  {
+    REGISTER_TIMER("wait_recv");
+    finishBatchCond_.wait([this]() { return oneBatchFinished_; });
+  }
   oneBatchFinished_ = false;
+  batchPending_ = false;
   {
     REGISTER_TIMER("sync_hostToDeviceStream");
     for (auto& para : parameters_) {
@@ -399,14 +452,26 @@ void ConcurrentRemoteParameterUpdater::finishBatch(real cost) {
       hl_stream_synchronize(kHostToDeviceStream);
     }
   }
+}
 
-  if (localUpdater_) {
-    ++numBatches_;
-  }
+bool ConcurrentRemoteParameterUpdater::finishPass(real cost) {
+  waitBatchFinished();
+  return RemoteParameterUpdater::finishPass(cost);
+}
+
+void ConcurrentRemoteParameterUpdater::apply() {
+  waitBatchFinished();
+  RemoteParameterUpdater::apply();
+}
+
+void ConcurrentRemoteParameterUpdater::restore() {
+  waitBatchFinished();
+  RemoteParameterUpdater::restore();
 }
 
 // Use para=NULL to signal the end of one batch
-void ConcurrentRemoteParameterUpdater::send(Parameter* para) {
+void ConcurrentRemoteParameterUpdater::send(Parameter* para,
+                                            int64_t batchSize) {
   const std::string& algorithm = config_.algorithm();
   ParameterUpdateMode mode;
   if (algorithm == TrainAlgorithm::AsyncSGD) {
@@ -429,10 +494,11 @@ void ConcurrentRemoteParameterUpdater::send(Parameter* para) {
         mode,
         sendType,
         paraSegment,
-        batchSize_,
+        batchSize,
         0,              // cost=0
         true,           // sendBackParameter = true
         batchStatus_);  // batchStatus_ = BATCH_FINISH
+    batchStatus_ = BATCH_START;
 
   } else {
     ParameterSegments paraSegTemp;
@@ -449,7 +515,7 @@ void ConcurrentRemoteParameterUpdater::send(Parameter* para) {
     parameterClient_->sendParameter(mode,
                                     sendType,
                                     paraSegment,
-                                    batchSize_,
+                                    batchSize,
                                     0,     // cost=0
                                     true,  // sendBackParameter = true
                                     batchStatus_);
@@ -462,6 +528,10 @@ void ConcurrentRemoteParameterUpdater::recv(Parameter* para) {
     REGISTER_TIMER("copySingleParaToDevice");
     SetDevice device(para->getDeviceId());
     copySingleParaToDevice(para, PARAMETER_VALUE);
+    if (pipelineRecv_) {
+      // forward may read the value as soon as it is marked ready.
+      hl_stream_synchronize(kHostToDeviceStream);
+    }
 
     if (localUpdater_) {
       para->getBuf(PARAMETER_DELTA)->copyFrom(*para->getBuf(PARAMETER_VALUE));
@@ -499,6 +569,7 @@ void ConcurrentRemoteParameterUpdater::recv() {
       FOR_TIMING(timer.start());
       recv(para);
       FOR_TIMING(timer.stop());
+      para->markValueReady();
       oneBatchFinished_ = false;
     }
   }
@@ -509,11 +580,12 @@ void ConcurrentRemoteParameterUpdater::send() {
   StatPtr stat = getStat("send");
   FOR_TIMING(Timer timer);
   while (true) {
-    int pid;
+    SendItem item;
     {
       REGISTER_TIMER("send_dequeue");
-      pid = sendQueue_.dequeue();
+      item = sendQueue_.dequeue();
     }
+    int pid = item.pid;
     if (pid == kFinishBatchPid) {
       batchStatus_ = BATCH_FINISH;
       if (!localUpdater_) {
@@ -530,7 +602,7 @@ void ConcurrentRemoteParameterUpdater::send() {
       }
       Parameter* para = NULL;
       FOR_TIMING(timer.start());
-      send(para);
+      send(para, item.batchSize);
       FOR_TIMING(timer.stop());
       FOR_TIMING(stat->addSample(timer.get()));
       FOR_TIMING(timer.reset());
@@ -544,7 +616,7 @@ void ConcurrentRemoteParameterUpdater::send() {
             ->add(*para->getBuf(PARAMETER_VALUE), -1.0f, 1.0f);
       }
       FOR_TIMING(timer.start());
-      send(para);
+      send(para, item.batchSize);
       FOR_TIMING(timer.stop());
       recvQueue_.enqueue(nonStaticParaIDMap_[para->getID()]);
     }
@@ -559,7 +631,12 @@ void ConcurrentRemoteParameterUpdater::updateImpl(Parameter* para) {
       return;
     }
   }
-  sendQueue_.enqueue(nonStaticParaIDMap_[para->getID()]);
+  // value will be refreshed by recv thread.
+  para->markValueNotReady();
+  sendQueue_.enqueue(
+      {static_cast<int>(nonStaticParaIDMap_[para->getID()]),
+       numQueuedBatches_,
+       batchSize_});
 }
 
 void ConcurrentRemoteParameterUpdater::copySingleParaToDevice(
@@ -724,6 +801,9 @@ bool SparseRemoteParameterUpdater::finishPass(real cost) {
     }
     parameterClient_->asyncFinishPass();
   }
+  if (FLAGS_trainer_id == 0) {
+    parameterClient_->rebalanceBlocks(FLAGS_save_dir);
+  }
 
   return true;
 }
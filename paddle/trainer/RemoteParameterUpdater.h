@@ -176,6 +176,14 @@ protected:
  * help to pipeline device-to-host copy and host-to-network to hide network
  * latency in backward stage.
  * It contains separate send and recv thread for pipeline usage.
+ *
+ * Gradients waiting to be sent are scheduled by the order in which their
+ * values are needed in the next forward (parameter id order, which follows
+ * the layer order of the config), and the updated values are received in
+ * the same order. With --pipeline_parameter_recv, finishBatch() does not
+ * wait for the values: each parameter is marked not ready until it is
+ * received, so the next forward can start on early layers while the values
+ * of late layers are still in flight.
  */
 class ConcurrentRemoteParameterUpdater : public RemoteParameterUpdater {
 public:
@@ -185,6 +193,20 @@ public:
       std::unique_ptr<ParameterUpdater>&& localUpdater);
   ~ConcurrentRemoteParameterUpdater();
 
+  /**
+   * @brief start batch
+   *
+   * @note  batch status is owned by send thread, since the end of
+   *        previous batch may still be in send queue.
+   */
+  virtual PassType startBatch(int64_t batchSize) {
+    if (localUpdater_) {
+      localUpdater_->startBatch(batchSize);
+    }
+    batchSize_ = batchSize;
+    return PASS_TRAIN;
+  }
+
   /**
    * @brief send paraemeters to all pservers
    *
@@ -193,11 +215,16 @@ public:
    *        do synchronization for all asynchronous host-to-device copy.
    */
   virtual void finishBatch(real cost);
+  virtual bool finishPass(real cost);
+
+  virtual void apply();
+  virtual void restore();
 
 protected:
   virtual void updateImpl(Parameter* para);
   /// internal thread called in send thread
-  void send(Parameter* para);  // para == NULL indicate end of a minibatch
+  void send(Parameter* para,  // para == NULL indicate end of a minibatch
+            int64_t batchSize);
   /// internal function called in recv thread
   void recv(Parameter* para);
   /**
@@ -220,14 +247,35 @@ protected:
   bool needToUpdateRemotely() {
     return (numBatches_ + 1) % config_.num_batches_per_send_parameter() == 0;
   }
+  /// wait for all values of the pipelined batch to be received
+  void waitBatchFinished();
 
 private:
+  /// An item of the send queue: a parameter, or the end of a batch.
+  struct SendItem {
+    int pid;
+    /// the batches are sent one after another
+    int64_t batchId;
+    /// the batch size is carried with the item, because with
+    /// --pipeline_parameter_recv the next startBatch() may change batchSize_
+    /// before the item is sent
+    int64_t batchSize;
+  };
+
+  /**
+   * Send order of the items in send queue: parameters needed earlier in
+   * forward are sent first, and the end of batch is always sent last.
+   */
+  struct SendOrder {
+    bool operator()(const SendItem& a, const SendItem& b) const;
+  };
+
   /// send thread used for overlapping
   std::unique_ptr<std::thread> sendThread_;
   /// recv thread used for overlapping
   std::unique_ptr<std::thread> recvThread_;
-  /// buffer queue for overlapping
-  Queue<int> sendQueue_;
+  /// buffer queue for overlapping, ordered by SendOrder
+  PriorityQueue<SendItem, SendOrder> sendQueue_;
   /// buffer queue for overlapping
   Queue<int> recvQueue_;
   /// flags indicating to stop
@@ -236,6 +284,12 @@ private:
   /// thread calling finishBatch and internal recv thread
   LockedCondition finishBatchCond_;
   bool oneBatchFinished_;
+  /// finishBatch() returns before the values are received
+  bool pipelineRecv_;
+  /// a pipelined batch is sent but its values may not be received yet
+  bool batchPending_;
+  /// number of batches whose end has been put in send queue
+  int64_t numQueuedBatches_;
 };
 
 // TODO(yanfei):
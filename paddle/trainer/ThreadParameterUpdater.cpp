@@ -20,11 +20,17 @@ limitations under the License. */
 #include "paddle/utils/Thread.h"
 
 P_DECLARE_int32(trainer_count);
+P_DECLARE_bool(hogwild);
 
 namespace paddle {
 
 SgdThreadUpdater::SgdThreadUpdater(const OptimizationConfig& optConfig)
-    : config_(optConfig), numSamplesProcessed_(0) {
+    : config_(optConfig),
+      numSamplesProcessed_(0),
+      hogwild_(FLAGS_hogwild && FLAGS_trainer_count > 1) {
+  // the sums of the averager would get one value per thread and batch
+  CHECK(!hogwild_ || optConfig.average_window() <= 0)
+      << "--hogwild does not support average_window";
   // fill types
   auto types = sgdOptimizerGetTypes(optConfig, false /*inPserver*/);
   for (auto type : types) {
@@ -58,6 +64,16 @@ void SgdThreadUpdater::init(std::vector<ParameterPtr>& parameters) {
       para->enableBufType(PARAMETER_GRADIENT);
     }
   }
+
+  denseParameters_.clear();
+  denseOffsets_.assign(1, 0);
+  for (auto& para : parameters_) {
+    if (!para->useGpu() && !para->isGradSparseUpdate() && !hogwild_) {
+      denseParameters_.push_back(para.get());
+      size_t end = denseOffsets_.back() + para->getSize();
+      denseOffsets_.push_back((end + 7) / 8 * 8);
+    }
+  }
 }
 
 void SgdThreadUpdater::startPass() {
@@ -78,7 +94,12 @@ bool SgdThreadUpdater::finishPass(real cost) {
 }
 
 void SgdThreadUpdater::updateImpl(Parameter* para) {
-  if (!para->useGpu()) return;
+  if (!para->useGpu()) {
+    if (hogwild_) {
+      hogwildUpdate(para);
+    }
+    return;
+  }
   SetDevice setDevice(para->getDeviceId());
   ParameterOptimizer* optimizer = optimizers_[para->getID()].get();
   optimizer->update(para->getBufs(), para->getConfig());
@@ -90,6 +111,38 @@ void SgdThreadUpdater::updateImpl(Parameter* para) {
   para->clearGradient();
 }
 
+void SgdThreadUpdater::hogwildUpdate(Parameter* para) {
+  // para belongs to one trainer thread. Its value and optimizer buffers are
+  // shared with the main parameter, its gradient is its own. The special
+  // traversal runs once per batch in finishBatch().
+  ParameterOptimizer* optimizer = optimizers_[para->getID()].get();
+  if (!para->isGradSparseUpdate()) {
+    optimizer->update(para->getBufs(), para->getConfig());
+    para->clearGradient();
+    return;
+  }
+
+  SparseRowCpuMatrix* grad =
+      dynamic_cast<SparseRowCpuMatrix*>(para->getMat(PARAMETER_GRADIENT).get());
+  CHECK(grad) << "Internal error: " << para->getName();
+  VectorPtr* vecs = Parameter::getTlsTempBufs();
+  size_t width = para->getConfig().dims(1);
+  std::vector<unsigned int>& localIndices = grad->getLocalIndices();
+  for (size_t i = 0; i < localIndices.size(); ++i) {
+    auto id = localIndices[i];
+    for (auto type : parameterTypes_) {
+      if (type == PARAMETER_GRADIENT) {
+        vecs[type]->subVecFrom(grad->getLocalRow(i), 0, width);
+      } else {
+        vecs[type]->subVecFrom(*para->getBuf(type), id * width, width);
+      }
+    }
+    std::lock_guard<SpinLock> guard(rowLocks_[id % kNumRowLocks]);
+    optimizer->update(vecs, para->getConfig(), id);
+  }
+  para->clearGradient();
+}
+
 void SgdThreadUpdater::threadTraverse(
     const ParameterOptimizer::TraverseCallback& callback,
     int tid,
@@ -192,12 +245,19 @@ PassType SgdThreadUpdater::startBatch(int64_t batchSize) {
 void SgdThreadUpdater::finishBatch(real cost) {
   getGlobalSyncThreadPool()->exec([&](int tid, size_t numThreads) {
     for (auto& para : parameters_) {
-      if (para->isGradSparseUpdate()) {
+      if (hogwild_ && !para->useGpu()) {
+        // the gradients were applied by the trainer threads before backward()
+        // returned, only the traversal is left
+        auto callback = optimizers_[para->getID()]->needSpecialTraversal(
+            para->getConfig());
+        if (callback) {
+          threadTraverse(callback, tid, numThreads, para.get());
+        }
+      } else if (para->isGradSparseUpdate()) {
         threadUpdateSparse(tid, numThreads, para.get());
-      } else if (!para->useGpu()) {
-        threadUpdateDense(tid, numThreads, para.get());
       }
     }
+    threadUpdateDense(tid, numThreads);
   });
 
   for (auto& para : parameters_) {
@@ -223,14 +283,13 @@ void SgdThreadUpdater::threadUpdateSparse(int tid,
         para->getMat(PARAMETER_GRADIENT).get());
     std::vector<uint32_t>& sparseIds = mainMat->getIds(tid);
 
-    for (auto id : sparseIds) {
-      // setup sub bufs
-      for (auto type : parameterTypes_) {
-        vecs[type]->subVecFrom(*para->getBuf(type), id * width, width);
-      }
-      optimizer->update(vecs, para->getConfig(), id);
-      vecs[PARAMETER_GRADIENT]->zeroMem();
-    }
+    // the ids of a thread are not touched by the other threads
+    SparseRows rows(para,
+                    sparseIds.data(),
+                    sparseIds.size(),
+                    para->getBuf(PARAMETER_GRADIENT)->getData(),
+                    /* localGrad= */ false);
+    optimizer->updateRows(rows, para->getConfig());
     sparseIds.clear();
   } else if (dynamic_cast<SparseRowCpuMatrix*>(
                  para->getMat(PARAMETER_GRADIENT).get())) {
@@ -243,20 +302,14 @@ void SgdThreadUpdater::threadUpdateSparse(int tid,
 
     auto interval =
         calcSplitArrayInterval(localIndices.size(), tid, numThreads);
-    for (size_t i = interval.first; i < interval.second; ++i) {
-      auto id = localIndices[i];
-      real* row = mainMat->getLocalRow(i);
-      // setup sub bufs
-      for (auto type : parameterTypes_) {
-        if (type == PARAMETER_GRADIENT) {
-          vecs[type]->subVecFrom(row, 0, width);
-        } else {
-          vecs[type]->subVecFrom(*para->getBuf(type), id * width, width);
-        }
-      }
-      optimizer->update(vecs, para->getConfig(), id);
-      vecs[PARAMETER_GRADIENT]->zeroMem();
-    }
+    // the local rows of mainMat are contiguous
+    SparseRows rows(para,
+                    localIndices.data(),
+                    localIndices.size(),
+                    localIndices.empty() ? nullptr : mainMat->getLocalRow(0),
+                    /* localGrad= */ true);
+    optimizer->updateRows(rows.slice(interval.first, interval.second),
+                          para->getConfig());
     // For numThreads > 1, MultiGradientMachine is used, which goes
     // to the above branch.
     CHECK_EQ(numThreads, 1UL);
@@ -278,27 +331,35 @@ void SgdThreadUpdater::threadUpdateSparse(int tid,
   }
 }
 
-void SgdThreadUpdater::threadUpdateDense(int tid,
-                                         size_t numThreads,
-                                         Parameter* para) {
-  int pid = para->getID();
-  ParameterOptimizer* optimizer = optimizers_[pid].get();
+void SgdThreadUpdater::threadUpdateDense(int tid, size_t numThreads) {
   VectorPtr* vecs = Parameter::getTlsTempBufs();
 
+  // Each thread takes an equal share of the flat array, so that a thread
+  // only visits the few parameters overlapping its share, instead of every
+  // thread updating a small slice of every parameter.
   auto interval = calcSplitArrayInterval(
-      para->getSize(), (size_t)tid, numThreads, 8LU /*for avx*/);
+      denseOffsets_.back(), (size_t)tid, numThreads, 8LU /*for avx*/);
 
-  // setup sub bufs
-  for (auto type : parameterTypes_) {
-    vecs[type]->subVecFrom(*para->getBuf(type), interval);
-  }
+  for (size_t i = 0; i < denseParameters_.size(); ++i) {
+    Parameter* para = denseParameters_[i];
+    size_t start = denseOffsets_[i];
+    size_t begin = std::max(interval.first, start);
+    size_t end = std::min(interval.second, start + para->getSize());
+    if (begin >= end) continue;
+
+    // setup sub bufs
+    for (auto type : parameterTypes_) {
+      vecs[type]->subVecFrom(*para->getBuf(type), begin - start, end - begin);
+    }
 
-  // update
-  optimizer->update(vecs, para->getConfig());
-  vecs[PARAMETER_GRADIENT]->zeroMem();
+    // update
+    ParameterOptimizer* optimizer = optimizers_[para->getID()].get();
+    optimizer->update(vecs, para->getConfig());
+    vecs[PARAMETER_GRADIENT]->zeroMem();
 
-  if (auto callback = optimizer->needSpecialTraversal(para->getConfig())) {
-    callback(vecs, para->getConfig(), -1LU);
+    if (auto callback = optimizer->needSpecialTraversal(para->getConfig())) {
+      callback(vecs, para->getConfig(), -1LU);
+    }
   }
 }
 
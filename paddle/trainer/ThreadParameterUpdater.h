@@ -14,6 +14,7 @@ limitations under the License. */
 
 #pragma once
 
+#include "paddle/utils/Locks.h"
 #include "paddle/utils/Util.h"
 #include "paddle/parameter/AverageOptimizer.h"
 #include "paddle/parameter/FirstOrderOptimizer.h"
@@ -37,6 +38,12 @@ namespace paddle {
    supplied to backward() and forwardBackward().
    For CPU, the parameter updates happens in separate threads maintained by this
    class.
+   With --hogwild, the CPU parameters are instead updated in updateImpl() too,
+   called by every trainer thread of MultiGradientMachine with its own
+   gradient and the shared value. Rows of sparse parameters are then guarded
+   by striped spin locks, dense parameters are updated without locks. The
+   special traversals run once per batch in finishBatch(), and model
+   averaging is not supported.
  */
 class SgdThreadUpdater : public ParameterUpdater {
 public:
@@ -64,14 +71,33 @@ protected:
   OptimizationConfig config_;
   int64_t numSamplesProcessed_;
 
+  // Whether the trainer threads update the CPU parameters (--hogwild).
+  bool hogwild_;
+
+  // Row locks of sparse parameters in hogwild mode, row i uses
+  // rowLocks_[i % kNumRowLocks].
+  static const size_t kNumRowLocks = 64;
+  SpinLock rowLocks_[kNumRowLocks];
+
   // One optimizers for each parameter.
   std::vector<std::unique_ptr<ParameterOptimizer>> optimizers_;
 
+  // The dense CPU parameters updated by threadUpdateDense(), seen as one
+  // flat array where denseParameters_[i] starts at denseOffsets_[i].
+  // The offsets are rounded up to multiples of 8 for avx, the last one is
+  // the total size.
+  std::vector<Parameter*> denseParameters_;
+  std::vector<size_t> denseOffsets_;
+
   // The update function for CPU sparse parameters.
   void threadUpdateSparse(int tid, size_t numThreads, Parameter* para);
 
-  // The update function for CPU dense parameters.
-  void threadUpdateDense(int tid, size_t numThreads, Parameter* para);
+  // The update function for CPU dense parameters, all of them at once.
+  void threadUpdateDense(int tid, size_t numThreads);
+
+  // The update function for a CPU parameter of a trainer thread in hogwild
+  // mode.
+  void hogwildUpdate(Parameter* para);
   // The update function for after update operations, such as averager.
   void threadTraverse(const ParameterOptimizer::TraverseCallback& callback,
                       int tid,
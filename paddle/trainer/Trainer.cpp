@@ -26,6 +26,7 @@ limitations under the License. */
 
 #include "paddle/utils/PythonUtil.h"
 #include "paddle/utils/Stat.h"
+#include "paddle/utils/Trace.h"
 #include "paddle/utils/Util.h"
 #include "paddle/utils/Excepts.h"
 #include "paddle/utils/GlobalConstants.h"
@@ -403,7 +404,10 @@ void Trainer::startTrain() {
   trainerInternal_.getGradientMachine()->start(*config_, dataProvider_);
 }
 
-void Trainer::finishTrain() { trainerInternal_.getGradientMachine()->finish(); }
+void Trainer::finishTrain() {
+  Tracer::finish();
+  trainerInternal_.getGradientMachine()->finish();
+}
 
 void Trainer::startTrainPass() {
   stats_->reset();
@@ -14,16 +14,117 @@ limitations under the License. */
 
 #undef PADDLE_DISABLE_TIMER
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
 #include "Trainer.h"
+#include "paddle/gserver/layers/Layer.h"
 #include "paddle/utils/Stat.h"
 #include "paddle/utils/Util.h"
 
+P_DECLARE_string(config);
 P_DECLARE_int32(test_period);
 
 P_DEFINE_bool(feed_data, false, "Wether to read data from DataProvider.");
+P_DEFINE_int32(benchmark_warmup,
+               10,
+               "Number of batches run by --job=time before the measurement");
+P_DEFINE_int32(benchmark_iterations,
+               0,
+               "Number of batches measured by --job=time, "
+               "0 for test_period batches");
+P_DEFINE_string(benchmark_output,
+                "",
+                "File to write the result of --job=time to, as JSON. "
+                "The JSON is logged if empty");
 
 namespace paddle {
 
+namespace {
+
+/// Nearest-rank percentile of sorted values, 0 <= p <= 1.
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+/// Number of tokens of a batch: the rows of its first sequence input, or
+/// the number of samples if no input is a sequence.
+int64_t countTokens(const DataBatch& dataBatch) {
+  for (auto& arg : dataBatch.getStreams()) {
+    if (arg.sequenceStartPositions) {
+      return arg.getBatchSize();
+    }
+  }
+  return dataBatch.getSize();
+}
+
+std::string jsonString(const std::string& str) {
+  std::ostringstream os;
+  os << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c
+         << std::dec;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+  return os.str();
+}
+
+double toMs(double usec) { return usec * 1e-3; }
+
+/// What is collected over the batches of one run.
+struct BenchmarkRun {
+  std::vector<uint64_t> stepUsec;
+  uint64_t dataUsec;
+  uint64_t forwardUsec;
+  uint64_t backwardUsec;
+  uint64_t updateUsec;
+  int64_t numSamples;
+  int64_t numTokens;
+  BenchmarkRun()
+      : dataUsec(0),
+        forwardUsec(0),
+        backwardUsec(0),
+        updateUsec(0),
+        numSamples(0),
+        numTokens(0) {}
+};
+
+}  // namespace
+
+/**
+ * Benchmark of the training of one batch, for --job=time.
+ *
+ * After --benchmark_warmup batches, --benchmark_iterations batches are
+ * measured (with --feed_data each one reads a new batch, otherwise the same
+ * batch is trained again). They run through the normal forwardBackward()
+ * path, without any timing inside the batch, and give:
+ * - the throughput in samples and tokens per second,
+ * - the mean, p50, p99, min and max latency of a step.
+ *
+ * Then as many batches are run again with the layer timing on and with
+ * separate forward() and backward() calls. These batches are slower, so
+ * they only give the breakdown:
+ * - the mean time per batch of the phases: data, forward, backward (which
+ *   includes merge with trainer_count > 1, and update with pipelined
+ *   updates), merge of the CPU gradients by each trainer thread, and update,
+ * - the forward and backward time per batch of each layer, summed over the
+ *   trainer threads and the frames of recurrent layer groups (a layer group
+ *   also includes the time of its own layers).
+ */
 void Trainer::time() {
   startTrain();
 
@@ -41,28 +142,139 @@ void Trainer::time() {
   std::vector<paddle::Argument> outputs;
   // burning time
   LOG(INFO) << "Burning time...";
-  for (int n = 0; n < 10; ++n) {
+  for (int n = 0; n < FLAGS_benchmark_warmup; ++n) {
     trainerInternal_.trainOneBatch(n, dataBatch, &outputs);
   }
   LOG(INFO) << "Burning time end.";
 
-  for (int n = 0; n < FLAGS_test_period; n++) {
-    if (FLAGS_feed_data) {
-      REGISTER_TIMER("GetData");
-      num = dataProvider_->getNextBatch(batchSize, &dataBatch);
-    }
+  int iterations = FLAGS_benchmark_iterations > 0 ? FLAGS_benchmark_iterations
+                                                  : FLAGS_test_period;
+  TrainerInternal::BatchTimes batchTimes;
+  int64_t batchId = FLAGS_benchmark_warmup;
+  auto run = [&](bool profile, BenchmarkRun* result) {
+    trainerInternal_.setBatchTimes(profile ? &batchTimes : nullptr);
+    Layer::setTiming(profile);
+    for (int n = 0; n < iterations; n++) {
+      Timer stepTimer;
+      if (FLAGS_feed_data) {
+        REGISTER_TIMER("GetData");
+        Timer dataTimer;
+        num = dataProvider_->getNextBatch(batchSize, &dataBatch);
+        result->dataUsec += dataTimer.stop();
+      }
 
-    if (num != batchSize) {
-      break;
-    }
+      if (num != batchSize) {
+        break;
+      }
 
-    {
-      REGISTER_TIMER("FwdBwd");
-      trainerInternal_.trainOneBatch(n, dataBatch, &outputs);
+      {
+        REGISTER_TIMER("FwdBwd");
+        trainerInternal_.trainOneBatch(batchId++, dataBatch, &outputs);
+      }
+      result->stepUsec.push_back(stepTimer.stop());
+      result->forwardUsec += batchTimes.forward;
+      result->backwardUsec += batchTimes.backward;
+      result->updateUsec += batchTimes.update;
+      result->numSamples += dataBatch.getSize();
+      result->numTokens += countTokens(dataBatch);
     }
-  }
+    trainerInternal_.setBatchTimes(nullptr);
+    Layer::setTiming(false);
+  };
+
+  BenchmarkRun measured;
+  run(false, &measured);
+  size_t numSteps = measured.stepUsec.size();
+  CHECK(numSteps) << "No batch is measured, set --benchmark_iterations";
+
+  globalStat.reset();
+  layerForwardStat.reset();
+  layerBackwardStat.reset();
+  BenchmarkRun profiled;
+  run(true, &profiled);
+  // with --feed_data the data may end before the profiling run does
+  double numProfiled = std::max<size_t>(profiled.stepUsec.size(), 1);
+
   globalStat.setThreadInfo(true);
   globalStat.printSegTimerStatus();
+
+  std::vector<uint64_t>& stepUsec = measured.stepUsec;
+  uint64_t totalUsec = 0;
+  for (auto usec : stepUsec) {
+    totalUsec += usec;
+  }
+  std::sort(stepUsec.begin(), stepUsec.end());
+  StatInfo merge = globalStat.getStat("trainerThreadMerge")->getMergedInfo();
+  double mergeUsec = merge.count_ ? (double)merge.total_ / merge.count_ : 0;
+
+  std::unordered_map<std::string, StatPtr> forwardStats;
+  for (auto& stat : layerForwardStat.getAllStats()) {
+    forwardStats[stat->getName()] = stat;
+  }
+  std::unordered_map<std::string, StatPtr> backwardStats;
+  for (auto& stat : layerBackwardStat.getAllStats()) {
+    backwardStats[stat->getName()] = stat;
+  }
+
+  double samplesPerSec = measured.numSamples * 1e6 / totalUsec;
+  double tokensPerSec = measured.numTokens * 1e6 / totalUsec;
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(3);
+  os << "{\n";
+  os << "  \"config\": " << jsonString(FLAGS_config) << ",\n";
+  os << "  \"batch_size\": " << batchSize << ",\n";
+  os << "  \"trainer_count\": " << FLAGS_trainer_count << ",\n";
+  os << "  \"use_gpu\": " << (FLAGS_use_gpu ? "true" : "false") << ",\n";
+  os << "  \"warmup\": " << FLAGS_benchmark_warmup << ",\n";
+  os << "  \"iterations\": " << numSteps << ",\n";
+  os << "  \"profiled_iterations\": " << profiled.stepUsec.size() << ",\n";
+  os << "  \"samples_per_sec\": " << samplesPerSec << ",\n";
+  os << "  \"tokens_per_sec\": " << tokensPerSec << ",\n";
+  os << "  \"step_ms\": {\"mean\": " << toMs((double)totalUsec / numSteps)
+     << ", \"p50\": " << toMs(percentile(stepUsec, 0.5))
+     << ", \"p99\": " << toMs(percentile(stepUsec, 0.99))
+     << ", \"min\": " << toMs(stepUsec.front())
+     << ", \"max\": " << toMs(stepUsec.back()) << "},\n";
+  os << "  \"phase_ms\": {\"data\": " << toMs(profiled.dataUsec / numProfiled)
+     << ", \"forward\": " << toMs(profiled.forwardUsec / numProfiled)
+     << ", \"backward\": " << toMs(profiled.backwardUsec / numProfiled)
+     << ", \"merge\": " << toMs(mergeUsec)
+     << ", \"update\": " << toMs(profiled.updateUsec / numProfiled) << "},\n";
+  os << "  \"layers\": [";
+  bool first = true;
+  for (auto& layerConfig : config_->getConfig().model_config().layers()) {
+    const std::string& name = layerConfig.name();
+    auto forward = forwardStats.find(name);
+    if (forward == forwardStats.end()) continue;
+    StatInfo forwardInfo = forward->second->getMergedInfo();
+    StatInfo backwardInfo;
+    auto backward = backwardStats.find(name);
+    if (backward != backwardStats.end()) {
+      backwardInfo = backward->second->getMergedInfo();
+    }
+    os << (first ? "\n" : ",\n");
+    first = false;
+    os << "    {\"name\": " << jsonString(name)
+       << ", \"type\": " << jsonString(layerConfig.type())
+       << ", \"calls\": " << forwardInfo.count_ / numProfiled
+       << ", \"forward_ms\": " << toMs(forwardInfo.total_ / numProfiled)
+       << ", \"backward_ms\": " << toMs(backwardInfo.total_ / numProfiled)
+       << "}";
+  }
+  os << "\n  ]\n}\n";
+
+  LOG(INFO) << "samples/sec=" << samplesPerSec
+            << " tokens/sec=" << tokensPerSec
+            << " step p50=" << toMs(percentile(stepUsec, 0.5)) << "ms"
+            << " p99=" << toMs(percentile(stepUsec, 0.99)) << "ms";
+  if (FLAGS_benchmark_output.empty()) {
+    LOG(INFO) << "Benchmark result:\n" << os.str();
+  } else {
+    std::ofstream fs(FLAGS_benchmark_output);
+    CHECK(fs) << "Fail to open " << FLAGS_benchmark_output;
+    fs << os.str();
+    LOG(INFO) << "Benchmark result is written to " << FLAGS_benchmark_output;
+  }
   globalStat.reset();
 
   finishTrain();
@@ -26,10 +26,12 @@ limitations under the License. */
 
 #include "paddle/utils/PythonUtil.h"
 #include "paddle/utils/Stat.h"
+#include "paddle/utils/Trace.h"
 #include "paddle/utils/Util.h"
 #include "paddle/utils/GlobalConstants.h"
 #include "paddle/gserver/gradientmachines/NeuralNetwork.h"
 #include "paddle/gserver/layers/ValidationLayer.h"
+#include "paddle/parameter/ParameterUpdaterHook.h"
 
 #include "ThreadParameterUpdater.h"
 #include "RemoteParameterUpdater.h"
@@ -44,12 +46,22 @@ void TrainerInternal::init(const std::shared_ptr<TrainerConfigHelper>& config,
   config_ = config;
   intconfig_ = std::move(intconfig);
   stats_ = stats;
+  bool hogwild = FLAGS_hogwild && intconfig_->trainer_count > 1;
+  CHECK(!hogwild || intconfig_->local)
+      << "--hogwild only works with --local=true";
+  CHECK(!hogwild || !intconfig_->use_old_updater)
+      << "--hogwild does not work with --use_old_updater";
 
   //! in training will use parameter updater definitly.
   //! But only use parameter in testing mode when some parameter in pserver.
   if (!testing || (config_->getOptConfig().use_sparse_remote_updater() &&
                    intconfig_->loadsave_parameters_in_pserver)) {
     createParameterUpdater(testing);
+    // the trainer threads call the updater concurrently, which only
+    // SgdThreadUpdater supports
+    CHECK(!hogwild ||
+          dynamic_cast<SgdThreadUpdater*>(parameterUpdater_.get()))
+        << "--hogwild only works with the sgd algorithm";
   }
 
   gradientMachine_ = gradientMachine;
@@ -66,18 +78,37 @@ void TrainerInternal::init(const std::shared_ptr<TrainerConfigHelper>& config,
 void TrainerInternal::trainOneBatch(int64_t batchId,
                                     const DataBatch& dataBatch,
                                     std::vector<Argument>* outArgs) {
+  Tracer::startBatch();
+  REGISTER_TRACE("trainOneBatch", "trainer");
   // true means updating parameter whenever gradient is ready during backward()
   bool doPipelineUpdate =
       (intconfig_->mode != GradientMachine::kSgdSparseCpuTraining) &&
       (intconfig_->local || intconfig_->use_gpu ||
        intconfig_->trainer_count <= 1);
+  // With --hogwild the trainer threads apply their own CPU gradients, they
+  // call the callback concurrently.
+  bool hogwild = FLAGS_hogwild && intconfig_->trainer_count > 1;
+  if (hogwild) {
+    doPipelineUpdate = true;
+  }
+  // With loss scaling, all the gradients of the batch are checked for
+  // overflow before any parameter is updated. The gradients of several GPUs
+  // are only merged in the pipelined update.
+  bool lossScaling = LossScaler::isEnabled();
+  if (lossScaling) {
+    CHECK(intconfig_->local && !hogwild &&
+          !(intconfig_->use_gpu && intconfig_->trainer_count > 1))
+        << "loss_scaling hooks only work with --local=true, without "
+        << "--hogwild and with one GPU";
+    doPipelineUpdate = false;
+  }
 
   int64_t actualBatchSize = dataBatch.getSize();
   if (actualBatchSize == 0) {
     return;
   }
 
-  bool showStats = intconfig_->show_param_stats_period > 0 &&
+  bool showStats = !hogwild && intconfig_->show_param_stats_period > 0 &&
                    (batchId + 1) % intconfig_->show_param_stats_period == 0 &&
                    intconfig_->trainer_id == 0;
 
@@ -88,7 +119,9 @@ void TrainerInternal::trainOneBatch(int64_t batchId,
 
   const std::vector<Argument>& inArgs = dataBatch.getStreams();
 
+  Timer updateTimer;
   PassType passType = parameterUpdater_->startBatch(actualBatchSize);
+  updateTimer.stop();
 
   if (config_->getOptConfig().use_sparse_remote_updater()) {
     REGISTER_TIMER("prefetch");
@@ -116,20 +149,45 @@ void TrainerInternal::trainOneBatch(int64_t batchId,
     timer.start();
 #endif
     REGISTER_TIMER("forwardBackward");
-    forwardBackwardBatch(
-        inArgs, *outArgs, passType, updateCallback, doPipelineUpdate);
+    REGISTER_TRACE("forwardBackward", "trainer");
+    if (batchTimes_) {
+      Timer forwardTimer;
+      gradientMachine_->forward(inArgs, outArgs, passType);
+      batchTimes_->forward = forwardTimer.stop();
+      Timer backwardTimer;
+      gradientMachine_->backward(doPipelineUpdate ? updateCallback : nullptr);
+      batchTimes_->backward = backwardTimer.stop();
+    } else {
+      forwardBackwardBatch(
+          inArgs, *outArgs, passType, updateCallback, doPipelineUpdate);
+    }
 #ifndef PADDLE_DISABLE_TIMER
     timer.stop();
     parameterUpdater_->setForwardbackwardTime(timer.get());
 #endif
   }
 
-  if (!doPipelineUpdate) {
+  updateTimer.start();
+  bool skipUpdate = false;
+  if (lossScaling) {
+    REGISTER_TIMER("unscaleGradients");
+    auto& parameters = gradientMachine_->getNonStaticParameters();
+    skipUpdate = !LossScaler::unscaleGradients(parameters);
+    if (skipUpdate) {
+      for (auto& para : parameters) {
+        SetDevice device(para->getDeviceId());
+        para->clearGradient();
+      }
+    }
+  }
+  if (!doPipelineUpdate && !skipUpdate) {
+    REGISTER_TRACE("update", "trainer");
     auto& parameters = gradientMachine_->getNonStaticParameters();
     for (auto& para : parameters) {
       updateCallback(para.get());
     }
   }
+  updateTimer.stop();
 
   real cost = 0;
   {
@@ -150,9 +208,17 @@ void TrainerInternal::trainOneBatch(int64_t batchId,
   *stats_ += {actualBatchSize, cost};
   {
     REGISTER_TIMER("finishBatch");
-    parameterUpdater_->finishBatch(cost);
+    updateTimer.start();
+    // the updaters may apply the gradients in finishBatch()
+    if (!skipUpdate) {
+      parameterUpdater_->finishBatch(cost);
+    }
+    updateTimer.stop();
   }
 
+  if (batchTimes_) {
+    batchTimes_->update = updateTimer.get();
+  }
   if (showStats) {
     showParameterStats(paraStats);
   }
@@ -273,7 +339,9 @@ void TrainerInternal::createParameterUpdater(bool testing) {
     CHECK_EQ(config_->getOptConfig().num_batches_per_send_parameter(), 1)
         << "num_batches_per_send_parameter should be one in local mode!";
 
-    if (GradientMachine::kSgdSparseCpuTraining == intconfig_->mode) {
+    if (GradientMachine::kSgdSparseCpuTraining == intconfig_->mode ||
+        (FLAGS_hogwild && intconfig_->trainer_count > 1 &&
+         (alg == TrainAlgorithm::SGD || alg == TrainAlgorithm::AsyncSGD))) {
       parameterUpdater_.reset(new SgdThreadUpdater(*config_));
     } else if (alg == TrainAlgorithm::SGD || alg == TrainAlgorithm::AsyncSGD) {
       if (config_->getModelConfig().type() == "recursive_nn") {
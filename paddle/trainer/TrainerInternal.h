@@ -41,7 +41,15 @@ public:
     ParaStat() : maxAbsGrad(.0), avgAbsGrad(.0) {}
   };
 
-  TrainerInternal() {}
+  /// Wall time of the phases of one batch, in microseconds.
+  struct BatchTimes {
+    uint64_t forward;
+    uint64_t backward;
+    uint64_t update;
+    BatchTimes() : forward(0), backward(0), update(0) {}
+  };
+
+  TrainerInternal() : batchTimes_(nullptr) {}
 
   /**
    * Intializes trainer internal class
@@ -81,6 +89,14 @@ public:
                      const DataBatch& dataBatch,
                      std::vector<Argument>* outArgs);
 
+  /**
+   * Record the phases of each trainOneBatch() into batchTimes, nullptr to
+   * stop. Forward and backward are then run by two calls of the gradient
+   * machine instead of one forwardBackward(). With pipelined updates, the
+   * update of the parameters is part of the backward time.
+   */
+  void setBatchTimes(BatchTimes* batchTimes) { batchTimes_ = batchTimes; }
+
   /**
    * showParameterStats
    * @param paraStats training stats
@@ -134,6 +150,7 @@ protected:
   std::shared_ptr<TrainerStats> stats_;
   Evaluator* currentEvaluator_;
   Evaluator* evaluator_;
+  BatchTimes* batchTimes_;
 };
 
 }  // namespace paddle
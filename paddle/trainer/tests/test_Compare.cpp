@@ -28,6 +28,7 @@ P_DECLARE_int32(gpu_id);
 P_DECLARE_bool(use_gpu);
 P_DECLARE_string(config);
 P_DECLARE_string(config_args);
+P_DECLARE_bool(overlap_grad_merge);
 
 struct comData {
   vector<Argument> outArgs;
@@ -93,6 +94,17 @@ TEST(Trainer, create) {
     compareGradient(comDataCpu, comData);
     LOG(INFO) << "Cpu4 is completed";
   }
+
+  {
+    LOG(INFO) << "Test cpu4 with overlap_grad_merge=true";
+    comData comData;
+    FLAGS_trainer_count = 4;
+    FLAGS_overlap_grad_merge = true;
+    calcGradient(false, comData);
+    FLAGS_overlap_grad_merge = false;
+    compareGradient(comDataCpu, comData);
+    LOG(INFO) << "Cpu4 overlap_grad_merge is completed";
+  }
 }
 
 double checkBuffer(real* A, real* B, size_t len) {
@@ -38,6 +38,7 @@ P_DECLARE_bool(local);
 P_DECLARE_bool(use_old_updater);
 P_DECLARE_bool(parallel_nn);
 P_DECLARE_string(config_args);
+P_DECLARE_bool(hogwild);
 P_DEFINE_double(max_diff_ratio,
                 0.0f,
                 "max diff ratio allowed for parameters value");
@@ -212,6 +213,45 @@ TEST(compareSparse, NeuralNetwork) {
   FLAGS_parallel_nn = false;
 }
 
+// max |A - B| over all the values of para
+static double maxAbsDiff(const ParameterPtr& paraA, const ParameterPtr& paraB) {
+  const real* A = paraA->getBuf(PARAMETER_VALUE)->getData();
+  const real* B = paraB->getBuf(PARAMETER_VALUE)->getData();
+  double maxDiff = 0;
+  for (size_t i = 0; i < paraA->getSize(); ++i) {
+    maxDiff = std::max<double>(maxDiff, fabs(A[i] - B[i]));
+  }
+  return maxDiff;
+}
+
+TEST(compareSparse, hogwild) {
+  FLAGS_local = 1;
+  FLAGS_num_passes = 0;
+  std::vector<ParameterPtr> initParameters =
+      trainerOnePassTest(configFile1, true, 4);
+  FLAGS_num_passes = 1;
+  std::vector<ParameterPtr> syncParameters =
+      trainerOnePassTest(configFile1, true, 4);
+  FLAGS_hogwild = true;
+  std::vector<ParameterPtr> hogwildParameters =
+      trainerOnePassTest(configFile1, true, 4);
+  FLAGS_hogwild = false;
+
+  // The threads apply their gradients one after another, reading values
+  // which the others have already updated, so the values do not match
+  // synchronous training exactly. With the small learning rate of the
+  // config, the stale reads only change the second order terms of the
+  // update, far below the change made by the training. A lost or repeated
+  // gradient of one thread changes its first order term by 1/4.
+  for (size_t i = 0; i < syncParameters.size(); ++i) {
+    double change = maxAbsDiff(initParameters[i], syncParameters[i]);
+    double diff = maxAbsDiff(syncParameters[i], hogwildParameters[i]);
+    LOG(INFO) << syncParameters[i]->getName() << " change=" << change
+              << " hogwildDiff=" << diff;
+    EXPECT_LE(diff, 0.01 * change) << syncParameters[i]->getName();
+  }
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   initMain(argc, argv);
@@ -0,0 +1,152 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <paddle/parameter/OptimizerFunctions.h>
+#include <paddle/trainer/ThreadParameterUpdater.h>
+#include <paddle/utils/Util.h>
+
+using namespace paddle;  // NOLINT
+
+P_DECLARE_int32(trainer_count);
+
+// Small parameters, most of them not a multiple of 8, so that the share of
+// a thread in the flat array covers several parameters and cuts some of
+// them in the middle.
+const size_t kSizes[] = {3, 17, 40, 5, 64, 1, 29, 8};
+const size_t kNumParameters = sizeof(kSizes) / sizeof(kSizes[0]);
+const int kNumBatches = 4;
+const int kBatchSize = 10;
+
+struct TestConfig {
+  std::string method;
+  real momentum;
+  real decayRate;
+  double averageWindow;
+};
+
+class ThreadUpdateDenseTest : public ::testing::TestWithParam<TestConfig> {
+protected:
+  virtual void SetUp() {
+    const TestConfig& test = GetParam();
+    optConfig_.set_batch_size(kBatchSize);
+    optConfig_.set_learning_rate(0.1);
+    optConfig_.set_learning_method(test.method);
+    optConfig_.set_average_window(test.averageWindow);
+
+    for (size_t i = 0; i < kNumParameters; ++i) {
+      ParameterConfig config;
+      config.set_name("para" + std::to_string(i));
+      config.set_size(kSizes[i]);
+      config.add_dims(1);
+      config.add_dims(kSizes[i]);
+      config.set_learning_rate(0.5);
+      config.set_momentum(test.momentum);
+      config.set_decay_rate(test.decayRate);
+      paraConfigs_.push_back(config);
+    }
+  }
+
+  std::vector<ParameterPtr> createParameters() {
+    std::vector<ParameterPtr> parameters;
+    for (size_t i = 0; i < kNumParameters; ++i) {
+      parameters.push_back(
+          std::make_shared<Parameter>(paraConfigs_[i], /* useGpu= */ false));
+      parameters.back()->setID(i);
+    }
+    return parameters;
+  }
+
+  OptimizationConfig optConfig_;
+  std::vector<ParameterConfig> paraConfigs_;
+};
+
+// SgdThreadUpdater splits the dense parameters as one flat array over the
+// threads. It must give the same result as updating each parameter alone.
+TEST_P(ThreadUpdateDenseTest, compareWithPerParameterUpdate) {
+  ASSERT_GT(FLAGS_trainer_count, 1);
+  std::vector<ParameterPtr> parameters = createParameters();
+  SgdThreadUpdater updater(optConfig_);
+  updater.init(parameters);
+  for (auto& para : parameters) {
+    para->getBuf(PARAMETER_VALUE)->rand();
+  }
+
+  std::vector<ParameterPtr> expectedParameters = createParameters();
+  std::vector<std::unique_ptr<ParameterOptimizer>> optimizers;
+  for (size_t i = 0; i < kNumParameters; ++i) {
+    optimizers.emplace_back(sgdOptimizerCreate(optConfig_,
+                                               paraConfigs_[i],
+                                               /* isParameterSparse= */ false,
+                                               /* inPserver= */ false));
+    optimizers[i]->init(0, &paraConfigs_[i]);
+    for (auto type : optimizers[i]->getParameterTypes()) {
+      expectedParameters[i]->enableType(type);
+      expectedParameters[i]->getBuf(type)->copyFrom(
+          *parameters[i]->getBuf(type));
+    }
+  }
+
+  updater.startPass();
+  for (auto& optimizer : optimizers) {
+    optimizer->startPass();
+  }
+  for (int batch = 0; batch < kNumBatches; ++batch) {
+    updater.startBatch(kBatchSize);
+    for (size_t i = 0; i < kNumParameters; ++i) {
+      parameters[i]->getBuf(PARAMETER_GRADIENT)->randnorm(0, 2);
+      expectedParameters[i]->getBuf(PARAMETER_GRADIENT)->copyFrom(
+          *parameters[i]->getBuf(PARAMETER_GRADIENT));
+      updater.update(parameters[i].get());
+    }
+    updater.finishBatch(/* cost= */ 0);
+
+    for (size_t i = 0; i < kNumParameters; ++i) {
+      Parameter* para = expectedParameters[i].get();
+      optimizers[i]->startBatch((batch + 1) * kBatchSize);
+      optimizers[i]->update(para->getBufs(), paraConfigs_[i]);
+      if (auto callback = optimizers[i]->needSpecialTraversal(
+              paraConfigs_[i])) {
+        callback(para->getBufs(), paraConfigs_[i], -1LU);
+      }
+      optimizers[i]->finishBatch();
+      para->getBuf(PARAMETER_GRADIENT)->zeroMem();
+
+      const real* expected = para->getBuf(PARAMETER_VALUE)->getData();
+      const real* actual = parameters[i]->getBuf(PARAMETER_VALUE)->getData();
+      for (size_t j = 0; j < kSizes[i]; ++j) {
+        ASSERT_NEAR(expected[j], actual[j], 1e-5 * (1 + fabs(expected[j])))
+            << "batch " << batch << " " << para->getName() << " element "
+            << j;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Optimizers,
+    ThreadUpdateDenseTest,
+    ::testing::Values(TestConfig{"momentum", 0, 0, 0},
+                      TestConfig{"momentum", 0.9, 0.01, 0},
+                      TestConfig{"momentum", 0.5, 0, 0.5},
+                      TestConfig{"adagrad", 0.5, 0.01, 0},
+                      TestConfig{"rmsprop", 0, 0.01, 0},
+                      TestConfig{"decayed_adagrad", 0.5, 0, 0}));
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  FLAGS_trainer_count = 4;
+  return RUN_ALL_TESTS();
+}
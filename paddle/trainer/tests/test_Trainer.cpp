@@ -32,6 +32,7 @@ P_DECLARE_bool(use_gpu);
 P_DECLARE_string(config);
 P_DECLARE_int32(gpu_id);
 P_DECLARE_bool(allow_only_one_model_on_one_gpu);
+P_DECLARE_string(thread_batch_split);
 
 void checkGradientTest(const string& configFile,
                        bool useGpu,
@@ -107,6 +108,13 @@ TEST(checkGradient, chunk) {
 #endif
 }
 
+TEST(checkGradient, chunk_split_tokens) {
+  // chunking.conf has sequences of different lengths
+  FLAGS_thread_batch_split = "tokens";
+  checkGradientTest(configFile3, false, false, 4);
+  FLAGS_thread_batch_split = "samples";
+}
+
 TEST(checkGradient, non_parallel) {
   checkGradientTest(configFile4, false, false);
 }
@@ -12,6 +12,8 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
 
+#include <fstream>
+#include <iterator>
 #include <paddle/utils/PythonUtil.h>
 #include <paddle/utils/GlobalConstants.h>
 #include "paddle/trainer/Trainer.h"
@@ -33,6 +35,13 @@ P_DECLARE_int32(gpu_id);
 P_DECLARE_int32(seed);
 P_DECLARE_int32(num_passes);
 P_DECLARE_int32(saving_period);
+P_DECLARE_bool(hogwild);
+P_DECLARE_bool(overlap_grad_merge);
+P_DECLARE_bool(numa_bind);
+P_DECLARE_string(numa_shared_value);
+P_DECLARE_int32(benchmark_warmup);
+P_DECLARE_int32(benchmark_iterations);
+P_DECLARE_string(benchmark_output);
 
 class TrainerForTest : public paddle::Trainer {
 public:
@@ -76,6 +85,52 @@ void trainerOnePassTest(const string& configFile,
 // 1. test trainer (cpu, gpu).
 TEST(trainerOnePass, cpu) { trainerOnePassTest(configFile1, false, false); }
 
+TEST(trainerOnePass, cpu4_hogwild) {
+  FLAGS_hogwild = true;
+  trainerOnePassTest(configFile1, false, false, 4);
+  FLAGS_hogwild = false;
+}
+
+TEST(trainerOnePass, cpu4_overlap_grad_merge) {
+  FLAGS_overlap_grad_merge = true;
+  trainerOnePassTest(configFile1, false, false, 4);
+  FLAGS_overlap_grad_merge = false;
+}
+
+TEST(trainerOnePass, cpu4_numa) {
+  FLAGS_numa_bind = true;
+  for (auto placement : {"interleave", "replicate"}) {
+    FLAGS_numa_shared_value = placement;
+    trainerOnePassTest(configFile1, false, false, 4);
+  }
+  FLAGS_numa_shared_value = "interleave";
+  FLAGS_numa_bind = false;
+}
+
+TEST(trainerBenchmark, cpu4) {
+  FLAGS_use_gpu = false;
+  FLAGS_parallel_nn = false;
+  FLAGS_config = configFile1;
+  FLAGS_trainer_count = 4;
+  FLAGS_benchmark_warmup = 2;
+  FLAGS_benchmark_iterations = 5;
+  FLAGS_benchmark_output = "benchmark.json";
+  Trainer trainer;
+  trainer.init(TrainerConfigHelper::createFromFlagConfig());
+  trainer.time();
+
+  std::ifstream fs(FLAGS_benchmark_output);
+  std::string result((std::istreambuf_iterator<char>(fs)),
+                     std::istreambuf_iterator<char>());
+  EXPECT_NE(std::string::npos, result.find("\"iterations\": 5,"));
+  EXPECT_NE(std::string::npos, result.find("\"profiled_iterations\": 5,"));
+  EXPECT_NE(std::string::npos, result.find("\"p99\""));
+  EXPECT_NE(std::string::npos, result.find("\"forward_ms\""));
+  FLAGS_benchmark_output = "";
+  FLAGS_benchmark_iterations = 0;
+  FLAGS_benchmark_warmup = 10;
+}
+
 #ifndef PADDLE_ONLY_CPU
 TEST(trainerOnePass, gpu) { trainerOnePassTest(configFile1, true, false); }
 
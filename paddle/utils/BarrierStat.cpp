@@ -337,4 +337,136 @@ void BarrierDeltaStat::showAbstract(std::ostream &output) const {
            << std::endl;
   }
 }
+
+BarrierLagStat::BarrierLagStat(uint16_t numConnThreads, const std::string &name)
+    : BarrierStatBase(numConnThreads, name) {
+  histograms_.resize(numConnThreads_);
+  reset(true);
+  LOG(INFO) << " create barrierLagStat: " << name;
+}
+
+size_t BarrierLagStat::getBucket(uint64_t lag) {
+  size_t bucket = 0;
+  while (lag) {
+    lag >>= 1;
+    bucket++;
+  }
+  return bucket < kNumBuckets ? bucket : kNumBuckets - 1;
+}
+
+void BarrierLagStat::updateStat(uint64_t lag, int32_t trainerId) {
+  CHECK_GE(trainerId, 0) << "trainerId is invalid in barrier";
+  CHECK_LT(trainerId, numConnThreads_) << "trainerId is invalid in barrier";
+
+  std::lock_guard<std::mutex> guard(lock_);
+  histograms_[trainerId][getBucket(lag)]++;
+
+  auto &abstract = abstract_[trainerId];
+  abstract.freq++;
+  if (lag < abstract.minDelta) {
+    abstract.minDelta = lag;
+  }
+  if (lag > abstract.maxDelta) {
+    abstract.maxDelta = lag;
+  }
+  abstract.totDelta += lag;
+
+  totAbstract_.freq++;
+  if (lag < totAbstract_.minDelta) {
+    totAbstract_.minDelta = lag;
+  }
+  if (lag > totAbstract_.maxDelta) {
+    totAbstract_.maxDelta = lag;
+  }
+  totAbstract_.totDelta += lag;
+  totSamples_++;
+}
+
+uint64_t BarrierLagStat::getBucketCount(int32_t trainerId,
+                                        size_t bucket) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return histograms_[trainerId][bucket];
+}
+
+void BarrierLagStat::reset(bool clearRawData) {
+  int32_t i = 0;
+
+  std::lock_guard<std::mutex> guard(lock_);
+
+  totSamples_ = 0;
+  for (auto &histogram : histograms_) {
+    histogram.assign(kNumBuckets, 0);
+  }
+  for (auto &abstract : abstract_) {
+    memset((void *)&abstract, 0, sizeof(abstract));
+    abstract.minDelta = UINT64_MAX;
+    abstract.trainerId = i++;
+  }
+  memset((void *)&totAbstract_, 0, sizeof(Abstract));
+  totAbstract_.minDelta = UINT64_MAX;
+}
+
+void BarrierLagStat::showAbstract(std::ostream &output) const {
+  if (!totSamples_) {
+    return;
+  }
+
+  // the most lagged trainers first
+  std::vector<struct Abstract> outputAbstract = abstract_;
+  std::sort(outputAbstract.begin(),
+            outputAbstract.end(),
+            [](const struct Abstract &a, const struct Abstract &b) {
+              if (!a.freq || !b.freq) {
+                return a.freq > b.freq;
+              }
+              return a.totDelta * b.freq > b.totDelta * a.freq;
+            });
+
+  output << std::setw(20) << name_ << std::endl;
+
+  /* Note:
+   * avgLag: average lag of all updates from the trainer
+   * minLag: min lag of all updates from the trainer
+   * maxLag: max lag of all updates from the trainer
+   * histogram: "lo-hi:count" means count updates lagged in [lo, hi]
+   *
+   * log_barrier_lowest_nodes controls how many trainers are shown.
+   */
+  output << std::setw(42) << " " << std::setw(15) << "trainerId"
+         << std::setw(15) << "avgLag" << std::setw(10) << "minLag"
+         << std::setw(10) << "maxLag" << std::setw(10) << "samples"
+         << "  histogram" << std::endl;
+  auto showHistogram = [&](const Abstract &abstract,
+                           const std::vector<uint64_t> *histogram) {
+    output << std::setw(15) << (float)abstract.totDelta / abstract.freq
+           << std::setw(10) << abstract.minDelta << std::setw(10)
+           << abstract.maxDelta << std::setw(10) << abstract.freq << " ";
+    if (histogram) {
+      for (size_t bucket = 0; bucket < kNumBuckets; ++bucket) {
+        if (!(*histogram)[bucket]) {
+          continue;
+        }
+        uint64_t lo = bucket ? 1UL << (bucket - 1) : 0;
+        uint64_t hi = bucket ? (1UL << (bucket - 1)) * 2 - 1 : 0;
+        output << " " << lo;
+        if (hi != lo) {
+          output << "-" << hi;
+        }
+        output << ":" << (*histogram)[bucket];
+      }
+    }
+    output << std::endl;
+  };
+  output << std::setw(42) << " " << std::setw(15) << "totAbstract";
+  showHistogram(totAbstract_, nullptr);
+
+  int count = 0;
+  for (auto &abstract : outputAbstract) {
+    if (!abstract.freq || count++ >= FLAGS_log_barrier_lowest_nodes) {
+      break;
+    }
+    output << std::setw(42) << " " << std::setw(15) << abstract.trainerId;
+    showHistogram(abstract, &histograms_[abstract.trainerId]);
+  }
+}
 }  // namespace paddle
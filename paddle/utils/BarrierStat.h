@@ -293,6 +293,38 @@ private:
   std::unique_ptr<TimeVectorDelta> timeVector_;
 };
 
+// the lag of updates from different trainers, eg, the staleness of gradients
+// in async-sgd at pserver end. the lags of each trainer are kept in a
+// histogram, bucket 0 counts lag 0, and bucket k counts lag in
+// [2^(k-1), 2^k).
+class BarrierLagStat : public BarrierStatBase {
+public:
+  BarrierLagStat(uint16_t numConnThreads, const std::string &name);
+  ~BarrierLagStat() {}
+
+  virtual void updateStat(uint64_t lag, int32_t trainerId = -1);
+  virtual void updateStat(struct timeval &cur, int32_t trainerId = -1) {
+    LOG(INFO) << "have no timeval updateStat in BarrierLagStat";
+  }
+
+  virtual void reset(bool clearRawData = true);
+
+  // lags are not collected by round, so there is no raw data to check.
+  virtual bool checkPassBarrier() { return true; }
+
+  uint64_t getBucketCount(int32_t trainerId, size_t bucket) const;
+
+  static size_t getBucket(uint64_t lag);
+  static const size_t kNumBuckets = 64;
+
+protected:
+  virtual void showAbstract(std::ostream &output) const;
+
+private:
+  // histogram of lags for each trainer
+  std::vector<std::vector<uint64_t>> histograms_;
+};
+
 // to distinguish different contexts for same parallel threads, and different
 // threads with same code-sgement, just use tagName to tag the run-time
 // position.
@@ -344,6 +376,17 @@ private:
     }                                                                 \
   } while (0);
 
+// lag barrier
+#define __REGISTER_BARRIER_LAG_SERVER_SET(                        \
+    set, statName, numConnThreads, trainerId, lag, ...)           \
+  do {                                                            \
+    std::string internalName =                                    \
+        std::string(statName) + std::string(__VA_ARGS__);         \
+    BarrierStatPtr __stat =                                       \
+        (set).getStat(numConnThreads, internalName, BARRIER_LAG); \
+    __stat->updateStat(lag, trainerId);                           \
+  } while (0);
+
 // check end barrier
 #define __CHECK_BARRIER_TIMER(set, statName, numConnThreads, ...)   \
   do {                                                              \
@@ -390,6 +433,8 @@ private:
     set, statName, numConnThreads, trainerId, cur, ...)
 #define REGISTER_BARRIER_DELTA_SERVER_SET( \
     set, statName, numConnThreads, trainerId, cur, ...)
+#define REGISTER_BARRIER_LAG_SERVER_SET( \
+    set, statName, numConnThreads, trainerId, lag, ...)
 
 #else
 
@@ -422,5 +467,12 @@ private:
   __REGISTER_BARRIER_DELTA_SERVER_SET(                    \
       (set), statName, numConnThreads, trainerId, delta, __VA_ARGS__)
 
+// try to capture the lag of updates from all trainers, such as the staleness
+// of gradients in async-sgd, which shows how far each trainer falls behind.
+#define REGISTER_BARRIER_LAG_SERVER_SET(                \
+    set, statName, numConnThreads, trainerId, lag, ...) \
+  __REGISTER_BARRIER_LAG_SERVER_SET(                    \
+      (set), statName, numConnThreads, trainerId, lag, __VA_ARGS__)
+
 #endif  // DISABLE_TIMER
 }  // namespace paddle
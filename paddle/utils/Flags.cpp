@@ -29,6 +29,20 @@ P_DEFINE_bool(
     "If it was set true, the gpu core is specified by the trainer"
     "  config file(gpu_id will be ignored).");
 P_DEFINE_int32(trainer_count, 1, "Defined how many trainers to train");
+P_DEFINE_bool(hogwild,
+              false,
+              "If true and trainer_count > 1, each CPU trainer thread applies "
+              "its own gradients to the shared parameter values right after "
+              "its backward, without merging them with the other threads");
+P_DEFINE_bool(numa_bind,
+              false,
+              "If true, pin each CPU trainer thread to a core and allocate "
+              "its buffers on the NUMA node of that core");
+P_DEFINE_string(numa_shared_value,
+                "interleave",
+                "How to place the parameter values shared by the CPU trainer "
+                "threads with --numa_bind: interleave spreads their pages over "
+                "all the nodes, replicate keeps one copy on each node");
 P_DEFINE_int32(gpu_id, 0, "Which gpu core to use");
 P_DEFINE_int32(port, 20134, "Listening port for pserver");
 P_DEFINE_int32(data_server_port, 21134, "Listening port for dserver");
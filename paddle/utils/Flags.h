@@ -23,6 +23,9 @@ P_DECLARE_int32(data_server_port);
 P_DECLARE_bool(use_gpu);
 P_DECLARE_int32(gpu_id);
 P_DECLARE_int32(trainer_count);
+P_DECLARE_bool(hogwild);
+P_DECLARE_bool(numa_bind);
+P_DECLARE_string(numa_shared_value);
 P_DECLARE_int32(ports_num);
 P_DECLARE_int32(ports_num_for_sparse);
 P_DECLARE_string(nics);
@@ -0,0 +1,90 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "DisableCopy.h"
+
+namespace paddle {
+
+/**
+ * NUMA topology, thread pinning and memory placement.
+ *
+ * The topology is read from /sys/devices/system/node and the placement uses
+ * the sched_setaffinity and mbind system calls directly, so that libnuma is
+ * not needed. On other systems there is one node holding all the cpus and
+ * the binding functions do nothing.
+ *
+ * Every thread has a node (-1 if none), set by bindThreadToCpu(),
+ * bindThreadToNode() or NumaNodeScope. With --numa_bind, the CPU buffers
+ * allocated by a thread come from the memory pool of its node, and the
+ * workers of a SyncThreadPool are bound to the node of the thread which
+ * created the pool.
+ */
+namespace numa {
+
+/// Number of NUMA nodes, at least 1.
+int getNumNodes();
+
+/// The cpus of node.
+const std::vector<int>& getNodeCpus(int node);
+
+/// Pin the calling thread to cpu, which belongs to node.
+/// Returns false if the system refused.
+bool bindThreadToCpu(int cpu, int node);
+
+/// Let the calling thread run on any cpu of node.
+/// Returns false if the system refused.
+bool bindThreadToNode(int node);
+
+/// The node of the calling thread, -1 if none.
+int getThreadNode();
+
+/// Set the node of the calling thread without changing where it runs.
+void setThreadNode(int node);
+
+/// Move the whole pages within [ptr, ptr + size) to node.
+void bindMemory(void* ptr, size_t size, int node);
+
+/// Spread the whole pages within [ptr, ptr + size) over all the nodes.
+void interleaveMemory(void* ptr, size_t size);
+
+}  // namespace numa
+
+/**
+ * @brief Set the node of the calling thread within a scope, so that the
+ *        buffers created in the scope are allocated on that node.
+ *
+ * A negative node leaves the node of the thread unchanged.
+ */
+class NumaNodeScope {
+public:
+  explicit NumaNodeScope(int node) : oldNode_(numa::getThreadNode()) {
+    if (node >= 0) {
+      numa::setThreadNode(node);
+    }
+  }
+
+  ~NumaNodeScope() { numa::setThreadNode(oldNode_); }
+
+  DISABLE_COPY(NumaNodeScope);
+
+private:
+  int oldNode_;
+};
+
+}  // namespace paddle
@@ -16,7 +16,10 @@ limitations under the License. */
 
 #include <condition_variable>
 #include <deque>
+#include <functional>
 #include <mutex>
+#include <queue>
+#include <vector>
 
 #include "Locks.h"
 
@@ -252,4 +255,75 @@ private:
   size_t capacity_;
 };
 
+/**
+ * A thread-safe priority queue. Dequeue returns the greatest element
+ * according to Compare (the same convention as std::priority_queue),
+ * and blocks current thread while the queue is empty.
+ *
+ * For example.
+ * @code{.cpp}
+ *
+ * // dequeue smaller job ids first.
+ * paddle::PriorityQueue<int, std::greater<int>> q;
+ * q.enqueue(3);
+ * q.enqueue(1);
+ * q.dequeue();  // return 1
+ *
+ * @endcode
+ */
+template <class T, class Compare = std::less<T>>
+class PriorityQueue {
+public:
+  explicit PriorityQueue(const Compare& compare = Compare())
+      : queue_(compare) {}
+
+  /**
+   * @brief enqueue an element into PriorityQueue.
+   * @param[in] el The enqueue element.
+   * @note This method is thread-safe, and will wake up another blocked thread.
+   */
+  void enqueue(const T& el) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    queue_.push(el);
+    notEmpty_.notify_one();
+  }
+
+  /**
+   * Dequeue the greatest element.
+   * @note this method will be blocked until not empty.
+   */
+  T dequeue() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this] { return !queue_.empty(); });
+    T el(queue_.top());
+    queue_.pop();
+    return el;
+  }
+
+  /**
+   * Return size of queue.
+   *
+   * @note This method is thread safe.
+   */
+  size_t size() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return queue_.size();
+  }
+
+  /**
+   * @brief is empty or not.
+   * @return true if empty.
+   * @note This method is thread safe.
+   */
+  bool empty() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return queue_.empty();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::priority_queue<T, std::vector<T>, Compare> queue_;
+};
+
 }  // namespace paddle
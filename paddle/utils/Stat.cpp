@@ -16,52 +16,192 @@ limitations under the License. */
 #include "Util.h"
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
 
 namespace paddle {
 
 StatSet globalStat("GlobalStatInfo");
 
-void Stat::addSample(uint64_t value) {
-  StatInfo* statInfo = statInfo_.get(false);
-  if (!statInfo) {
-    statInfo = new StatInfo(this);
-    statInfo_.set(statInfo);
-    std::lock_guard<std::mutex> guard(lock_);
-    threadLocalBuf_.push_back({statInfo, getTID()});
+const int StatInfo::kSubBucketBits;
+const int StatInfo::kMaxValueBits;
+const size_t StatInfo::kNumBuckets;
+
+uint64_t StatInfo::getBucketStart(size_t bucket) {
+  if (bucket < (1UL << kSubBucketBits)) {
+    return bucket;
+  }
+  int shift = (bucket >> (kSubBucketBits - 1)) - 1;
+  return (bucket - ((size_t)shift << (kSubBucketBits - 1))) << shift;
+}
+
+uint64_t StatInfo::percentile(double p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  uint64_t rank = std::ceil(p * count_);
+  if (rank <= 1) {
+    return min_;
+  }
+  if (rank >= count_) {
+    return max_;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      uint64_t start = getBucketStart(i);
+      uint64_t width = getBucketEnd(i) - start;
+      // the middle of the bucket, within the observed range
+      uint64_t value = start + width / 2;
+      return std::min(std::max(value, min_), max_);
+    }
+  }
+  return max_;
+}
+
+ThreadStat::ThreadStat(pid_t tid)
+    : epoch_(0),
+      total_(0),
+      max_(0),
+      count_(0),
+      min_(UINT64_MAX),
+      tid_(tid),
+      state_(kOwned),
+      next_(nullptr) {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void ThreadStat::clear(uint64_t epoch) {
+  const auto relaxed = std::memory_order_relaxed;
+  total_.store(0, relaxed);
+  count_.store(0, relaxed);
+  max_.store(0, relaxed);
+  min_.store(UINT64_MAX, relaxed);
+  for (auto& bucket : buckets_) {
+    bucket.store(0, relaxed);
+  }
+  // a reader seeing the new epoch also sees the cleared samples
+  epoch_.store(epoch, std::memory_order_release);
+}
+
+void ThreadStat::mergeTo(uint64_t epoch, StatInfo* info) const {
+  if (epoch_.load(std::memory_order_acquire) != epoch) {
+    return;
+  }
+  const auto relaxed = std::memory_order_relaxed;
+  info->total_ += total_.load(relaxed);
+  info->count_ += count_.load(relaxed);
+  info->max_ = std::max(info->max_, max_.load(relaxed));
+  info->min_ = std::min(info->min_, min_.load(relaxed));
+  for (size_t i = 0; i < StatInfo::kNumBuckets; ++i) {
+    info->buckets_[i] += buckets_[i].load(relaxed);
+  }
+}
+
+ThreadStatKey::ThreadStatKey() : numIndices_(0) {
+  PCHECK(pthread_key_create(&key_, releaseThreadStats) == 0);
+}
+
+// the slots of the threads still running are not freed, like the memory of
+// any other pthread key deleted before its threads exit
+ThreadStatKey::~ThreadStatKey() { pthread_key_delete(key_); }
+
+void ThreadStatKey::set(size_t index, ThreadStat* threadStat) {
+  auto slots =
+      static_cast<std::vector<ThreadStat*>*>(pthread_getspecific(key_));
+  if (!slots) {
+    slots = new std::vector<ThreadStat*>();
+    PCHECK(pthread_setspecific(key_, slots) == 0);
   }
-  if (value > statInfo->max_) {
-    statInfo->max_ = value;
+  if (index >= slots->size()) {
+    slots->resize(index + 1, nullptr);
   }
-  if (value < statInfo->min_) {
-    statInfo->min_ = value;
+  (*slots)[index] = threadStat;
+}
+
+void ThreadStatKey::releaseThreadStats(void* slots) {
+  auto threadStats = static_cast<std::vector<ThreadStat*>*>(slots);
+  for (ThreadStat* threadStat : *threadStats) {
+    if (threadStat &&
+        threadStat->state_.exchange(ThreadStat::kReleased) ==
+            ThreadStat::kOrphaned) {
+      delete threadStat;
+    }
   }
-  statInfo->total_ += value;
-  statInfo->count_++;
+  delete threadStats;
 }
 
-void Stat::mergeThreadStat(StatInfo& allThreadStat) {
-  allThreadStat = destructStat_;
-  for (auto& buf : threadLocalBuf_) {
-    if (buf.first->max_ > allThreadStat.max_) {
-      allThreadStat.max_ = buf.first->max_;
+Stat::Stat(const std::string& statName,
+           std::shared_ptr<ThreadStatKey> threadStatKey)
+    : threadStatKey_(threadStatKey ? threadStatKey
+                                   : std::make_shared<ThreadStatKey>()),
+      index_(threadStatKey_->newIndex()),
+      threadStats_(nullptr),
+      epoch_(0),
+      name_(statName),
+      openThreadInfo_(false) {}
+
+Stat::~Stat() {
+  ThreadStat* threadStat = threadStats_.load(std::memory_order_acquire);
+  while (threadStat) {
+    ThreadStat* next = threadStat->next_;
+    // the ThreadStat of a running thread is deleted when the thread exits
+    if (threadStat->state_.exchange(ThreadStat::kOrphaned) !=
+        ThreadStat::kOwned) {
+      delete threadStat;
     }
-    if (buf.first->min_ < allThreadStat.min_) {
-      allThreadStat.min_ = buf.first->min_;
+    threadStat = next;
+  }
+}
+
+ThreadStat* Stat::acquireThreadStat() {
+  pid_t tid = getTID();
+  ThreadStat* threadStat = threadStats_.load(std::memory_order_acquire);
+  for (; threadStat; threadStat = threadStat->next_) {
+    int state = ThreadStat::kReleased;
+    if (threadStat->state_.load(std::memory_order_relaxed) == state &&
+        threadStat->state_.compare_exchange_strong(state,
+                                                   ThreadStat::kOwned)) {
+      threadStat->tid_.store(tid, std::memory_order_relaxed);
+      break;
     }
-    allThreadStat.total_ += buf.first->total_;
-    allThreadStat.count_ += buf.first->count_;
   }
+  if (!threadStat) {
+    threadStat = new ThreadStat(tid);
+    ThreadStat* head = threadStats_.load(std::memory_order_relaxed);
+    do {
+      threadStat->next_ = head;
+    } while (!threadStats_.compare_exchange_weak(
+        head, threadStat, std::memory_order_release));
+  }
+  threadStatKey_->set(index_, threadStat);
+  return threadStat;
+}
+
+StatInfo Stat::getMergedInfo() const {
+  StatInfo info;
+  uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+  ThreadStat* threadStat = threadStats_.load(std::memory_order_acquire);
+  for (; threadStat; threadStat = threadStat->next_) {
+    threadStat->mergeTo(epoch, &info);
+  }
+  return info;
 }
 
-void Stat::reset() {
-  std::lock_guard<std::mutex> guard(lock_);
-  for (auto& buf : threadLocalBuf_) {
-    buf.first->reset();
+std::vector<std::pair<pid_t, StatInfo>> Stat::getThreadInfos() const {
+  std::vector<std::pair<pid_t, StatInfo>> infos;
+  uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+  ThreadStat* threadStat = threadStats_.load(std::memory_order_acquire);
+  for (; threadStat; threadStat = threadStat->next_) {
+    infos.emplace_back(threadStat->getTID(), StatInfo());
+    threadStat->mergeTo(epoch, &infos.back().second);
   }
+  return infos;
 }
 
 std::ostream& operator<<(std::ostream& outPut, const Stat& stat) {
-  std::lock_guard<std::mutex> guard(const_cast<Stat&>(stat).lock_);
   auto showStat = [&](const StatInfo* info, pid_t tid, bool isFirst = true) {
     uint64_t average = 0;
     if (info->count_ > 0) {
@@ -78,20 +218,20 @@ std::ostream& operator<<(std::ostream& outPut, const Stat& stat) {
              << " avg=" << std::setw(10) << average * 0.001
              << " max=" << std::setw(10) << info->max_ * 0.001
              << " min=" << std::setw(10) << info->min_ * 0.001
+             << " p50=" << std::setw(10) << info->percentile(0.5) * 0.001
+             << " p99=" << std::setw(10) << info->percentile(0.99) * 0.001
              << " count=" << std::setw(10) << info->count_ << std::endl;
     }
   };
   if (!stat.getThreadInfo()) {
-    StatInfo infoVarTmp;
-    const_cast<Stat&>(stat).mergeThreadStat(infoVarTmp);
-    showStat(&infoVarTmp, 0);
+    StatInfo info = stat.getMergedInfo();
+    showStat(&info, 0);
   } else {
     bool isFirst = true;
-    for (auto& buf : stat.threadLocalBuf_) {
-      showStat(buf.first, buf.second, isFirst);
-      if (isFirst) isFirst = false;
+    for (auto& info : stat.getThreadInfos()) {
+      showStat(&info.second, info.first, isFirst);
+      if (isFirst && info.second.count_ > 0) isFirst = false;
     }
-    showStat(&stat.destructStat_, 0);
   }
 
   return outPut;
@@ -120,6 +260,8 @@ BarrierStatPtr StatSet::getStat(uint16_t numConnThreads,
     stat = std::make_shared<BarrierEndStat>(numConnThreads, name);
   } else if (bType == BARRIER_DELTA) {
     stat = std::make_shared<BarrierDeltaStat>(numConnThreads, name);
+  } else if (bType == BARRIER_LAG) {
+    stat = std::make_shared<BarrierLagStat>(numConnThreads, name);
   }
   auto ret = barrierStatSet_.insert(std::make_pair(name, stat));
   return ret.first->second;
@@ -163,6 +305,20 @@ void StatSet::printStatus(const std::string& name) {
   LOG(INFO) << *(iter->second);
 }
 
+std::vector<StatPtr> StatSet::getAllStats() {
+  std::vector<StatPtr> stats;
+  {
+    ReadLockGuard guard(lock_);
+    for (auto& stat : statSet_) {
+      stats.push_back(stat.second);
+    }
+  }
+  std::sort(stats.begin(), stats.end(), [](const StatPtr& a, const StatPtr& b) {
+    return a->getName() < b->getName();
+  });
+  return stats;
+}
+
 void StatSet::reset(bool clearRawData) {
   ReadLockGuard guard(lock_);
   for (auto& stat : statSet_) {
@@ -188,21 +344,6 @@ void StatSet::deleteStat(const std::string& name) {
   statSet_.erase(iter);
 }
 
-StatInfo::~StatInfo() {
-  if (stat_) {
-    std::lock_guard<std::mutex> guard(stat_->lock_);
-    if (stat_->destructStat_.max_ < this->max_) {
-      stat_->destructStat_.max_ = this->max_;
-    }
-    if (stat_->destructStat_.min_ > this->min_) {
-      stat_->destructStat_.min_ = this->min_;
-    }
-    stat_->destructStat_.total_ += this->total_;
-    stat_->destructStat_.count_ += this->count_;
-    stat_->threadLocalBuf_.remove({this, getTID()});
-  }
-}
-
 static unsigned g_profileCount = 0;
 static std::recursive_mutex g_profileMutex;
 
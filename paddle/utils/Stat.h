@@ -14,14 +14,18 @@ limitations under the License. */
 
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
+#include <atomic>
 #include <iostream>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "BarrierStat.h"
 #include "Locks.h"
@@ -33,29 +37,154 @@ namespace paddle {
 
 class Stat;
 
+/**
+ * @brief Samples of a Stat: total, max, min, count and a histogram.
+ *
+ * The histogram is log-linear (HDR style): a value below 2^kSubBucketBits
+ * has a bucket of its own, and each larger power of two is split into
+ * 2^(kSubBucketBits - 1) buckets of equal width. A percentile is therefore
+ * exact to within 1/2^kSubBucketBits of its value. Values of
+ * 2^kMaxValueBits or more are counted in the last bucket.
+ */
 class StatInfo {
 public:
-  explicit StatInfo(Stat* stat = nullptr) : stat_(stat) {
-    total_ = 0;
-    max_ = 0;
-    count_ = 0;
-    min_ = UINT64_MAX;
+  static const int kSubBucketBits = 5;
+  static const int kMaxValueBits = 40;
+  static const size_t kNumBuckets = (kMaxValueBits - kSubBucketBits + 2)
+                                    << (kSubBucketBits - 1);
+
+  StatInfo()
+      : total_(0),
+        max_(0),
+        count_(0),
+        min_(UINT64_MAX),
+        buckets_(kNumBuckets) {}
+
+  static size_t getBucket(uint64_t value) {
+    if (value < (1UL << kSubBucketBits)) {
+      return value;
+    }
+    if (value >> kMaxValueBits) {
+      value = (1UL << kMaxValueBits) - 1;
+    }
+    int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+    return ((size_t)shift << (kSubBucketBits - 1)) + (value >> shift);
   }
 
-  void reset() {
-    total_ = 0;
-    count_ = 0;
-    max_ = 0;
-    min_ = UINT64_MAX;
+  /// The smallest value of a bucket.
+  static uint64_t getBucketStart(size_t bucket);
+
+  /// The smallest value of the bucket after bucket.
+  static uint64_t getBucketEnd(size_t bucket) {
+    return bucket + 1 < kNumBuckets ? getBucketStart(bucket + 1) : UINT64_MAX;
   }
 
-  ~StatInfo();
+  /// The p-th quantile (0 < p <= 1) of the samples, 0 if there is none.
+  uint64_t percentile(double p) const;
 
-  Stat* stat_;
   uint64_t total_;
   uint64_t max_;
   uint64_t count_;
   uint64_t min_;
+  std::vector<uint64_t> buckets_;
+};
+
+/**
+ * @brief The samples of a Stat added by one thread.
+ *
+ * Only the thread writes to it, with relaxed atomic stores which compile to
+ * plain stores, so adding a sample takes no lock and no atomic
+ * read-modify-write. Other threads read it at any time to take a snapshot.
+ *
+ * Stat::reset() only increases the epoch of the Stat: the thread clears its
+ * samples when it adds one in a newer epoch, and a snapshot ignores the
+ * samples of older epochs. When the thread exits, the ThreadStat is kept,
+ * with its samples, for the next thread which adds to the Stat. If the Stat
+ * is deleted first, the thread deletes the ThreadStat when it exits.
+ */
+class ThreadStat {
+public:
+  explicit ThreadStat(pid_t tid);
+
+  void addSample(uint64_t value, uint64_t epoch) {
+    const auto relaxed = std::memory_order_relaxed;
+    if (epoch_.load(relaxed) != epoch) {
+      clear(epoch);
+    }
+    total_.store(total_.load(relaxed) + value, relaxed);
+    count_.store(count_.load(relaxed) + 1, relaxed);
+    if (value > max_.load(relaxed)) {
+      max_.store(value, relaxed);
+    }
+    if (value < min_.load(relaxed)) {
+      min_.store(value, relaxed);
+    }
+    auto& bucket = buckets_[StatInfo::getBucket(value)];
+    bucket.store(bucket.load(relaxed) + 1, relaxed);
+  }
+
+  /// Add the samples of epoch to info.
+  void mergeTo(uint64_t epoch, StatInfo* info) const;
+
+  pid_t getTID() const { return tid_.load(std::memory_order_relaxed); }
+
+private:
+  void clear(uint64_t epoch);
+
+  std::atomic<uint64_t> epoch_;
+  std::atomic<uint64_t> total_;
+  std::atomic<uint64_t> max_;
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> min_;
+  std::atomic<uint64_t> buckets_[StatInfo::kNumBuckets];
+
+  enum State {
+    kOwned,     // the thread is running
+    kReleased,  // the thread has exited
+    kOrphaned,  // the Stat was deleted while the thread is running
+  };
+
+  /// the thread which adds to it, and its State
+  std::atomic<pid_t> tid_;
+  std::atomic<int> state_;
+  /// the next ThreadStat of the Stat, set before it is published
+  ThreadStat* next_;
+
+  friend class Stat;
+  friend class ThreadStatKey;
+};
+
+/**
+ * @brief The pthread key through which the Stats of a StatSet find the
+ * ThreadStats of the calling thread.
+ *
+ * A process has only PTHREAD_KEYS_MAX keys, fewer than the Stats of a large
+ * network, so the Stats share one key. Each Stat gets an index, and the key
+ * of a thread holds the ThreadStats of the thread by index. An index is
+ * never reused, so a slot never refers to the ThreadStat of a newer Stat.
+ */
+class ThreadStatKey {
+public:
+  ThreadStatKey();
+  ~ThreadStatKey();
+
+  size_t newIndex() { return numIndices_.fetch_add(1); }
+
+  /// The ThreadStat of the calling thread for the Stat of index, or null.
+  ThreadStat* get(size_t index) const {
+    auto slots =
+        static_cast<std::vector<ThreadStat*>*>(pthread_getspecific(key_));
+    return slots && index < slots->size() ? (*slots)[index] : nullptr;
+  }
+
+  void set(size_t index, ThreadStat* threadStat);
+
+private:
+  /// Release the ThreadStats of an exited thread.
+  static void releaseThreadStats(void* slots);
+
+  pthread_key_t key_;
+  std::atomic<size_t> numIndices_;
 };
 
 class Stat;
@@ -65,11 +194,13 @@ typedef std::shared_ptr<BarrierStatBase> BarrierStatPtr;
 enum BarrierStatType {
   BARRIER_END = 0,
   BARRIER_DELTA = 1,
+  BARRIER_LAG = 2,
 };
 
 class StatSet {
 public:
-  explicit StatSet(const std::string& name) : name_(name) {}
+  explicit StatSet(const std::string& name)
+      : name_(name), threadStatKey_(std::make_shared<ThreadStatKey>()) {}
   ~StatSet() {}
 
   // print to LOG(INFO)
@@ -79,6 +210,9 @@ public:
 
   void printStatus(const std::string& name);
 
+  /// All the stats of the set, sorted by name.
+  std::vector<StatPtr> getAllStats();
+
   StatPtr getStat(const std::string& name) {
     {
       ReadLockGuard guard(lock_);
@@ -87,7 +221,7 @@ public:
         return it->second;
       }
     }
-    StatPtr stat = std::make_shared<Stat>(name);
+    StatPtr stat = std::make_shared<Stat>(name, threadStatKey_);
     std::lock_guard<RWLock> guard(lock_);
     auto ret = statSet_.insert(std::make_pair(name, stat));
     return ret.first->second;
@@ -122,26 +256,40 @@ private:
   std::unordered_map<std::string, StatPtr> statSet_;
   std::unordered_map<std::string, BarrierStatPtr> barrierStatSet_;
   const std::string name_;
+  /// shared by all the stats of the set
+  std::shared_ptr<ThreadStatKey> threadStatKey_;
   RWLock lock_;
 };
 
 extern StatSet globalStat;
 
-/*@brief : a simple stat*/
+/**
+ * @brief A stat of samples, usually time intervals in microseconds.
+ *
+ * addSample() is lock free and costs a few nanoseconds: every thread adds
+ * to its own ThreadStat, found through a ThreadStatKey, and the ThreadStats
+ * of a Stat are in a list to which a new one is prepended by
+ * compare-and-swap. Reading the stat walks the list without lock either.
+ */
 class Stat {
 public:
-  explicit Stat(const std::string& statName)
-      : destructStat_(nullptr), name_(statName), openThreadInfo_(false) {}
-  ~Stat() {}
-
-  typedef std::list<std::pair<StatInfo*, pid_t>> ThreadLocalBuf;
+  /// A Stat without key gets its own, the Stats of a StatSet share one.
+  explicit Stat(const std::string& statName,
+                std::shared_ptr<ThreadStatKey> threadStatKey = nullptr);
+  ~Stat();
 
   const std::string& getName() const { return name_; }
 
-  void addSample(uint64_t value);
+  void addSample(uint64_t value) {
+    ThreadStat* threadStat = threadStatKey_->get(index_);
+    if (!threadStat) {
+      threadStat = acquireThreadStat();
+    }
+    threadStat->addSample(value, epoch_.load(std::memory_order_relaxed));
+  }
 
   // clear all stats
-  void reset();
+  void reset() { epoch_.fetch_add(1, std::memory_order_relaxed); }
 
   friend std::ostream& operator<<(std::ostream& outPut, const Stat& stat);
 
@@ -152,15 +300,22 @@ public:
 
   bool getThreadInfo() const { return openThreadInfo_; }
 
-  friend class StatInfo;
+  /// The samples of all the threads merged into one StatInfo.
+  StatInfo getMergedInfo() const;
 
-private:
-  void mergeThreadStat(StatInfo& allThreadStat);
+  /// The samples of each thread. The samples of the exited threads are
+  /// under the thread which took over their ThreadStat.
+  std::vector<std::pair<pid_t, StatInfo>> getThreadInfos() const;
 
-  std::mutex lock_;
-  ThreadLocalBuf threadLocalBuf_;
-  StatInfo destructStat_;
-  ThreadLocal<StatInfo> statInfo_;
+private:
+  /// Take over the ThreadStat of an exited thread, or create one.
+  ThreadStat* acquireThreadStat();
+
+  std::shared_ptr<ThreadStatKey> threadStatKey_;
+  /// index of the Stat in threadStatKey_
+  const size_t index_;
+  std::atomic<ThreadStat*> threadStats_;
+  std::atomic<uint64_t> epoch_;
   const std::string name_;
   bool openThreadInfo_;
 };
@@ -171,10 +326,11 @@ inline StatPtr getStat(const std::string& name) {
   return globalStat.getStat(name);
 }
 
+/// Microseconds from a monotonic clock, only meaningful as an interval.
 inline uint64_t nowInMicroSec() {
-  timeval tvTime;
-  (void)gettimeofday(&tvTime, NULL);
-  return tvTime.tv_sec * 1000000LU + tvTime.tv_usec;
+  timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LU + ts.tv_nsec / 1000;
 }
 
 /**
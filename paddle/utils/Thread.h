@@ -15,6 +15,7 @@ limitations under the License. */
 #pragma once
 #include "Util.h"
 #include "Logging.h"
+#include "Numa.h"
 #include <thread>
 
 #include "Queue.h"
@@ -241,9 +242,18 @@ protected:
    * @brief Start all the workers in the pool, call their run() function.
    */
   void start() {
+    // A thread pinned to one core would pin its workers to the same core,
+    // let them run on the whole node instead.
+    int node = numa::getThreadNode();
     for (size_t i = 0; i < workers_.size(); ++i) {
-      workers_[i].reset(
-          new std::thread([this](int tid) { this->run(tid); }, i));
+      workers_[i].reset(new std::thread(
+          [this, node](int tid) {
+            if (node >= 0) {
+              numa::bindThreadToNode(node);
+            }
+            this->run(tid);
+          },
+          i));
     }
   }
 
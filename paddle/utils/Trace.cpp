@@ -0,0 +1,231 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "Trace.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "Logging.h"
+#include "Util.h"
+
+P_DEFINE_string(trace_file,
+                "",
+                "Write a timeline of the execution to this file, in the "
+                "Chrome trace event format. Empty for no tracing");
+P_DEFINE_int32(trace_start_batch,
+               10,
+               "The first batch recorded to --trace_file, counted from the "
+               "start of the training");
+P_DEFINE_int32(trace_num_batches, 5, "Number of batches in --trace_file");
+P_DEFINE_int32(trace_buffer_size,
+               100000,
+               "Number of trace events kept by each thread");
+
+namespace paddle {
+
+std::atomic<bool> Tracer::tracing_(false);
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  const char* category;
+  uint64_t beginNs;
+  uint64_t endNs;
+  pid_t tid;
+};
+
+/// The ring buffer of a thread. Only the thread writes to it.
+class TraceBuffer {
+public:
+  explicit TraceBuffer(size_t capacity)
+      : events_(capacity), size_(0), owned_(true) {}
+
+  void add(const TraceEvent& event) {
+    uint64_t size = size_.load(std::memory_order_relaxed);
+    events_[size % events_.size()] = event;
+    size_.store(size + 1, std::memory_order_release);
+  }
+
+  void collect(std::vector<TraceEvent>* events) const {
+    uint64_t size = size_.load(std::memory_order_acquire);
+    // the oldest slot may be being overwritten by a late event
+    uint64_t begin = size > events_.size() ? size - events_.size() + 1 : 0;
+    for (uint64_t i = begin; i < size; ++i) {
+      events->push_back(events_[i % events_.size()]);
+    }
+  }
+
+  void clear() { size_.store(0, std::memory_order_relaxed); }
+
+  std::vector<TraceEvent> events_;
+  std::atomic<uint64_t> size_;
+  std::atomic<bool> owned_;
+};
+
+class TraceBuffers {
+public:
+  TraceBuffers() {
+    PCHECK(pthread_key_create(&threadBufferKey_, releaseBuffer) == 0);
+  }
+
+  TraceBuffer* getThreadBuffer() {
+    auto buffer =
+        static_cast<TraceBuffer*>(pthread_getspecific(threadBufferKey_));
+    if (!buffer) {
+      buffer = acquireBuffer();
+      PCHECK(pthread_setspecific(threadBufferKey_, buffer) == 0);
+    }
+    return buffer;
+  }
+
+  std::vector<TraceEvent> collect() {
+    std::vector<TraceEvent> events;
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto& buffer : buffers_) {
+      buffer->collect(&events);
+    }
+    return events;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto& buffer : buffers_) {
+      buffer->clear();
+    }
+  }
+
+private:
+  /// Take over the buffer of an exited thread, or create one.
+  TraceBuffer* acquireBuffer() {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto& buffer : buffers_) {
+      bool owned = false;
+      if (buffer->owned_.compare_exchange_strong(owned, true)) {
+        return buffer.get();
+      }
+    }
+    buffers_.emplace_back(new TraceBuffer(FLAGS_trace_buffer_size));
+    return buffers_.back().get();
+  }
+
+  static void releaseBuffer(void* buffer) {
+    static_cast<TraceBuffer*>(buffer)->owned_.store(false,
+                                                    std::memory_order_release);
+  }
+
+  pthread_key_t threadBufferKey_;
+  std::mutex lock_;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+};
+
+TraceBuffers& getTraceBuffers() {
+  static TraceBuffers buffers;
+  return buffers;
+}
+
+void writeJsonString(std::ostream& os, const char* str) {
+  os << '"';
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      os << '\\' << *str;
+    } else if (static_cast<unsigned char>(*str) >= 0x20) {
+      os << *str;
+    }
+  }
+  os << '"';
+}
+
+}  // namespace
+
+uint64_t Tracer::nowInNanoSec() {
+  timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LU + ts.tv_nsec;
+}
+
+void Tracer::addEvent(const char* name,
+                      const char* category,
+                      uint64_t beginNs) {
+  uint64_t endNs = nowInNanoSec();
+  static __thread pid_t tid = 0;
+  if (!tid) {
+    tid = getTID();
+  }
+  getTraceBuffers().getThreadBuffer()->add(
+      {name, category, beginNs, endNs, tid});
+}
+
+void Tracer::startBatch() {
+  if (FLAGS_trace_file.empty()) {
+    return;
+  }
+  static int64_t numBatches = 0;
+  if (numBatches == FLAGS_trace_start_batch) {
+    LOG(INFO) << "Start tracing " << FLAGS_trace_num_batches << " batches";
+    clear();
+    setTracing(true);
+  } else if (numBatches == FLAGS_trace_start_batch + FLAGS_trace_num_batches) {
+    finish();
+  }
+  ++numBatches;
+}
+
+void Tracer::finish() {
+  if (FLAGS_trace_file.empty() || !isTracing()) {
+    return;
+  }
+  setTracing(false);
+  dump(FLAGS_trace_file);
+}
+
+void Tracer::clear() { getTraceBuffers().clear(); }
+
+void Tracer::dump(const std::string& file) {
+  std::vector<TraceEvent> events = getTraceBuffers().collect();
+  std::sort(events.begin(),
+            events.end(),
+            [](const TraceEvent& a, const TraceEvent& b) {
+              return a.beginNs < b.beginNs;
+            });
+
+  std::ofstream os(file);
+  CHECK(os) << "Fail to open " << file;
+  os << std::fixed << std::setprecision(3);
+  os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  pid_t pid = getpid();
+  for (size_t i = 0; i < events.size(); ++i) {
+    const TraceEvent& event = events[i];
+    os << (i ? ",\n" : "\n") << "{\"name\": ";
+    writeJsonString(os, event.name);
+    os << ", \"cat\": ";
+    writeJsonString(os, event.category);
+    os << ", \"ph\": \"X\", \"ts\": " << event.beginNs * 1e-3
+       << ", \"dur\": " << (event.endNs - event.beginNs) * 1e-3
+       << ", \"pid\": " << pid << ", \"tid\": " << event.tid << "}";
+  }
+  os << "\n]}\n";
+  LOG(INFO) << "Write " << events.size() << " trace events to " << file;
+}
+
+}  // namespace paddle
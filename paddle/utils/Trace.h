@@ -0,0 +1,103 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include "DisableCopy.h"
+
+namespace paddle {
+
+/**
+ * @brief Timeline of the execution in the Chrome trace event format, which
+ *        chrome://tracing and Perfetto display.
+ *
+ * With --trace_file, the trainer records the scopes marked by REGISTER_TRACE
+ * during the batches [trace_start_batch, trace_start_batch +
+ * trace_num_batches) and writes them to trace_file when the window ends, or
+ * when the training finishes first. The traced scopes include the layers,
+ * the phases of the trainer threads, the parameter client send/recv and the
+ * data provider.
+ *
+ * Every thread records its events to a ring buffer of trace_buffer_size
+ * events of its own, without lock. When the buffer is full the oldest events
+ * are overwritten. The buffer of an exited thread is kept for the dump and
+ * reused by the next new thread.
+ *
+ * The name and the category of an event are not copied: they must be string
+ * literals or strings which outlive the dump, such as layer names.
+ */
+class Tracer {
+public:
+  static bool isTracing() { return tracing_.load(std::memory_order_relaxed); }
+
+  /// Start or stop recording, regardless of the batch window.
+  static void setTracing(bool tracing) {
+    tracing_.store(tracing, std::memory_order_relaxed);
+  }
+
+  /// Record a scope of the calling thread which began at beginNs and ends
+  /// now.
+  static void addEvent(const char* name,
+                       const char* category,
+                       uint64_t beginNs);
+
+  /// Called by the trainer before each batch, opens and closes the window.
+  static void startBatch();
+
+  /// Close the window if it is open, and write trace_file.
+  static void finish();
+
+  /// Drop the recorded events. Must not be called while tracing.
+  static void clear();
+
+  /// Write the recorded events to file.
+  static void dump(const std::string& file);
+
+  /// Nanoseconds from a monotonic clock.
+  static uint64_t nowInNanoSec();
+
+private:
+  static std::atomic<bool> tracing_;
+};
+
+/// Record the lifetime of the scope as a trace event.
+class TraceScope {
+public:
+  TraceScope(const char* name, const char* category)
+      : name_(name),
+        category_(category),
+        beginNs_(Tracer::isTracing() ? Tracer::nowInNanoSec() : 0) {}
+
+  ~TraceScope() {
+    if (beginNs_ && Tracer::isTracing()) {
+      Tracer::addEvent(name_, category_, beginNs_);
+    }
+  }
+
+  DISABLE_COPY(TraceScope);
+
+private:
+  const char* name_;
+  const char* category_;
+  uint64_t beginNs_;
+};
+
+#define REGISTER_TRACE(name, category) \
+  TraceScope __traceScope(name, category)
+
+}  // namespace paddle
@@ -0,0 +1,163 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/utils/Numa.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include "paddle/utils/Logging.h"
+#include "paddle/utils/StringUtil.h"
+
+// from <linux/mempolicy.h>, which is not always installed
+#define PADDLE_MPOL_BIND 2
+#define PADDLE_MPOL_INTERLEAVE 3
+#define PADDLE_MPOL_MF_MOVE (1 << 1)
+
+namespace paddle {
+namespace numa {
+
+static __thread int gThreadNode = -1;
+
+namespace {
+
+struct Topology {
+  std::vector<std::vector<int>> nodeCpus;
+
+  Topology() {
+    for (int node = 0;; ++node) {
+      std::ifstream fs("/sys/devices/system/node/node" + std::to_string(node) +
+                       "/cpulist");
+      if (!fs) break;
+      std::string line;
+      std::getline(fs, line);
+      nodeCpus.push_back(parseCpuList(line));
+    }
+    if (nodeCpus.empty()) {
+      nodeCpus.resize(1);
+      int64_t numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+      for (int64_t cpu = 0; cpu < numCpus; ++cpu) {
+        nodeCpus[0].push_back(cpu);
+      }
+    }
+  }
+
+  // "0-7,16-23" => {0, ..., 7, 16, ..., 23}
+  static std::vector<int> parseCpuList(const std::string& line) {
+    std::vector<int> cpus;
+    std::vector<std::string> ranges;
+    str::split(line, ',', &ranges);
+    for (auto& range : ranges) {
+      if (range.empty()) continue;
+      size_t dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+};
+
+const Topology& getTopology() {
+  static Topology topology;
+  return topology;
+}
+
+bool setAffinity(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (ret != 0) {
+    LOG(WARNING) << "Fail to set the cpu affinity: " << ret;
+  }
+  return ret == 0;
+}
+
+void setMemoryPolicy(void* ptr,
+                     size_t size,
+                     int mode,
+                     const std::vector<int>& nodes) {
+#ifdef __NR_mbind
+  const size_t kBitsPerWord = 8 * sizeof(unsigned long);  // NOLINT
+  std::vector<unsigned long> mask(getNumNodes() / kBitsPerWord + 1);  // NOLINT
+  for (int node : nodes) {
+    mask[node / kBitsPerWord] |= 1UL << (node % kBitsPerWord);
+  }
+  // mbind() works on whole pages, the partial pages at both ends may hold
+  // other memory and are left alone
+  uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t begin =
+      (reinterpret_cast<uintptr_t>(ptr) + pageSize - 1) & ~(pageSize - 1);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(pageSize - 1);
+  if (end <= begin) return;
+  if (syscall(__NR_mbind,
+              begin,
+              end - begin,
+              mode,
+              mask.data(),
+              mask.size() * kBitsPerWord,
+              PADDLE_MPOL_MF_MOVE) != 0) {
+    VLOG(1) << "mbind failed, the memory placement is left to the system";
+  }
+#endif
+}
+
+}  // namespace
+
+int getNumNodes() { return getTopology().nodeCpus.size(); }
+
+const std::vector<int>& getNodeCpus(int node) {
+  CHECK_GE(node, 0);
+  CHECK_LT(node, getNumNodes());
+  return getTopology().nodeCpus[node];
+}
+
+bool bindThreadToCpu(int cpu, int node) {
+  gThreadNode = node;
+  return setAffinity({cpu});
+}
+
+bool bindThreadToNode(int node) {
+  gThreadNode = node;
+  return setAffinity(getNodeCpus(node));
+}
+
+int getThreadNode() { return gThreadNode; }
+
+void setThreadNode(int node) { gThreadNode = node; }
+
+void bindMemory(void* ptr, size_t size, int node) {
+  if (getNumNodes() == 1) return;
+  setMemoryPolicy(ptr, size, PADDLE_MPOL_BIND, {node});
+}
+
+void interleaveMemory(void* ptr, size_t size) {
+  if (getNumNodes() == 1) return;
+  std::vector<int> nodes;
+  for (int node = 0; node < getNumNodes(); ++node) {
+    nodes.push_back(node);
+  }
+  setMemoryPolicy(ptr, size, PADDLE_MPOL_INTERLEAVE, nodes);
+}
+
+}  // namespace numa
+}  // namespace paddle
@@ -0,0 +1,61 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/utils/Numa.h"
+#include <unistd.h>
+#include "paddle/utils/Logging.h"
+
+// OSX has neither NUMA nodes nor thread affinity, there is one node holding
+// all the cpus and the threads are never pinned.
+
+namespace paddle {
+namespace numa {
+
+static __thread int gThreadNode = -1;
+
+int getNumNodes() { return 1; }
+
+const std::vector<int>& getNodeCpus(int node) {
+  CHECK_EQ(node, 0);
+  static std::vector<int> cpus = [] {
+    std::vector<int> all;
+    int64_t numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int64_t cpu = 0; cpu < numCpus; ++cpu) {
+      all.push_back(cpu);
+    }
+    return all;
+  }();
+  return cpus;
+}
+
+bool bindThreadToCpu(int cpu, int node) {
+  gThreadNode = node;
+  return false;
+}
+
+bool bindThreadToNode(int node) {
+  gThreadNode = node;
+  return false;
+}
+
+int getThreadNode() { return gThreadNode; }
+
+void setThreadNode(int node) { gThreadNode = node; }
+
+void bindMemory(void* ptr, size_t size, int node) {}
+
+void interleaveMemory(void* ptr, size_t size) {}
+
+}  // namespace numa
+}  // namespace paddle
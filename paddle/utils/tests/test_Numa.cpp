@@ -0,0 +1,90 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+#include "paddle/utils/Numa.h"
+#include "paddle/utils/Thread.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+TEST(Numa, topology) {
+  int numNodes = numa::getNumNodes();
+  ASSERT_GE(numNodes, 1);
+  std::set<int> allCpus;
+  for (int node = 0; node < numNodes; ++node) {
+    for (int cpu : numa::getNodeCpus(node)) {
+      // a cpu belongs to one node only
+      EXPECT_TRUE(allCpus.insert(cpu).second) << cpu;
+    }
+  }
+  EXPECT_FALSE(allCpus.empty());
+}
+
+TEST(Numa, nodeScope) {
+  std::thread thread([] {
+    EXPECT_EQ(-1, numa::getThreadNode());
+    {
+      NumaNodeScope scope(0);
+      EXPECT_EQ(0, numa::getThreadNode());
+      {
+        NumaNodeScope keep(-1);
+        EXPECT_EQ(0, numa::getThreadNode());
+      }
+    }
+    EXPECT_EQ(-1, numa::getThreadNode());
+  });
+  thread.join();
+}
+
+TEST(Numa, bindThread) {
+  int node = numa::getNumNodes() - 1;
+  int cpu = numa::getNodeCpus(node)[0];
+  std::thread thread([node, cpu] {
+    numa::bindThreadToCpu(cpu, node);
+    EXPECT_EQ(node, numa::getThreadNode());
+
+    // the workers of a pool run on the node of the thread creating it
+    SyncThreadPool pool(2, /* checkOwner= */ false);
+    std::vector<int> workerNodes(pool.getNumThreads(), -1);
+    pool.exec([&workerNodes](int tid, size_t numThreads) {
+      workerNodes[tid] = numa::getThreadNode();
+    });
+    for (int workerNode : workerNodes) {
+      EXPECT_EQ(node, workerNode);
+    }
+  });
+  thread.join();
+}
+
+TEST(Numa, memory) {
+  // placing memory is only a hint, it must keep the content
+  std::vector<float> buf(1 << 20, 1.0f);
+  numa::interleaveMemory(buf.data(), buf.size() * sizeof(float));
+  numa::bindMemory(buf.data(), buf.size() * sizeof(float), 0);
+  // a range within one page binds nothing
+  numa::bindMemory(buf.data() + 1, 100 * sizeof(float), 0);
+  for (float v : buf) {
+    ASSERT_EQ(1.0f, v);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  paddle::initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "paddle/utils/Queue.h"
+
+using paddle::PriorityQueue;  // NOLINT
+
+TEST(PriorityQueue, order) {
+  PriorityQueue<int> maxFirst;
+  PriorityQueue<int, std::greater<int>> minFirst;
+  for (int el : {3, 1, 4, 1, 5, 9, 2, 6}) {
+    maxFirst.enqueue(el);
+    minFirst.enqueue(el);
+  }
+  EXPECT_EQ(8UL, maxFirst.size());
+  for (int el : {9, 6, 5, 4, 3, 2, 1, 1}) {
+    EXPECT_EQ(el, maxFirst.dequeue());
+  }
+  for (int el : {1, 1, 2, 3, 4, 5, 6, 9}) {
+    EXPECT_EQ(el, minFirst.dequeue());
+  }
+  EXPECT_TRUE(maxFirst.empty());
+  EXPECT_TRUE(minFirst.empty());
+}
+
+TEST(PriorityQueue, blockingDequeue) {
+  const int numProducers = 4;
+  const int numPerProducer = 1000;
+  PriorityQueue<int, std::greater<int>> queue;
+
+  // the consumer blocks on the empty queue until the producers catch up
+  std::vector<int> received;
+  std::thread consumer([&] {
+    for (int i = 0; i < numProducers * numPerProducer; ++i) {
+      received.push_back(queue.dequeue());
+    }
+  });
+  std::vector<std::thread> producers;
+  for (int p = 0; p < numProducers; ++p) {
+    producers.emplace_back([&queue, p] {
+      for (int i = 0; i < numPerProducer; ++i) {
+        queue.enqueue(p * numPerProducer + i);
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  consumer.join();
+
+  std::sort(received.begin(), received.end());
+  for (int i = 0; i < numProducers * numPerProducer; ++i) {
+    ASSERT_EQ(i, received[i]);
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,129 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "paddle/utils/Stat.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+TEST(StatInfo, bucket) {
+  for (uint64_t value = 0; value < (1UL << 24); value = value * 9 / 8 + 1) {
+    size_t bucket = StatInfo::getBucket(value);
+    ASSERT_LT(bucket, StatInfo::kNumBuckets);
+    uint64_t start = StatInfo::getBucketStart(bucket);
+    uint64_t end = StatInfo::getBucketEnd(bucket);
+    ASSERT_LE(start, value);
+    ASSERT_LT(value, end);
+    // a bucket holds one value or is narrower than 1/16 of its values
+    ASSERT_TRUE(end - start == 1 ||
+                (end - start) << (StatInfo::kSubBucketBits - 1) <= start);
+    if (bucket > 0) {
+      ASSERT_EQ(StatInfo::getBucketEnd(bucket - 1), start);
+    }
+  }
+  EXPECT_EQ(StatInfo::kNumBuckets - 1, StatInfo::getBucket(UINT64_MAX));
+}
+
+TEST(Stat, percentile) {
+  Stat stat("percentile");
+  for (uint64_t value = 1; value <= 10000; ++value) {
+    stat.addSample(value);
+  }
+  StatInfo info = stat.getMergedInfo();
+  EXPECT_EQ(10000UL, info.count_);
+  EXPECT_EQ(1UL, info.min_);
+  EXPECT_EQ(10000UL, info.max_);
+  EXPECT_NEAR(5000, info.percentile(0.5), 5000 / 32.0);
+  EXPECT_NEAR(9900, info.percentile(0.99), 9900 / 32.0);
+  EXPECT_EQ(1UL, info.percentile(0.0001));
+  EXPECT_EQ(10000UL, info.percentile(1));
+}
+
+TEST(Stat, threads) {
+  Stat stat("threads");
+  const int kNumThreads = 8;
+  const uint64_t kNumSamples = 100000;
+  for (int round = 0; round < 3; ++round) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.emplace_back([&stat, i] {
+        for (uint64_t n = 0; n < kNumSamples; ++n) {
+          stat.addSample(i);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    StatInfo info = stat.getMergedInfo();
+    EXPECT_EQ((round + 1) * kNumThreads * kNumSamples, info.count_);
+    EXPECT_EQ((round + 1) * kNumSamples * kNumThreads * (kNumThreads - 1) / 2,
+              info.total_);
+    EXPECT_EQ(0UL, info.min_);
+    EXPECT_EQ(kNumThreads - 1UL, info.max_);
+    // the exited threads hand their ThreadStat over to the new ones
+    EXPECT_LE(stat.getThreadInfos().size(), (size_t)kNumThreads);
+  }
+}
+
+TEST(Stat, reset) {
+  Stat stat("reset");
+  stat.addSample(100);
+  std::thread([&stat] { stat.addSample(200); }).join();
+  EXPECT_EQ(2UL, stat.getMergedInfo().count_);
+
+  stat.reset();
+  EXPECT_EQ(0UL, stat.getMergedInfo().count_);
+  EXPECT_EQ(0UL, stat.getMergedInfo().percentile(0.5));
+
+  stat.addSample(3);
+  StatInfo info = stat.getMergedInfo();
+  EXPECT_EQ(1UL, info.count_);
+  EXPECT_EQ(3UL, info.total_);
+  EXPECT_EQ(3UL, info.max_);
+}
+
+TEST(StatSet, manyStats) {
+  // more stats than PTHREAD_KEYS_MAX, they share the key of the set
+  StatSet statSet("many");
+  const int kNumStats = 2000;
+  for (int i = 0; i < kNumStats; ++i) {
+    statSet.getStat("stat" + std::to_string(i))->addSample(i);
+  }
+  std::thread([&statSet] {
+    statSet.getStat("stat1")->addSample(10);
+  }).join();
+  for (int i = 0; i < kNumStats; i += 100) {
+    StatPtr stat = statSet.getStat("stat" + std::to_string(i));
+    EXPECT_EQ((uint64_t)i, stat->getMergedInfo().total_);
+  }
+  EXPECT_EQ(11UL, statSet.getStat("stat1")->getMergedInfo().total_);
+
+  // a thread which outlives a deleted stat frees its ThreadStat on exit
+  std::thread thread([&statSet] {
+    statSet.getStat("stat2")->addSample(1);
+    statSet.deleteStat("stat2");
+    statSet.getStat("stat2")->addSample(5);
+    EXPECT_EQ(5UL, statSet.getStat("stat2")->getMergedInfo().total_);
+  });
+  thread.join();
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  paddle::initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
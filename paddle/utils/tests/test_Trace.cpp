@@ -0,0 +1,90 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "paddle/utils/Trace.h"
+#include "paddle/utils/Util.h"
+
+P_DECLARE_string(trace_file);
+P_DECLARE_int32(trace_start_batch);
+P_DECLARE_int32(trace_num_batches);
+
+using namespace paddle;  // NOLINT
+
+static std::string readTrace(const std::string& file) {
+  std::ifstream fs(file);
+  return std::string((std::istreambuf_iterator<char>(fs)),
+                     std::istreambuf_iterator<char>());
+}
+
+static size_t countOf(const std::string& str, const std::string& pattern) {
+  size_t count = 0;
+  for (size_t pos = str.find(pattern); pos != std::string::npos;
+       pos = str.find(pattern, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+TEST(Trace, threads) {
+  Tracer::clear();
+  { REGISTER_TRACE("not_traced", "test"); }
+
+  Tracer::setTracing(true);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([] {
+      for (int n = 0; n < 10; ++n) {
+        REGISTER_TRACE("outer", "test");
+        { REGISTER_TRACE("inner", "test"); }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Tracer::setTracing(false);
+  { REGISTER_TRACE("not_traced", "test"); }
+
+  Tracer::dump("trace_threads.json");
+  std::string trace = readTrace("trace_threads.json");
+  EXPECT_EQ(0UL, trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\""));
+  EXPECT_EQ(40UL, countOf(trace, "\"name\": \"outer\""));
+  EXPECT_EQ(40UL, countOf(trace, "\"name\": \"inner\""));
+  EXPECT_EQ(0UL, countOf(trace, "not_traced"));
+}
+
+TEST(Trace, batchWindow) {
+  FLAGS_trace_file = "trace_window.json";
+  FLAGS_trace_start_batch = 2;
+  FLAGS_trace_num_batches = 3;
+  for (int batch = 0; batch < 8; ++batch) {
+    Tracer::startBatch();
+    REGISTER_TRACE("batch", "test");
+  }
+  Tracer::finish();
+  EXPECT_FALSE(Tracer::isTracing());
+  EXPECT_EQ(3UL, countOf(readTrace("trace_window.json"), "\"batch\""));
+  FLAGS_trace_file = "";
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  paddle::initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
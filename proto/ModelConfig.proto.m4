@@ -414,6 +414,10 @@ sinclude(`ModelConfigLayer.proto.m4')
   // to string and reinterpreted in the user's own layer implementation.  
   optional string user_arg = 49;
 
+  // For NCELayer
+  // If true, the random negative labels are generated once for a batch and
+  // shared by all the samples in the batch.
+  optional bool share_neg_samples = 50 [default = false];
 }
 
 message EvaluatorConfig {
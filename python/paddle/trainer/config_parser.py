@@ -2035,6 +2035,7 @@ class NCELayer(LayerBase):
                  inputs,
                  num_neg_samples=10,
                  neg_sampling_dist=None,
+                 share_neg_samples=False,
                  bias=True,
                  **xargs):
         super(NCELayer, self).__init__(name, 'nce', 1, inputs=inputs, **xargs)
@@ -2054,6 +2055,8 @@ class NCELayer(LayerBase):
             self.config.neg_sampling_dist.extend(neg_sampling_dist)
 
         self.config.num_neg_samples = num_neg_samples
+        if share_neg_samples:
+            self.config.share_neg_samples = True
         num_real_inputs = len(self.inputs) - 1
         input_layer = self.get_input_layer(num_real_inputs)
         config_assert(input_layer.type == 'data',
@@ -3021,6 +3024,10 @@ def ParameterHook(type, **kwargs):
         hook.type = type
         hook.purning_mask_filename = mask_filename
         return hook
+    elif type == 'loss_scaling':
+        hook = ParameterUpdaterHookConfig()
+        hook.type = type
+        return hook
     else:
         return None
 
@@ -4232,6 +4232,7 @@ def nce_layer(input,
               weight=None,
               num_neg_samples=10,
               neg_distribution=None,
+              share_neg_samples=False,
               name=None,
               bias_attr=None,
               layer_attr=None):
@@ -4263,6 +4264,10 @@ def nce_layer(input,
                              A uniform distribution will be used if not provided.
                              If not None, its length must be equal to num_classes.
     :type neg_distribution: list|tuple|collections.Sequence|None
+    :param share_neg_samples: Whether all the samples in a batch share the same
+                              negative samples. If True, the negative samples
+                              are scored by one matrix multiplication.
+    :type share_neg_samples: bool
     :param bias_attr: Bias parameter attribute. True if no bias.
     :type bias_attr: ParameterAttribute|None|False
     :param layer_attr: Extra Layer Attribute.
@@ -4301,6 +4306,7 @@ def nce_layer(input,
         num_classes=num_classes,
         neg_sampling_dist=neg_distribution,
         num_neg_samples=num_neg_samples,
+        share_neg_samples=share_neg_samples,
         inputs=ipts_for_layer,
         bias=ParamAttr.to_bias(bias_attr),
         **ExtraLayerAttribute.to_kwargs(layer_attr))